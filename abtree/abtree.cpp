@@ -25,6 +25,7 @@
 #include <cstdio> // snprintf
 #include <cstring> // memcpy
 #include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <limits> // std::numeric_limits<int64_t>
@@ -38,6 +39,9 @@
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "configuration.hpp"
 #include "console_arguments.hpp"
@@ -45,6 +49,7 @@
 #include "miscellaneous.hpp" // to_string_with_unit_suffix
 #include "timer.hpp" // Time the single PANN operations
 #include "distribution/random_permutation.hpp"
+#include "pma/generic/interleaved_lookup.hpp"
 
 using namespace distribution; // RandomPermutation
 
@@ -119,10 +124,7 @@ void ABTree::initialize_from_array(std::pair<int64_t, int64_t>* elements, size_t
 
     // sort the elements in the input array
     if(do_sort){
-        auto comparator = [](const pair<int64_t, int64_t>& e1, const pair<int64_t, int64_t>& e2){
-            return e1.first < e2.first;
-        };
-        std::sort(elements, elements + size, comparator);
+        sort_parallel(elements, size);
     }
 
     assert(root == nullptr);
@@ -134,102 +136,132 @@ void ABTree::initialize_from_array(std::pair<int64_t, int64_t>* elements, size_t
             VALUES(leaf)[i] = elements[i].second;
         }
         leaf->N = cardinality = size;
+        if(bloom_filter_blocks > 0) bloom_filter_rebuild(leaf);
 
         root = leaf;
+        height = 1;
         return;
     }
 
     // general case
-    // leaves
-    const size_t num_leaves = ceil(static_cast<double>(size) / leaf_b);
-    const size_t leaf_ff = size / num_leaves;
-    const size_t leaf_ff_mod = size % num_leaves;
-    size_t leaf_index = 0; // in [0, leaf_ff), or leaf_ff+1) for the first leaves
-    size_t leaf_bbpoint = leaf_ff_mod * (leaf_ff + 1);
-    Leaf* leaf_current = create_leaf();
-
-    // inner nodes
-    int64_t num_levels = ceil(log(num_leaves) / log(intnode_b));
-    struct NodeState{
-        InternalNode* node = nullptr;
-        int64_t first_key = 0; /* it doesn't matter: we don't store the leftmost min anywhere */
-        size_t fill_factor = 0;
-        size_t index = 0;
-        size_t bbpoint = 0;
-    };
-    vector<NodeState> levels(num_levels);
-    height = num_levels + 1;
-
-    // compute the fill factor & bbpoint
-    size_t num_children = num_leaves;
-    for(int l = num_levels -1; l > 0; l--){
-        size_t num_nodes = ceil(((double) num_children) / intnode_b);
-        size_t ff = num_children / num_nodes;
-        size_t mod = num_children % num_nodes;
-        levels[l].fill_factor = ff;
-        levels[l].bbpoint = mod;
-
-        num_children = num_nodes;
-    }
-    levels[0].fill_factor = intnode_b;
-    levels[0].bbpoint = 1;
-
-    std::function<void(int,Node*,int64_t,bool)> propagate;
-    propagate = [&propagate, this, &levels](int level, Node* child, int64_t key, bool last){
-        assert(level >= 0);
-
-        NodeState& current = levels[level];
-        if(!current.node ||
-                (current.index < current.bbpoint && current.node->N == current.fill_factor +1) ||
-                (current.index >= current.bbpoint && current.node->N == current.fill_factor)){
-            assert(((current.node == nullptr && level == 0) || last == false) &&
-                    "It implies creating a new node with no key at the last iteration");
-            assert((current.node == nullptr || level > 0) && "Are we splitting the root?!");
-            if(current.node != nullptr){
-                propagate(level -1, current.node, current.first_key, last);
-                current.index++;
+    // leaves, filled up to the target fill factor, but with at least leaf_a elements each
+    const size_t leaf_target = max<size_t>(leaf_a, min<size_t>(leaf_b, bulk_load_fill_factor * leaf_b));
+    size_t num_leaves = (size + leaf_target -1) / leaf_target;
+    if(size / num_leaves < leaf_a) num_leaves = size / leaf_a;
+
+    // allocate the leaves sequentially, so that with the slab allocator they are contiguous in memory
+    vector<Node*> children(num_leaves);
+    vector<int64_t> first_keys(num_leaves); // the minimum of each child
+    Leaf* leaf_previous = nullptr;
+    for(size_t i = 0; i < num_leaves; i++){
+        Leaf* leaf = create_leaf(leaf_previous);
+        leaf->previous = leaf_previous;
+        if(leaf_previous != nullptr) leaf_previous->next = leaf;
+        children[i] = leaf_previous = leaf;
+    }
+
+    // the elements are spread evenly, the i-th leaf stores the elements in [size * i / num_leaves, size * (i +1) / num_leaves)
+    parallel_for(num_leaves, size, [&](size_t leaf_start, size_t leaf_end){
+        for(size_t i = leaf_start; i < leaf_end; i++){
+            Leaf* leaf = reinterpret_cast<Leaf*>(children[i]);
+            size_t offset = size * i / num_leaves;
+            leaf->N = size * (i +1) / num_leaves - offset;
+            int64_t* __restrict keys = KEYS(leaf);
+            int64_t* __restrict values = VALUES(leaf);
+            for(size_t j = 0; j < leaf->N; j++){
+                keys[j] = elements[offset + j].first;
+                values[j] = elements[offset + j].second;
             }
-            current.node = create_internal_node();
-            CHILDREN(current.node)[0] = child;
-            current.node->N = 1; // node->N refers to the # pointers contained!
-            current.first_key = key;
-
-        } else {
-            assert(current.node->N > 0 && current.node->N < intnode_b);
-            CHILDREN(current.node)[current.node->N] = child;
-            KEYS(current.node)[current.node->N -1] = key;
-            current.node->N++;
-            if(last && level > 0)
-                propagate(level -1, current.node, current.first_key, last);
+            if(bloom_filter_blocks > 0) bloom_filter_rebuild(leaf);
+            first_keys[i] = keys[0];
+        }
+    });
+    height = 1;
+
+    // inner nodes, one level at the time, bottom-up
+    while(children.size() > 1){
+        const size_t num_children = children.size();
+        const size_t num_nodes = (num_children + intnode_b -1) / intnode_b;
+        vector<Node*> parents(num_nodes);
+        vector<int64_t> parents_first_keys(num_nodes);
+        InternalNode* inode_previous = nullptr;
+        for(size_t i = 0; i < num_nodes; i++){
+            parents[i] = inode_previous = create_internal_node(inode_previous);
         }
-    };
 
-    for(size_t i = 0; i < size; i++){
-        // next leaf?
-        if((i < leaf_bbpoint && leaf_index > leaf_ff) || (i >= leaf_bbpoint && leaf_index >= leaf_ff)){
-            leaf_current->N = leaf_ff;
-            if(i <= leaf_bbpoint) leaf_current->N++; // leaf_current refers to the previous leaf here!
+        parallel_for(num_nodes, num_children, [&](size_t node_start, size_t node_end){
+            for(size_t i = node_start; i < node_end; i++){
+                InternalNode* inode = reinterpret_cast<InternalNode*>(parents[i]);
+                size_t offset = num_children * i / num_nodes;
+                inode->N = num_children * (i +1) / num_nodes - offset; // node->N refers to the # pointers contained!
+                memcpy(CHILDREN(inode), children.data() + offset, inode->N * sizeof(Node*));
+                memcpy(KEYS(inode), first_keys.data() + offset +1, (inode->N -1) * sizeof(int64_t)); // we don't store the leftmost min
+                parents_first_keys[i] = first_keys[offset];
+            }
+        });
 
-            propagate(num_levels -1, leaf_current, KEYS(leaf_current)[0], false);
+        children.swap(parents);
+        first_keys.swap(parents_first_keys);
+        height++;
+    }
 
-            Leaf* leaf_next = create_leaf();
-            leaf_next->previous = leaf_current;
-            leaf_current->next = leaf_next;
-            leaf_current = leaf_next;
-            leaf_index = 0;
-        }
+    root = children[0];
+    cardinality = size;
+}
 
-        KEYS(leaf_current)[leaf_index] = elements[i].first;
-        VALUES(leaf_current)[leaf_index] = elements[i].second;
+size_t ABTree::get_num_workers(size_t num_elements) const {
+    constexpr size_t min_elements_per_thread = 1ull << 16; // below this threshold, the cost of the threads is not worth it
+    return std::max<size_t>(1, std::min<size_t>(bulk_load_threads, num_elements / min_elements_per_thread));
+}
 
-        leaf_index++;
+void ABTree::parallel_for(size_t num_items, size_t num_elements, const std::function<void(size_t, size_t)>& fn) const {
+    using namespace std;
+    size_t num_threads = min(num_items, get_num_workers(num_elements));
+    if(num_threads <= 1){
+        fn(0, num_items);
+        return;
     }
-    leaf_current->N = leaf_ff; // update the size for the last leaf
-    propagate(num_levels -1, leaf_current, KEYS(leaf_current)[0], true); // attach the last leaf
-    root = levels[0].node;
-    cardinality = size;
+
+    vector<future<void>> tasks;
+    for(size_t i = 0; i < num_threads; i++){
+        size_t start = num_items * i / num_threads, end = num_items * (i +1) / num_threads;
+        tasks.push_back( async(launch::async, [&fn, start, end](){ fn(start, end); }) );
+    }
+    for(auto& t : tasks) t.get();
 }
 
+void ABTree::sort_parallel(std::pair<int64_t, int64_t>* elements, size_t size) const {
+    using namespace std;
+    auto compare = [](const pair<int64_t, int64_t>& e1, const pair<int64_t, int64_t>& e2){ return e1.first < e2.first; };
+    size_t num_threads = get_num_workers(size);
+    if(num_threads == 1){
+        std::sort(elements, elements + size, compare);
+        return;
+    }
+
+    // sort the partitions independently
+    vector<size_t> boundaries;
+    for(size_t i = 0; i <= num_threads; i++){ boundaries.push_back(size * i / num_threads); }
+    parallel_for(num_threads, size, [&](size_t start, size_t end){
+        for(size_t i = start; i < end; i++){ std::sort(elements + boundaries[i], elements + boundaries[i +1], compare); }
+    });
+
+    // merge the pairs of adjacent partitions, in log(num_threads) rounds
+    while(boundaries.size() > 2){
+        vector<size_t> boundaries_next;
+        vector<future<void>> tasks;
+        for(size_t i = 0; i +1 < boundaries.size(); i += 2){
+            boundaries_next.push_back(boundaries[i]);
+            if(i +2 < boundaries.size()){
+                size_t start = boundaries[i], middle = boundaries[i +1], end = boundaries[i +2];
+                tasks.push_back( async(launch::async, [=](){ std::inplace_merge(elements + start, elements + middle, elements + end, compare); }) );
+            }
+        }
+        for(auto& t : tasks) t.get();
+        boundaries_next.push_back(size);
+        boundaries.swap(boundaries_next);
+    }
+}
 
 void ABTree::load(const std::pair<int64_t, int64_t>* elements, size_t elements_sz){
     assert(cardinality == 0 && "Expected empty");
@@ -237,6 +269,7 @@ void ABTree::load(const std::pair<int64_t, int64_t>* elements, size_t elements_s
 
     assert(root != nullptr);
     assert(root->N == 0);
+    end_defragmentation();
     delete_node(root, 0); root = nullptr;
 
     // check whether the elements are already sorted
@@ -258,6 +291,54 @@ void ABTree::load(const std::pair<int64_t, int64_t>* elements, size_t elements_s
     }
 }
 
+void ABTree::bulk_load(std::pair<int64_t, int64_t>* elements, size_t elements_sz){
+    using namespace std;
+    constexpr size_t min_ratio_rebuild = 8; // insert the elements one by one when the batch is smaller than cardinality / min_ratio_rebuild
+
+    if(static_cast<size_t>(cardinality) > elements_sz * min_ratio_rebuild){
+        for(size_t i = 0; i < elements_sz; i++){ insert(elements[i].first, elements[i].second); }
+        return;
+    }
+
+    // merge the existing elements with the new batch
+    sort_parallel(elements, elements_sz);
+    unique_ptr<pair<int64_t, int64_t>[]> merged_ptr;
+    pair<int64_t, int64_t>* input = elements;
+    size_t input_sz = elements_sz;
+    if(cardinality > 0){
+        input_sz = cardinality + elements_sz;
+        merged_ptr.reset(new pair<int64_t, int64_t>[input_sz]);
+        input = merged_ptr.get();
+
+        Node* node = root;
+        for(int depth = 0; depth < height -1; depth++){ node = CHILDREN(reinterpret_cast<InternalNode*>(node))[0]; }
+        Leaf* leaf = reinterpret_cast<Leaf*>(node);
+        size_t i = 0, j = 0, k = 0; // cursors in the leaf, the batch and the output
+        while(leaf != nullptr){
+            int64_t* __restrict keys = KEYS(leaf);
+            int64_t* __restrict values = VALUES(leaf);
+            while(i < leaf->N){
+                if(j < elements_sz && elements[j].first < keys[i]){
+                    input[k++] = elements[j++];
+                } else {
+                    input[k++] = make_pair(keys[i], values[i]);
+                    i++;
+                }
+            }
+            leaf = leaf->next;
+            i = 0;
+        }
+        while(j < elements_sz){ input[k++] = elements[j++]; }
+        assert(k == input_sz);
+    }
+
+    // rebuild the tree
+    end_defragmentation();
+    delete_node(root, 0); root = nullptr;
+    cardinality = 0;
+    initialize_from_array(input, input_sz, /* sort ? */ false);
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Node properties                                                         *
@@ -285,6 +366,11 @@ int64_t* ABTree::VALUES(const Leaf* leaf) const {
     return KEYS(leaf) + leaf_b;
 }
 
+pma::BloomFilter::Block* ABTree::BLOOM_FILTER(const Leaf* leaf) const {
+    Leaf* instance = const_cast<Leaf*>(leaf);
+    return reinterpret_cast<pma::BloomFilter::Block*>(reinterpret_cast<uint8_t*>(instance) + offset_bloom_filter());
+}
+
 
 /*****************************************************************************
  *                                                                           *
@@ -301,14 +387,18 @@ bool ABTree::is_leaf(int depth) const {
     return (depth == height -1);
 }
 
-ABTree::InternalNode* ABTree::create_internal_node() const {
+ABTree::InternalNode* ABTree::create_internal_node(const InternalNode* neighbour) const {
     static_assert(!std::is_polymorphic<InternalNode>::value, "Expected a non polymorphic type (no vtable)");
     static_assert(sizeof(InternalNode) == 8, "Expected only 8 bytes for the cardinality");
 
     // (cardinality) 1 + (keys=) intnode_b + (pointers) intnode_b +1 == 2 * intnode_b +2;
     InternalNode* ptr (nullptr);
-    int rc = posix_memalign((void**) &ptr, /* alignment = */ 64,  /* size = */ memsize_internal_node());
-    if(rc != 0) throw std::runtime_error("ABTree::create_internal_node, cannot obtain a chunk of aligned memory");
+    if(slab_inodes){
+        ptr = reinterpret_cast<InternalNode*>(slab_inodes->allocate(neighbour));
+    } else {
+        int rc = posix_memalign((void**) &ptr, /* alignment = */ 64,  /* size = */ memsize_internal_node());
+        if(rc != 0) throw std::runtime_error("ABTree::create_internal_node, cannot obtain a chunk of aligned memory");
+    }
     ptr->N = 0;
 
     num_nodes_allocated++;
@@ -321,22 +411,27 @@ size_t ABTree::init_memsize_internal_node() const {
 
 size_t ABTree::memsize_internal_node() const {
     if (common_memsize){
-        return std::max(min_sizeof_inode, min_sizeof_leaf);
+        return memsize_leaf();
     } else {
         return min_sizeof_inode;
     }
 }
 
-ABTree::Leaf* ABTree::create_leaf() const {
+ABTree::Leaf* ABTree::create_leaf(const Leaf* neighbour) const {
     static_assert(!std::is_polymorphic<Leaf>::value, "Expected a non polymorphic type (no vtable)");
     static_assert(sizeof(Leaf) == 24, "Expected 24 bytes for the cardinality + ptr previous + ptr next");
 
     // (cardinality) 1 + (ptr left/right) 2 + (keys=) leaf_b + (values) leaf_b == 2 * leaf_b + 1;
     Leaf* ptr (nullptr);
-    int rc = posix_memalign((void**) &ptr, /* alignment = */ 64,  /* size = */ memsize_leaf());
-    if(rc != 0) throw std::runtime_error("ABTree::create_leaf, cannot obtain a chunk of aligned memory");
+    if(slab_leaves){
+        ptr = reinterpret_cast<Leaf*>(slab_leaves->allocate(neighbour));
+    } else {
+        int rc = posix_memalign((void**) &ptr, /* alignment = */ 64,  /* size = */ memsize_leaf());
+        if(rc != 0) throw std::runtime_error("ABTree::create_leaf, cannot obtain a chunk of aligned memory");
+    }
     ptr->N = 0;
     ptr->next = ptr->previous = nullptr;
+    if(bloom_filter_blocks > 0) pma::BloomFilter::clear(BLOOM_FILTER(ptr), bloom_filter_blocks);
 
     num_leaves_allocated++;
     return ptr;
@@ -347,10 +442,27 @@ size_t ABTree::init_memsize_leaf() const {
     return sizeof(Leaf) + sizeof(int64_t) * (2 * leaf_b);
 }
 size_t ABTree::memsize_leaf() const {
+    size_t sizeof_leaf = min_sizeof_leaf;
+    if(bloom_filter_blocks > 0){ sizeof_leaf = offset_bloom_filter() + bloom_filter_blocks * sizeof(pma::BloomFilter::Block); }
+
     if (common_memsize){
-        return std::max(min_sizeof_inode, min_sizeof_leaf);
+        return std::max(min_sizeof_inode, sizeof_leaf);
     } else {
-        return min_sizeof_leaf;
+        return sizeof_leaf;
+    }
+}
+
+size_t ABTree::offset_bloom_filter() const {
+    return (min_sizeof_leaf + 63) / 64 * 64; // start from a new cache line
+}
+
+void ABTree::bloom_filter_rebuild(Leaf* leaf){
+    assert(bloom_filter_blocks > 0 && "Bloom filters not enabled");
+    pma::BloomFilter::Block* filter = BLOOM_FILTER(leaf);
+    pma::BloomFilter::clear(filter, bloom_filter_blocks);
+    int64_t* __restrict keys = KEYS(leaf);
+    for(size_t i = 0; i < leaf->N; i++){
+        pma::BloomFilter::insert(filter, bloom_filter_blocks, keys[i]);
     }
 }
 
@@ -367,11 +479,16 @@ void ABTree::delete_node(Node* node, int depth) const {
         }
 
         num_nodes_allocated--;
+        if(slab_inodes){ slab_inodes->deallocate(node); } else { free(node); }
     } else {
         num_leaves_allocated--;
+        if(slab_leaves){ slab_leaves->deallocate(node); } else { free(node); }
     }
+}
 
-    free(node);
+void ABTree::init_slab_allocators(){
+    slab_inodes.reset(new SlabAllocator(memsize_internal_node()));
+    slab_leaves.reset(new SlabAllocator(memsize_leaf()));
 }
 
 #define _STR(x) #x
@@ -436,7 +553,11 @@ void ABTree::validate_rec(const Node* node, int depth) const{
 }
 
 size_t ABTree::memory_footprint() const {
-    return num_nodes_allocated * memsize_internal_node() + num_leaves_allocated * memsize_leaf();
+    if(slab_leaves){
+        return slab_inodes->memory_footprint() + slab_leaves->memory_footprint();
+    } else {
+        return num_nodes_allocated * memsize_internal_node() + num_leaves_allocated * memsize_leaf();
+    }
 }
 
 int64_t ABTree::key_max() const {
@@ -483,7 +604,7 @@ void ABTree::split(InternalNode* inode, size_t child_index, int child_depth){
     if(child_is_leaf){
         // split a leaf in half
         Leaf* l1 = reinterpret_cast<Leaf*>(CHILDREN(inode)[child_index]);
-        Leaf* l2 = create_leaf();
+        Leaf* l2 = create_leaf(l1);
 
         assert(l1->N <= leaf_b);
 
@@ -502,6 +623,14 @@ void ABTree::split(InternalNode* inode, size_t child_index, int child_depth){
         if( l2->next != nullptr ) { l2->next->previous = l2; }
         l2->previous = l1;
         l1->next = l2;
+        defrag_record_link(l1);
+        defrag_record_link(l2);
+
+        // purge the keys moved to l2 from the filter of l1
+        if(bloom_filter_blocks > 0){
+            bloom_filter_rebuild(l1);
+            bloom_filter_rebuild(l2);
+        }
 
         // threshold derives the new pivot
         pivot = KEYS(l2)[0]; // == l1->keys[thres]
@@ -511,7 +640,7 @@ void ABTree::split(InternalNode* inode, size_t child_index, int child_depth){
     // split an internal node
     else {
         InternalNode* n1 = reinterpret_cast<InternalNode*>(CHILDREN(inode)[child_index]);
-        InternalNode* n2 = create_internal_node();
+        InternalNode* n2 = create_internal_node(n1);
 
         size_t thres = n1->N /2;
         n2->N = n1->N - (thres +1);
@@ -555,7 +684,7 @@ void ABTree::insert(Node* node, int64_t key, int64_t value, int depth){
         assert(inode->N > 0);
         size_t i = 0, last_key = inode->N -1;
         int64_t* __restrict keys = KEYS(inode);
-        while(i < last_key && key > keys[i]) i++;
+        i = rank</* inclusive ? */ false>(keys, last_key, key);
         node = CHILDREN(inode)[i];
         COUT_DEBUG("inode: " << inode << ", depth: " << depth << "/" << height << ", child index: " << i);
 
@@ -582,14 +711,21 @@ void ABTree::insert(Node* node, int64_t key, int64_t value, int depth){
     size_t i = leaf->N;
     int64_t* __restrict keys = KEYS(leaf);
     int64_t* __restrict values = VALUES(leaf);
-    while(i > 0 && keys[i-1] > key){
-        keys[i] = keys[i-1];
-        values[i] = values[i-1];
-        i--;
+    if(simd_search){
+        i = rank</* inclusive ? */ true>(keys, leaf->N, key);
+        memmove(keys + i + 1, keys + i, (leaf->N - i) * sizeof(int64_t));
+        memmove(values + i + 1, values + i, (leaf->N - i) * sizeof(int64_t));
+    } else {
+        while(i > 0 && keys[i-1] > key){
+            keys[i] = keys[i-1];
+            values[i] = values[i-1];
+            i--;
+        }
     }
     keys[i] = key;
     values[i] = value;
     leaf->N++;
+    if(bloom_filter_blocks > 0) pma::BloomFilter::insert(BLOOM_FILTER(leaf), bloom_filter_blocks, key);
 
     cardinality += 1;
 }
@@ -607,6 +743,8 @@ void ABTree::insert(int64_t key, int64_t value){
         split_root();
     }
 
+    if(defrag_rate > 0) defragment_online();
+
     sanity_check();
 }
 
@@ -631,6 +769,9 @@ void ABTree::merge(InternalNode* node, size_t child_index, int child_depth){
         // move all elements from l2 to l1
         memcpy(KEYS(l1) + l1->N, KEYS(l2), l2->N * sizeof(KEYS(l2)[0]));
         memcpy(VALUES(l1) + l1->N, VALUES(l2), l2->N * sizeof(VALUES(l2)[0]));
+        if(bloom_filter_blocks > 0){
+            for(size_t i = 0; i < l2->N; i++) pma::BloomFilter::insert(BLOOM_FILTER(l1), bloom_filter_blocks, KEYS(l2)[i]);
+        }
 
         // update the sizes of the two leaves
         l1->N += l2->N;
@@ -639,6 +780,7 @@ void ABTree::merge(InternalNode* node, size_t child_index, int child_depth){
         // adjust the links
         l1->next = l2->next;
         if(l2->next != nullptr){ l2->next->previous = l1; }
+        defrag_record_link(l1);
 
         // free the memory from l2
         delete_node(l2, child_depth); l2 = nullptr;
@@ -669,9 +811,9 @@ void ABTree::merge(InternalNode* node, size_t child_index, int child_depth){
     }
 
     // finally, remove the pivot from the parent (current node)
-    assert(node->N >= get_lowerbound(child_depth -1) || node == root);
     // node->N might become |a-1|, this is still okay in a remove operation as we are
-    // going to rebalance this node in post-order
+    // going to rebalance this node in post-order. In a range removal, the node may be already
+    // below its lower bound, after its subtrees have been removed, see #remove_keys
     int64_t* keys = KEYS(node);
     Node** children = CHILDREN(node);
     for(size_t i = child_index +1, last = node->N -1; i < last; i++){
@@ -699,15 +841,16 @@ void ABTree::rotate_right(InternalNode* node, size_t child_index, int child_dept
         int64_t* __restrict l2_values = VALUES(l2);
 
         // shift elements in l2 by `need'
-        for(size_t i = l2->N -1 + need; i > 0; i--){
-            l2_keys[i] = l2_keys[i - need];
-            l2_values[i] = l2_values[i - need];
+        for(size_t i = l2->N; i > 0; i--){
+            l2_keys[i -1 + need] = l2_keys[i -1];
+            l2_values[i -1 + need] = l2_values[i -1];
         }
 
         // copy `need' elements from l1 to l2
         for(size_t i = 0; i < need; i++){
             l2_keys[i] = l1_keys[l1->N - need +i];
             l2_values[i] = l1_values[l1->N - need +i];
+            if(bloom_filter_blocks > 0) pma::BloomFilter::insert(BLOOM_FILTER(l2), bloom_filter_blocks, l2_keys[i]);
         }
         // update the split point
         KEYS(node)[child_index -1] = l2_keys[0];
@@ -738,7 +881,7 @@ void ABTree::rotate_right(InternalNode* node, size_t child_index, int child_dept
 
         // copy the remaining elements from n1 to n2
         size_t idx = n1->N - need;
-        for(size_t i = 0; i < need -1; i--){
+        for(size_t i = 0; i < need -1; i++){
             n2_keys[i] = n1_keys[idx];
             n2_children[i] = n1_children[idx];
             idx++;
@@ -772,6 +915,7 @@ void ABTree::rotate_left(InternalNode* node, size_t child_index, int child_depth
         for(size_t i = 0; i < need; i++){
             l1_keys[l1->N + i] = l2_keys[i];
             l1_values[l1->N + i] = l2_values[i];
+            if(bloom_filter_blocks > 0) pma::BloomFilter::insert(BLOOM_FILTER(l1), bloom_filter_blocks, l2_keys[i]);
         }
 
         // left shift elements by `need' in l2
@@ -804,8 +948,8 @@ void ABTree::rotate_left(InternalNode* node, size_t child_index, int child_depth
         // move 'need -1' elements from n2 to n1
         size_t idx = n1->N;
         for(size_t i = 0; i < need -1; i++){
-            n1_keys[idx] = n2_keys[i];
-            n1_children[idx +1] = n2_children[i +1];
+            n1_keys[idx + i] = n2_keys[i];
+            n1_children[idx + i +1] = n2_children[i +1];
         }
 
         // update the pivot
@@ -827,7 +971,6 @@ void ABTree::rotate_left(InternalNode* node, size_t child_index, int child_depth
 
 void ABTree::rebalance_lb(InternalNode* node, size_t child_index, int child_depth){
     assert(node != nullptr);
-    assert(node->N > 1 || node == root);
     assert(child_index < node->N);
     COUT_DEBUG("Node: " << node << ", child_index: " << child_index << ", child_depth: " << child_depth);
 
@@ -836,8 +979,9 @@ void ABTree::rebalance_lb(InternalNode* node, size_t child_index, int child_dept
     const size_t lowerbound = get_lowerbound(child_depth);
     if(child_sz >= lowerbound){ return; } // nothing to do!
 
-    // okay, if this is the root && it has only one child, there is not much we can do
-    if(node == root && node->N <= 1) return;
+    // okay, if this node has only one child, there is not much we can do. Unless this is the root, it can only occur in
+    // a range removal, and the node is fixed afterwards by its parent, see #rebalance_rec
+    if(node->N <= 1) return;
 
     // how many nodes do we need?
     int64_t need = lowerbound - child_sz;
@@ -879,13 +1023,17 @@ void ABTree::rebalance_lb(InternalNode* node, size_t child_index, int child_dept
     // both siblings contain |a -1 + a| elements, merge the nodes
     if(child_index < node->N -1){
         merge(node, child_index, child_depth);
-
-        validate_bounds(CHILDREN(node)[child_index], child_depth);
     } else {
         assert(child_index > 0);
         merge(node, child_index -1, child_depth);
+        child_index--;
+    }
 
-        validate_bounds(CHILDREN(node)[child_index -1], child_depth);
+    // in a range removal, the sibling may have been below its lower bound as well
+    if(CHILDREN(node)[child_index]->N < lowerbound){
+        rebalance_lb(node, child_index, child_depth);
+    } else {
+        validate_bounds(CHILDREN(node)[child_index], child_depth);
     }
 }
 
@@ -967,7 +1115,8 @@ bool ABTree::remove_keys(Node* node, int64_t range_min, int64_t range_max, int d
 
         // remove the keys at the head
         retrebalance |= remove_keys(CHILDREN(inode)[start], range_min, range_max, depth +1, min);
-        if(CHILDREN(inode)[start]->empty()){
+        bool start_removed = CHILDREN(inode)[start]->empty();
+        if(start_removed){
             remove_trees_start--;
             remove_trees_length++;
         }
@@ -987,7 +1136,7 @@ bool ABTree::remove_keys(Node* node, int64_t range_min, int64_t range_max, int d
         if(remove_trees_length > 0){
             // before shifting the key containing the minimum for the next available block,
             // record into the variable *min
-            if(min && start == 0){
+            if(min && start == 0 && start_removed){
                 *min = (remove_trees_length < inode->N) ? KEYS(inode)[remove_trees_length -1] : -1;
             }
 
@@ -1039,7 +1188,7 @@ bool ABTree::remove_keys(Node* node, int64_t range_min, int64_t range_max, int d
 
 }
 
-void ABTree::rebalance_rec(Node* node, int64_t range_min, int64_t range_max, int depth){
+void ABTree::rebalance_rec(Node* node, int64_t key, bool upper, int depth){
     // base case
     if(is_leaf(depth)){
         assert(node->N >= leaf_a || node == root);
@@ -1048,37 +1197,91 @@ void ABTree::rebalance_rec(Node* node, int64_t range_min, int64_t range_max, int
 
     // rebalance the internal nodes
     InternalNode* inode = reinterpret_cast<InternalNode*>(node);
-    int64_t* keys = KEYS(inode);
-    Node** children = CHILDREN(inode);
     assert(inode->N > 0);
-    size_t i = 0, inode_num_keys = inode->N -1;
-    while(i < inode_num_keys && keys[i] < range_min) i++;
+    auto find_child = [this, key, upper](InternalNode* inode){ // the rotations & the merges alter the pivots, search the child again after each of them
+        int64_t* keys = KEYS(inode);
+        size_t i = 0, inode_num_keys = inode->N -1;
+        while(i < inode_num_keys && (keys[i] < key || (upper && keys[i] == key))) i++;
+        return i;
+    };
 
+    size_t i = find_child(inode);
     rebalance_lb(inode, i, depth +1); // the first call ensures inode[i] >= |a+1| if possible, otherwise inode[i] >= |a|
 
     // if this is the root, check whether we need to reduce the tree if it has only one child
-    if(node == root){
-        bool reduced = reduce_tree(); // reduced is the same as checking root != node
-        if(reduced){ return rebalance_rec(root, range_min, range_max, 0); }
-    }
+    if(node == root && reduce_tree()){ return rebalance_rec(root, key, upper, 0); }
 
-    rebalance_rec(children[i], range_min, range_max, depth +1);
+    i = find_child(inode);
+    rebalance_rec(CHILDREN(inode)[i], key, upper, depth +1);
 
     rebalance_lb(inode, i, depth +1); // the second time, it brings inode[i] from |a-1| to at least |a|
 
     // if this is the root, check whether we need to reduce the tree if it has only one child
-    if(node == root && reduce_tree()){ return rebalance_rec(root, range_min, range_max, 0); }
+    if(node == root && reduce_tree()){ return rebalance_rec(root, key, upper, 0); }
+
+    // when inode[i] was left with a single child, it could not rebalance it. Visit it again, now that it has siblings.
+    if(!is_leaf(depth +1)){
+        InternalNode* child = reinterpret_cast<InternalNode*>(CHILDREN(inode)[find_child(inode)]);
+        if(child->N > 1 && CHILDREN(child)[find_child(child)]->N < get_lowerbound(depth +2)){
+            rebalance_rec(child, key, upper, depth +1);
+        }
+    }
+}
+
+int64_t ABTree::remove_unlink_leaves(int64_t range_min, int64_t range_max){
+    if(height == 1) return std::numeric_limits<int64_t>::min(); // the root is the only leaf, nothing to rebalance
+
+    // the first and the last leaf visited by #remove_keys, all leaves in between are removed
+    auto descend = [this](int64_t key, bool upper){
+        Node* node = root;
+        for(int depth = 0, l = height -1; depth < l; depth++){
+            InternalNode* inode = reinterpret_cast<InternalNode*>(node);
+            size_t i = 0, N = inode->N -1;
+            int64_t* __restrict keys = KEYS(inode);
+            while(i < N && (keys[i] < key || (upper && keys[i] == key))) i++;
+            node = CHILDREN(inode)[i];
+        }
+        return reinterpret_cast<Leaf*>(node);
+    };
+    Leaf* first = descend(range_min, false);
+    Leaf* last = descend(range_max, true);
 
-    if(inode->N > 1 && i < inode->N -2 && keys[i] < range_max){
-        rebalance_lb(inode, i +1, depth +1);
-        if(node == root && reduce_tree()){ return rebalance_rec(root, range_min, range_max, 0); }
-        rebalance_rec(children[i+1], range_min, range_max, depth +1);
-        rebalance_lb(inode, i +1, depth +1); // ensure inode[i+1] >= |a|
-        if(node == root && reduce_tree()){ return rebalance_rec(root, range_min, range_max, 0); }
+    // a leaf is removed only when all of its elements fall in the interval
+    auto survives = [this, range_min, range_max](Leaf* leaf){
+        return leaf->N > 0 && (KEYS(leaf)[0] < range_min || KEYS(leaf)[leaf->N -1] > range_max);
+    };
+    Leaf* survivors[4]; size_t num_survivors = 0;
+    if(first->previous != nullptr) survivors[num_survivors++] = first->previous;
+    if(survives(first)) survivors[num_survivors++] = first;
+    if(last != first && survives(last)) survivors[num_survivors++] = last;
+    if(last->next != nullptr) survivors[num_survivors++] = last->next;
+
+    if(num_survivors > 0){ // the first & last leaves of the tree
+        if(first->previous == nullptr) survivors[0]->previous = nullptr;
+        if(last->next == nullptr) survivors[num_survivors -1]->next = nullptr;
+    }
+    for(size_t i = 1; i < num_survivors; i++){
+        survivors[i -1]->next = survivors[i];
+        survivors[i]->previous = survivors[i -1];
+        defrag_record_link(survivors[i -1]);
+    }
+
+    // the first key after the interval
+    int64_t* keys = KEYS(last);
+    size_t i = 0;
+    while(i < last->N && keys[i] <= range_max) i++;
+    if(i < last->N){
+        return keys[i];
+    } else if(last->next != nullptr){
+        return KEYS(last->next)[0];
+    } else {
+        return std::numeric_limits<int64_t>::min();
     }
 }
 
 void ABTree::remove(Node* node, int64_t keymin, int64_t keymax, int depth){
+    int64_t keynext = remove_unlink_leaves(keymin, keymax);
+
     // first pass, remove the elements
     bool rebalance = remove_keys(node, keymin, keymax, depth, nullptr);
 
@@ -1089,8 +1292,9 @@ void ABTree::remove(Node* node, int64_t keymin, int64_t keymax, int depth){
             height =1;
             root = create_leaf();
         } else {
-            // standard case
-            rebalance_rec(node, keymin, keymax, 0);
+            // standard case, rebalance both the nodes on the left & on the right of the removed interval
+            rebalance_rec(root, keymin, /* upper */ false, 0);
+            if(keynext != std::numeric_limits<int64_t>::min()){ rebalance_rec(root, keynext, /* upper */ true, 0); }
         }
     }
 }
@@ -1195,12 +1399,49 @@ int64_t ABTree::remove(int64_t key) {
             delete_node(iroot, 0);
             height--;
         }
+
+        if(defrag_rate > 0) defragment_online();
     }
 
     sanity_check();
     return value;
 }
 
+/******************************************************************************
+ *                                                                            *
+ *   Search inside a node                                                     *
+ *                                                                            *
+ *****************************************************************************/
+
+template<bool inclusive>
+size_t ABTree::rank(const int64_t* keys, size_t N, int64_t key) const {
+    size_t i = 0;
+#if defined(__AVX2__)
+    if(simd_search){
+        // compare four keys at the time, the keys are sorted so we can stop at the first block
+        // where not all keys satisfy the predicate
+        const __m256i vkey = _mm256_set1_epi64x(key);
+        while(i + 4 <= N){
+            __m256i vkeys = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+            __m256i cmp = inclusive ? _mm256_cmpgt_epi64(vkeys, vkey) /* keys[i] > key */ : _mm256_cmpgt_epi64(vkey, vkeys) /* keys[i] < key */;
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(cmp));
+            if(inclusive){
+                if(mask != 0) return i + __builtin_ctz(mask); // first key > key
+            } else {
+                if(mask != 0xF) return i + __builtin_popcount(mask);
+            }
+            i += 4;
+        }
+    }
+#endif
+    if(inclusive){
+        while(i < N && keys[i] <= key) i++;
+    } else {
+        while(i < N && keys[i] < key) i++;
+    }
+    return i;
+}
+
 /******************************************************************************
  *                                                                            *
  *   Find (single element)                                                    *
@@ -1217,18 +1458,91 @@ int64_t ABTree::find(int64_t key) const noexcept {
         size_t i = 0, N = inode->N -1;
         assert(N > 0 && N <= intnode_b);
         int64_t* __restrict keys = KEYS(inode);
-        while(i < N && keys[i] <= key) i++;
+        i = rank</* inclusive ? */ true>(keys, N, key);
         node = CHILDREN(inode)[i];
     }
 
     // base case, this is a leaf
     Leaf* leaf = reinterpret_cast<Leaf*>(node);
+    if(bloom_filter_blocks > 0 && !pma::BloomFilter::contains(BLOOM_FILTER(leaf), bloom_filter_blocks, key)) return -1; // certainly absent
     size_t i = 0, N = leaf->N;
     int64_t* __restrict keys = KEYS(leaf);
-    while(i < N && keys[i] < key) i++;
+    i = rank</* inclusive ? */ false>(keys, N, key);
     return (i < N && keys[i] == key) ? VALUES(leaf)[i] : -1;
 }
 
+void ABTree::find_interleaved(const int64_t* keys, int64_t* values, size_t num_keys, size_t group_size) const {
+    struct State {
+        const Node* m_node; // the node to visit in the next step
+        int m_depth; // the depth of m_node
+        size_t m_position; // index of the key in the leaf, once the leaf has been searched
+        uint64_t m_index; // index of the lookup, in the arrays keys/values
+    };
+    const int leaf_depth = height -1;
+    const size_t sizeof_inode = sizeof(InternalNode) + intnode_b * sizeof(int64_t);
+    const size_t sizeof_leaf = sizeof(Leaf) + leaf_b * sizeof(int64_t);
+    auto prefetch_node = [&](const Node* node, int depth){
+        if(depth < leaf_depth){
+            pma::prefetch_range(node, sizeof_inode);
+        } else if(bloom_filter_blocks > 0){ // check the Bloom filter first
+            PREFETCH(node);
+            pma::prefetch_range(BLOOM_FILTER(reinterpret_cast<const Leaf*>(node)), bloom_filter_blocks * sizeof(pma::BloomFilter::Block));
+        } else {
+            pma::prefetch_range(node, sizeof_leaf);
+        }
+    };
+
+    auto start = [&](State& state, uint64_t index){
+        state.m_node = root;
+        state.m_depth = 0;
+        state.m_position = std::numeric_limits<size_t>::max();
+        state.m_index = index;
+        prefetch_node(state.m_node, state.m_depth);
+    };
+
+    auto step = [&](State& state){
+        const int64_t key = keys[state.m_index];
+        if(state.m_depth < leaf_depth){ // internal node
+            const InternalNode* inode = reinterpret_cast<const InternalNode*>(state.m_node);
+            size_t i = rank</* inclusive ? */ true>(KEYS(inode), inode->N -1, key);
+            state.m_node = CHILDREN(inode)[i];
+            state.m_depth++;
+            prefetch_node(state.m_node, state.m_depth);
+            return false;
+        }
+
+        const Leaf* leaf = reinterpret_cast<const Leaf*>(state.m_node);
+        if(state.m_position != std::numeric_limits<size_t>::max()){ // the value has been prefetched
+            values[state.m_index] = VALUES(leaf)[state.m_position];
+            return true;
+        } else if(state.m_depth == leaf_depth){
+            if(bloom_filter_blocks > 0){
+                if(!pma::BloomFilter::contains(BLOOM_FILTER(leaf), bloom_filter_blocks, key)){ // certainly absent
+                    values[state.m_index] = -1;
+                    return true;
+                }
+                state.m_depth++; // the Bloom filter has been checked, search the keys in the next step
+                pma::prefetch_range(leaf, sizeof_leaf);
+                return false;
+            }
+            state.m_depth++;
+        }
+
+        const int64_t* __restrict leaf_keys = KEYS(leaf);
+        size_t i = rank</* inclusive ? */ false>(leaf_keys, leaf->N, key);
+        if(i < leaf->N && leaf_keys[i] == key){
+            state.m_position = i;
+            PREFETCH(VALUES(leaf) + i);
+            return false;
+        } else {
+            values[state.m_index] = -1;
+            return true;
+        }
+    };
+
+    pma::interleave_lookups<State>(num_keys, group_size, start, step);
+}
+
 /******************************************************************************
  *                                                                            *
  *   Iterator                                                                 *
@@ -1247,6 +1561,13 @@ std::pair<int64_t, int64_t>  ABTree::Iterator::next() {
     if(pos >= block->N - 1){
         block = block->next;
         pos = 0;
+
+        // prefetch the leaf after the one we are going to read
+        if(tree->simd_search && block != nullptr && block->next != nullptr){
+            PREFETCH(block->next);
+            PREFETCH(tree->KEYS(block->next));
+            PREFETCH(tree->VALUES(block->next));
+        }
     } else {
         pos++;
     }
@@ -1289,8 +1610,7 @@ std::unique_ptr<ABTree::Iterator> ABTree::leaf_scan(Leaf* leaf, int64_t min, int
 
     // standard case, find the first key that satisfies the interval
     } else {
-        size_t i = 0;
-        while(i < leaf->N && KEYS(leaf)[i] < min) i++;
+        size_t i = rank</* inclusive ? */ false>(KEYS(leaf), leaf->N, min);
         return create_iterator(max, leaf, i);
     }
 }
@@ -1305,7 +1625,7 @@ std::unique_ptr<pma::Iterator> ABTree::find(int64_t min, int64_t max) const {
         size_t i = 0, N = inode->N;
         assert(N > 0);
         int64_t* __restrict keys = KEYS(inode);
-        while(i < N -1 && keys[i] < min) i++;
+        i = rank</* inclusive ? */ false>(keys, N -1, min);
         node = CHILDREN(inode)[i];
     }
 
@@ -1328,7 +1648,7 @@ pma::Interface::SumResult ABTree::sum(int64_t min, int64_t max) const {
         size_t i = 0, N = inode->N;
         assert(N > 0);
         int64_t* __restrict keys = KEYS(inode);
-        while(i < N -1 && keys[i] < min) i++;
+        i = rank</* inclusive ? */ false>(keys, N -1, min);
         node = CHILDREN(inode)[i];
     }
 
@@ -1351,19 +1671,28 @@ pma::Interface::SumResult ABTree::sum(int64_t min, int64_t max) const {
     // standard case, find the first key that satisfies the interval
     int64_t* __restrict keys = KEYS(leaf);
     int64_t* __restrict values = VALUES(leaf);
-    int64_t i = 0;
-    while(/*i < leaf->N && */ keys[i] < min) i++;
+    int64_t i = rank</* inclusive ? */ false>(keys, leaf->N, min);
 
     int64_t N = leaf->N;
     SumResult result;
     result.m_first_key = keys[i];
 
     do {
-        while(i < N && keys[i] <= max /* inclusive */){
-            result.m_sum_keys += keys[i];
-            result.m_sum_values += values[i];
-            result.m_num_elements++;
-            i++;
+        if(simd_search){
+            int64_t end = rank</* inclusive ? */ true>(keys, N, max);
+            for(int64_t j = i; j < end; j++){
+                result.m_sum_keys += keys[j];
+                result.m_sum_values += values[j];
+            }
+            result.m_num_elements += end - i;
+            i = end;
+        } else {
+            while(i < N && keys[i] <= max /* inclusive */){
+                result.m_sum_keys += keys[i];
+                result.m_sum_values += values[i];
+                result.m_num_elements++;
+                i++;
+            }
         }
         result.m_last_key = keys[i -1]; // just in case
 
@@ -1522,6 +1851,110 @@ void ABTree::set_record_leaf_statistics(bool value) {
     record_leaf_statistics = value;
 }
 
+void ABTree::set_simd_search(bool value) {
+    simd_search = value;
+}
+
+void ABTree::set_bulk_load_threads(size_t num_threads) {
+    bulk_load_threads = std::max<size_t>(1, num_threads);
+}
+
+void ABTree::set_bulk_load_fill_factor(double value) {
+    if(value <= 0 || value > 1) throw std::invalid_argument("Invalid fill factor, expected a value in (0, 1]");
+    bulk_load_fill_factor = value;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Defragmentation                                                         *
+ *                                                                           *
+ *****************************************************************************/
+
+void ABTree::set_defragmentation_rate(size_t leaves_per_update){
+    defrag_rate = leaves_per_update;
+}
+
+ABTree::Leaf* ABTree::relocate_leaf(InternalNode* parent, size_t child_index, Leaf* leaf){
+    assert(leaf != nullptr);
+    Leaf* copy (nullptr);
+    if(slab_leaves){
+        copy = reinterpret_cast<Leaf*>(slab_leaves->allocate_sequential());
+    } else {
+        int rc = posix_memalign((void**) &copy, /* alignment = */ 64,  /* size = */ memsize_leaf());
+        if(rc != 0) throw std::runtime_error("ABTree::relocate_leaf, cannot obtain a chunk of aligned memory");
+    }
+    memcpy(static_cast<void*>(copy), leaf, memsize_leaf()); // including the Bloom filter, if present
+
+    // fix the pointers to the leaf
+    if(parent != nullptr){
+        assert(CHILDREN(parent)[child_index] == leaf);
+        CHILDREN(parent)[child_index] = copy;
+    } else {
+        assert(root == leaf);
+        root = copy;
+    }
+    if(copy->previous != nullptr) copy->previous->next = copy;
+    if(copy->next != nullptr) copy->next->previous = copy;
+
+    // the number of allocated leaves does not change
+    if(slab_leaves){ slab_leaves->deallocate(leaf); } else { free(leaf); }
+
+    return copy;
+}
+
+bool ABTree::defragment(size_t max_leaves){
+    if(!defrag_active){ // start a new pass from the first leaf
+        defrag_active = true;
+        defrag_cursor = std::numeric_limits<int64_t>::min();
+        defrag_num_unordered = 0;
+    }
+
+    for(size_t num_moves = 0; num_moves < max_leaves; num_moves++){
+        // search the leaf for the cursor, as in #find
+        Node* node = root;
+        InternalNode* parent = nullptr;
+        size_t child_index = 0;
+        for(int depth = 0, l = height -1; depth < l; depth++){
+            parent = reinterpret_cast<InternalNode*>(node);
+            size_t i = 0, N = parent->N -1;
+            int64_t* __restrict keys = KEYS(parent);
+            while(i < N && keys[i] <= defrag_cursor) i++;
+            node = CHILDREN(parent)[i];
+            child_index = i;
+        }
+
+        Leaf* leaf = relocate_leaf(parent, child_index, reinterpret_cast<Leaf*>(node));
+        if(leaf->next == nullptr){ // last leaf, end of the pass
+            end_defragmentation();
+            return true;
+        }
+        defrag_cursor = KEYS(leaf->next)[0];
+    }
+
+    return false;
+}
+
+void ABTree::end_defragmentation(){
+    defrag_active = false;
+    if(slab_leaves) slab_leaves->end_sequential(); // the remaining slots of the chunk reserved to the pass become available
+}
+
+void ABTree::defragment(){
+    end_defragmentation(); // restart from the first leaf
+    defragment(std::numeric_limits<size_t>::max());
+}
+
+void ABTree::defragment_online(){
+    assert(defrag_rate > 0);
+    if(!defrag_active && defrag_num_unordered * defrag_threshold < num_leaves_allocated) return; // not fragmented enough
+    defragment(defrag_rate);
+}
+
+void ABTree::defrag_record_link(const Leaf* l1){
+    assert(l1 != nullptr);
+    if(l1->next != nullptr && l1->next < l1) defrag_num_unordered++;
+}
+
 #if !defined(NDEBUG)
 void ABTree::sanity_check(Node* node, int depth, int64_t minimum, std::unordered_map<Node*, bool>& map){
     assert(node != nullptr);
@@ -1731,6 +2164,38 @@ void ABTree::set_common_memsize_nodes(bool value){
     if(common_memsize != value){
         common_memsize = value;
         delete_node(root, 0);
+        if(slab_leaves){ init_slab_allocators(); }
+        root = create_leaf();
+    }
+}
+
+void ABTree::set_bloom_filters(bool value){
+    if(size() != 0){
+        throw std::logic_error("Cannot invoke the method #set_bloom_filters when the data structure is not empty");
+    }
+
+    size_t num_blocks = value ? pma::BloomFilter::num_blocks(leaf_b, /* bits per key */ 8) : 0;
+    if(bloom_filter_blocks != num_blocks){
+        delete_node(root, 0);
+        bloom_filter_blocks = num_blocks;
+        if(slab_leaves){ init_slab_allocators(); }
+        root = create_leaf();
+    }
+}
+
+void ABTree::set_slab_allocator(bool value){
+    if(size() != 0){
+        throw std::logic_error("Cannot invoke the method #set_slab_allocator when the data structure is not empty");
+    }
+
+    if(value != (slab_leaves != nullptr)){
+        delete_node(root, 0);
+        if(value){
+            init_slab_allocators();
+        } else {
+            slab_inodes.reset();
+            slab_leaves.reset();
+        }
         root = create_leaf();
     }
 }
@@ -1742,6 +2207,10 @@ void ABTree::build(){
     if(abtree_random_permutation){
         permute(ARGREF(uint64_t, "seed_random_permutation") + size());
     }
+
+    if(defrag_rate > 0 && defrag_active){ // complete the pass in progress
+        defragment(std::numeric_limits<size_t>::max());
+    }
 }
 
 void ABTree::permute(uint64_t random_seed){
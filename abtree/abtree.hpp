@@ -18,20 +18,36 @@
 #ifndef PMA_ABTREE_v2_HPP_
 #define PMA_ABTREE_v2_HPP_
 
+#include "abtree/slab_allocator.hpp"
+#include "pma/bulk_loading.hpp"
+#include "pma/generic/bloom_filter.hpp"
 #include "pma/interface.hpp"
 #include "pma/iterator.hpp"
 
 #include <cinttypes>
+#include <functional>
+#include <memory>
 #include <ostream>
 #include <unordered_map>
 #include <utility>
 
 namespace abtree {
 
+/**
+ * Route pma::BulkLoading#load to ABTree#bulk_load. The override lives here, rather than in the ABTree, so that
+ * the name `load' in the scope of the ABTree only refers to ABTree#load(const ...), which does not alter its input.
+ */
+class ABTreeBulkLoading : public pma::BulkLoading {
+public:
+    void load(std::pair<int64_t, int64_t>* elements, size_t elements_sz) override { bulk_load(elements, elements_sz); }
+
+    virtual void bulk_load(std::pair<int64_t, int64_t>* elements, size_t elements_sz) = 0;
+};
+
 /**
  * Basic implementation of a B+ tree
  */
-class ABTree : public pma::InterfaceRQ {
+class ABTree : public pma::InterfaceRQ, public ABTreeBulkLoading {
     ABTree(const ABTree&) = delete;
     ABTree& operator= (ABTree&) = delete;
 
@@ -74,6 +90,7 @@ class ABTree : public pma::InterfaceRQ {
 
     int64_t* KEYS(const Leaf* leaf) const;
     int64_t* VALUES(const Leaf* leaf) const;
+    pma::BloomFilter::Block* BLOOM_FILTER(const Leaf* leaf) const; // only valid when the Bloom filters are enabled
 
   class Iterator : public pma::Iterator {
     friend class ABTree;
@@ -94,6 +111,9 @@ class ABTree : public pma::InterfaceRQ {
   const size_t leaf_a; // lower bound for leaves
   const size_t leaf_b; // upper bound for leaves
   bool common_memsize = false; // whether all nodes must be allocated with the same size
+  size_t bloom_filter_blocks = 0; // number of blocks of the Bloom filter appended to each leaf, 0 if disabled
+  std::unique_ptr<SlabAllocator> slab_inodes; // allocator for the internal nodes, nullptr to use posix_memalign
+  std::unique_ptr<SlabAllocator> slab_leaves; // allocator for the leaves, nullptr to use posix_memalign
   const size_t min_sizeof_inode; // the minimum size, in bytes, of an allocated InternalNode
   const size_t min_sizeof_leaf; // the minimum size, in bytes, of an allocated Leaf
   Node* root; // current root
@@ -102,9 +122,27 @@ class ABTree : public pma::InterfaceRQ {
   mutable size_t num_nodes_allocated; // internal profiling
   mutable size_t num_leaves_allocated; // internal profiling
   bool record_leaf_statistics = false; // whether to record the leaf distances when deleting the tree
-
+  size_t defrag_rate = 0; // number of leaves to relocate after each update, 0 to disable the online defragmentation
+  bool defrag_active = false; // whether a pass of the defragmentation is in progress
+  int64_t defrag_cursor = 0; // the next leaf to relocate is the one reached by searching this key
+  size_t defrag_num_unordered = 0; // number of links between leaves at descending addresses created by the splits & merges since the last pass started
+  constexpr static size_t defrag_threshold = 8; // start a new online pass when at least 1/defrag_threshold of the leaves have been linked out of order
+  bool simd_search = false; // whether to search the keys inside the nodes with SIMD instructions and prefetch the next leaves in the iterators
+  size_t bulk_load_threads = 1; // max number of threads to sort the elements and build the tree in a bulk load
+  double bulk_load_fill_factor = 1.0; // target fill factor of the leaves in a bulk load, in (0, 1]
+
+  // Build the tree bottom-up from the given elements. The tree must be empty, with root == nullptr.
   void initialize_from_array(std::pair<int64_t, int64_t>* elements, size_t size, bool do_sort = true);
 
+  // Number of threads to employ to process `num_elements' in a bulk load
+  size_t get_num_workers(size_t num_elements) const;
+
+  // Split the range [0, num_items) in chunks and process them in parallel, with fn(start, end). The number of threads depends on `num_elements'.
+  void parallel_for(size_t num_items, size_t num_elements, const std::function<void(size_t, size_t)>& fn) const;
+
+  // Sort the given elements by key, with up to `bulk_load_threads' threads
+  void sort_parallel(std::pair<int64_t, int64_t>* elements, size_t size) const;
+
   // Validate the parameters a, b (lowerbound and upperbound respectively)
   void validate_bounds() const;
 
@@ -117,9 +155,12 @@ class ABTree : public pma::InterfaceRQ {
   size_t get_lowerbound(int depth) const;
   size_t get_upperbound(int depth) const;
 
-  // Create a new node / leaf
-  InternalNode* create_internal_node() const;
-  Leaf* create_leaf() const;
+  // Create a new node / leaf. With the slab allocators, the new node is placed close to `neighbour', if given.
+  InternalNode* create_internal_node(const InternalNode* neighbour = nullptr) const;
+  Leaf* create_leaf(const Leaf* neighbour = nullptr) const;
+
+  // (Re)create the slab allocators for the current sizes of the nodes
+  void init_slab_allocators();
 
   // Determine the memory size of an internal node / leaf
   size_t init_memsize_internal_node() const;
@@ -129,9 +170,27 @@ class ABTree : public pma::InterfaceRQ {
   size_t memsize_internal_node() const;
   size_t memsize_leaf() const;
 
+  // Offset, in bytes, of the Bloom filter inside a leaf
+  size_t offset_bloom_filter() const;
+
+  // Reset the Bloom filter of the given leaf and add again all of its keys
+  void bloom_filter_rebuild(Leaf* leaf);
+
   // Delete an existing node / leaf
   void delete_node(Node* node, int depth) const;
 
+  // Move the given leaf, child of `parent' at the position `child_index', to the next sequential slot of the allocator
+  Leaf* relocate_leaf(InternalNode* parent, size_t child_index, Leaf* leaf);
+
+  // Terminate the defragmentation pass in progress, if any, and stop reserving a chunk of the slab allocator to the relocated leaves
+  void end_defragmentation();
+
+  // Relocate the next `defrag_rate' leaves after an update, starting a new pass only when the tree is fragmented enough
+  void defragment_online();
+
+  // Record whether the link from `l1' to its next leaf is out of the address order
+  void defrag_record_link(const Leaf* l1);
+
   std::unique_ptr<ABTree::Iterator> create_iterator(int64_t max, Leaf* block, int64_t) const;
   std::unique_ptr<ABTree::Iterator> leaf_scan(Leaf* leaf, int64_t min, int64_t max) const;
 
@@ -150,7 +209,9 @@ class ABTree : public pma::InterfaceRQ {
   void rotate_left(InternalNode* node, size_t child_index, int child_depth, size_t num_nodes);
   void rotate_right(InternalNode* node, size_t child_index, int child_depth, size_t num_nodes);
   void rebalance_lb(InternalNode* node, size_t child_index, int child_depth);
-  void rebalance_rec(Node* node, int64_t range_min, int64_t range_max, int depth);
+  // Rebalance the nodes on the path of the given key, after the removal of an interval. The path follows the last child
+  // whose pivot is < key (upper = false) or <= key (upper = true).
+  void rebalance_rec(Node* node, int64_t key, bool upper, int depth);
 
   // Attempts to reduce the height of the tree, checking whether the root has only one child.
   bool reduce_tree();
@@ -167,12 +228,20 @@ class ABTree : public pma::InterfaceRQ {
   // Helper method, it performs the recursion of remove_subtrees
   void remove_subtrees_rec0(Node* node, int depth);
 
+  // Before removing the interval [range_min, range_max], link to each other the leaves that survive the removal.
+  // It returns the first key greater than range_max, or INT64_MIN if there is none.
+  int64_t remove_unlink_leaves(int64_t range_min, int64_t range_max);
+
   // Remove the given interval from the sub-tree starting at node
   void remove(Node* node, int64_t keymin, int64_t keymax, int depth);
 
   // Remove a single element from the tree
   int64_t remove(Node* node, int64_t key, int depth, int64_t* omin);
 
+  // Number of keys in the sorted sequence keys[0, N) that are less than `key' or, when `inclusive' is set, less than or equal to `key'
+  template<bool inclusive>
+  size_t rank(const int64_t* keys, size_t N, int64_t key) const;
+
   // Debugging
   void dump_data(std::ostream&, Node* node, int depth) const;
 
@@ -263,6 +332,12 @@ public:
    */
   virtual int64_t find(int64_t key) const noexcept override;
 
+  /**
+   * Batched lookup, it interleaves up to `group_size' root-to-leaf traversals at the time, prefetching
+   * the next node of each traversal before switching to the following one
+   */
+  virtual void find_interleaved(const int64_t* keys, int64_t* values, size_t num_keys, size_t group_size) const override;
+
   /**
    * Returns an iterator for all keys in the interval [min, max]
    */
@@ -316,6 +391,14 @@ public:
    */
   virtual void load(const std::pair<int64_t, int64_t>* elements, size_t elements_sz);
 
+  /**
+   * Bulk load the given elements into a tree, possibly non empty. It alters its input: the array
+   * `elements' is sorted in place. If the tree is empty, or the batch is not much smaller than the
+   * current cardinality, the tree is rebuilt bottom-up from the merged sequence of elements.
+   * Otherwise, the elements are inserted one by one. It's the implementation of pma::BulkLoading#load.
+   */
+  void bulk_load(std::pair<int64_t, int64_t>* elements, size_t elements_sz) override;
+
   /**
    * Verify that all nodes in the tree respect the proper bounds. If the validation fails,
    * a std::range_error exception is raised
@@ -333,6 +416,26 @@ public:
    */
   void set_common_memsize_nodes(bool value);
 
+  /**
+   * Set whether each leaf should embed a Bloom filter of its keys. When set, a lookup for an
+   * absent key can usually stop at the leaf without scanning its keys. The filters are updated
+   * on insert and rebuilt when the keys are moved among the leaves. The deleted keys are only
+   * purged on the next rebuild.
+   *
+   * This setting can be changed only when the tree is empty.
+   */
+  void set_bloom_filters(bool value);
+
+  /**
+   * Set whether to allocate the nodes from slabs of 2 MB chunks, one for the internal nodes
+   * and one for the leaves, rather than with a posix_memalign for each node. A new node is
+   * placed in the same chunk of its sibling, when possible, and released nodes are recycled
+   * LIFO within their chunk.
+   *
+   * This setting can be changed only when the tree is empty.
+   */
+  void set_slab_allocator(bool value);
+
   /**
    * Whether to record the average distance among the leaves in the tree. If set, when
    * the tree is deleted, a final pass among all the leaves of the tree is performed. Some
@@ -341,6 +444,50 @@ public:
    */
   void set_record_leaf_statistics(bool value);
 
+  /**
+   * Set the number of leaves to relocate after each insertion or deletion, to defragment the
+   * tree online. The leaves are visited in key order and moved, one by one, into fresh memory
+   * at ascending addresses, so that after a whole pass a scan reads the leaves sequentially.
+   * The placement is only guaranteed with the slab allocator, see #set_slab_allocator.
+   * Once a pass completes, a new one starts only after the splits and merges have linked at
+   * least 1/8 of the leaves to a leaf at a lower address. The value 0 (default) disables
+   * the online defragmentation. When set, #build also completes the pass in progress.
+   */
+  void set_defragmentation_rate(size_t leaves_per_update);
+
+  /**
+   * Relocate up to `max_leaves' leaves of the current defragmentation pass, starting a new pass
+   * if none is in progress.
+   * @return true if the pass has been completed, false otherwise
+   */
+  bool defragment(size_t max_leaves);
+
+  /**
+   * Perform a whole pass of defragmentation over all the leaves of the tree, restarting
+   * the pass in progress, if any
+   */
+  void defragment();
+
+  /**
+   * Whether to search the keys inside the internal nodes and the leaves with AVX2 instructions, rather
+   * than with a linear scan, and to prefetch the following leaf while iterating. It affects the lookups,
+   * the range scans, the sums and the descent of the insertions. If the binary was compiled without
+   * AVX2 support, the search falls back to the scalar code. Default: false.
+   */
+  void set_simd_search(bool value);
+
+  /**
+   * Set the max number of threads to sort the elements, fill the leaves and build the internal
+   * levels in a bulk load. Each thread processes at least 64k elements. Default: 1.
+   */
+  void set_bulk_load_threads(size_t num_threads);
+
+  /**
+   * Set the target fill factor, in (0, 1], of the leaves created by a bulk load. The leaves are
+   * anyway filled with at least `lA' elements. Default: 1, that is, full leaves.
+   */
+  void set_bulk_load_fill_factor(double value);
+
   /**
    * Intercept a batch of inserts has been executed, and randomly permute the node in memory
    * if the parameter --abtree_random_permutation has been set.
@@ -20,12 +20,18 @@
 
 #include "art.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib> // free, posix_memalign
+#include <emmintrin.h> // _mm_pause
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <new> // placement new
 
+#include "epoch_manager.hpp"
 #include "miscellaneous.hpp"
+#include "pma/generic/interleaved_lookup.hpp"
 
 using namespace std;
 
@@ -50,9 +56,11 @@ namespace abtree {
  *                                                                           *
  *****************************************************************************/
 
-ART::ART(uint64_t leaf_block_size) :
+ART::ART(uint64_t leaf_block_size, bool synchronized) :
+                m_synchronized(synchronized),
+                m_epoch(synchronized ? new EpochManager() : nullptr),
                 m_load_key{new LoadKeyImpl(this)},
-                m_index(m_load_key),
+                m_index(m_load_key, synchronized ? make_shared<DeleteNodeImpl>(m_epoch.get()) : nullptr),
                 m_first(nullptr),
                 m_leaf_block_size(leaf_block_size),
                 m_cardinality(0),
@@ -68,7 +76,7 @@ ART::~ART(){
         Leaf* pointer = leaf;
         leaf = leaf->next; // next element
 
-        free(pointer);
+        free(leaf_chunk(pointer));
     }
     m_leaf_count = 0;
 }
@@ -87,20 +95,28 @@ bool ART::empty() const noexcept {
     return m_cardinality == 0;
 }
 
+bool ART::is_synchronized() const noexcept {
+    return m_synchronized;
+}
+
 size_t ART::memsize_leaf() const {
-    return sizeof(Leaf) + sizeof(int64_t) * 2 /* key/value */ * m_leaf_block_size;
+    return (m_synchronized ? sizeof(uint64_t) /* version */ : 0) + sizeof(Leaf) + sizeof(int64_t) * 2 /* key/value */ * m_leaf_block_size;
 }
 
 ART::Leaf* ART::create_leaf() {
     static_assert(!is_polymorphic<Leaf>::value, "Expected a non polymorphic type (no vtable)");
     static_assert(sizeof(Leaf) == 24, "Expected 24 bytes for the cardinality + ptr previous + ptr next");
+    static_assert(sizeof(atomic<uint64_t>) == sizeof(uint64_t), "Expected a lock-free version word");
 
     // (cardinality) 1 + (ptr left/right) 2 + (keys=) leaf_b + (values) leaf_b == 2 * leaf_b + 1;
-    Leaf* ptr (nullptr);
-    int rc = posix_memalign((void**) &ptr, /* alignment = */ 64,  /* size = */ memsize_leaf());
+    // with synchronisation, the version word precedes the header of the leaf
+    uint8_t* chunk (nullptr);
+    int rc = posix_memalign((void**) &chunk, /* alignment = */ 64,  /* size = */ memsize_leaf());
     if(rc != 0) throw std::runtime_error("ART_nr::create_leaf, cannot obtain a chunk of aligned memory");
+    Leaf* ptr = reinterpret_cast<Leaf*>(chunk + (m_synchronized ? sizeof(uint64_t) : 0));
     ptr->N = 0;
     ptr->next = ptr->previous = nullptr;
+    if(m_synchronized){ new (chunk) atomic<uint64_t>(0b100); }
 
     m_leaf_count++;
     return ptr;
@@ -108,7 +124,7 @@ ART::Leaf* ART::create_leaf() {
 
 int64_t ART::get_pivot(void* pointer) const {
     Leaf* leaf = reinterpret_cast<Leaf*>(pointer);
-    assert(leaf->N > 0 && "This leaf is empty!");
+    assert((m_synchronized || leaf->N > 0) && "This leaf is empty!"); // optimistic readers can observe a leaf while it is altered
     return KEYS(leaf)[0];
 }
 
@@ -121,6 +137,15 @@ int64_t* ART::VALUES(const Leaf* leaf) const {
     return KEYS(leaf) + m_leaf_block_size;
 }
 
+atomic<uint64_t>& ART::VERSION(const Leaf* leaf) {
+    Leaf* instance = const_cast<Leaf*>(leaf);
+    return *(reinterpret_cast<atomic<uint64_t>*>(instance) -1);
+}
+
+void* ART::leaf_chunk(Leaf* leaf) const {
+    return reinterpret_cast<uint8_t*>(leaf) - (m_synchronized ? sizeof(uint64_t) : 0);
+}
+
 size_t ART::memory_footprint() const {
     size_t space_index = m_index.memory_footprint();
     size_t space_leaves = m_leaf_count * memsize_leaf();
@@ -128,6 +153,63 @@ size_t ART::memory_footprint() const {
     return space_index + space_leaves;
 }
 
+void ART::delete_leaf(Leaf* leaf){
+    if(m_synchronized){
+        // the leaf was locked by the writer, mark it as obsolete
+        VERSION(leaf).store(VERSION(leaf).load(memory_order_relaxed) + 0b11, memory_order_release);
+        m_epoch->retire(leaf_chunk(leaf), free);
+    } else {
+        free(leaf);
+    }
+    m_leaf_count--;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Optimistic lock coupling                                                *
+ *                                                                           *
+ *****************************************************************************/
+
+void ART::leaf_write_lock(Leaf* leaf) const {
+    if(!m_synchronized) return;
+    uint64_t version = VERSION(leaf).load(memory_order_relaxed);
+    assert((version & 0b10) == 0 && "The writers must be serialised");
+    VERSION(leaf).store(version + 0b10, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // the following changes must not be visible before the lock
+}
+
+void ART::leaf_write_unlock(Leaf* leaf) const {
+    if(!m_synchronized) return;
+    VERSION(leaf).store(VERSION(leaf).load(memory_order_relaxed) + 0b10, memory_order_release);
+}
+
+uint64_t ART::leaf_read_lock(const Leaf* leaf, bool& restart) const {
+    uint64_t version = VERSION(leaf).load(memory_order_acquire);
+    while(version & 0b10){ // locked
+        _mm_pause();
+        version = VERSION(leaf).load(memory_order_acquire);
+    }
+    if(version & 0b1){ restart = true; } // obsolete
+    return version;
+}
+
+void ART::leaf_check(const Leaf* leaf, uint64_t version, bool& restart) const {
+    atomic_thread_fence(memory_order_acquire); // the previous reads cannot be reordered after the check
+    if(VERSION(leaf).load(memory_order_relaxed) != version){ restart = true; }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   DeleteNodeImpl                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+ART::DeleteNodeImpl::DeleteNodeImpl(EpochManager* epoch) : m_epoch(epoch) { }
+
+void ART::DeleteNodeImpl::operator() (ART_unsynchronized::N* node) {
+    m_epoch->retire(node, [](void* pointer){ ART_unsynchronized::N::deleteNode(reinterpret_cast<ART_unsynchronized::N*>(pointer)); });
+}
+
 /*****************************************************************************
  *                                                                           *
  *   LoadKeyImpl                                                             *
@@ -154,6 +236,8 @@ void ART::LoadKeyImpl::store(int64_t pivot, ART_unsynchronized::Key& key){
  *****************************************************************************/
 void ART::insert(int64_t key, int64_t value) {
     COUT_DEBUG("key: " << key << ", value: " << value);
+    unique_lock<mutex> lock(m_writer_lock, defer_lock);
+    if(m_synchronized) lock.lock();
 
     if (UNLIKELY( empty() )){
         leaf_insert(m_first, key, value);
@@ -195,6 +279,7 @@ void ART::insert(int64_t key, int64_t value) {
 int64_t ART::leaf_insert(Leaf* leaf, int64_t key, int64_t value){
     COUT_DEBUG("leaf: " << leaf << ", key: " << key << ", value: " << value);
     assert(leaf->N < m_leaf_block_size);
+    leaf_write_lock(leaf);
     size_t i = leaf->N;
     int64_t* __restrict keys = KEYS(leaf);
     int64_t* __restrict values = VALUES(leaf);
@@ -207,6 +292,7 @@ int64_t ART::leaf_insert(Leaf* leaf, int64_t key, int64_t value){
     values[i] = value;
 
     leaf->N++;
+    leaf_write_unlock(leaf);
     m_cardinality += 1;
 
     return keys[0];
@@ -238,6 +324,7 @@ pair<int64_t, ART::Leaf*> ART::split(Leaf* l1){
     COUT_DEBUG("split: " << l1);
 
     Leaf* l2 = create_leaf();
+    leaf_write_lock(l1); // l2 is not visible to the readers until it is linked to l1
 
     size_t thres = (l1->N +1) /2;
     l2->N = l1->N - thres;
@@ -252,6 +339,7 @@ pair<int64_t, ART::Leaf*> ART::split(Leaf* l1){
     if( l2->next != nullptr ) { l2->next->previous = l2; }
     l2->previous = l1;
     l1->next = l2;
+    leaf_write_unlock(l1);
 
     int64_t pivot2 = KEYS(l2)[0];
 
@@ -265,6 +353,8 @@ pair<int64_t, ART::Leaf*> ART::split(Leaf* l1){
  *                                                                           *
  *****************************************************************************/
 int64_t ART::remove(int64_t key) {
+    unique_lock<mutex> lock(m_writer_lock, defer_lock);
+    if(m_synchronized) lock.lock();
     if(UNLIKELY(empty())) return -1;
     Leaf* leaf = index_find_leq(key);
     if(leaf == nullptr) return -1;
@@ -312,11 +402,13 @@ int64_t ART::leaf_remove(int64_t key, Leaf*& leaf, bool* out_update_min){
             while(i < N && keys[i] < key) i++;
             if(i < N && keys[i] == key){
                 value = values[i];
+                leaf_write_lock(leaf);
                 for(size_t j = i; j < leaf->N -1; j++){
                     keys[j] = keys[j+1];
                     values[j] = values[j+1];
                 }
                 leaf->N -= 1;
+                leaf_write_unlock(leaf);
                 found = true;
                 update_min = (i == 0);
             }
@@ -384,6 +476,8 @@ void ART::share_left(Leaf* leaf, int64_t need){
     int64_t* __restrict l1_values = VALUES(l1);
     int64_t* __restrict l2_keys = KEYS(l2);
     int64_t* __restrict l2_values = VALUES(l2);
+    leaf_write_lock(l1);
+    leaf_write_lock(l2);
 
     // remove the current separator key from the index
     index_remove(l2_keys[0], l2);
@@ -406,6 +500,8 @@ void ART::share_left(Leaf* leaf, int64_t need){
     // update the size of the elements
     l2->N += need;
     l1->N -= need;
+    leaf_write_unlock(l1);
+    leaf_write_unlock(l2);
 }
 
 void ART::share_right(Leaf* leaf, int64_t need){
@@ -420,6 +516,8 @@ void ART::share_right(Leaf* leaf, int64_t need){
     int64_t* __restrict l1_values = VALUES(l1);
     int64_t* __restrict l2_keys = KEYS(l2);
     int64_t* __restrict l2_values = VALUES(l2);
+    leaf_write_lock(l1);
+    leaf_write_lock(l2);
 
     // remove the current separator key from the index
     index_remove(l2_keys[0], l2);
@@ -442,12 +540,16 @@ void ART::share_right(Leaf* leaf, int64_t need){
     // update the cardinalities of the nodes
     l1->N += need;
     l2->N -= need;
+    leaf_write_unlock(l1);
+    leaf_write_unlock(l2);
 }
 
 void ART::merge(Leaf* l1, Leaf* l2){
     assert(l1 != nullptr && "Null pointer (l1)");
     assert(l2 != nullptr && "Null pointer (l2)");
     assert(l1->N + l2->N <= m_leaf_block_size);
+    leaf_write_lock(l1);
+    leaf_write_lock(l2);
 
     // move all elements from l2 to l1
     memcpy(KEYS(l1) + l1->N, KEYS(l2), l2->N * sizeof(KEYS(l2)[0]));
@@ -463,10 +565,10 @@ void ART::merge(Leaf* l1, Leaf* l2){
 
     // update the index
     index_remove(KEYS(l2)[0], l2);
+    leaf_write_unlock(l1);
 
     // free the memory from l2
-    free(l2); l2 = nullptr;
-    m_leaf_count--;
+    delete_leaf(l2); l2 = nullptr;
 }
 
 
@@ -494,6 +596,7 @@ int64_t ART::leaf_find(Leaf* leaf, int64_t key) const noexcept {
 }
 
 int64_t ART::find(int64_t key) const {
+    if(m_synchronized) return optimistic_find(key);
     Leaf* leaf = index_find_leq(key);
     COUT_DEBUG("Lookup: " << key << ", leaf: " << leaf);
     if(leaf == nullptr) return -1;
@@ -503,6 +606,63 @@ int64_t ART::find(int64_t key) const {
     return VALUES(leaf)[index];
 }
 
+void ART::find_interleaved(const int64_t* keys, int64_t* values, size_t num_keys, size_t group_size) const {
+    if(m_synchronized){ return pma::Interface::find_interleaved(keys, values, num_keys, group_size); }
+
+    struct State {
+        ART_unsynchronized::N* m_node; // the node of the radix tree to visit in the next step, nullptr once the leaf has been found
+        uint32_t m_level; // the depth of m_node, in bytes of the key
+        Leaf* m_leaf; // the leaf that may contain the key
+        int64_t m_position; // index of the key in the leaf, once the leaf has been searched
+        uint64_t m_index; // index of the lookup, in the arrays keys/values
+    };
+    const size_t sizeof_leaf = sizeof(Leaf) + m_leaf_block_size * sizeof(int64_t); // header + keys
+
+    auto start = [&](State& state, uint64_t index){
+        state.m_node = m_index.getRoot();
+        state.m_level = 0;
+        state.m_leaf = nullptr;
+        state.m_position = -1;
+        state.m_index = index;
+        pma::prefetch_range(state.m_node, 2 * 64); // header, keys and children of a N4/N16
+    };
+
+    auto step = [&](State& state){
+        const int64_t key = keys[state.m_index];
+        if(state.m_node != nullptr){ // descend the radix tree
+            ART_unsynchronized::Key art_key;
+            m_load_key->store(key, art_key);
+            state.m_node = ART_unsynchronized::Tree::descendStep(art_key, state.m_node, state.m_level);
+            if(state.m_node != nullptr){
+                pma::prefetch_range(state.m_node, 2 * 64);
+                return false;
+            }
+
+            // the path is now in the cache, resolve the leaf from the root
+            state.m_leaf = index_find_leq(key);
+            if(state.m_leaf == nullptr){
+                values[state.m_index] = -1;
+                return true;
+            }
+            pma::prefetch_range(state.m_leaf, sizeof_leaf);
+            return false;
+        } else if(state.m_position < 0){ // search the leaf
+            state.m_position = leaf_find(state.m_leaf, key);
+            if(state.m_position < 0){
+                values[state.m_index] = -1;
+                return true;
+            }
+            PREFETCH(VALUES(state.m_leaf) + state.m_position);
+            return false;
+        } else { // the value has been prefetched
+            values[state.m_index] = VALUES(state.m_leaf)[state.m_position];
+            return true;
+        }
+    };
+
+    pma::interleave_lookups<State>(num_keys, group_size, start, step);
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Iterator                                                                *
@@ -573,12 +733,14 @@ unique_ptr<ART::Iterator> ART::leaf_iterator(Leaf* leaf, int64_t min, int64_t ma
 
 unique_ptr<pma::Iterator> ART::find(int64_t min, int64_t max) const {
     if(min > max) return create_iterator(max, nullptr, 0);
+    if(m_synchronized) return unique_ptr<pma::Iterator>(new OptimisticIterator(this, min, max));
 
     Leaf* starting_point = index_find_leq(min);
     return leaf_iterator(starting_point, min, max);
 }
 
 unique_ptr<pma::Iterator> ART::iterator() const {
+    if(m_synchronized) return unique_ptr<pma::Iterator>(new OptimisticIterator(this, numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max()));
     return leaf_iterator(m_first, numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max());
 }
 
@@ -642,6 +804,7 @@ pma::Interface::SumResult ART::sum(int64_t min, int64_t max) const {
     using SumResult = pma::Interface::SumResult;
     if(min > max) return SumResult{};
     if(min < 0) min = 0; // this is because ART uses the most significant bit internally as a marker
+    if(m_synchronized) return optimistic_sum(min, max);
 
     Leaf* leaf = index_find_leq(min);
     if(leaf == nullptr) leaf = m_first;
@@ -669,6 +832,217 @@ pma::Interface::SumResult ART::sum(int64_t min, int64_t max) const {
     return leaf_sum(leaf, i, max);
 }
 
+/******************************************************************************
+ *                                                                            *
+ *   Optimistic readers                                                       *
+ *                                                                            *
+ *****************************************************************************/
+
+pair<ART::Leaf*, uint64_t> ART::optimistic_find_leaf(int64_t key) const {
+    assert(m_synchronized);
+    ART_unsynchronized::Key art_key;
+    m_load_key->store(key, art_key);
+
+    while(true){ // restart
+        bool restart = false;
+        Leaf* leaf = reinterpret_cast<Leaf*>(m_index.findLessOrEqualOptimistic(art_key));
+        if(leaf == nullptr) leaf = m_first;
+        uint64_t version = leaf_read_lock(leaf, restart);
+        if(restart) continue;
+
+        // the index can lag behind the leaves, while a writer changes the minimum of a leaf
+        size_t N = std::min<size_t>(leaf->N, m_leaf_block_size);
+        if(leaf != m_first && (N == 0 || KEYS(leaf)[0] > key)) continue;
+
+        // after a split, the key may have moved to the next leaves
+        while(true){
+            Leaf* next = leaf->next;
+            if(next == nullptr || N == 0 || KEYS(leaf)[N -1] >= key){
+                leaf_check(leaf, version, restart);
+                if(restart) break;
+                return make_pair(leaf, version);
+            }
+
+            uint64_t next_version = leaf_read_lock(next, restart);
+            leaf_check(leaf, version, restart); // `next' is still the successor of `leaf'
+            if(restart) break;
+            size_t next_N = std::min<size_t>(next->N, m_leaf_block_size);
+            if(next_N == 0 || KEYS(next)[0] > key){ // the key falls between the two leaves
+                leaf_check(next, next_version, restart);
+                if(restart) break;
+                return make_pair(leaf, version);
+            }
+
+            leaf = next;
+            version = next_version;
+            N = next_N;
+        }
+    }
+}
+
+int64_t ART::optimistic_find(int64_t key) const {
+    EpochManager::Guard guard { *m_epoch };
+
+    while(true){
+        bool restart = false;
+        auto position = optimistic_find_leaf(key);
+        Leaf* leaf = position.first;
+        size_t i = 0, N = std::min<size_t>(leaf->N, m_leaf_block_size);
+        int64_t* __restrict keys = KEYS(leaf);
+        while(i < N && keys[i] < key) i++;
+        int64_t value = (i < N && keys[i] == key) ? VALUES(leaf)[i] : -1;
+        leaf_check(leaf, position.second, restart);
+        if(!restart) return value;
+    }
+}
+
+pma::Interface::SumResult ART::optimistic_sum(int64_t min, int64_t max) const {
+    EpochManager::Guard guard { *m_epoch };
+    SumResult result;
+    // the duplicates of a key can span multiple leaves, on restart skip the `resume_count' elements with key
+    // `resume_key' already aggregated, rather than all elements with that key
+    int64_t resume_key = min;
+    uint64_t resume_count = 0;
+    uint64_t skip = 0; // the elements with key `min' still to skip
+
+    auto position = optimistic_find_leaf(min);
+    Leaf* leaf = position.first;
+    uint64_t version = position.second;
+    while(leaf != nullptr){
+        bool restart = false;
+
+        // aggregate the elements of the leaf
+        size_t N = std::min<size_t>(leaf->N, m_leaf_block_size);
+        int64_t* __restrict keys = KEYS(leaf);
+        int64_t* __restrict values = VALUES(leaf);
+        size_t i = 0;
+        while(i < N && keys[i] < min) i++;
+        size_t skipped = 0;
+        while(i < N && skipped < skip && keys[i] == min){ i++; skipped++; }
+        SumResult partial;
+        size_t start = i;
+        while(i < N && keys[i] <= max){
+            partial.m_sum_keys += keys[i];
+            partial.m_sum_values += values[i];
+            i++;
+        }
+        partial.m_num_elements = i - start;
+        uint64_t last_count = 0; // number of elements with the same key of the last one aggregated
+        if(partial.m_num_elements > 0){
+            partial.m_first_key = keys[start];
+            partial.m_last_key = keys[i -1];
+            while(last_count < partial.m_num_elements && keys[i -1 - last_count] == partial.m_last_key) last_count++;
+        }
+
+        // lock coupling with the next leaf
+        bool done = i < N; // found a key greater than max
+        Leaf* next = done ? nullptr : leaf->next;
+        uint64_t next_version = 0;
+        if(next != nullptr){ next_version = leaf_read_lock(next, restart); }
+        leaf_check(leaf, version, restart);
+        if(restart){ // resume after the last element aggregated, from the first leaf that may contain its duplicates
+            min = resume_key;
+            skip = resume_count;
+            position = optimistic_find_leaf(resume_count > 0 && resume_key > 0 ? resume_key -1 : resume_key);
+            leaf = position.first;
+            version = position.second;
+            continue;
+        }
+
+        // the next leaves are visited from their first element
+        skip -= skipped;
+        if(partial.m_num_elements > 0){
+            if(result.m_num_elements == 0){ result.m_first_key = partial.m_first_key; }
+            result.m_last_key = partial.m_last_key;
+            result.m_num_elements += partial.m_num_elements;
+            result.m_sum_keys += partial.m_sum_keys;
+            result.m_sum_values += partial.m_sum_values;
+            resume_count = (partial.m_last_key == resume_key ? resume_count : 0) + last_count;
+            resume_key = partial.m_last_key;
+        }
+
+        leaf = next;
+        version = next_version;
+    }
+
+    return result;
+}
+
+ART::OptimisticIterator::OptimisticIterator(const ART* tree, int64_t min, int64_t max) :
+        tree(tree), min(std::max<int64_t>(0, min)), skip(0), max(max), pos(0), exhausted(false) {
+    fetch();
+}
+
+void ART::OptimisticIterator::fetch(){
+    buffer.clear();
+    pos = 0;
+    if(exhausted || min > max) { exhausted = true; return; }
+
+    EpochManager::Guard guard { *(tree->m_epoch) };
+    // with duplicates already fetched, start from the first leaf that may contain them
+    const int64_t search_key = (skip > 0 && min > 0) ? min -1 : min;
+    uint64_t to_skip = skip; // the elements with key `min' still to skip
+    auto position = tree->optimistic_find_leaf(search_key);
+    Leaf* leaf = position.first;
+    uint64_t version = position.second;
+    while(leaf != nullptr){
+        bool restart = false;
+
+        // copy the qualifying elements of the leaf
+        size_t N = std::min<size_t>(leaf->N, tree->m_leaf_block_size);
+        int64_t* __restrict keys = tree->KEYS(leaf);
+        int64_t* __restrict values = tree->VALUES(leaf);
+        size_t i = 0;
+        while(i < N && keys[i] < min) i++;
+        size_t skipped = 0;
+        while(i < N && skipped < to_skip && keys[i] == min){ i++; skipped++; }
+        while(i < N && keys[i] <= max){
+            buffer.emplace_back(keys[i], values[i]);
+            i++;
+        }
+        bool done = i < N; // found a key greater than max
+        Leaf* next = leaf->next;
+        uint64_t next_version = 0;
+        if(!done && buffer.empty() && next != nullptr){ next_version = tree->leaf_read_lock(next, restart); }
+        tree->leaf_check(leaf, version, restart);
+        if(restart){
+            buffer.clear();
+            to_skip = skip;
+            position = tree->optimistic_find_leaf(search_key);
+            leaf = position.first;
+            version = position.second;
+            continue;
+        }
+
+        to_skip -= skipped;
+        if(done || next == nullptr){
+            exhausted = true;
+            break;
+        } else if(!buffer.empty()){ // the next fetch resumes after the last element in the buffer
+            int64_t last_key = buffer.back().first;
+            uint64_t last_count = 0;
+            while(last_count < buffer.size() && buffer[buffer.size() -1 - last_count].first == last_key) last_count++;
+            skip = (last_key == min ? skip : 0) + last_count;
+            min = last_key;
+            break;
+        }
+
+        leaf = next;
+        version = next_version;
+    }
+}
+
+bool ART::OptimisticIterator::hasNext() const {
+    return pos < buffer.size();
+}
+
+pair<int64_t, int64_t> ART::OptimisticIterator::next(){
+    if(pos >= buffer.size()) return pair<int64_t, int64_t>{-1, -1};
+    auto v = buffer[pos++];
+    if(pos >= buffer.size() && !exhausted){ fetch(); }
+    return v;
+}
+
 /******************************************************************************
  *                                                                            *
  *   Dump                                                                     *
@@ -22,10 +22,18 @@
 #ifndef ABTREE_ART_HPP_
 #define ABTREE_ART_HPP_
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include "pma/interface.hpp"
 #include "pma/iterator.hpp"
 #include "third-party/art/Tree.h"
 
+class EpochManager; // forward decl.
+
 namespace abtree {
 
 class ART : public pma::InterfaceRQ {
@@ -43,6 +51,13 @@ class ART : public pma::InterfaceRQ {
     int64_t* KEYS(const Leaf* leaf) const;
     int64_t* VALUES(const Leaf* leaf) const;
 
+    // With synchronisation, each leaf is preceded by a version word for the optimistic lock coupling: bit 0 = obsolete,
+    // bit 1 = locked. Without synchronisation, the word is not allocated at all.
+    static std::atomic<uint64_t>& VERSION(const Leaf* leaf);
+
+    // The start of the memory chunk allocated for the given leaf, including its version word
+    void* leaf_chunk(Leaf* leaf) const;
+
     // Iterator, for the range queries
     class Iterator : public pma::Iterator {
       friend class ART;
@@ -58,6 +73,29 @@ class ART : public pma::InterfaceRQ {
       virtual std::pair<int64_t, int64_t> next() override;
     };
 
+    // Iterator for the synchronised variant. It copies the qualifying elements of one leaf at the time,
+    // and it locates the next leaf again from the position of the last element returned, without holding
+    // any lock in between. The position is the key of the element and the number of its duplicates already returned.
+    class OptimisticIterator : public pma::Iterator {
+      friend class ART;
+      const ART* tree;
+      int64_t min; // the key of the last element fetched, or the start of the interval
+      uint64_t skip; // the number of elements with key `min' already fetched
+      const int64_t max;
+      std::vector<std::pair<int64_t, int64_t>> buffer; // the elements fetched from the current leaf
+      size_t pos; // current position in the buffer
+      bool exhausted; // whether there are no more leaves to fetch
+
+      OptimisticIterator(const ART* tree, int64_t min, int64_t max);
+
+      // Fetch the elements of the next leaf into the buffer
+      void fetch();
+
+    public:
+      virtual bool hasNext() const override;
+      virtual std::pair<int64_t, int64_t> next() override;
+    };
+
     // Translate a key from humans into a key for the ART tree
     struct LoadKeyImpl : public ART_unsynchronized::LoadKeyInterface {
         ART* m_art; // pointer to the ART_nr data structure
@@ -68,10 +106,18 @@ class ART : public pma::InterfaceRQ {
     };
     friend struct LoadKeyImpl;
 
+    // Defer the deallocation of the nodes removed from the index, with synchronisation
+    struct DeleteNodeImpl : public ART_unsynchronized::DeleteNodeInterface {
+        EpochManager* m_epoch;
+
+        DeleteNodeImpl(EpochManager* epoch);
+        void operator() (ART_unsynchronized::N* node) override;
+    };
+
     // Create a new leaf
     Leaf* create_leaf();
 
-    // Get the memory size of an internal node / leaf
+    // Get the memory size of an internal node / leaf, with synchronisation including its version word
     size_t memsize_leaf() const;
 
     // Get the minimum [first] key stored in the given leaf
@@ -119,16 +165,42 @@ class ART : public pma::InterfaceRQ {
     // Dump helpers
     void dump_leaves() const;
 
+    // Optimistic lock coupling for the leaves, only with synchronisation. See ART_unsynchronized::N for the protocol.
+    void leaf_write_lock(Leaf* leaf) const;
+    void leaf_write_unlock(Leaf* leaf) const;
+    uint64_t leaf_read_lock(const Leaf* leaf, bool& restart) const;
+    void leaf_check(const Leaf* leaf, uint64_t version, bool& restart) const;
+
+    // Release the memory of a leaf unlinked from the list
+    void delete_leaf(Leaf* leaf);
+
+    // With optimistic lock coupling, find the leaf that may contain the given key, moving right in the linked
+    // list when the index is not up to date. Return the leaf and the version it was read with.
+    std::pair<Leaf*, uint64_t> optimistic_find_leaf(int64_t key) const;
+
+    // Implementation of #find and #sum for the synchronised variant
+    int64_t optimistic_find(int64_t key) const;
+    SumResult optimistic_sum(int64_t min, int64_t max) const;
+
+    const bool m_synchronized; // whether readers can run concurrently to the writers
+    std::unique_ptr<EpochManager> m_epoch; // defer the deallocation of the leaves and the nodes, with synchronisation
     std::shared_ptr<LoadKeyImpl> m_load_key; // Store the search key for an element in the index
     ART_unsynchronized::Tree m_index; // the ART index
     Leaf* m_first; // the first leaf in the linked list of elements
     const uint64_t m_leaf_block_size;
     uint64_t m_cardinality; // total number of elements in the data structure
     uint64_t m_leaf_count; // total number of leaves currently present
+    std::mutex m_writer_lock; // serialise the writers, with synchronisation
 
     // Wrapper interface for the ART index
 public:
-    ART(uint64_t leaf_block_size);
+    /**
+     * Create a new instance
+     * @param leaf_block_size the capacity of each leaf
+     * @param synchronized whether to allow lookups and scans from multiple threads, concurrently to the insertions
+     *        and deletions, with optimistic lock coupling. The writers are serialised among themselves.
+     */
+    ART(uint64_t leaf_block_size, bool synchronized = false);
 
     virtual ~ART();
 
@@ -138,6 +210,13 @@ public:
 
     int64_t find(int64_t key) const override;
 
+    /**
+     * Batched lookup, it interleaves up to `group_size' descents of the radix tree at the time, prefetching
+     * the next node of each descent before switching to the following one. With synchronisation, it
+     * performs one lookup after the other.
+     */
+    void find_interleaved(const int64_t* keys, int64_t* values, size_t num_keys, size_t group_size) const override;
+
     std::unique_ptr<pma::Iterator> find(int64_t min, int64_t max) const override;
 
     std::unique_ptr<pma::Iterator> iterator() const override;
@@ -151,6 +230,11 @@ public:
     void dump() const override;
 
     size_t memory_footprint() const override;
+
+    /**
+     * Whether the instance allows concurrent readers
+     */
+    bool is_synchronized() const noexcept;
 };
 
 } // namespace abtree
@@ -18,12 +18,15 @@
 #include "dense_array.hpp"
 
 #include <algorithm> // std::sort
+#include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
 #include <cstring> // strerror
+#include <limits>
 #include <linux/memfd.h> // MFD_HUGETLB
 #include <iostream>
-#include <sys/mman.h> // mmap
+#include <sys/mman.h> // mmap, mremap
 #include <unistd.h> // close
 
 #include "configuration.hpp"
@@ -57,12 +60,24 @@ namespace abtree {
  *                                                                           *
  *****************************************************************************/
 
-DenseArray::DenseArray(size_t node_size) : m_index(node_size), m_keys(nullptr), m_values(nullptr), m_cardinality(0) { }
+DenseArray::DenseArray(size_t node_size, pma::StaticIndexLayout index_layout) : m_index(new StaticIndex(node_size, /* num segments */ 1, index_layout)),
+        m_keys(nullptr), m_values(nullptr), m_cardinality(0), m_delta(create_delta()) { }
 
 DenseArray::~DenseArray() {
+    if(m_merge.valid()){
+        try {
+            merge_wait();
+        } catch(std::exception& e){
+            cerr << "[DenseArray::~DenseArray] The merge in the background failed: " << e.what() << endl;
+        }
+    }
     release_memory(m_handle_physical_memory_keys, m_handle_physical_memory_values, m_keys, m_values, m_cardinality);
 }
 
+unique_ptr<ABTree> DenseArray::create_delta(){
+    return make_unique<ABTree>(/* node size */ 64);
+}
+
 
 /******************************************************************************
  *                                                                            *
@@ -71,15 +86,28 @@ DenseArray::~DenseArray() {
  *****************************************************************************/
 
 void DenseArray::insert(int64_t k, int64_t v){
-    m_delta.emplace_back(k, v);
+    m_delta->insert(k, v);
+
+    if(m_merge_threshold > 0){
+        merge_poll();
+        if(!m_merge.valid() && m_delta->size() >= m_merge_threshold){ merge_async(); }
+    }
 }
 
 size_t DenseArray::size() const {
-    return m_cardinality;
+    return m_cardinality + m_delta->size() + (m_delta_merging ? m_delta_merging->size() : 0);
 }
 
 bool DenseArray::empty() const {
-    return m_cardinality == 0;
+    return size() == 0;
+}
+
+void DenseArray::set_merge_threshold(uint64_t num_elements){
+    m_merge_threshold = num_elements;
+}
+
+void DenseArray::set_merge_threads(uint64_t num_threads){
+    m_merge_threads = max<uint64_t>(num_threads, 1);
 }
 
 /******************************************************************************
@@ -88,67 +116,181 @@ bool DenseArray::empty() const {
  *                                                                            *
  *****************************************************************************/
 void DenseArray::build() {
-    if(m_delta.empty()) return; // nop
+    merge_wait(); // complete the merge in progress
+    if(m_delta->size() == 0) return; // nop
+    delta_t delta = to_vector(m_delta.get());
+
+    // only rewrite the arrays from the first position altered by the delta, if at least half of them is left untouched
+    uint64_t position = lower_bound(m_keys, m_keys + m_cardinality, delta[0].first) - m_keys;
+    if(m_cardinality > 0 && position >= m_cardinality / 2){
+        merge_inplace(delta, position);
+    } else {
+        install(merge(delta));
+    }
 
-    // sort the delta
-    std::sort(begin(m_delta), end(m_delta), [](const auto& e1, const auto& e2){
-       return e1.first < e2.first;
-    });
+    m_delta = create_delta();
+}
 
-    // acquire some physical memory
-    uint64_t cardinality_new = m_cardinality + m_delta.size();
-    int handle_keys_new (-1), handle_values_new (-1);
-    int64_t *keys_new(nullptr), *values_new(nullptr);
-    acquire_memory(&handle_keys_new, &handle_values_new, &keys_new, &values_new, cardinality_new);
-    auto dealloc = [&, this](int64_t*){ release_memory(handle_keys_new, handle_values_new, keys_new, values_new, cardinality_new); };
-    unique_ptr<int64_t, decltype(dealloc)> protect_from_memory_leak{ (int64_t*) 0x1, dealloc };
+void DenseArray::merge_async(){
+    assert(!m_merge.valid() && "A merge is already in progress");
+    assert(m_delta_merging.get() == nullptr);
+    m_delta_merging = move(m_delta);
+    m_delta = create_delta();
+    m_merge = std::async(std::launch::async, [this, delta = m_delta_merging.get()](){ return merge(to_vector(delta)); });
+}
 
-    // merge
-    int64_t *__restrict keys_old(m_keys), *__restrict values_old(m_values);
-    uint64_t cardinality_old = m_cardinality;
-    uint64_t cardinality_delta = m_delta.size();
-    uint64_t i(0), j(0), k(0);
-    while(i < cardinality_old && j < cardinality_delta){
-        assert(k < cardinality_new && "Invalid index, over the actual capacity of the new arrays");
-        if(keys_old[i] < m_delta[j].first){
-            keys_new[k] = keys_old[i];
-            values_new[k] = values_old[i];
-            i++;
-        } else {
-            keys_new[k] = m_delta[j].first;
-            values_new[k] = m_delta[j].second;
-            j++;
-        }
-        k++;
+void DenseArray::merge_wait(){
+    if(!m_merge.valid()) return;
+    MergeOutput output;
+    try {
+        output = m_merge.get(); // rethrow the exception raised by the worker, if any
+    } catch(...) {
+        // the static arrays are untouched, give the frozen delta back to the writers, so that no update is lost
+        for(auto& e : to_vector(m_delta.get())){ m_delta_merging->insert(e.first, e.second); }
+        m_delta = move(m_delta_merging);
+        throw;
     }
-    while(i < cardinality_old){
-        keys_new[k] = keys_old[i];
-        values_new[k] = values_old[i];
-        i++; k++;
+    install(move(output));
+    m_delta_merging.reset();
+}
+
+void DenseArray::merge_poll(){
+    if(m_merge.valid() && m_merge.wait_for(chrono::seconds(0)) == future_status::ready){
+        merge_wait();
     }
-    while(j < cardinality_delta){
-        keys_new[k] = m_delta[j].first;
-        values_new[k] = m_delta[j].second;
-        j++; k++;
+}
+
+DenseArray::delta_t DenseArray::to_vector(const ABTree* delta){
+    delta_t result;
+    result.reserve(delta->size());
+    auto it = delta->iterator();
+    while(it->hasNext()){ result.push_back(it->next()); }
+    return result;
+}
+
+uint64_t DenseArray::get_num_workers(uint64_t num_elements) const {
+    constexpr uint64_t min_elements_per_thread = 1ull << 16; // below this threshold, the cost of the threads is not worth it
+    return max<uint64_t>(1, min<uint64_t>(m_merge_threads, num_elements / min_elements_per_thread));
+}
+
+uint64_t DenseArray::merge_path(const int64_t* keys, uint64_t keys_sz, const delta_t& delta, uint64_t diagonal){
+    // find the number of elements taken from `keys' among the first `diagonal' elements of the merged sequence. On equal
+    // keys, the elements of the delta come first.
+    uint64_t lo = (diagonal > delta.size()) ? diagonal - delta.size() : 0;
+    uint64_t hi = min(diagonal, keys_sz);
+    while(lo < hi){
+        uint64_t mid = (lo + hi +1) / 2;
+        if(keys[mid -1] < delta[diagonal - mid].first){
+            lo = mid;
+        } else {
+            hi = mid -1;
+        }
     }
+    return lo;
+}
 
-    // rebuild the index
-    const uint64_t node_size = m_index.node_size();
-    const uint64_t cardinality_index = cardinality_new / node_size + ((cardinality_new % node_size) > 0);
-    m_index.rebuild(cardinality_index);
-    for(uint64_t i = 0; i < cardinality_index; i++){ // `i' shadows the previous var for the merge
-        m_index.set_separator_key(i, keys_new[i * node_size]);
+void DenseArray::merge_parallel(const int64_t* keys, const int64_t* values, uint64_t sz, const delta_t& delta, int64_t* keys_out, int64_t* values_out) const {
+    const uint64_t sz_out = sz + delta.size();
+    auto merge_range = [&](uint64_t k_start, uint64_t k_end){
+        uint64_t i = merge_path(keys, sz, delta, k_start);
+        uint64_t j = k_start - i;
+        int64_t *__restrict keys_new(keys_out), *__restrict values_new(values_out);
+        for(uint64_t k = k_start; k < k_end; k++){
+            if(j == delta.size() || (i < sz && keys[i] < delta[j].first)){
+                keys_new[k] = keys[i];
+                values_new[k] = values[i];
+                i++;
+            } else {
+                keys_new[k] = delta[j].first;
+                values_new[k] = delta[j].second;
+                j++;
+            }
+        }
+    };
+
+    // split the output in independent ranges
+    uint64_t num_threads = get_num_workers(sz_out);
+    if(num_threads == 1){
+        merge_range(0, sz_out);
+    } else {
+        vector<future<void>> tasks;
+        for(uint64_t i = 0; i < num_threads; i++){
+            tasks.push_back( async(launch::async, merge_range, sz_out * i / num_threads, sz_out * (i +1) / num_threads) );
+        }
+        for(auto& t : tasks) t.get();
     }
+}
 
-    m_delta.clear(); // remove all elements from the delta
-    release_memory(m_handle_physical_memory_keys, m_handle_physical_memory_values, m_keys, m_values, m_cardinality);
-    m_keys = keys_new;
-    m_values = values_new;
-    m_cardinality = cardinality_new;
-    m_handle_physical_memory_keys = handle_keys_new;
-    m_handle_physical_memory_values = handle_values_new;
+unique_ptr<StaticIndex> DenseArray::build_index(const int64_t* keys, uint64_t cardinality) const {
+    const uint64_t node_size = m_index->node_size();
+    const uint64_t cardinality_index = cardinality / node_size + ((cardinality % node_size) > 0);
+    vector<int64_t> separator_keys(cardinality_index);
+    for(uint64_t i = 0; i < cardinality_index; i++){ separator_keys[i] = keys[i * node_size]; }
+    unique_ptr<StaticIndex> index { new StaticIndex(node_size, 1, m_index->layout()) };
+    index->rebuild(cardinality_index, separator_keys.data(), m_merge_threads);
+    return index;
+}
+
+DenseArray::MergeOutput DenseArray::merge(const delta_t& delta) const {
+    assert(delta.size() > 0);
+
+    // acquire some physical memory
+    MergeOutput output;
+    uint64_t cardinality_new = m_cardinality + delta.size();
+    acquire_memory(&output.m_handle_physical_memory_keys, &output.m_handle_physical_memory_values, &output.m_keys, &output.m_values, cardinality_new);
+    output.m_cardinality = cardinality_new;
+    auto dealloc = [&output](int64_t*){ release_memory(output.m_handle_physical_memory_keys, output.m_handle_physical_memory_values, output.m_keys, output.m_values, output.m_cardinality); };
+    unique_ptr<int64_t, decltype(dealloc)> protect_from_memory_leak{ (int64_t*) 0x1, dealloc };
+
+    merge_parallel(m_keys, m_values, m_cardinality, delta, output.m_keys, output.m_values);
+    output.m_index = build_index(output.m_keys, cardinality_new);
 
     protect_from_memory_leak.release();
+    return output;
+}
+
+void DenseArray::merge_inplace(const delta_t& delta, uint64_t position){
+    assert(m_cardinality > 0 && delta.size() > 0);
+    assert(position <= m_cardinality && (position == m_cardinality || m_keys[position] >= delta[0].first));
+    const uint64_t cardinality_old = m_cardinality;
+    const uint64_t cardinality_new = m_cardinality + delta.size();
+
+    // save the elements to shift, from `position' onwards
+    const uint64_t suffix_sz = cardinality_old - position;
+    unique_ptr<int64_t[]> suffix_keys { new int64_t[suffix_sz] };
+    unique_ptr<int64_t[]> suffix_values { new int64_t[suffix_sz] };
+    memcpy(suffix_keys.get(), m_keys + position, suffix_sz * sizeof(int64_t));
+    memcpy(suffix_values.get(), m_values + position, suffix_sz * sizeof(int64_t));
+
+    // extend the physical memory, the pages before `position' are neither copied nor altered
+    uint64_t memory_old = get_amount_memory_needed(cardinality_old);
+    uint64_t memory_new = get_amount_memory_needed(cardinality_new);
+    if(memory_new > memory_old){
+        int rc = ftruncate(m_handle_physical_memory_keys, memory_new);
+        if(rc != 0){ RAISE("Cannot extend the physical memory (keys). ftruncate error: " << strerror(errno) << "(" << errno << ")"); }
+        rc = ftruncate(m_handle_physical_memory_values, memory_new);
+        if(rc != 0){ RAISE("Cannot extend the physical memory (values). ftruncate error: " << strerror(errno) << "(" << errno << ")"); }
+        void* mremap_keys = mremap(m_keys, memory_old, memory_new, MREMAP_MAYMOVE);
+        if(mremap_keys == MAP_FAILED){ RAISE("Cannot extend the virtual memory (keys). mremap error: " << strerror(errno) << "(" << errno << ")"); }
+        m_keys = reinterpret_cast<int64_t*>(mremap_keys);
+        void* mremap_values = mremap(m_values, memory_old, memory_new, MREMAP_MAYMOVE);
+        if(mremap_values == MAP_FAILED){ RAISE("Cannot extend the virtual memory (values). mremap error: " << strerror(errno) << "(" << errno << ")"); }
+        m_values = reinterpret_cast<int64_t*>(mremap_values);
+    }
+    m_cardinality = cardinality_new;
+
+    merge_parallel(suffix_keys.get(), suffix_values.get(), suffix_sz, delta, m_keys + position, m_values + position);
+    m_index = build_index(m_keys, cardinality_new);
+}
+
+void DenseArray::install(MergeOutput&& output){
+    release_memory(m_handle_physical_memory_keys, m_handle_physical_memory_values, m_keys, m_values, m_cardinality);
+    m_index = move(output.m_index);
+    m_keys = output.m_keys; output.m_keys = nullptr;
+    m_values = output.m_values; output.m_values = nullptr;
+    m_cardinality = output.m_cardinality; output.m_cardinality = 0;
+    m_handle_physical_memory_keys = output.m_handle_physical_memory_keys; output.m_handle_physical_memory_keys = -1;
+    m_handle_physical_memory_values = output.m_handle_physical_memory_values; output.m_handle_physical_memory_values = -1;
 }
 
 /******************************************************************************
@@ -156,7 +298,7 @@ void DenseArray::build() {
  *   Memory handling                                                          *
  *                                                                            *
  *****************************************************************************/
-static int g_internal_id = 0;
+static atomic<int> g_internal_id { 0 }; // the merges can run concurrently
 
 void DenseArray::acquire_memory(int* out_handle_keys, int* out_handle_values, int64_t** out_array_keys, int64_t** out_array_values, uint64_t cardinality){
     // check the parameters are not null
@@ -172,9 +314,9 @@ void DenseArray::acquire_memory(int* out_handle_keys, int* out_handle_values, in
     unique_ptr<int64_t, decltype(dealloc)> protect_from_memory_leak{ (int64_t*) 0x1, dealloc };
 
     // create the physical handles
-    string id_handle_keys = "dense_array_keys_"; id_handle_keys += to_string(g_internal_id);
-    string id_handle_values = "dense_array_values_"; id_handle_values += to_string(g_internal_id);
-    g_internal_id++;
+    int internal_id = g_internal_id++;
+    string id_handle_keys = "dense_array_keys_"; id_handle_keys += to_string(internal_id);
+    string id_handle_values = "dense_array_values_"; id_handle_values += to_string(internal_id);
     int memfd_flags = configuration::use_huge_pages() ? MFD_HUGETLB : 0;
     *out_handle_keys = memfd_create(id_handle_keys.c_str(), memfd_flags);
     if(*out_handle_keys < 0){ RAISE("Cannot allocate the physical memory (keys); memfd_create error: " << strerror(errno) << "(" << errno << ")"); }
@@ -261,31 +403,50 @@ uint64_t DenseArray::get_amount_memory_needed(uint64_t cardinality){
  *                                                                            *
  *****************************************************************************/
 int64_t DenseArray::find(int64_t key) const {
-    if(empty()) return -1;
+    if(m_cardinality > 0){
+        size_t i = m_index->find_first(key) * m_index->node_size();
+        int64_t* __restrict keys = m_keys;
+        while(i < m_cardinality && keys[i] < key) i++;
+        if(i < m_cardinality && keys[i] == key) return m_values[i];
+    }
 
-    size_t i = m_index.find_first(key) * m_index.node_size();
-    int64_t* __restrict keys = m_keys;
-    while(i < m_cardinality && keys[i] < key) i++;
-    return (i < m_cardinality && keys[i] == key) ? m_values[i] : -1;
+    // search the deltas
+    if(m_delta_merging){
+        int64_t value = m_delta_merging->find(key);
+        if(value != -1) return value;
+    }
+    return m_delta->find(key);
 }
 
-unique_ptr<pma::Iterator> DenseArray::find(int64_t min, int64_t max) const {
-    if(min > max || empty()) return make_unique<InternalIterator>(this, 0, 0); // empty iterator
-    int64_t node_size = m_index.node_size();
-    int64_t index_first = m_index.find_first(min) * node_size;
-    int64_t end = m_cardinality;
+pair<uint64_t, uint64_t> DenseArray::find_static(int64_t min, int64_t max) const {
+    if(min > max || m_cardinality == 0) return make_pair(0, 0); // empty interval
+    uint64_t node_size = m_index->node_size();
+    uint64_t index_first = m_index->find_first(min) * node_size;
+    uint64_t end = m_cardinality;
     int64_t* __restrict keys = m_keys;
     while(index_first < end && keys[index_first] < min) index_first++;
-    int64_t index_last = m_index.find_last(max) * node_size;
+    uint64_t index_last = m_index->find_last(max) * node_size;
     while(index_last < end && keys[index_last] <= max) index_last++;
 
     COUT_DEBUG("[" << min << ", " << max << "] index_first: " << index_first << ", index_last: " << index_last);
 
-    return make_unique<InternalIterator>(this, index_first, index_last);
+    return make_pair(index_first, std::max(index_first, index_last));
+}
+
+unique_ptr<pma::Iterator> DenseArray::find(int64_t min, int64_t max) const {
+    auto interval = find_static(min, max);
+    unique_ptr<pma::Iterator> it_static = make_unique<InternalIterator>(this, interval.first, interval.second);
+    if(m_delta->size() == 0 && !m_delta_merging) return it_static; // only the static arrays
+
+    vector<unique_ptr<pma::Iterator>> sources;
+    sources.push_back(move(it_static));
+    if(m_delta_merging) sources.push_back(m_delta_merging->find(min, max));
+    sources.push_back(m_delta->find(min, max));
+    return make_unique<MergeIterator>(move(sources));
 }
 
 unique_ptr<pma::Iterator> DenseArray::iterator() const {
-    return make_unique<InternalIterator>(this, 0, m_cardinality);
+    return find(numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max());
 }
 
 DenseArray::InternalIterator::InternalIterator(const DenseArray* instance, size_t begin, size_t end) :
@@ -301,26 +462,48 @@ pair<int64_t, int64_t> DenseArray::InternalIterator::next() {
     return result;
 }
 
+DenseArray::MergeIterator::MergeIterator(vector<unique_ptr<pma::Iterator>>&& sources) : m_sources(move(sources)), m_heads(m_sources.size()), m_has_head(m_sources.size()) {
+    for(size_t i = 0; i < m_sources.size(); i++){ fetch(i); }
+}
+
+void DenseArray::MergeIterator::fetch(size_t source){
+    m_has_head[source] = m_sources[source]->hasNext();
+    if(m_has_head[source]){ m_heads[source] = m_sources[source]->next(); }
+}
+
+bool DenseArray::MergeIterator::hasNext() const {
+    for(bool has_head : m_has_head){ if(has_head) return true; }
+    return false;
+}
+
+pair<int64_t, int64_t> DenseArray::MergeIterator::next() {
+    // select the source with the smallest key, there are at most three sources
+    size_t candidate = m_sources.size();
+    for(size_t i = 0; i < m_sources.size(); i++){
+        if(m_has_head[i] && (candidate == m_sources.size() || m_heads[i].first < m_heads[candidate].first)){
+            candidate = i;
+        }
+    }
+    if(candidate == m_sources.size()) return pair<int64_t, int64_t>{-1, -1}; // depleted
+
+    auto result = m_heads[candidate];
+    fetch(candidate);
+    return result;
+}
+
 /******************************************************************************
  *                                                                            *
  *   Sum                                                                      *
  *                                                                            *
  *****************************************************************************/
-pma::Interface::SumResult DenseArray::sum(int64_t min, int64_t max) const {
+pma::Interface::SumResult DenseArray::sum_static(int64_t min, int64_t max) const {
     SumResult result;
-    if(min > max || empty()) return result;
+    auto interval = find_static(min, max);
+    uint64_t offset = interval.first, end = interval.second;
+    if(offset >= end) return result;
 
     int64_t* __restrict keys = m_keys;
     int64_t* __restrict values = m_values;
-
-    int64_t node_size = m_index.node_size();
-    int64_t offset = m_index.find_first(min) * node_size;
-    while(offset < m_cardinality && keys[offset] < min) offset++;
-    int64_t end = m_index.find_last(max) * node_size;
-    while(end < m_cardinality && keys[end] <= max) end++;
-
-    if(offset >= end) return result;
-
     result.m_first_key = keys[offset];
     result.m_last_key = keys[end -1];
     result.m_num_elements = end - offset;
@@ -333,17 +516,41 @@ pma::Interface::SumResult DenseArray::sum(int64_t min, int64_t max) const {
     return result;
 }
 
+pma::Interface::SumResult DenseArray::sum(int64_t min, int64_t max) const {
+    SumResult result = sum_static(min, max);
+
+    // add the elements from the deltas
+    auto add = [&result](const SumResult& partial){
+        if(partial.m_num_elements == 0) return;
+        if(result.m_num_elements == 0){
+            result.m_first_key = partial.m_first_key;
+            result.m_last_key = partial.m_last_key;
+        } else {
+            result.m_first_key = std::min(result.m_first_key, partial.m_first_key);
+            result.m_last_key = std::max(result.m_last_key, partial.m_last_key);
+        }
+        result.m_num_elements += partial.m_num_elements;
+        result.m_sum_keys += partial.m_sum_keys;
+        result.m_sum_values += partial.m_sum_values;
+    };
+    if(m_delta_merging) add(m_delta_merging->sum(min, max));
+    if(m_delta->size() > 0) add(m_delta->sum(min, max));
+
+    return result;
+}
+
 /******************************************************************************
  *                                                                            *
  *   Dump                                                                     *
  *                                                                            *
  *****************************************************************************/
 size_t DenseArray::memory_footprint() const {
-    return get_amount_memory_needed(m_cardinality) *2 /* x2 = keys and values */ + m_index.memory_footprint();
+    return get_amount_memory_needed(m_cardinality) *2 /* x2 = keys and values */ + m_index->memory_footprint() +
+            m_delta->memory_footprint() + (m_delta_merging ? m_delta_merging->memory_footprint() : 0);
 }
 
 void DenseArray::dump() const {
-    m_index.dump();
+    m_index->dump();
 
     cout << "[Dense arrays] cardinality: " << m_cardinality << ", memory footprint: 2x " << get_amount_memory_needed(m_cardinality) << " bytes" << endl;
     if(m_cardinality > 0){
@@ -353,10 +560,12 @@ void DenseArray::dump() const {
         cout << "\n\n";
     }
 
-    cout << "[Delta] cardinality: " << m_delta.size() << endl;
-    for(uint64_t i = 0; i < m_delta.size(); i++){
-        cout << "[" << i << "] key: " << m_delta[i].first << ", value: " << m_delta[i].second << "\n";
+    if(m_delta_merging){
+        cout << "[Delta being merged] cardinality: " << m_delta_merging->size() << endl;
+        m_delta_merging->dump();
     }
+    cout << "[Delta] cardinality: " << m_delta->size() << endl;
+    m_delta->dump();
 }
 
 } /* namespace abtree */
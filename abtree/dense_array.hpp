@@ -20,8 +20,11 @@
 
 #include <cinttypes> // fixed size scalar types
 #include <cstddef> // size_t
+#include <future>
+#include <memory>
 #include <vector>
 
+#include "abtree.hpp"
 #include "pma/interface.hpp"
 #include "pma/iterator.hpp"
 #include "pma/generic/static_index.hpp"
@@ -29,23 +32,86 @@
 namespace abtree {
 
 class DenseArray: public pma::InterfaceRQ {
+protected:
+    using delta_t = std::vector<std::pair<int64_t, int64_t>>;
+
+    // The product of a merge: the new static arrays with their index
+    struct MergeOutput {
+        std::unique_ptr<pma::StaticIndex> m_index;
+        int64_t* m_keys = nullptr;
+        int64_t* m_values = nullptr;
+        uint64_t m_cardinality = 0;
+        int m_handle_physical_memory_keys = -1;
+        int m_handle_physical_memory_values = -1;
+    };
+
+    // Merge the static arrays with the sorted `delta' into new arrays. It only reads the current arrays and the delta.
+    // When invoked by a merge in the background, it runs on the worker thread.
+    virtual MergeOutput merge(const delta_t& delta) const;
+
 private:
-    pma::StaticIndex m_index; // the index for the elements in the array
+    std::unique_ptr<pma::StaticIndex> m_index; // the index for the elements in the array
     int64_t* m_keys; // a dense static array containing the ordered sequence of keys
     int64_t* m_values; // a dense static array containing the ordered sequence of values
     uint64_t m_cardinality; // the current number of elements stored in the dense arrays (it doesn't take into account the delta)
-    using delta_t = std::vector<std::pair<int64_t, int64_t>>;
-    delta_t m_delta; // delta (temporary) storage, elements inserted but not yet merged in the static dense array.
     int m_handle_physical_memory_keys = -1; // the handle to the physical memory for the allocated storage that backs the array `m_keys'
     int m_handle_physical_memory_values = -1; // as above, for the array `m_values'
+    std::unique_ptr<ABTree> m_delta; // delta storage, sorted, elements inserted but not yet merged in the static dense arrays
+    std::unique_ptr<ABTree> m_delta_merging; // the delta being merged in the background, nullptr if no merge is in progress
+    uint64_t m_merge_threshold = 0; // start a merge in the background when the delta reaches this number of elements, 0 = only on #build()
+    uint64_t m_merge_threads = 1; // max number of threads to merge the delta and rebuild the index
+
+    // NB: both the deltas are searched by the lookups and participate in the scans. The inserts are sorted in the delta
+    // straight away, so that the readers never alter the data structure. While a merge is in progress, the
+    // static arrays and the delta being merged are read-only: the worker builds the new arrays and the new index in a fresh
+    // memfd region, and only the thread owning the dense array installs them, once the worker is done.
+
+    std::future<MergeOutput> m_merge; // the merge in progress in the background, if valid()
+
+    // Merge the sorted `delta' into the current arrays, extending their physical memory. The elements before `position',
+    // all smaller than the keys in the delta, are not moved.
+    void merge_inplace(const delta_t& delta, uint64_t position);
+
+    // Merge the sorted sequences `keys/values' and `delta' into keys_out/values_out, splitting the output among the workers
+    void merge_parallel(const int64_t* keys, const int64_t* values, uint64_t sz, const delta_t& delta, int64_t* keys_out, int64_t* values_out) const;
+
+    // Merge path, the number of elements from `keys' among the first `diagonal' elements of the merge of `keys' and `delta'
+    static uint64_t merge_path(const int64_t* keys, uint64_t keys_sz, const delta_t& delta, uint64_t diagonal);
+
+    // Number of workers to process `num_elements'
+    uint64_t get_num_workers(uint64_t num_elements) const;
+
+    // Create the index for the given sorted array of keys
+    std::unique_ptr<pma::StaticIndex> build_index(const int64_t* keys, uint64_t cardinality) const;
+
+    // Retrieve all elements in the given delta, in sorted order
+    static delta_t to_vector(const ABTree* delta);
+
+    // Replace the static arrays with the output of a merge
+    void install(MergeOutput&& output);
+
+    // Start merging the current delta in the background
+    void merge_async();
+
+    // Wait for the merge in progress, if any, and install its output. If the merge failed, the elements of the frozen
+    // delta are moved back into the current delta and the exception is rethrown.
+    void merge_wait();
+
+    // Install the output of the merge in progress, if it has already completed
+    void merge_poll();
 
-    // NB: the delta is merged only when explicitly invoking the method ::build(). In this implementation elements in the
-    // delta are NOT sorted, they do not participate in scans and are not searched in. A delta here only represents a
-    // temporary buffer for elements to be stored in the static dense arrays m_keys and m_values.
+    // Create an empty delta
+    static std::unique_ptr<ABTree> create_delta();
 
-    void acquire_memory(int* out_handle_keys, int* out_handle_values, int64_t** out_array_keys, int64_t** out_array_values, uint64_t total_cardinality);
+    // Sum the elements in the interval [min, max] of the static arrays only
+    SumResult sum_static(int64_t min, int64_t max) const;
 
-    void release_memory(int& handle_keys, int& handle_values, int64_t*& array_keys, int64_t*& array_values, uint64_t cardinality);
+    // Find the positions of the static arrays in the interval [min, max], as [begin_incl, end_excl)
+    std::pair<uint64_t, uint64_t> find_static(int64_t min, int64_t max) const;
+
+    static void acquire_memory(int* out_handle_keys, int* out_handle_values, int64_t** out_array_keys, int64_t** out_array_values, uint64_t total_cardinality);
+
+    static void release_memory(int& handle_keys, int& handle_values, int64_t*& array_keys, int64_t*& array_values, uint64_t cardinality);
 
     // Retrieve the amount of memory needed, in bytes, to store `cardinality' keys or values, such that the given quantity is aligned
     // to a page boundary.
@@ -75,12 +141,29 @@ private:
         std::pair<int64_t, int64_t> next() override;
     };
 
+    // Merge the sequences of the static arrays and the deltas, in key order
+    class MergeIterator : public pma::Iterator {
+        std::vector<std::unique_ptr<pma::Iterator>> m_sources; // the sequences to merge
+        std::vector<std::pair<int64_t, int64_t>> m_heads; // the next element of each sequence
+        std::vector<bool> m_has_head; // whether the corresponding entry in m_heads is valid
+
+        void fetch(size_t source); // load the next element from the given source
+
+    public:
+        MergeIterator(std::vector<std::unique_ptr<pma::Iterator>>&& sources);
+
+        bool hasNext() const override;
+
+        std::pair<int64_t, int64_t> next() override;
+    };
+
 public:
     /**
      * Initialise an empty dense array
      * @param node_size the capacity of the nodes, in terms of maximum number of separator keys, in the static index
+     * @param index_layout the physical layout of the static index
      */
-    DenseArray(size_t node_size = 64);
+    DenseArray(size_t node_size = 64, pma::StaticIndexLayout index_layout = pma::StaticIndexLayout::BTREE);
 
     /**
      * Destructor
@@ -88,25 +171,39 @@ public:
     virtual ~DenseArray();
 
     /**
-     * Append the given <key, value> in the delta
+     * Insert the given <key, value> in the delta. It may start a merge in the background, see #set_merge_threshold
      */
     void insert(int64_t key, int64_t value) override;
 
     /**
-     * Return the number of elements in the static tree, without taking into account the delta
+     * Return the number of elements in the dense arrays and in the deltas
      */
     std::size_t size() const override;
 
     /**
-     * Check whether the data structure is empty, withouth taking into account the delta
+     * Check whether the data structure is empty
      */
     bool empty() const;
 
     /**
-     * Rebuild the dense arrays by merging the current elements with the elements in the delta
+     * Rebuild the dense arrays by merging the current elements with the elements in the delta. It waits for
+     * the merge in progress in the background, if any. When at least half of the elements precede all the keys
+     * in the delta, the existing physical memory is extended and only the following elements are rewritten.
      */
     void build() override;
 
+    /**
+     * Start a merge in the background, on a worker thread, whenever the delta reaches `num_elements'. The value 0
+     * (default) only merges the delta on #build().
+     */
+    void set_merge_threshold(uint64_t num_elements);
+
+    /**
+     * Set the max number of threads to merge the delta and to rebuild the index, default 1. The output of
+     * the merge is split in independent ranges, one for each worker.
+     */
+    void set_merge_threads(uint64_t num_threads);
+
     /**
      * Return the value associated to the element with the given `key', or -1 if not present.
      * In case of duplicates, it returns the value of one of the qualifying elements.
@@ -129,7 +226,7 @@ public:
     SumResult sum(int64_t min, int64_t max) const override;
 
     /**
-     * Report the memory footprint, in bytes, of the dense arrays and the above index. The delta is not taken into account.
+     * Report the memory footprint, in bytes, of the dense arrays, the above index and the deltas
      */
     size_t memory_footprint() const override;
 
@@ -0,0 +1,189 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "slab_allocator.hpp"
+
+#include <cassert>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h> // mmap, madvise
+
+using namespace std;
+
+namespace abtree {
+
+constexpr size_t chunks_per_region = 32;
+
+static size_t compute_slot_size(size_t object_size){
+    return (object_size + 63) / 64 * 64; // align to the cache line
+}
+
+static size_t compute_chunk_size(size_t slot_size){
+    constexpr size_t huge_page_size = 1ull << 21; // 2 MB
+    constexpr size_t min_slots = 8;
+    size_t chunk_size = huge_page_size;
+    while(chunk_size < 64 + min_slots * slot_size) chunk_size *= 2;
+    return chunk_size;
+}
+
+SlabAllocator::SlabAllocator(size_t object_size) : m_slot_size(compute_slot_size(object_size)), m_chunk_size(compute_chunk_size(m_slot_size)),
+        m_slots_per_chunk((m_chunk_size - 64) / m_slot_size), m_available(nullptr), m_num_chunks(0), m_region_next(nullptr), m_region_end(nullptr), m_sequential(nullptr) {
+    static_assert(sizeof(Chunk) <= 64, "The metadata of a chunk is expected to fit a cache line");
+}
+
+SlabAllocator::~SlabAllocator(){
+    for(void* region : m_regions){
+        munmap(region, chunks_per_region * m_chunk_size);
+    }
+}
+
+SlabAllocator::Chunk* SlabAllocator::chunk_of(const void* object) const {
+    return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(object) & ~(static_cast<uintptr_t>(m_chunk_size) -1));
+}
+
+char* SlabAllocator::slots(Chunk* chunk) const {
+    return reinterpret_cast<char*>(chunk) + 64;
+}
+
+SlabAllocator::Chunk* SlabAllocator::create_chunk(){
+    Chunk* chunk = nullptr;
+    if(!m_released_chunks.empty()){
+        chunk = m_released_chunks.back();
+        m_released_chunks.pop_back();
+    } else {
+        if(m_region_next == m_region_end){ // map a new region
+            const size_t region_size = chunks_per_region * m_chunk_size;
+            // map an additional chunk and trim the excess, to align the region to the size of a chunk
+            void* mmap_ret = mmap(nullptr, region_size + m_chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if(mmap_ret == MAP_FAILED) throw std::bad_alloc();
+            uintptr_t start = reinterpret_cast<uintptr_t>(mmap_ret);
+            uintptr_t aligned = (start + m_chunk_size -1) & ~(static_cast<uintptr_t>(m_chunk_size) -1);
+            if(aligned > start) munmap(mmap_ret, aligned - start);
+            if(aligned < start + m_chunk_size) munmap(reinterpret_cast<void*>(aligned + region_size), start + m_chunk_size - aligned);
+            m_region_next = reinterpret_cast<char*>(aligned);
+            m_region_end = m_region_next + region_size;
+            m_regions.push_back(m_region_next);
+            madvise(m_region_next, region_size, MADV_HUGEPAGE); // ignore the result, transparent huge pages may not be available
+        }
+
+        chunk = reinterpret_cast<Chunk*>(m_region_next);
+        m_region_next += m_chunk_size;
+    }
+
+    chunk->m_free_list = nullptr;
+    chunk->m_num_used = 0;
+    chunk->m_num_fresh = 0;
+    chunk->m_previous = chunk->m_next = nullptr;
+    list_push(chunk);
+    m_num_chunks++;
+
+    return chunk;
+}
+
+void SlabAllocator::list_push(Chunk* chunk){
+    chunk->m_previous = nullptr;
+    chunk->m_next = m_available;
+    if(m_available != nullptr) m_available->m_previous = chunk;
+    m_available = chunk;
+}
+
+void SlabAllocator::list_remove(Chunk* chunk){
+    if(chunk->m_previous != nullptr){
+        chunk->m_previous->m_next = chunk->m_next;
+    } else {
+        assert(m_available == chunk);
+        m_available = chunk->m_next;
+    }
+    if(chunk->m_next != nullptr) chunk->m_next->m_previous = chunk->m_previous;
+    chunk->m_previous = chunk->m_next = nullptr;
+}
+
+void* SlabAllocator::allocate(const void* neighbour){
+    Chunk* chunk = nullptr;
+    if(neighbour != nullptr){
+        chunk = chunk_of(neighbour);
+        if(chunk->m_num_used == m_slots_per_chunk || chunk == m_sequential) chunk = nullptr; // full or reserved
+    }
+    if(chunk == nullptr){
+        chunk = m_available != nullptr ? m_available : create_chunk();
+    }
+    assert(chunk->m_num_used < m_slots_per_chunk);
+
+    void* object = nullptr;
+    if(chunk->m_free_list != nullptr){ // recycle the last released slot
+        object = chunk->m_free_list;
+        chunk->m_free_list = *reinterpret_cast<void**>(object);
+    } else {
+        assert(chunk->m_num_fresh < m_slots_per_chunk);
+        object = slots(chunk) + chunk->m_num_fresh * m_slot_size;
+        chunk->m_num_fresh++;
+    }
+
+    chunk->m_num_used++;
+    if(chunk->m_num_used == m_slots_per_chunk){ list_remove(chunk); }
+
+    return object;
+}
+
+void* SlabAllocator::allocate_sequential(){
+    if(m_sequential != nullptr && m_sequential->m_num_fresh == m_slots_per_chunk){ end_sequential(); }
+    if(m_sequential == nullptr){
+        m_sequential = create_chunk();
+        list_remove(m_sequential); // reserved
+    }
+
+    // the released slots are skipped, they are recycled only once the chunk is no longer reserved
+    void* object = slots(m_sequential) + m_sequential->m_num_fresh * m_slot_size;
+    m_sequential->m_num_fresh++;
+    m_sequential->m_num_used++;
+    return object;
+}
+
+void SlabAllocator::end_sequential(){
+    if(m_sequential == nullptr) return;
+    Chunk* chunk = m_sequential;
+    m_sequential = nullptr;
+    if(chunk->m_num_used < m_slots_per_chunk){ list_push(chunk); }
+}
+
+void SlabAllocator::deallocate(void* object){
+    assert(object != nullptr);
+    Chunk* chunk = chunk_of(object);
+    assert(chunk->m_num_used > 0);
+
+    if(chunk == m_sequential){ // reserved, not in the list of the available chunks
+        *reinterpret_cast<void**>(object) = chunk->m_free_list;
+        chunk->m_free_list = object;
+        chunk->m_num_used--;
+        return;
+    }
+
+    if(chunk->m_num_used == m_slots_per_chunk){ list_push(chunk); } // it was full
+    *reinterpret_cast<void**>(object) = chunk->m_free_list;
+    chunk->m_free_list = object;
+    chunk->m_num_used--;
+
+    // release the chunk, unless it's the only one with room left
+    if(chunk->m_num_used == 0 && (chunk->m_previous != nullptr || chunk->m_next != nullptr)){
+        list_remove(chunk);
+        madvise(chunk, m_chunk_size, MADV_DONTNEED); // return the physical memory
+        m_released_chunks.push_back(chunk);
+        m_num_chunks--;
+    }
+}
+
+} // namespace abtree
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ABTREE_SLAB_ALLOCATOR_HPP_
+#define ABTREE_SLAB_ALLOCATOR_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+namespace abtree {
+
+/**
+ * Allocator for objects of a fixed size, i.e. a single size class. The objects are carved out of chunks of 2 MB (or
+ * larger, to fit at least a few objects), aligned to their size, so that they can be backed by transparent huge pages.
+ * The chunks are in turn carved, in ascending order, out of regions of virtual memory mapped 32 chunks at the time.
+ *
+ * An allocation can be given the address of a logically close object, e.g. the sibling of a new node, and it is
+ * served from the same chunk when there is still room. The released objects are recycled LIFO within their chunk.
+ * Once a chunk becomes empty, its physical memory is returned to the system, unless it is the only chunk with free
+ * slots, and the chunk is reused for the next allocations.
+ */
+class SlabAllocator {
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    // Metadata at the start of each chunk
+    struct Chunk {
+        void* m_free_list; // LIFO of the released slots
+        uint32_t m_num_used; // number of slots currently in use
+        uint32_t m_num_fresh; // slots in [0, m_num_fresh) have been allocated at least once
+        Chunk* m_previous; // previous chunk in the list of chunks with free slots
+        Chunk* m_next; // next chunk in the list of chunks with free slots
+    };
+
+    const size_t m_slot_size; // size of each object, in bytes, multiple of the cache line
+    const size_t m_chunk_size; // size of each chunk, in bytes, power of 2
+    const size_t m_slots_per_chunk; // number of objects in each chunk
+    Chunk* m_available; // chunks with at least one free slot, the most recently used first
+    size_t m_num_chunks; // number of chunks in use
+    std::vector<void*> m_regions; // the regions of virtual memory mapped so far
+    char* m_region_next; // next chunk never used in the last region
+    char* m_region_end; // end of the last region
+    std::vector<Chunk*> m_released_chunks; // empty chunks, without physical memory, to reuse LIFO
+    Chunk* m_sequential; // chunk reserved to #allocate_sequential, nullptr if none
+
+    // Retrieve the chunk containing the given object
+    Chunk* chunk_of(const void* object) const;
+
+    // Address of the first slot in the chunk
+    char* slots(Chunk* chunk) const;
+
+    // Allocate a new chunk and add it to the list of available chunks
+    Chunk* create_chunk();
+
+    // Append/remove the given chunk to/from the list of available chunks
+    void list_push(Chunk* chunk);
+    void list_remove(Chunk* chunk);
+
+public:
+    /**
+     * Create an allocator for objects of `object_size' bytes
+     */
+    SlabAllocator(size_t object_size);
+
+    /**
+     * Destructor. All memory is released, regardless of whether the objects have been deallocated.
+     */
+    ~SlabAllocator();
+
+    /**
+     * Allocate an object. If given, try to serve the request from the same chunk of the object `neighbour'.
+     */
+    void* allocate(const void* neighbour = nullptr);
+
+    /**
+     * Allocate an object from a chunk reserved to these requests, so that consecutive invocations return
+     * objects at ascending addresses, until the chunk is exhausted and a new one is reserved.
+     */
+    void* allocate_sequential();
+
+    /**
+     * Stop reserving a chunk to #allocate_sequential, its remaining slots become available to #allocate
+     */
+    void end_sequential();
+
+    /**
+     * Release an object previously obtained with #allocate or #allocate_sequential
+     */
+    void deallocate(void* object);
+
+    /**
+     * Number of chunks in use
+     */
+    size_t num_chunks() const noexcept { return m_num_chunks; }
+
+    /**
+     * Memory footprint, in bytes
+     */
+    size_t memory_footprint() const noexcept { return m_num_chunks * m_chunk_size; }
+};
+
+} // namespace abtree
+
+#endif /* ABTREE_SLAB_ALLOCATOR_HPP_ */
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "aligned_memory.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include "errorhandling.hpp"
+
+using namespace std;
+
+static constexpr size_t HUGE_PAGE_SIZE = 1ull << 21; // 2 MB
+static constexpr size_t MIN_MAPPED_SIZE = HUGE_PAGE_SIZE / 2; // the smaller chunks are served by posix_memalign
+static constexpr size_t HEADER_SIZE = 64; // a cache line, to keep the user area aligned
+
+// Stored in front of each chunk, to release it without knowing its size
+struct Header {
+    void* m_region; // start of the region mapped, or of the block obtained by posix_memalign
+    size_t m_region_size; // size of the region mapped, 0 if the chunk has been obtained by posix_memalign
+};
+static_assert(sizeof(Header) <= HEADER_SIZE, "The header does not fit in a cache line");
+
+static atomic<bool> g_huge_pages { true }; // whether to back the large chunks with 2 MB pages
+
+void aligned_memory_set_huge_pages(bool value){
+    g_huge_pages = value;
+}
+
+bool aligned_memory_has_huge_pages(){
+    return g_huge_pages;
+}
+
+// map a region of `size' bytes, a multiple of HUGE_PAGE_SIZE, backed by huge pages if possible
+static void* map_region(size_t size){
+    if(!g_huge_pages){
+        void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return region == MAP_FAILED ? nullptr : region;
+    }
+
+    // first attempt, from the pool of the reserved huge pages
+    void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(region != MAP_FAILED) return region;
+
+    // second attempt, transparent huge pages. Map an additional huge page and trim the excess, to align the region
+    void* mmap_ret = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mmap_ret == MAP_FAILED) return nullptr;
+    uintptr_t start = reinterpret_cast<uintptr_t>(mmap_ret);
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE -1) & ~(static_cast<uintptr_t>(HUGE_PAGE_SIZE) -1);
+    if(aligned > start) munmap(mmap_ret, aligned - start);
+    if(aligned < start + HUGE_PAGE_SIZE) munmap(reinterpret_cast<void*>(aligned + size), start + HUGE_PAGE_SIZE - aligned);
+    region = reinterpret_cast<void*>(aligned);
+    madvise(region, size, MADV_HUGEPAGE); // ignore the result, transparent huge pages may not be available
+    return region;
+}
+
+void* aligned_memory_allocate(size_t size){
+    Header header;
+    size_t total_size = HEADER_SIZE + size;
+    if(total_size >= MIN_MAPPED_SIZE){
+        header.m_region_size = ((total_size + HUGE_PAGE_SIZE -1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+        header.m_region = map_region(header.m_region_size);
+        if(header.m_region == nullptr){
+            RAISE_EXCEPTION(Exception, "[aligned_memory_allocate] Cannot allocate " << size << " bytes, mmap error: " << strerror(errno) << " (" << errno << ")");
+        }
+    } else {
+        header.m_region_size = 0;
+        int rc = posix_memalign(&header.m_region, /* alignment */ 64, total_size);
+        if(rc != 0){
+            RAISE_EXCEPTION(Exception, "[aligned_memory_allocate] Cannot allocate " << size << " bytes, posix_memalign rc: " << rc);
+        }
+    }
+
+    memcpy(header.m_region, &header, sizeof(header));
+    return reinterpret_cast<char*>(header.m_region) + HEADER_SIZE;
+}
+
+void aligned_memory_free(void* ptr){
+    if(ptr == nullptr) return;
+    Header header;
+    memcpy(&header, reinterpret_cast<char*>(ptr) - HEADER_SIZE, sizeof(header));
+    if(header.m_region_size > 0){
+        munmap(header.m_region, header.m_region_size);
+    } else {
+        free(header.m_region);
+    }
+}
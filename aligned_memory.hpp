@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ALIGNED_MEMORY_HPP_
+#define ALIGNED_MEMORY_HPP_
+
+#include <cstddef>
+
+/**
+ * Cache aligned allocations for the arrays traversed at random, such as the static indexes and the cardinalities
+ * of the segments, whose lookups would otherwise take a TLB miss for each 4 KB page visited.
+ *
+ * The chunks of at least 1 MB are backed by 2 MB pages: first attempt to map them from the pool of the reserved
+ * huge pages (MAP_HUGETLB), otherwise map a region aligned to 2 MB and advise the kernel to use transparent huge
+ * pages for it. If neither is available, the region falls back to the usual 4 KB pages. The smaller chunks are
+ * served by posix_memalign. In all cases, the address returned is aligned to the size of a cache line.
+ */
+
+/**
+ * Allocate a chunk of (at least) `size' bytes, aligned to 64 bytes. The content is not initialised.
+ */
+void* aligned_memory_allocate(size_t size);
+
+/**
+ * Release a chunk allocated with aligned_memory_allocate. It does nothing if `ptr' is null.
+ */
+void aligned_memory_free(void* ptr);
+
+/**
+ * Whether to back the large chunks with 2 MB pages (default) or with 4 KB pages. It only affects the chunks
+ * allocated afterwards.
+ */
+void aligned_memory_set_huge_pages(bool value);
+
+/**
+ * Check whether the large chunks are backed by 2 MB pages
+ */
+bool aligned_memory_has_huge_pages();
+
+#endif /* ALIGNED_MEMORY_HPP_ */
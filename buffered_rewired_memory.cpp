@@ -22,6 +22,7 @@
 #include <iostream>
 
 #include "errorhandling.hpp"
+#include "rewired_memory_snapshot.hpp"
 
 using namespace std;
 
@@ -46,12 +47,26 @@ using namespace std;
  *                                                                           *
  *****************************************************************************/
 
-BufferedRewiredMemory::BufferedRewiredMemory(size_t pages_per_extent, size_t num_extents) :
-        m_instance(pages_per_extent, num_extents),
+BufferedRewiredMemory::BufferedRewiredMemory(size_t pages_per_extent, size_t num_extents, const string& directory) :
+        m_instance(pages_per_extent, num_extents, /* default max memory */ (1ull << 35), directory),
         m_buffer_start_address(static_cast<char*>(m_instance.get_start_address()) + m_instance.get_allocated_memory_size()),
         m_allocated_buffers(0)
         { }
 
+BufferedRewiredMemory::BufferedRewiredMemory(const string& path, size_t pages_per_extent, const vector<uint32_t>& translation_map, size_t num_buffers) :
+        m_instance(path, pages_per_extent, translation_map),
+        m_buffer_start_address(nullptr), m_allocated_buffers(num_buffers) {
+    if(num_buffers >= translation_map.size()) RAISE("Invalid number of buffers: " << num_buffers << ", total extents: " << translation_map.size());
+
+    // all buffers are free
+    m_buffer_start_address = static_cast<char*>(m_instance.get_start_address()) + (m_instance.get_allocated_extents() - num_buffers) * get_extent_size();
+    char* buffer_address = (char*) m_buffer_start_address;
+    for(size_t i = 0; i < m_allocated_buffers; i++){
+        m_buffers.push_front(buffer_address);
+        buffer_address += get_extent_size();
+    }
+}
+
 
 /*****************************************************************************
  *                                                                           *
@@ -79,6 +94,8 @@ void* BufferedRewiredMemory::acquire_buffer(){
     void* address = m_buffers.back();
     m_buffers.pop_back();
     COUT_DEBUG("address: " << address);
+    // the buffer may still refer to an extent frozen by a snapshot. Its old content is garbage anyway
+    m_instance.prepare_write(address, get_extent_size(), /* preserve content ? */ false);
     return address;
 }
 
@@ -199,3 +216,24 @@ size_t BufferedRewiredMemory::get_used_buffers() const noexcept{
 size_t BufferedRewiredMemory::get_max_memory() const noexcept{
     return m_instance.get_max_memory();
 }
+
+/*****************************************************************************
+ *                                                                           *
+ *   Snapshots                                                               *
+ *                                                                           *
+ *****************************************************************************/
+
+std::unique_ptr<RewiredMemorySnapshot> BufferedRewiredMemory::snapshot(){
+    return m_instance.snapshot(get_allocated_extents() - get_total_buffers());
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Persistence                                                             *
+ *                                                                           *
+ *****************************************************************************/
+
+void BufferedRewiredMemory::save(const std::string& path){
+    if(get_used_buffers() != 0) RAISE("There are buffers in use: " << get_used_buffers() << "/" << get_total_buffers());
+    m_instance.save(path);
+}
@@ -19,6 +19,9 @@
 #define BUFFERED_REWIRED_MEMORY_HPP_
 
 #include <deque>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "rewired_memory.hpp"
 
@@ -35,9 +38,19 @@ class BufferedRewiredMemory {
 
 public:
     /**
-     * It allocates a chunk of rewired memory
+     * It allocates a chunk of rewired memory. When `directory' is not empty, the physical memory is backed by a
+     * file in the given directory, see RewiredMemory
      */
-    BufferedRewiredMemory(size_t pages_per_extent, size_t num_extents);
+    BufferedRewiredMemory(size_t pages_per_extent, size_t num_extents, const std::string& directory = "");
+
+    /**
+     * Restore the memory previously persisted with #save in the file `path'
+     * @param path the file containing the physical memory
+     * @param pages_per_extent the size of a single extent, it must be the same used when the file was saved
+     * @param translation_map the translation map of the instance at the time it was saved, including the buffer space
+     * @param num_buffers the total number of buffers at the time the file was saved
+     */
+    BufferedRewiredMemory(const std::string& path, size_t pages_per_extent, const std::vector<uint32_t>& translation_map, size_t num_buffers);
 
     /**
      * Get a buffer from the free buffer space. A single buffer has the size of an extent.
@@ -96,6 +109,47 @@ public:
      * Total amount of reserved memory
      */
     size_t get_max_memory() const noexcept;
+
+    /**
+     * Create a read-only view of the extents in use, excluding the buffer space
+     */
+    std::unique_ptr<RewiredMemorySnapshot> snapshot();
+
+    /**
+     * Check whether there are live snapshots of this memory region
+     */
+    bool has_snapshots() const noexcept { return m_instance.has_snapshots(); }
+
+    /**
+     * Notify that the extents in the range [address, address + length) are about to be modified, see RewiredMemory::prepare_write
+     */
+    void prepare_write(void* address, size_t length){ m_instance.prepare_write(address, length); }
+
+    /**
+     * Make the physical memory durable in the file `path', see RewiredMemory::save.
+     * Precondition: no buffers must be in use
+     */
+    void save(const std::string& path);
+
+    /**
+     * Retrieve the current mapping between virtual extents and physical extents, including the buffer space
+     */
+    const std::vector<uint32_t>& get_translation_map() const noexcept { return m_instance.get_translation_map(); }
+
+    /**
+     * Check whether the physical memory is backed by a file
+     */
+    bool is_file_backed() const noexcept { return m_instance.is_file_backed(); }
+
+    /**
+     * Read ahead the extents in the range [address, address + length), see RewiredMemory::prefetch
+     */
+    void prefetch(void* address, size_t length){ m_instance.prefetch(address, length); }
+
+    /**
+     * Release the extents in the range [address, address + length) from main memory, see RewiredMemory::evict
+     */
+    void evict(void* address, size_t length, bool writeback = true){ m_instance.evict(address, length, writeback); }
 };
 //};
 
@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "epoch_manager.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "errorhandling.hpp"
+
+using namespace std;
+
+/*****************************************************************************
+ *                                                                           *
+ *   Thread registration                                                     *
+ *                                                                           *
+ *****************************************************************************/
+
+namespace {
+
+// The slots in use by the live threads, shared by all instances of the EpochManager
+class ThreadRegistry {
+    mutex m_mutex;
+    bool m_used[EpochManager::max_threads] = {false};
+
+public:
+    size_t acquire(){
+        lock_guard<mutex> lock(m_mutex);
+        for(size_t i = 0; i < EpochManager::max_threads; i++){
+            if(!m_used[i]){
+                m_used[i] = true;
+                return i;
+            }
+        }
+        RAISE_EXCEPTION(Exception, "EpochManager: too many threads concurrently registered, max: " << EpochManager::max_threads);
+    }
+
+    void release(size_t id){
+        lock_guard<mutex> lock(m_mutex);
+        assert(m_used[id] && "Slot not acquired");
+        m_used[id] = false;
+    }
+};
+
+ThreadRegistry g_thread_registry;
+
+// Release the slot of the thread when it terminates
+struct ThreadSlot {
+    const size_t m_id;
+    ThreadSlot() : m_id(g_thread_registry.acquire()) { }
+    ~ThreadSlot(){ g_thread_registry.release(m_id); }
+};
+
+} // anonymous namespace
+
+size_t EpochManager::thread_id(){
+    static thread_local ThreadSlot slot;
+    return slot.m_id;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+EpochManager::EpochManager(size_t reclaim_threshold) : m_reclaim_threshold(max<size_t>(1, reclaim_threshold)) { }
+
+EpochManager::~EpochManager(){
+    for(auto& garbage : m_garbage){
+        garbage.m_deleter(garbage.m_pointer);
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Readers                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+EpochManager::Guard::Guard(EpochManager& manager) : m_slot(&manager.m_slots[thread_id()]) {
+    if(m_slot->m_epoch.load(memory_order_relaxed) != 0){ // nested
+        m_slot = nullptr;
+    } else {
+        // seq_cst, the store must be visible to the writers before the reader accesses any node
+        m_slot->m_epoch.store(manager.m_global_epoch.load());
+    }
+}
+
+EpochManager::Guard::~Guard(){
+    if(m_slot != nullptr){
+        m_slot->m_epoch.store(0, memory_order_release);
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Writers                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+void EpochManager::retire(void* pointer, void (*deleter)(void*)){
+    assert(pointer != nullptr && deleter != nullptr);
+    lock_guard<mutex> lock(m_mutex);
+    m_garbage.push_back(Garbage{ m_global_epoch.load(), pointer, deleter });
+    m_num_retired++;
+    if(m_num_retired >= m_reclaim_threshold){
+        reclaim_unsafe();
+    }
+}
+
+void EpochManager::reclaim(){
+    lock_guard<mutex> lock(m_mutex);
+    reclaim_unsafe();
+}
+
+void EpochManager::reclaim_unsafe(){
+    m_num_retired = 0;
+    if(m_garbage.empty()) return;
+
+    // move to the next epoch, the readers entering from now on cannot observe the nodes already retired
+    uint64_t min_epoch = m_global_epoch.fetch_add(1) +1;
+    for(size_t i = 0; i < max_threads; i++){
+        uint64_t epoch = m_slots[i].m_epoch.load();
+        if(epoch != 0 && epoch < min_epoch){ min_epoch = epoch; }
+    }
+
+    // the nodes retired before the oldest active reader entered can be safely released
+    auto it = m_garbage.begin();
+    while(it != m_garbage.end() && it->m_epoch < min_epoch){
+        it->m_deleter(it->m_pointer);
+        it++;
+    }
+    m_garbage.erase(m_garbage.begin(), it);
+}
+
+size_t EpochManager::pending() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_garbage.size();
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EPOCH_MANAGER_HPP_
+#define EPOCH_MANAGER_HPP_
+
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ * Epoch based memory reclamation, for the data structures whose readers access the nodes
+ * without holding any lock. The readers announce themselves with a Guard for the duration
+ * of each operation, while the writers, rather than releasing the memory of the nodes
+ * unlinked from the data structure, retire them. A retired node is only deallocated once
+ * all readers that could have still observed it have left their critical section.
+ *
+ * Each thread is assigned a slot on its first access, up to `max_threads' concurrent threads.
+ */
+class EpochManager {
+public:
+    static constexpr size_t max_threads = 256; // max number of threads concurrently registered
+
+private:
+    // the epoch announced by a single thread, 0 if the thread is not inside a critical section
+    struct alignas(64) Slot { std::atomic<uint64_t> m_epoch {0}; };
+
+    // a node retired by the writers
+    struct Garbage {
+        uint64_t m_epoch; // the global epoch when the node was retired
+        void* m_pointer; // the node to deallocate
+        void (*m_deleter)(void*); // the function to release the node
+    };
+
+    std::atomic<uint64_t> m_global_epoch {1}; // current epoch
+    Slot m_slots[max_threads]; // the epochs announced by the readers
+    mutable std::mutex m_mutex; // protect the list of the garbage
+    std::vector<Garbage> m_garbage; // retired nodes, in order of epoch
+    const size_t m_reclaim_threshold; // attempt to deallocate the retired nodes every `m_reclaim_threshold' retirements
+    size_t m_num_retired = 0; // number of nodes retired since the last attempt to deallocate them
+
+    // Get the slot for the current thread
+    static size_t thread_id();
+
+    // Deallocate all retired nodes that cannot be accessed anymore. The mutex must be held by the caller.
+    void reclaim_unsafe();
+
+public:
+    /**
+     * Scope guard, it marks the critical section of a reader. Guards can be nested in the same thread.
+     */
+    class Guard {
+        Slot* m_slot; // the slot of the thread, or nullptr if the guard is nested
+
+    public:
+        Guard(EpochManager& manager);
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    /**
+     * Create a new instance
+     * @param reclaim_threshold attempt to deallocate the retired nodes every `reclaim_threshold' retirements
+     */
+    EpochManager(size_t reclaim_threshold = 1024);
+
+    /**
+     * Destructor, it deallocates all retired nodes. There must be no active readers.
+     */
+    ~EpochManager();
+
+    /**
+     * Defer the deallocation of the given node, already unlinked from the data structure, until no reader can access it
+     */
+    void retire(void* pointer, void (*deleter)(void*));
+
+    /**
+     * Deallocate all retired nodes that cannot be accessed anymore by any reader
+     */
+    void reclaim();
+
+    /**
+     * Retrieve the number of retired nodes still waiting to be deallocated
+     */
+    size_t pending() const;
+};
+
+#endif /* EPOCH_MANAGER_HPP_ */
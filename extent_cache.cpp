@@ -0,0 +1,168 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "extent_cache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "buffered_rewired_memory.hpp"
+
+using namespace std;
+
+/*****************************************************************************
+ *                                                                           *
+ *   Debug                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) std::cout << "[ExtentCache::" << __FUNCTION__ << "] " << msg << std::endl
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+ExtentCache::ExtentCache(size_t capacity) : m_capacity(max<size_t>(1, capacity)) {
+
+}
+
+void ExtentCache::attach(const std::vector<BufferedRewiredMemory*>& regions, size_t num_extents){
+    COUT_DEBUG("regions: " << regions.size() << ", extents: " << num_extents << ", capacity: " << m_capacity);
+    m_regions = regions;
+    m_state.assign(num_extents, FLAG_RESIDENT);
+    m_num_resident = num_extents;
+    m_clock_hand = 0;
+    trim();
+}
+
+void ExtentCache::detach(){
+    m_regions.clear();
+    m_state.clear();
+    m_num_resident = 0;
+    m_clock_hand = 0;
+}
+
+void ExtentCache::set_capacity(size_t capacity){
+    m_capacity = max<size_t>(1, capacity);
+    trim();
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Access                                                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+void ExtentCache::access(size_t extent_start, size_t num_extents){
+    if(!is_attached()) return;
+    assert(extent_start + num_extents <= m_state.size() && "Invalid range");
+
+    // read ahead the consecutive extents not resident with a single request
+    auto prefetch = [this](size_t run_start, size_t run_end){
+        if(run_start >= run_end) return;
+        for(auto region : m_regions){
+            const size_t extent_size = region->get_extent_size();
+            region->prefetch((char*) region->get_start_address() + run_start * extent_size, (run_end - run_start) * extent_size);
+        }
+    };
+
+    // the extents of the window are pinned until the whole window has been read ahead
+    const size_t extent_end = extent_start + num_extents;
+    size_t num_pinned = 0; // number of resident extents in the window
+    for(size_t extent_id = extent_start; extent_id < extent_end; extent_id++){
+        if(m_state[extent_id] & FLAG_RESIDENT) num_pinned++;
+    }
+
+    size_t run_start = extent_start;
+    for(size_t extent_id = extent_start; extent_id < extent_end; extent_id++){
+        if(m_state[extent_id] & FLAG_RESIDENT){
+            m_num_hits++;
+            m_state[extent_id] |= FLAG_REFERENCED;
+            prefetch(run_start, extent_id);
+            run_start = extent_id +1;
+        } else {
+            m_num_misses++;
+            while(m_num_resident >= m_capacity && m_num_resident > num_pinned){ evict_one(extent_start, extent_end); }
+            m_state[extent_id] = FLAG_RESIDENT | FLAG_REFERENCED;
+            m_num_resident++;
+            num_pinned++;
+        }
+    }
+    prefetch(run_start, extent_end);
+
+    trim(extent_start, extent_end); // the window may not fit the capacity
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Eviction                                                                *
+ *                                                                           *
+ *****************************************************************************/
+
+void ExtentCache::evict(size_t extent_id){
+    assert(m_state[extent_id] & FLAG_RESIDENT);
+    COUT_DEBUG("extent: " << extent_id);
+
+    for(auto region : m_regions){
+        const size_t extent_size = region->get_extent_size();
+        region->evict((char*) region->get_start_address() + extent_id * extent_size, extent_size);
+    }
+
+    m_state[extent_id] = 0;
+    m_num_resident--;
+    m_num_evictions++;
+}
+
+void ExtentCache::evict_one(size_t pinned_start, size_t pinned_end){
+    assert(m_num_resident > 0 && "No extents to evict");
+
+    // at most two sweeps: the first one may only clear the reference bits
+    while(true){
+        if(m_clock_hand >= m_state.size()) m_clock_hand = 0;
+        uint8_t state = m_state[m_clock_hand];
+        if((state & FLAG_RESIDENT) && (m_clock_hand < pinned_start || m_clock_hand >= pinned_end)){
+            if(state & FLAG_REFERENCED){
+                m_state[m_clock_hand] = FLAG_RESIDENT; // second chance
+            } else {
+                evict(m_clock_hand++);
+                return;
+            }
+        }
+        m_clock_hand++;
+    }
+}
+
+void ExtentCache::trim(size_t pinned_start, size_t pinned_end){
+    size_t num_pinned = 0;
+    for(size_t extent_id = pinned_start; extent_id < pinned_end; extent_id++){
+        if(m_state[extent_id] & FLAG_RESIDENT) num_pinned++;
+    }
+
+    // first the extents outside the pinned interval, then, if still required, the pinned extents in order
+    while(m_num_resident > m_capacity && m_num_resident > num_pinned){ evict_one(pinned_start, pinned_end); }
+    for(size_t extent_id = pinned_start; m_num_resident > m_capacity && extent_id < pinned_end; extent_id++){
+        if(m_state[extent_id] & FLAG_RESIDENT) evict(extent_id);
+    }
+}
@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXTENT_CACHE_HPP_
+#define EXTENT_CACHE_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+class BufferedRewiredMemory; // forward decl.
+
+/**
+ * Bound the amount of main memory used by a set of file-backed rewired memory regions (see RewiredMemory), with the
+ * same extent layout, e.g. the keys & the values of a PMA. An entry of the cache is the extent with the same offset
+ * in all regions. At most `capacity' extents are kept resident, the others are flushed to their files and released
+ * from memory. The victims are chosen with the clock (second chance) policy.
+ *
+ * The cache does not intercept the accesses to the memory: the user must notify it with #access before reading or
+ * writing an extent. An extent not notified is paged in anyway by the O.S., it is only not accounted in the budget.
+ */
+class ExtentCache {
+    size_t m_capacity; // max number of resident extents
+    std::vector<BufferedRewiredMemory*> m_regions; // the memory regions managed
+    std::vector<uint8_t> m_state; // for each extent, whether it is resident and it has been recently referenced
+    size_t m_num_resident = 0; // number of extents currently resident
+    size_t m_clock_hand = 0; // the next candidate for eviction
+    uint64_t m_num_hits = 0; // number of accesses to resident extents
+    uint64_t m_num_misses = 0; // number of accesses to extents not resident
+    uint64_t m_num_evictions = 0; // number of extents released from memory
+
+    constexpr static uint8_t FLAG_RESIDENT = 0x1;
+    constexpr static uint8_t FLAG_REFERENCED = 0x2;
+
+    /**
+     * Release the given extent from memory
+     */
+    void evict(size_t extent_id);
+
+    /**
+     * Select a victim with the clock policy and release it. The extents in [pinned_start, pinned_end) are never
+     * selected, there must be at least one resident extent outside this interval.
+     */
+    void evict_one(size_t pinned_start = 0, size_t pinned_end = 0);
+
+    /**
+     * Release the extents in excess of the capacity, preferring those outside [pinned_start, pinned_end)
+     */
+    void trim(size_t pinned_start = 0, size_t pinned_end = 0);
+
+public:
+    /**
+     * Create a cache that keeps at most `capacity' extents resident
+     */
+    ExtentCache(size_t capacity);
+
+    /**
+     * Manage the first `num_extents' extents of the given regions, replacing the previous ones. All extents are
+     * assumed to be resident, as they have just been written, and the cache is immediately trimmed to its capacity.
+     */
+    void attach(const std::vector<BufferedRewiredMemory*>& regions, size_t num_extents);
+
+    /**
+     * Stop managing any region
+     */
+    void detach();
+
+    /**
+     * Notify that the extents in [extent_start, extent_start + num_extents) are about to be accessed. The extents
+     * not resident are read ahead from their files with sequential reads, evicting other extents if required. The
+     * extents of the window are never evicted in favour of each other. When the window is larger than the capacity,
+     * its first extents are released once the whole window has been read ahead.
+     */
+    void access(size_t extent_start, size_t num_extents);
+
+    /**
+     * Change the max number of resident extents
+     */
+    void set_capacity(size_t capacity);
+
+    /**
+     * Retrieve the max number of resident extents
+     */
+    size_t capacity() const noexcept { return m_capacity; }
+
+    /**
+     * Check whether the cache is managing any region
+     */
+    bool is_attached() const noexcept { return !m_regions.empty(); }
+
+    /**
+     * Retrieve the number of extents currently resident
+     */
+    size_t num_resident() const noexcept { return m_num_resident; }
+
+    /**
+     * Retrieve the number of accesses to resident extents
+     */
+    uint64_t num_hits() const noexcept { return m_num_hits; }
+
+    /**
+     * Retrieve the number of accesses to extents that were not resident
+     */
+    uint64_t num_misses() const noexcept { return m_num_misses; }
+
+    /**
+     * Retrieve the number of extents released from memory
+     */
+    uint64_t num_evictions() const noexcept { return m_num_evictions; }
+};
+
+#endif /* EXTENT_CACHE_HPP_ */
@@ -0,0 +1,58 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "mapped_memory.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "errorhandling.hpp"
+
+using namespace std;
+
+// round the given size up to a multiple of the page size
+static size_t page_ceil(size_t size){
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    if(size == 0) size = 1; // mmap does not accept empty mappings
+    return ((size + page_size -1) / page_size) * page_size;
+}
+
+void* mapped_memory_allocate(size_t size){
+    void* ptr = mmap(nullptr, page_ceil(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED){
+        RAISE_EXCEPTION(Exception, "[mapped_memory_allocate] Cannot allocate " << size << " bytes, mmap error: " << strerror(errno) << " (" << errno << ")");
+    }
+    return ptr;
+}
+
+void* mapped_memory_resize(void* ptr, size_t old_size, size_t new_size){
+    size_t old_capacity = page_ceil(old_size);
+    size_t new_capacity = page_ceil(new_size);
+    if(old_capacity == new_capacity) return ptr;
+
+    void* result = mremap(ptr, old_capacity, new_capacity, MREMAP_MAYMOVE);
+    if(result == MAP_FAILED){
+        RAISE_EXCEPTION(Exception, "[mapped_memory_resize] Cannot resize the chunk " << ptr << " from " << old_size << " to " << new_size << " bytes, mremap error: " << strerror(errno) << " (" << errno << ")");
+    }
+    return result;
+}
+
+void mapped_memory_free(void* ptr, size_t size){
+    if(ptr == nullptr) return;
+    munmap(ptr, page_ceil(size));
+}
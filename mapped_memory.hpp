@@ -0,0 +1,47 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPED_MEMORY_HPP_
+#define MAPPED_MEMORY_HPP_
+
+#include <cstddef>
+
+/**
+ * Anonymous allocations backed directly by mmap(2). The size of each allocation is rounded up to a
+ * multiple of the page size, so that the chunk can later be grown or shrunk with mremap(2): the kernel
+ * only alters the page tables, and moves the mapping to a different virtual address if the adjacent
+ * range is not available (MREMAP_MAYMOVE), without copying the content nor requiring a second buffer.
+ */
+
+/**
+ * Allocate a chunk of (at least) `size' bytes, aligned to the page size.
+ */
+void* mapped_memory_allocate(size_t size);
+
+/**
+ * Alter the size of a chunk allocated with mapped_memory_allocate from `old_size' to `new_size' bytes.
+ * The content in the range [0, min(old_size, new_size)) is preserved. It returns the new address of the
+ * chunk, which may differ from `ptr'.
+ */
+void* mapped_memory_resize(void* ptr, size_t old_size, size_t new_size);
+
+/**
+ * Release a chunk allocated with mapped_memory_allocate, of the given size in bytes
+ */
+void mapped_memory_free(void* ptr, size_t size);
+
+#endif /* MAPPED_MEMORY_HPP_ */
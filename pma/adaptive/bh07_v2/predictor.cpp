@@ -20,6 +20,8 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <limits>
 
 #include "errorhandling.hpp"
 #include "miscellaneous.hpp"
@@ -49,7 +51,7 @@ namespace pma { namespace adaptive { namespace bh07_v2 {
  *                                                                           *
  *****************************************************************************/
 
-Predictor::Predictor(size_t size, size_t max_count) : m_buffer(nullptr){
+Predictor::Predictor(size_t size, size_t max_count) : m_buffer(nullptr), m_index(nullptr){
     set_max_count(max_count);
     if(size <= 1){ throw std::invalid_argument("Invalid size: <= 1"); }
 
@@ -58,10 +60,12 @@ Predictor::Predictor(size_t size, size_t max_count) : m_buffer(nullptr){
     m_capacity = size;
     m_tail = m_head = 0;
     m_empty = true;
+    allocate_index(m_capacity_max);
 }
 
 Predictor::~Predictor(){
     deallocate_buffer(m_buffer);
+    free(m_index); m_index = nullptr;
 }
 
 Item* Predictor::allocate_buffer(size_t capacity){
@@ -79,6 +83,20 @@ void Predictor::deallocate_buffer(Item*& buffer){
     free(buffer); buffer = nullptr;
 }
 
+void Predictor::allocate_index(size_t capacity_max){
+    free(m_index); m_index = nullptr;
+
+    // keep the load factor of the hash table at most 0.5
+    m_index_capacity = hyperceil(2 * capacity_max);
+    m_index_shift = 64 - static_cast<int>(log2(m_index_capacity));
+    int rc = posix_memalign((void**) &m_index, /* alignment */ 64,  /* size */ m_index_capacity * sizeof(m_index[0]));
+    if(rc != 0) {
+        RAISE_EXCEPTION(Exception, "[Predictor::allocate_index] It cannot obtain a chunk of aligned memory. " <<
+                "Requested size: " << (m_index_capacity * sizeof(m_index[0])) << " bytes, capacity " << m_index_capacity);
+    }
+    memset(m_index, 0xFF, m_index_capacity * sizeof(m_index[0])); // all buckets empty
+}
+
 void Predictor::set_max_count(size_t value){
     if( value < 1 || value > pow(2, 16)){
         throw std::invalid_argument("Invalid value for the max count");
@@ -149,6 +167,72 @@ vector<PermutedItem> Predictor::items(uint64_t min, uint64_t max){
     return weighted_elements(min, max);
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   Hash index                                                              *
+ *                                                                           *
+ *****************************************************************************/
+static constexpr uint32_t INDEX_EMPTY = numeric_limits<uint32_t>::max();
+
+size_t Predictor::index_bucket(uint64_t pointer) const {
+    return (pointer * 0x9E3779B97F4A7C15ull) >> m_index_shift; // fibonacci hashing
+}
+
+size_t Predictor::index_find_slot(size_t slot) const {
+    const size_t mask = m_index_capacity -1;
+    size_t bucket = index_bucket(m_buffer[slot].m_pointer);
+    while(m_index[bucket] != slot){
+        assert(m_index[bucket] != INDEX_EMPTY && "The slot is not registered in the index");
+        bucket = (bucket +1) & mask;
+    }
+    return bucket;
+}
+
+void Predictor::index_insert(size_t slot){
+    const size_t mask = m_index_capacity -1;
+    size_t bucket = index_bucket(m_buffer[slot].m_pointer);
+    while(m_index[bucket] != INDEX_EMPTY){
+        bucket = (bucket +1) & mask;
+    }
+    m_index[bucket] = slot;
+}
+
+void Predictor::index_remove(size_t hole){
+    const size_t mask = m_index_capacity -1;
+    size_t bucket = hole;
+    while(true){
+        bucket = (bucket +1) & mask;
+        if(m_index[bucket] == INDEX_EMPTY) break;
+
+        // can the entry in `bucket' be moved back to fill the hole?
+        size_t home = index_bucket(m_buffer[m_index[bucket]].m_pointer);
+        bool move_back = (hole <= bucket) ? (home <= hole || home > bucket) : (home <= hole && home > bucket);
+        if(move_back){
+            m_index[hole] = m_index[bucket];
+            hole = bucket;
+        }
+    }
+    m_index[hole] = INDEX_EMPTY;
+}
+
+void Predictor::rebuild_index(){
+    memset(m_index, 0xFF, m_index_capacity * sizeof(m_index[0]));
+    if(empty()) return;
+
+    if( m_head > m_tail ) {
+        for(size_t j = m_tail; j < m_head; j++){
+            index_insert(j);
+        }
+    } else { // m_head <= m_tail
+        for(size_t j = m_tail; j < m_capacity; j++){
+            index_insert(j);
+        }
+        for(size_t j = 0; j < m_head; j++){
+            index_insert(j);
+        }
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Update                                                                  *
@@ -176,27 +260,15 @@ void Predictor::update(uint64_t pointer){
 }
 
 int64_t Predictor::get_position(int64_t pointer) const {
-    if(empty()) {
-        return -1;
-    } else if ( m_head > m_tail ){
-        COUT_DEBUG("[case 1] from the head: " << (m_head -1) << " -> " << m_tail);
-        for(int64_t i = m_head -1, end = m_tail; i >= end; i--){
-            if(m_buffer[i].m_pointer == pointer)
-                return i;
-        }
-        return -1;
-    } else { // m_head <= m_tail
-        for(int64_t i = m_head -1; i >= 0; i--){
-            if(m_buffer[i].m_pointer == pointer)
-                return i;
-        }
-        for(int64_t i = m_capacity -1, end = m_tail; i >= end; i--){
-            if(m_buffer[i].m_pointer == pointer)
-                return i;
-        }
-
-        return -1;
+    const size_t mask = m_index_capacity -1;
+    size_t bucket = index_bucket(pointer);
+    while(m_index[bucket] != INDEX_EMPTY){
+        size_t slot = m_index[bucket];
+        if(m_buffer[slot].m_pointer == static_cast<uint64_t>(pointer))
+            return slot;
+        bucket = (bucket +1) & mask;
     }
+    return -1;
 }
 
 void Predictor::decrease_tail() {
@@ -207,6 +279,7 @@ void Predictor::decrease_tail() {
     auto& item = m_buffer[m_tail];
     item.m_count--;
     if( item.m_count == 0 ){ // remove the element from the queue ?
+        index_remove(index_find_slot(m_tail));
         m_tail++; // => (m_tail + 1) % m_capacity
         if(m_tail == m_capacity) { // reset the pointer back at the start of the array
             m_tail = 0;
@@ -229,7 +302,10 @@ size_t Predictor::move_ahead(size_t item_position){
         return item_position; // no change
     } else {
         size_t next_position = item_position == m_capacity -1 ? 0 : item_position +1;
+        size_t bucket1 = index_find_slot(item_position);
+        size_t bucket2 = index_find_slot(next_position);
         std::swap(m_buffer[item_position], m_buffer[next_position]);
+        std::swap(m_index[bucket1], m_index[bucket2]);
         return next_position;
     }
 }
@@ -240,6 +316,7 @@ void Predictor::insert_new_element(uint64_t pointer){
     assert(m_buffer[m_head].m_count == 0 && "Front of the queue not empty!");
 
     m_buffer[m_head] = { pointer, 1 };
+    index_insert(m_head);
 
     // move the pointer ahead of one position
     m_head++;
@@ -249,7 +326,9 @@ void Predictor::insert_new_element(uint64_t pointer){
 }
 
 void Predictor::reset_ptr(size_t index, size_t pma_position) {
+    index_remove(index_find_slot(index));
     m_buffer[index].m_pointer = pma_position;
+    index_insert(index);
 }
 
 /*****************************************************************************
@@ -264,7 +343,14 @@ void Predictor::resize(size_t sz) {
     if(sz < size()) { throw std::invalid_argument("Cannot reduce the size of the data structure, it contains too many elements"); };
 
     if(empty()){
-      m_capacity = sz;
+        if(sz > m_capacity_max){ // the underlying buffer is too small
+            deallocate_buffer(m_buffer);
+            m_capacity_max = hyperceil(sz);
+            m_buffer = allocate_buffer(m_capacity_max);
+            allocate_index(m_capacity_max);
+        }
+        m_tail = m_head = 0;
+        m_capacity = sz;
     } else if(sz > m_capacity){
         if(sz <= m_capacity_max){
             if(m_tail < m_head){
@@ -295,6 +381,7 @@ void Predictor::resize(size_t sz) {
                 }
 
                 m_capacity = sz;
+                rebuild_index(); // the elements have been moved to different slots
             }
         } else { //sz > m_capacity_max
             resize_with_new_buffer(sz);
@@ -329,12 +416,15 @@ void Predictor::resize_with_new_buffer(size_t sz){
         }
     }
     m_tail = 0;
-    m_head = i;
+    m_head = (i == capacity1) ? 0 : i; // the new buffer may be full
     m_capacity = capacity1;
     m_capacity_max = capacity_max1;
 
     deallocate_buffer(m_buffer);
     m_buffer = buffer1;
+
+    allocate_index(m_capacity_max);
+    rebuild_index();
 }
 
 /*****************************************************************************
@@ -54,6 +54,9 @@ class Predictor{
     size_t m_head; // pointer to the head of the array
     size_t m_count_max; // the max value a key in the array can hold
     bool m_empty; // is the circular buffer empty?
+    uint32_t* m_index; // open addressing hash table (linear probing), mapping a pointer to its slot in m_buffer
+    size_t m_index_capacity; // number of buckets in m_index, a power of 2 and at least twice m_capacity_max
+    int m_index_shift; // 64 - log2(m_index_capacity), to compute the bucket from the hash of a pointer
 
     /**
      * Allocate a buffer with the given capacity;
@@ -65,6 +68,36 @@ class Predictor{
      */
     static void deallocate_buffer(Item*& buffer);
 
+    /**
+     * Allocate & initialise the hash index for a buffer with the given max capacity
+     */
+    void allocate_index(size_t capacity_max);
+
+    /**
+     * Reinsert in the hash index all the elements currently stored in the circular array
+     */
+    void rebuild_index();
+
+    /**
+     * Compute the home bucket of the given pointer in the hash index
+     */
+    size_t index_bucket(uint64_t pointer) const;
+
+    /**
+     * Retrieve the bucket in the hash index referring to the given slot of the circular array
+     */
+    size_t index_find_slot(size_t slot) const;
+
+    /**
+     * Add the given slot of the circular array to the hash index
+     */
+    void index_insert(size_t slot);
+
+    /**
+     * Remove the given bucket from the hash index, shifting back the subsequent entries in its cluster
+     */
+    void index_remove(size_t bucket);
+
     /**
      * Find the position of the key in the circular array, or return -1 if not present
      */
@@ -20,6 +20,7 @@
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include "aligned_memory.hpp"
 #include "knobs.hpp"
 
 using namespace std;
@@ -27,11 +28,12 @@ using namespace std;
 namespace pma { namespace adaptive { namespace int1 {
 
 Detector::Detector(Knobs& knobs, size_t size, uint32_t modulus) : m_knobs(knobs), m_capacity(size), m_sizeof_entry(modulus + 3), m_modulus(modulus) {
-    m_buffer = new int64_t[ m_capacity * m_sizeof_entry ]();
+    m_buffer = (int64_t*) aligned_memory_allocate(m_capacity * m_sizeof_entry * sizeof(m_buffer[0]));
+    clear();
 }
 
 Detector::~Detector() {
-   delete[] m_buffer; m_buffer = nullptr;
+   aligned_memory_free(m_buffer); m_buffer = nullptr;
 }
 
 void Detector::clear(){
@@ -47,10 +49,11 @@ void Detector::clear(uint64_t segment_id){
 }
 
 void Detector::resize(size_t size){
-    delete[] m_buffer; m_buffer = nullptr;
+    aligned_memory_free(m_buffer); m_buffer = nullptr;
 
     m_capacity = size;
-    m_buffer = new int64_t[m_sizeof_entry * size]();
+    m_buffer = (int64_t*) aligned_memory_allocate(m_sizeof_entry * size * sizeof(m_buffer[0]));
+    clear();
 }
 
 void Detector::dump(std::ostream& out) const {
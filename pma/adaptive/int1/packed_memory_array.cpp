@@ -33,6 +33,7 @@
 #include <vector>
 
 #include "adaptive_rebalancing.hpp"
+#include "aligned_memory.hpp"
 #include "configuration.hpp"
 #include "database.hpp"
 #include "iterator.hpp"
@@ -103,8 +104,8 @@ PackedMemoryArray::~PackedMemoryArray() {
 
     free(m_storage.m_keys); m_storage.m_keys = nullptr;
     free(m_storage.m_values); m_storage.m_values = nullptr;
-    free(m_storage.m_segment_sizes); m_storage.m_segment_sizes = nullptr;
-    free(m_index.m_keys); m_index.m_keys = nullptr;
+    aligned_memory_free(m_storage.m_segment_sizes); m_storage.m_segment_sizes = nullptr;
+    aligned_memory_free(m_index.m_keys); m_index.m_keys = nullptr;
 
 #if defined(PROFILING)
     m_rebalancing_profiler.save_results();
@@ -257,7 +258,8 @@ void PackedMemoryArray::resize(const VectorOfPartitions& partitions, const bool
     auto xFreePtr = [](void* ptr){ free(ptr); };
     unique_ptr<int64_t, decltype(xFreePtr)> ixKeys_ptr { ixKeys, xFreePtr };
     unique_ptr<int64_t, decltype(xFreePtr)> ixValues_ptr{ ixValues, xFreePtr };
-    unique_ptr<remove_pointer_t<decltype(m_storage.m_segment_sizes)>, decltype(xFreePtr)> ixSizes_ptr{ ixSizes, xFreePtr };
+    auto xFreeSizes = [](void* ptr){ aligned_memory_free(ptr); };
+    unique_ptr<remove_pointer_t<decltype(m_storage.m_segment_sizes)>, decltype(xFreeSizes)> ixSizes_ptr{ ixSizes, xFreeSizes };
     int64_t* __restrict xKeys = m_storage.m_keys;
     int64_t* __restrict xValues = m_storage.m_values;
     decltype(m_storage.m_segment_sizes) __restrict xSizes = m_storage.m_segment_sizes;
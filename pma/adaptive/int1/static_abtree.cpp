@@ -17,8 +17,8 @@
 
 #include "static_abtree.hpp"
 
-#include <cstdlib> // posix_memalign
 #include <limits>
+#include "aligned_memory.hpp"
 #include "errorhandling.hpp"
 #include "miscellaneous.hpp" // hyperceil
 
@@ -40,17 +40,10 @@ void StaticABTree::realloc_keys() {
 }
 
 void StaticABTree::realloc_keys(size_t num_nodes) {
-    free(m_keys); m_keys = nullptr;
+    aligned_memory_free(m_keys); m_keys = nullptr;
 
-    int64_t* ptr (nullptr);
     size_t request_sz = B * sizeof(int64_t) * num_nodes;
-    int rc = posix_memalign((void**) &ptr, /* alignment */ 64,  /* size */ request_sz);
-    if(rc != 0) {
-        RAISE_EXCEPTION(Exception, "[StaticABTree::realloc_keys] It cannot obtain a chunk of aligned memory. " <<
-                "Requested size: " << request_sz << " for " << num_nodes << " ABTree nodes");
-    }
-
-    m_keys = ptr;
+    m_keys = (int64_t*) aligned_memory_allocate(request_sz); // backed by huge pages, if large enough
 }
 
 }}} // pma::adaptive::int1
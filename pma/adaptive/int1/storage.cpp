@@ -20,6 +20,7 @@
 #include <cmath>
 #include <numeric>
 #include <stdexcept>
+#include "aligned_memory.hpp"
 #include "errorhandling.hpp"
 #include "miscellaneous.hpp" // hyperceil
 
@@ -59,12 +60,13 @@ void Storage::alloc_workspace(size_t num_segments, int64_t** keys, int64_t** val
                 "Requested size: " << m_segment_capacity * sizeof(m_values[0]));
     }
 
-    rc = posix_memalign((void**) sizes, /* alignment */ 64,  /* size */ num_segments * sizeof(m_segment_sizes[0]));
-    if(rc != 0) {
+    try {
+        // traversed by the calibrator tree, back it with huge pages if large enough. Release with aligned_memory_free
+        *sizes = (uint16_t*) aligned_memory_allocate(num_segments * sizeof(m_segment_sizes[0]));
+    } catch(...) {
         free(*keys); *keys = nullptr;
         free(*values); *values = nullptr;
-        RAISE_EXCEPTION(Exception, "[Storage::Storage] It cannot obtain a chunk of aligned memory. " <<
-                "Requested size: " << m_segment_capacity * sizeof(m_segment_sizes[0]));
+        throw;
     }
 }
 
@@ -23,6 +23,7 @@
 #include <cstring>
 #include <numeric>
 #include <stdexcept>
+#include "aligned_memory.hpp"
 #include "buffered_rewired_memory.hpp"
 #include "errorhandling.hpp"
 #include "miscellaneous.hpp" // hyperceil, get_memory_page_size
@@ -156,11 +157,8 @@ void Storage::alloc_workspace(size_t num_segments, int64_t** keys, int64_t** val
                     "Requested size: " << elts_space_required_bytes);
         }
 
-        rc = posix_memalign((void**) sizes, /* alignment */ 64,  /* size */ card_space_required_bytes);
-        if(rc != 0) {
-            RAISE_EXCEPTION(Exception, "[Storage::alloc_workspace] It cannot obtain a chunk of aligned memory. " <<
-                    "Requested size: " << card_space_required_bytes);
-        }
+        // traversed by the calibrator tree, back it with huge pages if large enough
+        *sizes = (uint16_t*) aligned_memory_allocate(card_space_required_bytes);
     }
 
     // always allocate at least 2 segments, using the second segment as special mark with size = 0
@@ -187,7 +185,7 @@ void Storage::dealloc_workspace(int64_t** keys, int64_t** values, decltype(m_seg
         *sizes = nullptr;
         delete *rewired_memory_cardinalities; *rewired_memory_cardinalities = nullptr;
     } else {
-        free(*sizes); *sizes = nullptr;
+        aligned_memory_free(*sizes); *sizes = nullptr;
     }
 }
 
@@ -21,20 +21,24 @@
 #include <iostream>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
 #include "detector.hpp"
 #include "memory_pool.hpp"
 #include "packed_memory_array.hpp"
+#include "sketch_detector.hpp"
 
 using namespace std;
 
 namespace pma { namespace adaptive { namespace int3 {
 
 MoveDetectorInfo::MoveDetectorInfo(PackedMemoryArray& pma, size_t segment_start)
-    : MoveDetectorInfo(pma.memory_pool(), pma.detector().buffer() + segment_start * pma.detector().sizeof_entry(),
-            pma.detector().sizeof_entry()) { }
+    : MoveDetectorInfo(pma.memory_pool(),
+            pma.sketch_detector() ? nullptr : pma.detector().buffer() + segment_start * pma.detector().sizeof_entry(),
+            pma.detector().sizeof_entry(), pma.sketch_detector(), segment_start) { }
 
-MoveDetectorInfo::MoveDetectorInfo(CachedMemoryPool& memory_pool, int64_t* detector_buffer, const size_t entry_size) :
+MoveDetectorInfo::MoveDetectorInfo(CachedMemoryPool& memory_pool, int64_t* detector_buffer, const size_t entry_size, SketchDetector* sketch_detector, size_t segment_start) :
         m_memory_pool(memory_pool), m_detector_buffer(detector_buffer), m_detector_entry_size(entry_size),
+        m_sketch_detector(sketch_detector), m_segment_start(segment_start),
         m_registered_segments(nullptr), m_registered_segments_capacity(0), m_registered_segments_sz(0) {
 
 }
@@ -63,6 +67,8 @@ void MoveDetectorInfo::move_section(uint32_t from, uint32_t to){
 }
 
 void MoveDetectorInfo::move(){
+    if(m_sketch_detector != nullptr){ move_sketch(); return; }
+
     auto& memory_pool = m_memory_pool;
     auto fn_deallocate = [&memory_pool](void* ptr){ memory_pool.deallocate(ptr); };
     unique_ptr<int64_t, decltype(fn_deallocate)> buffer_ptr = { m_memory_pool.allocate<int64_t>(sizeof(int64_t) * m_detector_entry_size * m_registered_segments_sz), fn_deallocate };
@@ -79,6 +85,33 @@ void MoveDetectorInfo::move(){
     }
 }
 
+void MoveDetectorInfo::move_sketch(){
+    // as for the detector buffer, first detach all entries and then reassign them, as the sources & destinations may
+    // overlap. The same source can also be copied to multiple destinations.
+    vector<pair<uint32_t, SketchDetector::Entry>> sources;
+    auto find_source = [&sources](uint32_t segment_id) -> SketchDetector::Entry* {
+        for(auto& s : sources){ if(s.first == segment_id) return &(s.second); }
+        return nullptr;
+    };
+
+    for(size_t i = 0; i < m_registered_segments_sz; i++){
+        uint32_t source = m_registered_segments[i].first;
+        SketchDetector::Entry entry;
+        if(find_source(source) == nullptr && m_sketch_detector->extract(m_segment_start + source, &entry)){
+            sources.emplace_back(source, entry);
+        }
+    }
+
+    for(size_t i = 0; i < m_registered_segments_sz; i++){
+        SketchDetector::Entry* entry = find_source(m_registered_segments[i].first);
+        if(entry != nullptr){
+            m_sketch_detector->restore(m_segment_start + m_registered_segments[i].second, *entry);
+        } else { // as the memcpy of an empty section, reset the destination
+            m_sketch_detector->clear(m_segment_start + m_registered_segments[i].second);
+        }
+    }
+}
+
 void MoveDetectorInfo::dump(std::ostream& out) const{
     out << "{MoveDetectorInfo entry size: " << m_detector_entry_size << ", size: " << m_registered_segments_sz << ", capacity: " <<
             m_registered_segments_capacity << ", entries: [";
@@ -30,11 +30,14 @@ namespace pma { namespace adaptive { namespace int3 {
 
 // forward decl.
 class PackedMemoryArray;
+class SketchDetector;
 
 class MoveDetectorInfo{
     CachedMemoryPool& m_memory_pool;
     int64_t* m_detector_buffer; // input
     const size_t m_detector_entry_size; // size of each entry in the detector buffer
+    SketchDetector* m_sketch_detector; // if not null, move the entries of the sketch rather than the detector buffer
+    const size_t m_segment_start; // the segment ids registered are relative to this offset
     std::pair<uint32_t, uint32_t>* m_registered_segments; // segments that need to be moved
     size_t m_registered_segments_capacity; // space in the array m_registered_segments
     size_t m_registered_segments_sz; // current number of segments registered
@@ -42,10 +45,13 @@ class MoveDetectorInfo{
 private:
    void move();
 
+   // Move the heavy hitters of the sketch detector
+   void move_sketch();
+
 public:
    MoveDetectorInfo(PackedMemoryArray& pma, size_t segment_start);
 
-   MoveDetectorInfo(CachedMemoryPool& memory_pool, int64_t* detector_buffer, const size_t entry_size);
+   MoveDetectorInfo(CachedMemoryPool& memory_pool, int64_t* detector_buffer, const size_t entry_size, SketchDetector* sketch_detector = nullptr, size_t segment_start = 0);
 
     ~MoveDetectorInfo();
 
@@ -130,6 +130,13 @@ size_t PackedMemoryArray::balanced_thresholds_cutoff() const {
     return 64 * m_storage.get_segments_per_extent();
 }
 
+void PackedMemoryArray::adapt_densities(){
+    if(!m_density_controller || !m_density_controller->update(m_storage.m_cardinality)) return;
+    m_density_bounds0.set_densities(m_density_controller->adapt(m_density_bounds0.densities()));
+    m_density_bounds1.set_densities(m_density_controller->adapt(m_density_bounds1.densities()));
+    COUT_DEBUG("theta_h: " << m_density_controller->theta());
+}
+
 CachedMemoryPool& PackedMemoryArray::memory_pool() {
     return m_memory_pool;
 }
@@ -138,6 +145,10 @@ Detector& PackedMemoryArray::detector(){
     return m_detector;
 }
 
+SketchDetector* PackedMemoryArray::sketch_detector(){
+    return m_sketch_detector.get();
+}
+
 Knobs& PackedMemoryArray::knobs(){
     return m_knobs;
 }
@@ -148,12 +159,58 @@ size_t PackedMemoryArray::get_segment_capacity() const noexcept{
 
 size_t PackedMemoryArray::memory_footprint() const {
     size_t space_index = m_index.memory_footprint();
-    size_t space_storage = m_storage.memory_footprint();
+    size_t space_storage = m_storage.memory_footprint() + m_cardinality_tree.memory_footprint() - sizeof(m_cardinality_tree);
     size_t space_detector = m_detector.capacity() * m_detector.sizeof_entry() * sizeof(uint64_t);
+    if(m_sketch_detector){ space_detector += m_sketch_detector->memory_footprint(); }
 
     return sizeof(decltype(*this)) + space_index + space_storage + space_detector;
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   Detector                                                                *
+ *                                                                           *
+ *****************************************************************************/
+void PackedMemoryArray::detector_insert(size_t segment_id, int64_t predecessor, int64_t successor){
+    if(m_sketch_detector){
+        m_sketch_detector->insert(segment_id, predecessor, successor);
+    } else {
+        m_detector.insert(segment_id, predecessor, successor);
+    }
+}
+
+void PackedMemoryArray::detector_remove(size_t segment_id, int64_t predecessor, int64_t successor){
+    if(m_sketch_detector){
+        m_sketch_detector->remove(segment_id, predecessor, successor);
+    } else {
+        m_detector.remove(segment_id, predecessor, successor);
+    }
+}
+
+void PackedMemoryArray::detector_clear(){
+    if(m_sketch_detector){
+        m_sketch_detector->clear();
+    } else {
+        m_detector.clear();
+    }
+}
+
+void PackedMemoryArray::detector_clear(size_t segment_id){
+    if(m_sketch_detector){
+        m_sketch_detector->clear(segment_id);
+    } else {
+        m_detector.clear(segment_id);
+    }
+}
+
+void PackedMemoryArray::detector_resize(size_t num_segments){
+    if(m_sketch_detector){
+        m_sketch_detector->resize(num_segments);
+    } else {
+        m_detector.resize(num_segments);
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Insert                                                                  *
@@ -169,6 +226,7 @@ void PackedMemoryArray::insert(int64_t key, int64_t value){
         size_t segment = m_index.find(key);
         insert_common(segment, key, value);
     }
+    if(m_density_controller){ m_density_controller->record_update(); }
 
 //#if defined(DEBUG)
 //    dump();
@@ -185,6 +243,7 @@ void PackedMemoryArray::insert_empty(int64_t key, int64_t value){
     m_storage.m_keys[pos] = key;
     m_storage.m_values[pos] = value;
     m_storage.m_cardinality = 1;
+    m_cardinality_tree.rebuild(m_storage.m_segment_sizes, m_storage.m_number_segments);
 }
 
 void PackedMemoryArray::insert_common(size_t segment_id, int64_t key, int64_t value){
@@ -198,7 +257,8 @@ void PackedMemoryArray::insert_common(size_t segment_id, int64_t key, int64_t va
     } else { // find a spot where to insert this element
         int64_t predecessor, successor;
         bool minimum_updated = m_storage.insert(segment_id, key, value, &predecessor, &successor);
-        m_detector.insert(segment_id, predecessor, successor);
+        m_cardinality_tree.update(segment_id, +1);
+        detector_insert(segment_id, predecessor, successor);
 
         // have we just updated the minimum ?
         if (minimum_updated) m_index.set_separator_key(segment_id, key);
@@ -242,6 +302,7 @@ int64_t PackedMemoryArray::remove(int64_t key){
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
             m_storage.m_cardinality--;
+            m_cardinality_tree.update(segment_id, -1);
 
             if(i == imin){ // update the pivot
                 if(m_storage.m_cardinality == 0){ // global minimum
@@ -270,6 +331,7 @@ int64_t PackedMemoryArray::remove(int64_t key){
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
             m_storage.m_cardinality--;
+            m_cardinality_tree.update(segment_id, -1);
 
             // update the minimum
             if(i == 0 && sz > 0){ // sz > 0 => otherwise we are going to rebalance this segment anyway
@@ -280,9 +342,11 @@ int64_t PackedMemoryArray::remove(int64_t key){
 
     // shall we rebalance ?
     if(value != -1){
-        m_detector.remove(segment_id, predecessor, successor);
+        detector_remove(segment_id, predecessor, successor);
+        if(m_density_controller){ m_density_controller->record_update(); }
 
         if(m_storage.m_number_segments >= 2 * balanced_thresholds_cutoff() && static_cast<double>(m_storage.m_cardinality) < 0.5 * m_storage.capacity()){
+            adapt_densities();
             auto plan = rebalance_plan(false, 0, 0, m_storage.m_cardinality, true);
             rebalance_run_apma(plan);
             do_rebalance(plan);
@@ -308,6 +372,7 @@ int64_t PackedMemoryArray::remove(int64_t key){
 void PackedMemoryArray::rebalance(size_t segment_id, int64_t* key, int64_t* value){
     assert(((key && value) || (!key && !value)) && "Either both key & value are specified (insert) or none of them is (delete)");
     const bool is_insert = key != nullptr;
+    adapt_densities();
 
     int64_t window_start {0}, window_length {0}, cardinality {0};
     bool do_resize { false };
@@ -335,12 +400,10 @@ void PackedMemoryArray::rebalance_find_window(size_t segment_id, bool is_inserti
     int height = 1;
     // these inits are only valid for the edge case that the calibrator tree has height 1, i.e. the data structure contains only one segment
     double rho = 0.0, theta = 1.0, density = static_cast<double>(cardinality_after)/m_storage.m_segment_capacity;
+    assert(m_cardinality_tree.size() == m_storage.m_number_segments && "The cardinality tree is not in sync with the storage");
 
     // determine the window to rebalance
     if(m_storage.height() > 1){
-        int64_t index_left = segment_id -1;
-        int64_t index_right = segment_id +1;
-
         do {
             height++;
             window_length *= 2;
@@ -359,15 +422,8 @@ void PackedMemoryArray::rebalance_find_window(size_t segment_id, bool is_inserti
             rho = density_bounds.first;
             theta = density_bounds.second;
 
-            // find the number of elements in the interval
-            while(index_left >= window_start){
-                cardinality_after += m_storage.m_segment_sizes[index_left];
-                index_left--;
-            }
-            while(index_right < window_end){
-                cardinality_after += m_storage.m_segment_sizes[index_right];
-                index_right++;
-            }
+            // find the number of elements in the interval, in O(log n)
+            cardinality_after = m_cardinality_tree.sum(window_start, window_end) + (is_insertion ? 1 : 0);
 
             density = ((double) cardinality_after) / (window_length * m_storage.m_segment_capacity);
 
@@ -453,7 +509,7 @@ RebalanceMetadata PackedMemoryArray::rebalance_plan(bool is_insert, int64_t wind
 
 void PackedMemoryArray::rebalance_run_apma(RebalanceMetadata& action) {
     // hack: pretend the new element has already been inserted
-    if(action.is_insert()){ m_storage.m_segment_sizes[action.m_insert_segment]++; }
+    if(action.is_insert()){ m_storage.m_segment_sizes[action.m_insert_segment]++; m_cardinality_tree.update(action.m_insert_segment, +1); }
 
     // detect the hammered segments/intervals
     size_t window_start = action.m_window_start;
@@ -463,7 +519,7 @@ void PackedMemoryArray::rebalance_run_apma(RebalanceMetadata& action) {
     int wbalance = weights_builder.balance(); // = amount of hammer insertions minus amount of hammer deletions
 
     // hack: readjust the cardinalities
-    if(action.is_insert()){ m_storage.m_segment_sizes[action.m_insert_segment]--; }
+    if(action.is_insert()){ m_storage.m_segment_sizes[action.m_insert_segment]--; m_cardinality_tree.update(action.m_insert_segment, -1); }
 
     MoveDetectorInfo mdi { *this, static_cast<size_t>( action.m_window_start ) }, *ptr_mdi = nullptr;
     if(action.m_operation == RebalanceOperation::REBALANCE){
@@ -479,6 +535,8 @@ void PackedMemoryArray::rebalance_run_apma(RebalanceMetadata& action) {
 
 
 void PackedMemoryArray::do_rebalance(const RebalanceMetadata& action) {
+    if(m_density_controller){ m_density_controller->record_rebalance(action.get_cardinality_after()); }
+
     switch(action.m_operation){
     case RebalanceOperation::REBALANCE: {
         if (action.m_window_length < m_storage.get_segments_per_extent()){
@@ -492,17 +550,24 @@ void PackedMemoryArray::do_rebalance(const RebalanceMetadata& action) {
     } break;
     case RebalanceOperation::RESIZE_REBALANCE: { // use rewiring
         COUT_DEBUG("REBALANCE RESIZE: cardinality: " << action.get_cardinality_after() << ", " << m_storage.m_number_segments << " -> " << action.m_window_length);
-        m_detector.resize(action.m_window_length);
+        detector_resize(action.m_window_length);
         resize_rebalance(action);
 
     } break;
     case RebalanceOperation::RESIZE: {
-        m_detector.resize(action.m_window_length);
+        detector_resize(action.m_window_length);
         resize(action);
     } break;
     default:
         assert(0 && "Invalid operation");
     }
+
+    // realign the cumulative cardinalities
+    if(action.m_operation == RebalanceOperation::REBALANCE){
+        m_cardinality_tree.refresh(m_storage.m_segment_sizes, action.m_window_start, action.m_window_length);
+    } else {
+        m_cardinality_tree.rebuild(m_storage.m_segment_sizes, m_storage.m_number_segments);
+    }
 }
 
 /*****************************************************************************
@@ -563,7 +628,7 @@ void PackedMemoryArray::spread_local(const RebalanceMetadata& action){
     assert(segment_id == action.m_window_length && "Not all segments visited");
 
     if(action.m_window_length == m_storage.m_number_segments)
-        m_detector.clear();
+        detector_clear();
 }
 
 
@@ -643,7 +708,7 @@ void PackedMemoryArray::spread_save(size_t segment_id, int64_t* keys_from, int64
     m_storage.m_segment_sizes[segment_id] = cardinality;
 
     if(detector_record && detector_record->m_position >= 0 && detector_record->m_position < cardinality)
-        m_detector.insert(segment_id, detector_record->m_predecessor, detector_record->m_successor);
+        detector_insert(segment_id, detector_record->m_predecessor, detector_record->m_successor);
 }
 
 void PackedMemoryArray::spread_save(size_t window_start, size_t window_length, int64_t* keys_from, int64_t* values_from, size_t cardinality, const spread_detector_record* detector_record){
@@ -666,7 +731,7 @@ void PackedMemoryArray::spread_save(size_t window_start, size_t window_length, i
             segment_id = odd_segments + detector_position / card_per_segment;
         }
         assert(segment_id < window_length && "Incorrect calculus");
-        m_detector.insert(window_start + segment_id, detector_record->m_predecessor, detector_record->m_successor);
+        detector_insert(window_start + segment_id, detector_record->m_predecessor, detector_record->m_successor);
     }
 
     // 2) set the segment sizes
@@ -752,17 +817,31 @@ void PackedMemoryArray::resize_rebalance(const RebalanceMetadata& action) {
 
     // 1) Extend the PMA
     if(num_segments_after > num_segments_before){ m_storage.extend(num_segments_after - num_segments_before); }
-    m_index.rebuild(num_segments_after);
 
     // 2) Spread
     SpreadWithRewiring rewiring_instance(this, 0, num_segments_after, action.m_apma_partitions );
     if(action.m_is_insert){ rewiring_instance.set_element_to_insert(action.m_insert_key, action.m_insert_value); }
     size_t start_position = (num_segments_before -1) * m_storage.m_segment_capacity + m_storage.m_segment_sizes[num_segments_before -1];
     rewiring_instance.set_absolute_position(start_position);
+    rewiring_instance.set_update_separator_keys(false);
     rewiring_instance.execute();
 
     // 3) Shrink the PMA
     if(num_segments_after < num_segments_before){ m_storage.shrink(num_segments_before - num_segments_after); }
+
+    // 4) Rebuild the index
+    rebuild_index();
+}
+
+void PackedMemoryArray::rebuild_index(){
+    const size_t num_segments = m_storage.m_number_segments;
+    unique_ptr<int64_t[]> separator_keys { new int64_t[num_segments] };
+    int64_t next_minimum = numeric_limits<int64_t>::max();
+    for(int64_t i = num_segments -1; i >= 0; i--){ // an empty segment takes the minimum of its successor, so that #find skips it
+        if(m_storage.m_segment_sizes[i] > 0){ next_minimum = m_storage.get_minimum(i); }
+        separator_keys[i] = next_minimum;
+    }
+    m_index.rebuild(num_segments, separator_keys.get(), m_index_build_threads);
 }
 
 /*****************************************************************************
@@ -796,8 +875,6 @@ void PackedMemoryArray::resize(const RebalanceMetadata& action) {
     int64_t* __restrict xValues = m_storage.m_values;
     decltype(m_storage.m_segment_sizes) __restrict xSizes = m_storage.m_segment_sizes;
 
-    m_index.rebuild(num_segments);
-
     // fetch the first non-empty input segment
     size_t input_segment_id = 0;
     size_t input_size = ixSizes[0];
@@ -837,8 +914,6 @@ void PackedMemoryArray::resize(const RebalanceMetadata& action) {
         int64_t* output_keys = xKeys + output_canonical_index + output_offset;
         int64_t* output_values = xValues + output_canonical_index + output_offset;
         xSizes[j] = elements_to_copy;
-        if(input_size > 0) // protect from the edge case: the first segment will contain only one element, that is the new element to be inserted
-            m_index.set_separator_key(j, input_keys[0]);
 
         do {
             assert(elements_to_copy <= m_storage.m_segment_capacity && "Overflow");
@@ -849,9 +924,7 @@ void PackedMemoryArray::resize(const RebalanceMetadata& action) {
                 // merge
                 input_copied = max<int64_t>(0, static_cast<int64_t>(cpy1) -1); // min = 0
                 output_copied = input_copied +1;
-                size_t position = spread_insert_unsafe(input_keys, input_values, output_keys, output_values, input_copied, action.m_insert_key, action.m_insert_value);
-                if(position == 0 && output_keys == xKeys + output_canonical_index + output_offset)
-                    m_index.set_separator_key(j, action.m_insert_key);
+                spread_insert_unsafe(input_keys, input_values, output_keys, output_values, input_copied, action.m_insert_key, action.m_insert_value);
                 do_insert = false;
             } else {
                 input_copied = output_copied = cpy1;
@@ -897,9 +970,8 @@ void PackedMemoryArray::resize(const RebalanceMetadata& action) {
         // should we insert a new element in this bucket
         if(do_insert && action.m_insert_key < output_keys[-1]){
             int64_t predecessor, successor;
-            auto min = m_storage.insert(j, action.m_insert_key, action.m_insert_value, &predecessor, &successor);
-            m_detector.insert(j, predecessor, successor);
-            if(min) m_index.set_separator_key(j, action.m_insert_key); // update the minimum in the B+ tree
+            m_storage.insert(j, action.m_insert_key, action.m_insert_value, &predecessor, &successor);
+            detector_insert(j, predecessor, successor);
             do_insert = false;
         }
 
@@ -922,14 +994,15 @@ void PackedMemoryArray::resize(const RebalanceMetadata& action) {
     // if the element hasn't been inserted yet, it means it has to be placed in the last segment
     if(do_insert){
         int64_t predecessor, successor;
-        auto min = m_storage.insert(num_segments -1, action.m_insert_key, action.m_insert_value, &predecessor, &successor);
-        m_detector.insert(num_segments -1, predecessor, successor);
-        if(min) m_index.set_separator_key(num_segments -1, action.m_insert_key); // update the minimum in the B+ tree
+        m_storage.insert(num_segments -1, action.m_insert_key, action.m_insert_value, &predecessor, &successor);
+        detector_insert(num_segments -1, predecessor, successor);
         do_insert = false;
     }
 
     // update the PMA properties
     m_storage.m_number_segments = num_segments;
+
+    rebuild_index();
 }
 
 /*****************************************************************************
@@ -1020,7 +1093,9 @@ unique_ptr<::pma::Iterator> PackedMemoryArray::iterator() const {
  *                                                                           *
  *****************************************************************************/
 ::pma::Interface::SumResult PackedMemoryArray::sum(int64_t min, int64_t max) const {
-    return do_sum(m_storage, m_index.find_first(min), m_index.find_last(max), min, max );
+    auto result = do_sum(m_storage, m_index.find_first(min), m_index.find_last(max), min, max );
+    if(m_density_controller){ m_density_controller->record_scan(result.m_num_elements); }
+    return result;
 }
 
 /*****************************************************************************
@@ -1161,6 +1236,36 @@ void PackedMemoryArray::set_record_segment_statistics(bool value) {
     m_segment_statistics = value;
 }
 
+void PackedMemoryArray::set_index_build_threads(uint64_t num_threads) {
+    m_index_build_threads = max<uint64_t>(num_threads, 1);
+}
+
+void PackedMemoryArray::set_weights_threads(uint64_t num_threads) {
+    m_weights_threads = max<uint64_t>(num_threads, 1);
+}
+
+void PackedMemoryArray::set_sketch_detector(bool value) {
+    if(!value){
+        if(m_sketch_detector){
+            m_sketch_detector.reset();
+            m_detector.resize(m_storage.m_number_segments);
+        }
+    } else if(!m_sketch_detector){
+        m_sketch_detector.reset(new SketchDetector(m_knobs));
+        m_sketch_detector->resize(m_storage.m_number_segments);
+        m_detector.resize(1); // unused
+    }
+}
+
+void PackedMemoryArray::set_adaptive_densities(bool value) {
+    if(!value){
+        m_density_controller.reset(); // keep the current thresholds
+    } else if(!m_density_controller){
+        // theta_h >= 0.6, as a deletion shrinks the array when its density falls below 0.5
+        m_density_controller.reset(new DensityController(m_density_bounds1.get_upper_threshold_root()));
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Dump                                                                    *
@@ -1186,7 +1291,11 @@ void PackedMemoryArray::dump(std::ostream& out) const {
 
     out << "\n";
 
-    m_detector.dump(out);
+    if(m_sketch_detector){
+        m_sketch_detector->dump(out);
+    } else {
+        m_detector.dump(out);
+    }
 
     assert(integrity_check && "Integrity check failed!");
 }
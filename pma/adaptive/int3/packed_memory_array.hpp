@@ -22,6 +22,7 @@
 #include <random>
 
 #include "pma/density_bounds.hpp"
+#include "pma/generic/fenwick_tree.hpp"
 #include "pma/interface.hpp"
 #include "pma/iterator.hpp"
 #include "detector.hpp"
@@ -29,6 +30,7 @@
 #include "memory_pool.hpp"
 #include "partition.hpp"
 #include "rebalance_metadata.hpp"
+#include "sketch_detector.hpp"
 #include "static_abtree.hpp"
 #include "storage.hpp"
 
@@ -43,13 +45,18 @@ class PackedMemoryArray : public InterfaceRQ {
 private:
     StaticABTree m_index;
     Storage m_storage;
+    FenwickTree m_cardinality_tree; // cumulative cardinalities of the segments, to compute the density of a window in O(log n)
     Knobs m_knobs; // APMA settings
     Detector m_detector;
+    std::unique_ptr<SketchDetector> m_sketch_detector; // alternative to m_detector with a fixed memory footprint, nullptr if disabled
     CachedDensityBounds m_density_bounds0; // user thresholds (for num_segments<=balanced_thresholds_cutoff())
     CachedDensityBounds m_density_bounds1; // primary thresholds (for num_segmnets>balanced_thresholds_cutoff())
+    std::unique_ptr<DensityController> m_density_controller; // tune the thresholds according to the workload, nullptr if disabled
     CachedMemoryPool m_memory_pool;
     bool m_segment_statistics = false; // record segment statistics at the end?
     bool m_primary_densities = false; // use the primary thresholds?
+    uint64_t m_index_build_threads = 1; // max number of threads to rebuild the index after a resize
+    uint64_t m_weights_threads = 1; // max number of threads to detect the hammered segments in large windows
 
     // Insert the first element in the (empty) container
     void insert_empty(int64_t key, int64_t value);
@@ -87,6 +94,9 @@ private:
     // Spread (with rewiring) the elements in the given window
     void resize_rebalance(const RebalanceMetadata& action);
 
+    // Rebuild the whole index from the minima of the segments, after a resize
+    void rebuild_index();
+
     // Spread (without rewiring) the elements in the given window
     void spread_local(const RebalanceMetadata& action);
     struct spread_detector_record{ int64_t m_position; int64_t m_predecessor; int64_t m_successor; };
@@ -108,6 +118,16 @@ private:
     // Retrieve the number of segments after that the primary thresholds are used
     size_t balanced_thresholds_cutoff() const;
 
+    // With the adaptive densities, at the end of an epoch, move the thresholds according to the recent workload
+    void adapt_densities();
+
+    // Record an update, or reset the recordings, in the detector in use
+    void detector_insert(size_t segment_id, int64_t predecessor, int64_t successor);
+    void detector_remove(size_t segment_id, int64_t predecessor, int64_t successor);
+    void detector_clear();
+    void detector_clear(size_t segment_id);
+    void detector_resize(size_t num_segments);
+
     // Returns an empty iterator, i.e. with an empty record set!
     std::unique_ptr<pma::Iterator> empty_iterator() const;
 
@@ -164,12 +184,32 @@ public:
     // Whether to save segment statistics, at the end, in the table `btree_leaf_statistics' ?
     void set_record_segment_statistics(bool value);
 
+    // Max number of threads to rebuild the index after a resize
+    void set_index_build_threads(uint64_t num_threads);
+
+    // Max number of threads to fetch and rank the timestamps of the detector, for the largest windows to rebalance
+    void set_weights_threads(uint64_t num_threads);
+
+    // Detect the hammered segments with a count-min sketch and a fixed table of heavy hitters, rather than keeping
+    // a number of timestamps for each segment. The memory overhead no longer depends on the number of segments.
+    void set_sketch_detector(bool value);
+
+    // Tune the density thresholds online, according to the recent mix of updates & scans and the cost of the rebalances.
+    // The new thresholds are applied at the next rebalance or resize.
+    void set_adaptive_densities(bool value);
+
+    // Retrieve the controller of the adaptive densities, or nullptr if disabled
+    const DensityController* get_density_controller() const noexcept { return m_density_controller.get(); }
+
     // Accessor to the underlying memory pool
     CachedMemoryPool& memory_pool();
 
     // Accessor to the underlying predictor/detector
     Detector& detector();
 
+    // Accessor to the sketch based detector, or nullptr if disabled
+    SketchDetector* sketch_detector();
+
     // Retrieve the densities currently in use
     const CachedDensityBounds& get_thresholds() const;
 
@@ -0,0 +1,413 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sketch_detector.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "errorhandling.hpp"
+#include "miscellaneous.hpp"
+
+using namespace std;
+
+/*****************************************************************************
+ *                                                                           *
+ *   DEBUG                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) std::cout << "[SketchDetector::" << __FUNCTION__ << "] " << msg << std::endl
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+namespace pma { namespace adaptive { namespace int3 {
+
+// multipliers for the hash functions of the count-min sketch, odd constants from splitmix64 & murmur3
+static constexpr uint64_t SKETCH_SEEDS[] = { 0x9E3779B97F4A7C15ull, 0xBF58476D1CE4E5B9ull, 0x94D049BB133111EBull, 0xFF51AFD7ED558CCDull,
+                                             0xC4CEB9FE1A85EC53ull, 0x87C37B91114253D5ull, 0x4CF5AD432745937Full, 0x52DCE729DA3ED2B9ull };
+static constexpr size_t SKETCH_MAX_DEPTH = sizeof(SKETCH_SEEDS) / sizeof(SKETCH_SEEDS[0]);
+
+// number of buckets inspected to select a victim, when the table of the heavy hitters is full
+static constexpr size_t EVICTION_SAMPLES = 8;
+
+// min estimated frequency, in the sketch, to promote a segment to a heavy hitter
+static constexpr uint32_t ADMISSION_THRESHOLD = 3;
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+SketchDetector::SketchDetector(Knobs& knobs, size_t num_heavy_hitters, size_t sketch_width, size_t sketch_depth) :
+        m_knobs(knobs),
+        m_sketch_width(hyperceil(max<size_t>(sketch_width, 2))),
+        m_sketch_depth(sketch_depth),
+        m_sketch_shift(64 - static_cast<int>(log2(m_sketch_width))),
+        m_entries_capacity(hyperceil(2 * max<size_t>(num_heavy_hitters, EVICTION_SAMPLES))),
+        m_entries_shift(64 - static_cast<int>(log2(m_entries_capacity))) {
+    if(sketch_depth < 1 || sketch_depth > SKETCH_MAX_DEPTH){ throw invalid_argument("[SketchDetector] Invalid value for the depth of the sketch"); }
+
+    int rc = posix_memalign((void**) &m_sketch, /* alignment */ 64, m_sketch_width * m_sketch_depth * sizeof(m_sketch[0]));
+    if(rc != 0){ RAISE_EXCEPTION(Exception, "[SketchDetector] Cannot allocate the sketch, " << m_sketch_width << " x " << m_sketch_depth << " counters"); }
+    rc = posix_memalign((void**) &m_entries, /* alignment */ 64, m_entries_capacity * sizeof(m_entries[0]));
+    if(rc != 0){ free(m_sketch); m_sketch = nullptr; RAISE_EXCEPTION(Exception, "[SketchDetector] Cannot allocate the heavy hitters, capacity: " << m_entries_capacity); }
+
+    resize(1);
+}
+
+SketchDetector::~SketchDetector(){
+    free(m_sketch); m_sketch = nullptr;
+    free(m_entries); m_entries = nullptr;
+}
+
+void SketchDetector::clear(){
+    memset(m_sketch, 0, m_sketch_width * m_sketch_depth * sizeof(m_sketch[0]));
+    memset(m_entries, 0, m_entries_capacity * sizeof(m_entries[0]));
+    m_entries_size = 0;
+    m_updates = 0;
+}
+
+void SketchDetector::clear(uint64_t segment_id){
+    int64_t bucket = find(segment_id);
+    if(bucket >= 0) remove_entry(bucket);
+}
+
+void SketchDetector::resize(size_t size){
+    // Halve the counters once all segments received, on average, one update each. Do not decay more often than once
+    // every m_entries_capacity updates, to keep the cost of #decay amortised.
+    m_decay_period = max<uint64_t>(size, m_entries_capacity);
+    clear();
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Heavy hitters                                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+size_t SketchDetector::hash_entry(uint64_t segment_id) const {
+    return ((segment_id +1) * SKETCH_SEEDS[0]) >> m_entries_shift;
+}
+
+size_t SketchDetector::entries_max() const {
+    return m_entries_capacity / 2;
+}
+
+int64_t SketchDetector::find(uint64_t segment_id) const {
+    const size_t mask = m_entries_capacity -1;
+    size_t bucket = hash_entry(segment_id);
+    while(m_entries[bucket].m_segment != 0){
+        if(m_entries[bucket].m_segment == segment_id +1) return bucket;
+        bucket = (bucket +1) & mask;
+    }
+    return -1;
+}
+
+size_t SketchDetector::insert_entry(const Entry& entry){
+    assert(entry.m_segment != 0 && "Invalid segment");
+    assert(m_entries_size < entries_max() && "No space left");
+    const size_t mask = m_entries_capacity -1;
+    size_t bucket = hash_entry(entry.segment());
+    while(m_entries[bucket].m_segment != 0){
+        bucket = (bucket +1) & mask;
+    }
+    m_entries[bucket] = entry;
+    m_entries_size++;
+    return bucket;
+}
+
+void SketchDetector::remove_entry(size_t hole){
+    assert(m_entries[hole].m_segment != 0 && "Empty bucket");
+    const size_t mask = m_entries_capacity -1;
+    size_t bucket = hole;
+    while(true){
+        bucket = (bucket +1) & mask;
+        if(m_entries[bucket].m_segment == 0) break;
+
+        // can the entry in `bucket' be moved back to fill the hole?
+        size_t home = hash_entry(m_entries[bucket].segment());
+        bool move_back = (hole <= bucket) ? (home <= hole || home > bucket) : (home <= hole && home > bucket);
+        if(move_back){
+            m_entries[hole] = m_entries[bucket];
+            hole = bucket;
+        }
+    }
+    m_entries[hole].m_segment = 0;
+    m_entries_size--;
+}
+
+bool SketchDetector::evict(uint32_t frequency){
+    const size_t mask = m_entries_capacity -1;
+    int64_t victim = -1;
+    size_t num_samples = 0;
+
+    // as the load factor is at most 0.5, the loop terminates after a few iterations
+    while(num_samples < EVICTION_SAMPLES){
+        size_t bucket = m_clock;
+        m_clock = (m_clock +1) & mask;
+        if(m_entries[bucket].m_segment == 0) continue;
+        if(victim == -1 || m_entries[bucket].m_frequency < m_entries[victim].m_frequency){ victim = bucket; }
+        num_samples++;
+    }
+
+    if(m_entries[victim].m_frequency < frequency){
+        COUT_DEBUG("evict segment " << m_entries[victim].segment() << ", frequency: " << m_entries[victim].m_frequency);
+        remove_entry(victim);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+bool SketchDetector::extract(uint64_t segment_id, Entry* out){
+    int64_t bucket = find(segment_id);
+    if(bucket < 0) return false;
+    *out = m_entries[bucket];
+    remove_entry(bucket);
+    return true;
+}
+
+void SketchDetector::restore(uint64_t segment_id, const Entry& entry){
+    int64_t bucket = find(segment_id);
+    if(bucket >= 0){
+        remove_entry(bucket);
+    } else if(m_entries_size >= entries_max()){
+        evict(numeric_limits<uint32_t>::max()); // always succeeds, the frequencies are < 2^16
+    }
+    Entry copy = entry;
+    copy.m_segment = segment_id +1;
+    insert_entry(copy);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Sketch                                                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+uint32_t SketchDetector::sketch_update(uint64_t segment_id){
+    constexpr uint16_t counter_max = numeric_limits<uint16_t>::max();
+    size_t positions[SKETCH_MAX_DEPTH];
+    uint16_t minimum = counter_max;
+    for(size_t r = 0; r < m_sketch_depth; r++){
+        positions[r] = r * m_sketch_width + (((segment_id +1) * SKETCH_SEEDS[r]) >> m_sketch_shift);
+        minimum = min(minimum, m_sketch[positions[r]]);
+    }
+
+    // conservative update: only increment the counters that determine the estimate
+    if(minimum < counter_max){
+        for(size_t r = 0; r < m_sketch_depth; r++){
+            if(m_sketch[positions[r]] == minimum) m_sketch[positions[r]]++;
+        }
+        minimum++;
+    }
+
+    return minimum;
+}
+
+uint32_t SketchDetector::estimate(uint64_t segment_id) const {
+    uint16_t minimum = numeric_limits<uint16_t>::max();
+    for(size_t r = 0; r < m_sketch_depth; r++){
+        minimum = min(minimum, m_sketch[r * m_sketch_width + (((segment_id +1) * SKETCH_SEEDS[r]) >> m_sketch_shift)]);
+    }
+    return minimum;
+}
+
+void SketchDetector::decay(){
+    COUT_DEBUG("updates: " << m_updates << ", heavy hitters: " << m_entries_size);
+    for(size_t i = 0, sz = m_sketch_width * m_sketch_depth; i < sz; i++){
+        m_sketch[i] >>= 1;
+    }
+    for(size_t i = 0; i < m_entries_capacity; i++){
+        Entry& entry = m_entries[i];
+        // stale entries are not removed here, they are simply the first candidates for eviction
+        entry.m_frequency >>= 1;
+    }
+    m_updates = 0;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Update                                                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+template<int increment>
+void SketchDetector::update(size_t segment_id, int64_t predecessor, int64_t successor){
+    if(++m_updates >= m_decay_period) decay();
+    int64_t timestamp = ++m_counter;
+    uint32_t frequency = sketch_update(segment_id);
+
+    int16_t sequence_count_max = static_cast<int16_t>(m_knobs.get_max_sequence_counter());
+    int16_t sequence_count_min = -sequence_count_max;
+    int16_t segment_count_max = static_cast<int16_t>(m_knobs.get_max_segment_counter());
+
+    int64_t bucket = find(segment_id);
+    if(bucket < 0){ // promote the segment to a heavy hitter?
+        if(frequency < ADMISSION_THRESHOLD) return;
+        if(m_entries_size >= entries_max() && !evict(frequency)) return;
+
+        // the previous updates were only recorded in the sketch, assume they all had the same sign of this one
+        Entry entry {};
+        entry.m_segment = segment_id +1;
+        entry.m_count_segment = increment * (min<int>(frequency, segment_count_max) -1);
+        entry.m_frequency = frequency -1;
+        bucket = insert_entry(entry);
+    }
+    Entry& entry = m_entries[bucket];
+    if(entry.m_frequency < numeric_limits<uint16_t>::max()){ entry.m_frequency++; }
+    entry.m_timestamps[entry.m_timestamps_head] = timestamp;
+    entry.m_timestamps_head = (entry.m_timestamps_head +1) % NUM_TIMESTAMPS;
+
+    // segment counter, same state machine of Detector::update
+    if(entry.m_count_segment * increment >= 0){
+        if((entry.m_count_segment * increment) < segment_count_max){
+            entry.m_count_segment += increment;
+        }
+    } else { // decrease by 2
+        entry.m_count_segment = entry.m_count_segment + 2 * increment;
+    }
+
+    // sequence counter
+    if(successor == entry.m_key_bwd){ // direction forwards
+        if((increment > 0 && entry.m_count_bwd < sequence_count_max) || (increment < 0 && entry.m_count_bwd > sequence_count_min)){
+            entry.m_count_bwd += increment;
+        }
+    } else if (predecessor == entry.m_key_fwd){ // direction backwards
+        if((increment > 0 && entry.m_count_fwd < sequence_count_max) || (increment < 0 && entry.m_count_fwd > sequence_count_min)){
+            entry.m_count_fwd += increment;
+        }
+    } else {
+        if(entry.m_count_fwd == 0){
+            entry.m_count_fwd += increment;
+            entry.m_key_fwd = predecessor;
+        } else {
+            entry.m_count_fwd -= increment;
+        }
+        if(entry.m_count_bwd == 0){
+            entry.m_count_bwd += increment;
+            entry.m_key_bwd = successor;
+        } else {
+            entry.m_count_bwd -= increment;
+        }
+    }
+}
+
+void SketchDetector::insert(uint64_t segment, int64_t predecessor, int64_t successor){
+    update<+1>(segment, predecessor, successor);
+}
+
+void SketchDetector::remove(uint64_t segment, int64_t predecessor, int64_t successor){
+    update<-1>(segment, predecessor, successor);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Query                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+
+void SketchDetector::hammered(uint64_t window_start, uint64_t window_length, std::vector<Entry>& out) const {
+    out.clear();
+    const int64_t segment_threshold = m_knobs.get_segment_threshold();
+
+    // As the Detector, select the segments whose oldest timestamp is greater than the timestamp with the given rank among
+    // all timestamps recorded in the window
+    vector<int64_t> timestamps; // all timestamps of the heavy hitters in the window
+    auto visit = [&](const Entry& entry){
+        for(int i = 0; i < NUM_TIMESTAMPS; i++){
+            if(entry.m_timestamps[i] != 0) timestamps.push_back(entry.m_timestamps[i]);
+        }
+        if(abs(entry.m_count_segment) > segment_threshold){ out.push_back(entry); }
+    };
+
+    // 1) retrieve the candidates in the window
+    if(window_length <= m_entries_capacity / EVICTION_SAMPLES){ // small window, probe the segments one by one
+        for(uint64_t segment_id = window_start, end = window_start + window_length; segment_id < end; segment_id++){
+            int64_t bucket = find(segment_id);
+            if(bucket >= 0){ visit(m_entries[bucket]); }
+        }
+    } else {
+        for(size_t i = 0; i < m_entries_capacity; i++){
+            const Entry& entry = m_entries[i];
+            if(entry.m_segment == 0) continue;
+            if(entry.segment() < window_start || entry.segment() >= window_start + window_length) continue;
+            visit(entry);
+        }
+        sort(begin(out), end(out), [](const Entry& e1, const Entry& e2){ return e1.m_segment < e2.m_segment; });
+    }
+    if(out.empty()) return;
+
+    // 2) the threshold for the timestamps, the same rank of Weights::Weights
+    size_t rank_position = static_cast<size_t>(m_knobs.get_rank_threshold() * timestamps.size());
+    rank_position = min<size_t>(rank_position, timestamps.size() > NUM_TIMESTAMPS ? timestamps.size() - NUM_TIMESTAMPS : 0);
+    nth_element(begin(timestamps), begin(timestamps) + rank_position, end(timestamps));
+    int64_t select_threshold = max<int64_t>(timestamps[rank_position], 1);
+
+    // 3) filter the candidates
+    out.erase(remove_if(begin(out), end(out), [select_threshold](const Entry& entry){
+        return entry.timestamp_min() < select_threshold;
+    }), end(out));
+}
+
+size_t SketchDetector::size() const {
+    return m_entries_size;
+}
+
+size_t SketchDetector::memory_footprint() const {
+    return sizeof(SketchDetector) + m_sketch_width * m_sketch_depth * sizeof(m_sketch[0]) + m_entries_capacity * sizeof(m_entries[0]);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Dump                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+void SketchDetector::dump(std::ostream& out) const {
+    out << "[SketchDetector] sketch: " << m_sketch_depth << " x " << m_sketch_width << ", heavy hitters: " << m_entries_size << "/" << entries_max() <<
+            ", updates since the last decay: " << m_updates << "/" << m_decay_period << "\n";
+
+    std::vector<Entry> entries;
+    for(size_t i = 0; i < m_entries_capacity; i++){
+        if(m_entries[i].m_segment != 0) entries.push_back(m_entries[i]);
+    }
+    sort(begin(entries), end(entries), [](const Entry& e1, const Entry& e2){ return e1.m_segment < e2.m_segment; });
+    for(auto& e : entries){
+        out << "[" << e.segment() << "] sc: " << e.m_count_segment << ", fwd: " << e.m_key_fwd << "(" << e.m_count_fwd << "), bwd: " <<
+                e.m_key_bwd << "(" << e.m_count_bwd << "), frequency: " << e.m_frequency << "\n";
+    }
+
+    flush(out);
+}
+
+void SketchDetector::dump() const {
+    dump(cout);
+}
+
+}}} // pma::adaptive::int3
@@ -0,0 +1,182 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PMA_ADAPTIVE_INT3_SKETCH_DETECTOR_HPP_
+#define PMA_ADAPTIVE_INT3_SKETCH_DETECTOR_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "knobs.hpp"
+
+namespace pma { namespace adaptive { namespace int3 {
+
+/**
+ * Alternative to the Detector, to recognise the hammered segments with a fixed amount of memory, independent of
+ * the number of segments in the PMA.
+ *
+ * Each update is first recorded in a count-min sketch, with conservative updates, over the segment ids. Only the
+ * segments whose estimated frequency reaches a small admission threshold are promoted to a table of heavy hitters,
+ * which tracks the same state of the Detector: the insert/delete counter of the segment, the fwd/bwd sequence
+ * counters and the timestamps of the last updates. The counters of the sketch are halved every `number of segments'
+ * updates, so that the segments updated in the past fade away and can be evicted from the heavy hitters.
+ */
+class SketchDetector {
+public:
+    static constexpr int NUM_TIMESTAMPS = 8; // number of timestamps recorded for each heavy hitter, as the modulus of the Detector
+
+    struct Entry {
+        uint64_t m_segment; // the segment id + 1, 0 for an empty bucket
+        int64_t m_key_fwd; // last predecessor recorded
+        int64_t m_key_bwd; // last successor recorded
+        int16_t m_count_fwd; // sequence counter on the predecessor m_key_fwd, i.e. a sequence of decreasing keys (backwards)
+        int16_t m_count_bwd; // sequence counter on the successor m_key_bwd, i.e. a sequence of increasing keys (forwards)
+        int16_t m_count_segment; // insertions minus deletions in the segment
+        uint16_t m_frequency; // decayed number of updates, to select the entry to evict
+        int64_t m_timestamps[NUM_TIMESTAMPS]; // circular buffer with the timestamps of the last updates, 0 if not set
+        uint32_t m_timestamps_head; // next position to overwrite in m_timestamps, i.e. the oldest timestamp
+
+        // The segment id associated to this entry
+        uint64_t segment() const { return m_segment -1; }
+
+        // The oldest of the last NUM_TIMESTAMPS timestamps, or 0 if fewer updates have been recorded
+        int64_t timestamp_min() const { return m_timestamps[m_timestamps_head]; }
+    };
+
+private:
+    Knobs& m_knobs; // apma settings
+    uint16_t* m_sketch = nullptr; // count-min sketch, m_sketch_depth rows of m_sketch_width counters each
+    const uint32_t m_sketch_width; // number of counters in each row, a power of 2
+    const uint32_t m_sketch_depth; // number of rows, i.e. hash functions
+    const int m_sketch_shift; // 64 - log2(m_sketch_width)
+    Entry* m_entries = nullptr; // heavy hitters, open addressing hash table (linear probing) on the segment id
+    const uint32_t m_entries_capacity; // number of buckets in m_entries, a power of 2
+    uint32_t m_entries_size = 0; // number of heavy hitters currently tracked
+    const int m_entries_shift; // 64 - log2(m_entries_capacity)
+    uint32_t m_clock = 0; // position of the clock hand to select the victims for eviction
+    uint64_t m_updates = 0; // number of updates since the last decay
+    int64_t m_counter = 0; // timestamp of the last update
+    uint64_t m_decay_period; // number of updates after which all counters are halved, it depends on the number of segments
+
+    template<int increment>
+    void update(size_t segment_id, int64_t predecessor, int64_t successor);
+
+    // Record the update in the sketch and return the (estimated) frequency of the segment
+    uint32_t sketch_update(uint64_t segment_id);
+
+    // Halve all counters
+    void decay();
+
+    // Bucket of the heavy hitter for the given segment, or -1 if the segment is not tracked
+    int64_t find(uint64_t segment_id) const;
+
+    // Insert a new heavy hitter, assuming it's not already present and there is space left. Return its bucket.
+    size_t insert_entry(const Entry& entry);
+
+    // Remove the heavy hitter in the given bucket, shifting back the subsequent entries in its cluster
+    void remove_entry(size_t bucket);
+
+    // Evict the heavy hitter with the lowest frequency among the next buckets pointed by the clock hand, if its
+    // frequency is lower than the given one. Return true if an entry has been evicted.
+    bool evict(uint32_t frequency);
+
+    // Home bucket of the given segment in the heavy hitters
+    size_t hash_entry(uint64_t segment_id) const;
+
+    // Max number of heavy hitters that can be tracked (load factor 0.5)
+    size_t entries_max() const;
+
+public:
+    /**
+     * Create a new instance with room for `num_heavy_hitters' segments and a sketch of `sketch_depth' x `sketch_width' counters
+     */
+    SketchDetector(Knobs& knobs, size_t num_heavy_hitters = 1024, size_t sketch_width = 4096, size_t sketch_depth = 4);
+
+    ~SketchDetector();
+
+    /**
+     * Record an insertion
+     */
+    void insert(uint64_t segment, int64_t predecessor, int64_t successor);
+
+    /**
+     * Record a deletion
+     */
+    void remove(uint64_t segment, int64_t predecessor, int64_t successor);
+
+    /**
+     * Reset the recordings
+     */
+    void clear();
+
+    /**
+     * Reset the recordings of only a particular segment
+     */
+    void clear(uint64_t segment_id);
+
+    /**
+     * Invoked when the number of segments changes. As the segment ids are not valid anymore, it clears all recordings.
+     * The number of segments also determines how often the counters are halved.
+     */
+    void resize(size_t size);
+
+    /**
+     * Detach the recordings of the given segment, to later reassign them to another segment with #restore.
+     * Return false if the segment is not tracked.
+     */
+    bool extract(uint64_t segment_id, Entry* out);
+
+    /**
+     * Assign the recordings previously extracted to the given segment
+     */
+    void restore(uint64_t segment_id, const Entry& entry);
+
+    /**
+     * Retrieve the segments hammered in the window [window_start, window_start + window_length), sorted by segment id.
+     * As in the Detector, a segment is hammered if the absolute value of its counter is greater than the segment
+     * threshold of the knobs and its last updates are among the most recent in the window, according to the rank
+     * threshold of the knobs.
+     */
+    void hammered(uint64_t window_start, uint64_t window_length, std::vector<Entry>& out) const;
+
+    /**
+     * Estimated number of updates recorded for the given segment, since the last decay
+     */
+    uint32_t estimate(uint64_t segment_id) const;
+
+    /**
+     * Number of heavy hitters currently tracked
+     */
+    size_t size() const;
+
+    /**
+     * Amount of memory used, in bytes. It does not depend on the number of segments.
+     */
+    size_t memory_footprint() const;
+
+    /**
+     * Dump the content of the data structure, for debug purposes.
+     */
+    void dump(std::ostream& out) const;
+    void dump() const;
+};
+
+}}} // pma::adaptive::int3
+
+#endif /* PMA_ADAPTIVE_INT3_SKETCH_DETECTOR_HPP_ */
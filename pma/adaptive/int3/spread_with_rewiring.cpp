@@ -337,8 +337,10 @@ void SpreadWithRewiring::spread_elements(int64_t* __restrict destination_keys, i
             }
         }
 
-        m_instance.m_index.set_separator_key(segment_base + output_segment_id_rel, output_keys[0]);
-        m_instance.m_index.set_separator_key(segment_base + output_segment_id_rel + 1, output_keys[output_run_sz_lhs]);
+        if(m_update_separator_keys){
+            m_instance.m_index.set_separator_key(segment_base + output_segment_id_rel, output_keys[0]);
+            m_instance.m_index.set_separator_key(segment_base + output_segment_id_rel + 1, output_keys[output_run_sz_lhs]);
+        }
 
         COUT_DEBUG("output segments: " << (segment_base + output_segment_id_rel) << " and " << (segment_base + output_segment_id_rel +1) << "; "
                 "output_run_sz: " << (output_run_sz_lhs + output_run_sz_rhs) << ", first element: " << output_keys[0] << ", last element: " << output_keys[(output_run_sz_lhs + output_run_sz_rhs) -1]);
@@ -460,7 +462,7 @@ void SpreadWithRewiring::finalize_insert(){
     assert(m_insert_successor != -1 && "Invalid value for the predecessor, it should be either >= 0 || int64_t::max");
     m_instance.m_storage.m_cardinality++;
     COUT_DEBUG("key: " << m_insert_key << ", value: " << m_insert_value << ", segment: " << m_insert_to_segment << ", predecessor: " << m_insert_predecessor << ", successor: " << m_insert_successor);
-    m_instance.m_detector.insert(m_insert_to_segment, m_insert_predecessor, m_insert_successor);
+    m_instance.detector_insert(m_insert_to_segment, m_insert_predecessor, m_insert_successor);
 }
 
 void SpreadWithRewiring::update_segment_sizes(){
@@ -509,4 +511,8 @@ void SpreadWithRewiring::set_absolute_position(size_t position){
     m_position = position;
 }
 
+void SpreadWithRewiring::set_update_separator_keys(bool value){
+    m_update_separator_keys = value;
+}
+
 }}} // pma::adaptive::int3
@@ -43,6 +43,7 @@ protected:
     std::deque<Extent2Rewire> m_extents_to_rewire; // a list of extents to be rewired
     size_t m_partition_id = 0; // current partition
     size_t m_partition_offset = 0; // current offset in the partition
+    bool m_update_separator_keys = true; // whether to set the separator keys of the index, otherwise the caller rebuilds the whole index
 
 
 // whether to insert a new element during the rebalancing
@@ -193,6 +194,12 @@ public:
      */
     void set_absolute_position(size_t position);
 
+    /**
+     * Whether to set the separator keys in the index while spreading, true by default. Skip it when the caller
+     * rebuilds the whole index afterwards.
+     */
+    void set_update_separator_keys(bool value);
+
     /**
      * Helper, get the cardinality for the partition at the given position/offset
      */
@@ -17,13 +17,16 @@
 
 #include "weights.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <future>
 #include <iostream>
 #include <stdexcept>
 #include "detector.hpp"
 #include "errorhandling.hpp"
 #include "memory_pool.hpp"
 #include "packed_memory_array.hpp"
+#include "sketch_detector.hpp"
 
 using namespace std;
 
@@ -44,6 +47,7 @@ namespace pma { namespace adaptive { namespace int3 {
 
 Weights::Weights(PackedMemoryArray& pma, size_t segment_start, size_t segment_length) :
         m_pma(pma), m_cardinalities(pma.m_storage.m_segment_sizes), m_segment_start(segment_start), m_segment_length(segment_length),
+        m_num_threads(max<size_t>(1, min<size_t>(pma.m_weights_threads, segment_length / MIN_SEGMENTS_PER_THREAD))),
         m_output{ m_pma.memory_pool().allocator<Interval>() }
 {
     double threshold = m_pma.knobs().get_rank_threshold();
@@ -57,6 +61,18 @@ Weights::Weights(PackedMemoryArray& pma, size_t segment_start, size_t segment_le
 #endif
 
 
+    // step 0: the number of elements preceding each segment. For large windows, retrieve them from the cumulative
+    // cardinalities maintained by the PMA, rather than scanning the whole window
+    if(m_segment_length < MIN_SEGMENTS_PER_THREAD){ prefix_sum_cardinalities(); }
+    m_cardinality_window = get_cardinality_upto_excl(m_segment_length);
+
+    // with the sketch, the detector directly reports the hammered segments in the window, skip steps 1 & 2
+    if(m_pma.sketch_detector() != nullptr){
+        detect_hammered_sketch();
+        remove_neutral();
+        return;
+    }
+
     size_t sz = m_pma.detector().modulus() * m_segment_length;
     m_timestamps = m_pma.memory_pool().allocate<int64_t>(sz);
 
@@ -78,19 +94,16 @@ Weights::Weights(PackedMemoryArray& pma, size_t segment_start, size_t segment_le
         int rank_max = max<int>(0, static_cast<int>(m_timestamps_length) - m_pma.detector().modulus());
         rank_position = min(rank_position, rank_max);
 
-        select_threshold = rank(rank_position);
+        select_threshold = (m_num_threads == 1) ? rank(rank_position) : rank_parallel(rank_position);
         COUT_DEBUG("Rank: " << rank_position << ", value: " << select_threshold);
     } else {
         select_threshold = std::numeric_limits<int64_t>::max();
     }
 
-    // step 3: prefix sum the cardinalities, to quick discover how many elements precede a given segment
-    prefix_sum_cardinalities();
-
-    // step 4: finally identify the intervals that satisfy these weights
+    // step 3: finally identify the intervals that satisfy these weights
     detect_hammered(select_threshold);
 
-    // step 5: remove neutral intervals. This is an edge case, it represents intervals created when two hammered
+    // step 4: remove neutral intervals. This is an edge case, it represents intervals created when two hammered
     // intervals with conflicting signs (insertions/deletions) have been detected
     remove_neutral();
 
@@ -108,6 +121,24 @@ Weights::~Weights(){
     memory_pool.deallocate(m_prefix_sum_cardinalities); m_prefix_sum_cardinalities = nullptr;
 }
 
+template<typename Function>
+void Weights::parallel_for(Function fn){
+    if(m_num_threads == 1){
+        fn(/* thread id */ 0, /* start */ 0, /* end */ m_segment_length);
+    } else {
+        vector<future<void>> tasks;
+        size_t segments_per_thread = m_segment_length / m_num_threads;
+        size_t odd_segments = m_segment_length % m_num_threads;
+        size_t start = 0;
+        for(size_t i = 0; i < m_num_threads; i++){
+            size_t end = start + segments_per_thread + (i < odd_segments);
+            tasks.push_back( async(launch::async, fn, i, start, end) );
+            start = end;
+        }
+        for(auto& t: tasks) t.get();
+    }
+}
+
 void Weights::prefix_sum_cardinalities(){
     assert(m_prefix_sum_cardinalities == nullptr && "Already initialised");
     m_prefix_sum_cardinalities = m_pma.memory_pool().allocate<int32_t>(m_segment_length);
@@ -119,9 +150,13 @@ void Weights::prefix_sum_cardinalities(){
 }
 
 size_t Weights::get_cardinality_upto_incl(size_t segment_id) const {
-    assert(m_prefix_sum_cardinalities != nullptr && "Array m_prefix_sum_cardinalities not initialised yet. Invoke ::prefix_sum_cardinalities to init it");
     assert(segment_id < m_segment_length);
-    return m_prefix_sum_cardinalities[segment_id];
+    if(m_prefix_sum_cardinalities != nullptr){
+        return m_prefix_sum_cardinalities[segment_id];
+    } else {
+        const FenwickTree& tree = m_pma.m_cardinality_tree;
+        return tree.sum(m_segment_start, m_segment_start + segment_id +1);
+    }
 }
 
 size_t Weights::get_cardinality_upto_excl(size_t segment_id) const {
@@ -141,15 +176,39 @@ int Weights::find_key(size_t segment_id, int64_t key) const noexcept {
 void Weights::fetch_detector_keys(){
     Detector& detector = m_pma.detector();
     int64_t* __restrict detector_buffer = detector.buffer() + m_segment_start * detector.sizeof_entry();
-    int64_t* __restrict timestamps = m_timestamps;
-    for(size_t i = 0; i < m_segment_length; i++){
-        int64_t* __restrict section = detector_buffer + detector.sizeof_entry() * i;
-//        int16_t* __restrict header = reinterpret_cast<int16_t*>(section);
 
-        for(int h = 0; h < detector.modulus(); h++){
-            int64_t value = section[3 + h];
-            if(value) timestamps[m_timestamps_length++] = value;
+    if(m_num_threads == 1){
+        int64_t* __restrict timestamps = m_timestamps;
+        for(size_t i = 0; i < m_segment_length; i++){
+            int64_t* __restrict section = detector_buffer + detector.sizeof_entry() * i;
+
+            for(int h = 0; h < detector.modulus(); h++){
+                int64_t value = section[3 + h];
+                if(value) timestamps[m_timestamps_length++] = value;
+            }
         }
+    } else {
+        // each worker copies the timestamps of its own range of segments in its own slice of m_timestamps
+        m_slices.resize(m_num_threads);
+        parallel_for([this, &detector, detector_buffer](size_t thread_id, size_t start, size_t end){
+            int64_t* __restrict timestamps = m_timestamps + start * detector.modulus();
+            size_t length = 0;
+            int64_t min = numeric_limits<int64_t>::max(), max = numeric_limits<int64_t>::min();
+            for(size_t i = start; i < end; i++){
+                int64_t* __restrict section = detector_buffer + detector.sizeof_entry() * i;
+                for(int h = 0; h < detector.modulus(); h++){
+                    int64_t value = section[3 + h];
+                    if(value){
+                        timestamps[length++] = value;
+                        min = std::min(min, value);
+                        max = std::max(max, value);
+                    }
+                }
+            }
+            m_slices[thread_id] = TimestampsSlice{ timestamps, length, min, max };
+        });
+
+        for(auto& slice : m_slices){ m_timestamps_length += slice.m_length; }
     }
 }
 
@@ -157,6 +216,60 @@ int64_t Weights::rank(size_t position){
     return rank(m_timestamps, m_timestamps_length, position);
 }
 
+int64_t Weights::rank_parallel(size_t position){
+    assert(position < static_cast<size_t>(m_timestamps_length));
+    int64_t min = numeric_limits<int64_t>::max(), max = numeric_limits<int64_t>::min();
+    for(auto& slice : m_slices){
+        if(slice.m_length == 0) continue;
+        min = std::min(min, slice.m_min);
+        max = std::max(max, slice.m_max);
+    }
+    if(min == max) return min;
+
+    // radix select, first pass: histogram of the most significant bits of (timestamp - min)
+    constexpr int RADIX_BITS = 11;
+    constexpr size_t NUM_BUCKETS = 1ull << RADIX_BITS;
+    const uint64_t range = static_cast<uint64_t>(max - min);
+    const int shift = std::max(0, (64 - __builtin_clzll(range)) - RADIX_BITS);
+    vector<uint32_t> histograms(m_num_threads * NUM_BUCKETS, 0);
+    parallel_for([this, &histograms, min, shift](size_t thread_id, size_t, size_t){
+        const TimestampsSlice& slice = m_slices[thread_id];
+        uint32_t* __restrict histogram = histograms.data() + thread_id * NUM_BUCKETS;
+        for(size_t i = 0; i < slice.m_length; i++){
+            histogram[static_cast<uint64_t>(slice.m_timestamps[i] - min) >> shift]++;
+        }
+    });
+
+    // find the bucket containing the given rank
+    size_t bucket = 0;
+    size_t count_before = 0;
+    while(true){
+        size_t count = 0;
+        for(size_t t = 0; t < m_num_threads; t++){ count += histograms[t * NUM_BUCKETS + bucket]; }
+        if(count_before + count > position) break;
+        count_before += count;
+        bucket++;
+        assert(bucket < NUM_BUCKETS);
+    }
+
+    // second pass: gather the timestamps in the bucket and select among them
+    vector<vector<int64_t>> candidates(m_num_threads);
+    parallel_for([this, &candidates, min, shift, bucket](size_t thread_id, size_t, size_t){
+        const TimestampsSlice& slice = m_slices[thread_id];
+        auto& output = candidates[thread_id];
+        for(size_t i = 0; i < slice.m_length; i++){
+            if((static_cast<uint64_t>(slice.m_timestamps[i] - min) >> shift) == bucket){
+                output.push_back(slice.m_timestamps[i]);
+            }
+        }
+    });
+    for(size_t t = 1; t < m_num_threads; t++){
+        candidates[0].insert(end(candidates[0]), begin(candidates[t]), end(candidates[t]));
+    }
+
+    return rank(candidates[0].data(), candidates[0].size(), position - count_before);
+}
+
 int64_t Weights::rank(int64_t* __restrict A, size_t length, size_t rank){
     assert(length >= 1);
     assert(rank < length);
@@ -219,120 +332,152 @@ size_t Weights::partition(int64_t* __restrict A, size_t length){
     return i_lt;
 }
 
-void Weights::detect_hammered(int64_t select_threshold){
+int Weights::get_weight(size_t segment_id, int64_t select_threshold) const {
     Detector& detector = m_pma.detector();
+    int64_t* __restrict section = detector.buffer() + (m_segment_start + segment_id) * detector.sizeof_entry();
+    int16_t* __restrict header = reinterpret_cast<int16_t*>(section);
+    int head = header[0];
+    int segment_counter = header[3];
+
+#if !defined(DEBUG)
+    int64_t timestamp_min = section[3 + head];
+#else
+    // for debug purposes only, find the minimum even when not all timestamps have been seen
+    int64_t timestamp_min = 0;
+    for(int h = head, stop = detector.modulus(); h < stop && !timestamp_min; h++){
+        timestamp_min = section[3 + h];
+    }
+    for(int h = 0; h < head && !timestamp_min; h++){
+        timestamp_min = section[3 + h];
+    }
+#endif
+    COUT_DEBUG("candidate segment: " << segment_id << ", timestamp: " << timestamp_min << ", segment_counter: " << segment_counter);
+    if(timestamp_min < select_threshold) return 0; // skip this segment
 
+    // candidate for hammering ?
     int apma_segment_threshold = m_pma.knobs().get_segment_threshold();
-    int apma_sequence_threshold = m_pma.knobs().get_sequence_threshold();
+    if(segment_counter > apma_segment_threshold){
+        return 1;
+    } else if(segment_counter < -apma_segment_threshold) {
+        return -1;
+    } else {
+        return 0; // ignore this segment
+    }
+}
 
+void Weights::detect_hammered(int64_t select_threshold){
+    Detector& detector = m_pma.detector();
     int64_t* __restrict detector_buffer = detector.buffer() + m_segment_start * detector.sizeof_entry();
-    for(size_t i = 0; i < m_segment_length; i++){
+    auto add_segment = [this, &detector, detector_buffer](size_t i, int weight){
         int64_t* __restrict section = detector_buffer + detector.sizeof_entry() * i;
         int16_t* __restrict header = reinterpret_cast<int16_t*>(section);
-        int head = header[0];
-        int segment_counter = header[3];
-        int weight = 0;
+        add_hammered_segment(i, weight, /* count fwd */ header[1], /* count bwd */ header[2], /* predecessor */ section[1], /* successor */ section[2]);
+    };
 
-#if !defined(DEBUG)
-        int64_t timestamp_min = section[3 + head];
-#else
-        // for debug purposes only, find the minimum even when not all timestamps have been seen
-        int64_t timestamp_min = 0;
-        for(int h = head, stop = detector.modulus(); h < stop && !timestamp_min; h++){
-            timestamp_min = section[3 + h];
+    if(m_num_threads == 1){
+        for(size_t i = 0; i < m_segment_length; i++){
+            int weight = get_weight(i, select_threshold);
+            if(weight != 0) add_segment(i, weight);
         }
-        for(int h = 0; h < head && !timestamp_min; h++){
-            timestamp_min = section[3 + h];
-        }
-#endif
-        COUT_DEBUG("candidate segment: " << i << ", timestamp: " << timestamp_min << ", segment_counter: " << segment_counter);
-        if(timestamp_min < select_threshold) continue; // skip this segment
-
-        // candidate for hammering ?
-        if(segment_counter > apma_segment_threshold){
-            weight = 1;
-        } else if(segment_counter < -apma_segment_threshold) {
-            weight = -1;
-        } else {
-            continue; // ignore this segment
-        }
-
-        size_t base = get_cardinality_upto_excl(i);
-        size_t length = get_cardinality(i);
-        COUT_DEBUG("-> hammered segment detected, base: " << base << ", length: " << length << ", weight: " << weight);
-
-        int count_fwd = header[1];
-        int count_bwd = header[2];
-        auto predecessor = section[1];
-        auto successor = section[2];
-
-        if((weight > 0 && count_bwd >= apma_sequence_threshold) || (weight < 0 && count_bwd <= -apma_sequence_threshold)){ // forwards
-            int pos_hammered = find_key(i, successor);
-            if(pos_hammered != -1){
-                if(pos_hammered > 0) pos_hammered--; // as this is the next element
-                base += pos_hammered;
-                length = 2;
-            }
-        } else if ((weight > 0 && count_fwd >= apma_sequence_threshold) || (weight < 0 && count_bwd <= -apma_sequence_threshold)){ // backwards
-            int pos_hammered = find_key(i, predecessor);
-            if(pos_hammered != -1){
-                base += pos_hammered;
-                length = 2;
+    } else {
+        // the workers only select the candidates, the intervals are appended in order by a single thread, as
+        // consecutive intervals may need to be merged
+        vector<vector<pair<uint32_t, int>>> candidates(m_num_threads);
+        parallel_for([this, &candidates, select_threshold](size_t thread_id, size_t start, size_t end){
+            for(size_t i = start; i < end; i++){
+                int weight = get_weight(i, select_threshold);
+                if(weight != 0) candidates[thread_id].emplace_back(i, weight);
             }
+        });
+        for(auto& c : candidates){
+            for(auto& p : c){ add_segment(p.first, p.second); }
         }
+    }
+}
 
-        // if we are inserting at the end of the array, the length of the hammered section is actually 1,
-        // there are no successor elements yet after the hammered point
-        if(base + length > get_cardinality_upto_incl(m_segment_length -1))
-            length = get_cardinality_upto_incl(m_segment_length -1) - base;
+void Weights::detect_hammered_sketch(){
+    vector<SketchDetector::Entry> entries;
+    m_pma.sketch_detector()->hammered(m_segment_start, m_segment_length, entries);
 
+    for(auto& entry : entries){
+        size_t i = entry.segment() - m_segment_start;
+        int weight = entry.m_count_segment > 0 ? 1 : -1;
+        COUT_DEBUG("candidate segment: " << i << ", segment_counter: " << entry.m_count_segment);
+        add_hammered_segment(i, weight, entry.m_count_fwd, entry.m_count_bwd, entry.m_key_fwd, entry.m_key_bwd);
+    }
+}
 
-        // in case of deletes, a segment might be empty (...)
-        if(length == 0){
-            if(base >= get_cardinality_upto_incl(m_segment_length -1)){
-                base = get_cardinality_upto_incl(m_segment_length -1) -1;
-            }
-            length = 1;
+void Weights::add_hammered_segment(size_t i, int weight, int count_fwd, int count_bwd, int64_t predecessor, int64_t successor){
+    int apma_sequence_threshold = m_pma.knobs().get_sequence_threshold();
+
+    size_t base = get_cardinality_upto_excl(i);
+    size_t length = get_cardinality(i);
+    COUT_DEBUG("-> hammered segment detected, base: " << base << ", length: " << length << ", weight: " << weight);
+
+    if((weight > 0 && count_bwd >= apma_sequence_threshold) || (weight < 0 && count_bwd <= -apma_sequence_threshold)){ // forwards
+        int pos_hammered = find_key(i, successor);
+        if(pos_hammered != -1){
+            if(pos_hammered > 0) pos_hammered--; // as this is the next element
+            base += pos_hammered;
+            length = 2;
         }
+    } else if ((weight > 0 && count_fwd >= apma_sequence_threshold) || (weight < 0 && count_bwd <= -apma_sequence_threshold)){ // backwards
+        int pos_hammered = find_key(i, predecessor);
+        if(pos_hammered != -1){
+            base += pos_hammered;
+            length = 2;
+        }
+    }
 
-        // we have a bit of corner case here, it might happen that a sequenced section with length=2 is followed by a segment section.
-        // The two intervals might overlap, because of length =2. In general, let's merge consecutive sections with the same weight
-        if(m_output.size() > 0){
-            auto& predecessor = m_output.back();
-            auto predecessor_wend = predecessor.m_start + predecessor.m_length;
-
-            // do the intervals overlap?
-            if(predecessor_wend >= base){
-                auto current_wend = base + length;
-
-                // merge the two intervals
-                predecessor.m_length = current_wend - predecessor.m_start;
-
-                // This case is interesting, they have different weights. The strategy here is to not report none of the two
-                // intervals as `hammered', we simply don't have a clear indication to say which one should be considered hammered
-                if(predecessor.m_weight != weight) {
-                    m_balance += -(predecessor.m_weight); // roll back the contribution on the global balance
-                    predecessor.m_weight = 0; // set a balance of zero, we'll perform a final pass at the end of the algorithm to remove this interval
-                    detector.clear(m_segment_start + i); // reset the entry in the detector for this entry, we'll do the same for the predecessor eventually
-                }
+    // if we are inserting at the end of the array, the length of the hammered section is actually 1,
+    // there are no successor elements yet after the hammered point
+    if(base + length > m_cardinality_window)
+        length = m_cardinality_window - base;
 
-                continue; // ignore this section
-            }
+
+    // in case of deletes, a segment might be empty (...)
+    if(length == 0){
+        if(base >= m_cardinality_window){
+            base = m_cardinality_window -1;
         }
+        length = 1;
+    }
+
+    // we have a bit of corner case here, it might happen that a sequenced section with length=2 is followed by a segment section.
+    // The two intervals might overlap, because of length =2. In general, let's merge consecutive sections with the same weight
+    if(m_output.size() > 0){
+        auto& predecessor = m_output.back();
+        auto predecessor_wend = predecessor.m_start + predecessor.m_length;
+
+        // do the intervals overlap?
+        if(predecessor_wend >= base){
+            auto current_wend = base + length;
+
+            // merge the two intervals
+            predecessor.m_length = current_wend - predecessor.m_start;
+
+            // This case is interesting, they have different weights. The strategy here is to not report none of the two
+            // intervals as `hammered', we simply don't have a clear indication to say which one should be considered hammered
+            if(predecessor.m_weight != weight) {
+                m_balance += -(predecessor.m_weight); // roll back the contribution on the global balance
+                predecessor.m_weight = 0; // set a balance of zero, we'll perform a final pass at the end of the algorithm to remove this interval
+                m_pma.detector_clear(m_segment_start + i); // reset the entry in the detector for this entry, we'll do the same for the predecessor eventually
+            }
 
-        m_output.push_back(Interval{base, length, weight, i});
-        m_balance += weight;
+            return; // ignore this section
+        }
     }
+
+    m_output.push_back(Interval{base, length, weight, i});
+    m_balance += weight;
 }
 
 void Weights::remove_neutral(){
-    Detector& detector = m_pma.detector();
-
     for(int64_t i = static_cast<int64_t>(m_output.size()) -1; i>=0; i--){
         auto& entry = m_output[i];
         if(entry.m_weight == 0){
             if(entry.m_associated_segment >= 0)
-                detector.clear(m_segment_start + entry.m_associated_segment);
+                m_pma.detector_clear(m_segment_start + entry.m_associated_segment);
             m_output.erase(begin(m_output) + i);
         }
     }
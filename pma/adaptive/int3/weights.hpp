@@ -58,11 +58,23 @@ private:
     const size_t m_segment_start;
     const size_t m_segment_length;
 //    const double m_threshold;
+    const size_t m_num_threads; // number of workers to fetch & rank the timestamps, 1 for small windows
+    constexpr static size_t MIN_SEGMENTS_PER_THREAD = 8192; // below this threshold, the cost of the threads is not worth it
 
     // intermediate information
     int64_t* m_timestamps = nullptr;
     int64_t m_timestamps_length = 0;
-    int32_t* m_prefix_sum_cardinalities = nullptr;
+    int32_t* m_prefix_sum_cardinalities = nullptr; // only for the windows smaller than MIN_SEGMENTS_PER_THREAD
+    size_t m_cardinality_window = 0; // total number of elements in the window
+
+    // the portion of m_timestamps fetched by each worker, when m_num_threads > 1
+    struct TimestampsSlice {
+        int64_t* m_timestamps; // start of the slice
+        size_t m_length; // number of timestamps in the slice
+        int64_t m_min; // the min timestamp in the slice
+        int64_t m_max; // the max timestamp in the slice
+    };
+    std::vector<TimestampsSlice> m_slices;
 
     bool m_output_released = false; // already returned the vector of intervals (a call to ::release())
     VectorOfIntervals m_output; // output
@@ -74,6 +86,17 @@ private:
 
     int64_t rank(int64_t* __restrict array, size_t length, size_t position);
 
+    /**
+     * Select the timestamp with the given rank among the slices fetched by the workers, with a parallel radix select
+     */
+    int64_t rank_parallel(size_t position);
+
+    /**
+     * Execute fn(thread_id, start, end) for each of the m_num_threads ranges of segments of the window
+     */
+    template<typename Function>
+    void parallel_for(Function fn);
+
     /**
      * Helper function: standard partition method for quick sort
      */
@@ -85,7 +108,8 @@ private:
     void prefix_sum_cardinalities();
 
     /**
-     * Get the number of elements in [m_segment_start, m_segment_start + segment_id];
+     * Get the number of elements in [m_segment_start, m_segment_start + segment_id]. For the large windows, the sums are
+     * not recomputed, they are retrieved from the cumulative cardinalities maintained by the PMA in O(log n).
      */
     size_t get_cardinality_upto_incl(size_t segment_id) const;
 
@@ -104,11 +128,26 @@ private:
      */
     int find_key(size_t segment_id, int64_t key) const noexcept;
 
+    /**
+     * Weight of the given segment: +1 if hammered by insertions, -1 if hammered by deletions, 0 otherwise
+     */
+    int get_weight(size_t segment_id, int64_t select_threshold) const;
+
     /**
      * Identify the intervals hammered and populate them in the vector m_output;
      */
     void detect_hammered(int64_t select_threshold);
 
+    /**
+     * Identify the intervals hammered when the PMA employs the SketchDetector, and populate them in the vector m_output;
+     */
+    void detect_hammered_sketch();
+
+    /**
+     * Append the hammered segment m_segment_start + segment_id to the vector m_output, merging it with the last interval if they overlap.
+     */
+    void add_hammered_segment(size_t segment_id, int weight, int count_fwd, int count_bwd, int64_t predecessor, int64_t successor);
+
     /**
      * Remove neutral intervals. These are intervals whose weight is zero.
      */
@@ -0,0 +1,185 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "block_size_calibration.hpp"
+
+#include <algorithm>
+#include <cstring> // memcpy
+#include <limits>
+#include <memory>
+#include <random>
+#include <sched.h> // sched_getcpu
+
+#include "configuration.hpp"
+#include "cpu_topology.hpp"
+#include "miscellaneous.hpp"
+#include "timer.hpp"
+
+using namespace std;
+
+namespace pma {
+
+/*****************************************************************************
+ *                                                                           *
+ *   Microbenchmarks                                                         *
+ *                                                                           *
+ *****************************************************************************/
+namespace {
+
+constexpr uint64_t NUM_PROBES = 1ull << 18; // number of lookups to evaluate a single candidate
+constexpr uint64_t PROBES_SEED = 31337; // seed for the keys to search
+
+volatile uint64_t g_sink; // prevent the compiler from removing the lookups in the microbenchmarks
+
+/**
+ * Read the cache geometry of the current host. If the topology cannot be retrieved, fall back to 64 bytes for a
+ * cache line, 32 KB for the L1 and 1 MB for the L2.
+ */
+void read_cache_geometry(BlockSizeCalibration& calibration){
+    calibration.m_cache_line = 64;
+    calibration.m_l1_size = 32 * 1024;
+    calibration.m_l2_size = 1024 * 1024;
+
+    try {
+        auto& topology = get_cpu_topology();
+        calibration.m_cache_line = topology.get_firstcache_line();
+        calibration.m_l1_size = topology.get_firstcache_size();
+        int cpu_id = sched_getcpu();
+        if(cpu_id >= 0 && topology.get_cache_levels(cpu_id) >= 2){
+            calibration.m_l2_size = topology.get_cache_size(cpu_id, 2);
+        }
+    } catch(cpu_topology_exception& e){
+        LOG_VERBOSE("[calibrate_block_sizes] Cannot read the cache geometry, using the defaults. Reason: " << e.what());
+    }
+}
+
+/**
+ * Generate the keys to search, uniformly distributed in [0, max_key)
+ */
+unique_ptr<int64_t[]> generate_probes(int64_t max_key){
+    mt19937_64 random_generator { PROBES_SEED };
+    uniform_int_distribution<int64_t> distribution { 0, max_key -1 };
+    unique_ptr<int64_t[]> probes { new int64_t[NUM_PROBES] };
+    for(uint64_t i = 0; i < NUM_PROBES; i++){ probes[i] = distribution(random_generator); }
+    return probes;
+}
+
+/**
+ * Average time, in nanosecs, of StaticIndex::find with the given node size, over all the elements in the array
+ */
+double evaluate_inode_block_size(StaticIndexLayout layout, uint64_t node_size, const int64_t* elements, uint64_t num_elements, const int64_t* probes){
+    StaticIndex index { node_size, num_elements, layout };
+    index.rebuild(num_elements, elements);
+
+    uint64_t checksum = 0;
+    for(uint64_t i = 0; i < NUM_PROBES / 8; i++){ checksum += index.find(probes[i]); } // warm up
+    Timer timer { true };
+    for(uint64_t i = 0; i < NUM_PROBES; i++){ checksum += index.find(probes[i]); }
+    timer.stop();
+    g_sink = checksum;
+
+    return timer.nanoseconds<double>() / NUM_PROBES;
+}
+
+/**
+ * Average time, in nanosecs, to locate the position of a key in an array partitioned in segments of the given
+ * capacity: search the segment in the static index, probe the segment and copy its tail, as it would be shifted by
+ * an insertion.
+ */
+double evaluate_leaf_block_size(StaticIndexLayout layout, uint64_t node_size, uint64_t segment_capacity, const int64_t* elements, uint64_t num_elements, const int64_t* probes, int64_t* workspace){
+    const uint64_t num_segments = num_elements / segment_capacity;
+    unique_ptr<int64_t[]> separator_keys { new int64_t[num_segments] };
+    for(uint64_t i = 0; i < num_segments; i++){ separator_keys[i] = elements[i * segment_capacity]; }
+    StaticIndex index { node_size, num_segments, layout };
+    index.rebuild(num_segments, separator_keys.get());
+
+    auto probe = [&](int64_t key){
+        const int64_t* __restrict segment = elements + index.find(key) * segment_capacity;
+        uint64_t position = 0;
+        while(position < segment_capacity && segment[position] < key) position++;
+        memcpy(workspace, segment + position, (segment_capacity - position) * sizeof(int64_t));
+        return position;
+    };
+
+    uint64_t checksum = 0;
+    for(uint64_t i = 0; i < NUM_PROBES / 8; i++){ checksum += probe(probes[i]); } // warm up
+    Timer timer { true };
+    for(uint64_t i = 0; i < NUM_PROBES; i++){ checksum += probe(probes[i]); }
+    timer.stop();
+    g_sink = checksum;
+
+    return timer.nanoseconds<double>() / NUM_PROBES;
+}
+
+} // anonymous namespace
+
+/*****************************************************************************
+ *                                                                           *
+ *   Calibration                                                             *
+ *                                                                           *
+ *****************************************************************************/
+
+BlockSizeCalibration calibrate_block_sizes(StaticIndexLayout layout, uint64_t inode_block_size, uint64_t leaf_block_size){
+    BlockSizeCalibration calibration;
+    read_cache_geometry(calibration);
+    calibration.m_inode_block_size = inode_block_size;
+    calibration.m_leaf_block_size = leaf_block_size;
+
+    // the data set must exceed the L2, elements[i] = 2*i, so that half of the searches are misses
+    const uint64_t num_elements = min<uint64_t>(max<uint64_t>(hyperceil(4 * calibration.m_l2_size / sizeof(int64_t)), 1ull << 16), 1ull << 24);
+    unique_ptr<int64_t[]> elements { new int64_t[num_elements] };
+    for(uint64_t i = 0; i < num_elements; i++){ elements[i] = 2 * i; }
+    auto probes = generate_probes(2 * num_elements);
+
+    if(inode_block_size == 0){ // from a cache line up to a quarter of the L1
+        const uint64_t min_node_size = max<uint64_t>(calibration.m_cache_line / sizeof(int64_t), 4);
+        const uint64_t max_node_size = min<uint64_t>(max(calibration.m_l1_size / (4 * sizeof(int64_t)), min_node_size), numeric_limits<uint16_t>::max());
+        double best_time = numeric_limits<double>::max();
+        for(uint64_t node_size = min_node_size; node_size <= max_node_size; node_size *= 2){
+            double time = evaluate_inode_block_size(layout, node_size, elements.get(), num_elements, probes.get());
+            LOG_VERBOSE("[calibrate_block_sizes] iB: " << node_size << ", find: " << time << " nanosecs");
+            if(time < best_time){
+                best_time = time;
+                calibration.m_inode_block_size = node_size;
+            }
+        }
+    }
+
+    if(leaf_block_size == 0){ // from 32 elements up to a virtual page, to be compatible with memory rewiring
+        const uint64_t max_segment_capacity = max<uint64_t>(get_memory_page_size() / sizeof(int64_t), 32);
+        unique_ptr<int64_t[]> workspace { new int64_t[max_segment_capacity] };
+        double best_time = numeric_limits<double>::max();
+        for(uint64_t segment_capacity = 32; segment_capacity <= max_segment_capacity; segment_capacity *= 2){
+            double time = evaluate_leaf_block_size(layout, calibration.m_inode_block_size, segment_capacity, elements.get(), num_elements, probes.get(), workspace.get());
+            LOG_VERBOSE("[calibrate_block_sizes] lB: " << segment_capacity << ", probe: " << time << " nanosecs");
+            if(time < best_time){
+                best_time = time;
+                calibration.m_leaf_block_size = segment_capacity;
+            }
+        }
+    }
+
+    return calibration;
+}
+
+std::ostream& operator<<(std::ostream& out, const BlockSizeCalibration& calibration){
+    out << "cache line: " << calibration.m_cache_line << " bytes, L1: " << calibration.m_l1_size / 1024 << " KB, "
+            "L2: " << calibration.m_l2_size / 1024 << " KB, iB: " << calibration.m_inode_block_size << ", lB: " << calibration.m_leaf_block_size;
+    return out;
+}
+
+} // namespace pma
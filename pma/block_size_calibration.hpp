@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PMA_BLOCK_SIZE_CALIBRATION_HPP_
+#define PMA_BLOCK_SIZE_CALIBRATION_HPP_
+
+#include <cinttypes>
+#include <ostream>
+
+#include "pma/generic/static_index.hpp"
+
+namespace pma {
+
+/**
+ * The outcome of the calibration, see #calibrate_block_sizes
+ */
+struct BlockSizeCalibration {
+    uint64_t m_cache_line; // size of a cache line, in bytes
+    uint64_t m_l1_size; // size of the L1 data cache, in bytes
+    uint64_t m_l2_size; // size of the L2 cache, in bytes
+    uint64_t m_inode_block_size; // the chosen node size for the static index, iB
+    uint64_t m_leaf_block_size; // the chosen capacity for the segments/leaves, lB
+};
+
+/**
+ * Choose the node size of the static index (iB) and the capacity of the segments (lB) for the current host.
+ *
+ * The candidates are bounded by the cache geometry reported by cpu_topology: the nodes span from one cache line up to
+ * a quarter of the L1, the segments from 32 elements up to a virtual page, as required by memory rewiring. Each
+ * candidate is then evaluated with a short microbenchmark, over an index and a sparse array that exceed the L2:
+ * - iB: random lookups with StaticIndex::find;
+ * - lB: StaticIndex::find to locate the segment, a linear probe of the segment and the shift of its tail, as in an
+ *   insertion, using the chosen iB.
+ * The whole calibration takes a few hundreds of milliseconds.
+ *
+ * @param layout the layout of the static index to calibrate
+ * @param inode_block_size if not zero, do not calibrate iB and use the given node size
+ * @param leaf_block_size if not zero, do not calibrate lB and use the given segment capacity
+ */
+BlockSizeCalibration calibrate_block_sizes(StaticIndexLayout layout = StaticIndexLayout::BTREE, uint64_t inode_block_size = 0, uint64_t leaf_block_size = 0);
+
+/**
+ * Print the outcome of the calibration, for debugging purposes
+ */
+std::ostream& operator<<(std::ostream& out, const BlockSizeCalibration& calibration);
+
+} // namespace pma
+
+#endif /* PMA_BLOCK_SIZE_CALIBRATION_HPP_ */
@@ -17,14 +17,19 @@
 
 #include "packed_memory_array.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <limits>
 #include <iostream>
 #include "buffered_rewired_memory.hpp"
 #include "iterator.hpp"
 #include "miscellaneous.hpp"
 #include "rewired_memory.hpp"
+#include "snapshot.hpp"
 #include "spread_with_rewiring.hpp"
+#include "sum.hpp"
 
 using namespace std;
 
@@ -96,8 +101,56 @@ size_t PackedMemoryArray8::balanced_thresholds_cutoff() const {
     return 64 * m_storage.get_segments_per_extent();
 }
 
+void PackedMemoryArray8::set_adaptive_densities(bool value){
+    if(!value){
+        m_density_controller.reset(); // keep the current thresholds
+    } else if(!m_density_controller){
+        // theta_h >= 0.6, as a deletion shrinks the array when its density falls below 0.5
+        m_density_controller.reset(new DensityController(m_density_bounds1.get_upper_threshold_root()));
+    }
+}
+
+void PackedMemoryArray8::set_bloom_filters(bool value){
+    if(!value){
+        m_bloom_filters.reset();
+    } else if(!m_bloom_filters){
+        m_bloom_filters.reset(new BloomFilterArray(/* keys per filter */ 2 * m_storage.m_segment_capacity, /* bits per key */ 8));
+        m_bloom_filters->resize((m_storage.m_number_segments +1) / 2);
+        if(!empty()) bloom_filters_rebuild(0, m_storage.m_number_segments);
+    }
+}
+
+void PackedMemoryArray8::bloom_filters_rebuild(size_t segment_start, size_t num_segments){
+    assert(m_bloom_filters != nullptr && "Bloom filters not enabled");
+    assert(segment_start + num_segments <= m_storage.m_number_segments && "Window out of bounds");
+    if(num_segments == 0) return;
+
+    for(size_t pair_id = segment_start / 2, pair_end = (segment_start + num_segments -1) / 2 +1; pair_id < pair_end; pair_id++){
+        m_bloom_filters->clear(pair_id);
+        size_t segment_id = pair_id * 2;
+        size_t num_segments_pair = min<size_t>(2, m_storage.m_number_segments - segment_id);
+        m_storage.fetch(segment_id, num_segments_pair);
+
+        // the elements of an even segment are stored at its end, the elements of an odd segment at its start
+        const int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
+        size_t start = m_storage.m_segment_capacity - m_storage.m_segment_sizes[segment_id];
+        size_t end = m_storage.m_segment_capacity + (num_segments_pair == 2 ? m_storage.m_segment_sizes[segment_id +1] : 0);
+        for(size_t i = start; i < end; i++){
+            m_bloom_filters->insert(pair_id, keys[i]);
+        }
+    }
+}
+
+void PackedMemoryArray8::adapt_densities(){
+    if(!m_density_controller || !m_density_controller->update(m_storage.m_cardinality)) return;
+    m_density_bounds0.set_densities(m_density_controller->adapt(m_density_bounds0.densities()));
+    m_density_bounds1.set_densities(m_density_controller->adapt(m_density_bounds1.densities()));
+    COUT_DEBUG("theta_h: " << m_density_controller->theta());
+}
+
 size_t PackedMemoryArray8::memory_footprint() const {
-    return sizeof(PackedMemoryArray8) + m_index.memory_footprint() + m_storage.memory_footprint();
+    size_t space_bloom_filters = m_bloom_filters ? m_bloom_filters->memory_footprint() : 0;
+    return sizeof(PackedMemoryArray8) + m_index.memory_footprint() + m_storage.memory_footprint() + space_bloom_filters;
 }
 
 /*****************************************************************************
@@ -110,8 +163,10 @@ void PackedMemoryArray8::insert(int64_t key, int64_t value){
         insert_empty(key, value);
     } else {
         size_t segment = m_index.find(key);
+        m_storage.fetch(segment, 1);
         insert_common(segment, key, value);
     }
+    if(m_density_controller){ m_density_controller->record_update(); }
 
 //#if defined(DEBUG)
 //    dump();
@@ -123,11 +178,13 @@ void PackedMemoryArray8::insert_empty(int64_t key, int64_t value){
     assert(m_storage.capacity() > 0 && "The storage does not have any capacity?");
 
     m_index.set_separator_key(0, key);
+    m_storage.prepare_write(0, 1);
     m_storage.m_segment_sizes[0] = 1;
     size_t pos = m_storage.m_segment_capacity -1;
     m_storage.m_keys[pos] = key;
     m_storage.m_values[pos] = value;
     m_storage.m_cardinality = 1;
+    if(m_bloom_filters){ m_bloom_filters->insert(0, key); }
 }
 
 void PackedMemoryArray8::insert_common(size_t segment_id, int64_t key, int64_t value){
@@ -145,6 +202,8 @@ void PackedMemoryArray8::insert_common(size_t segment_id, int64_t key, int64_t v
 
         // have we just updated the minimum ?
         if (minimum_updated) m_index.set_separator_key(segment_id, key);
+
+        if(m_bloom_filters){ m_bloom_filters->insert(segment_id / 2, key); }
     }
 }
 
@@ -158,6 +217,7 @@ int64_t PackedMemoryArray8::remove(int64_t key){
 
     auto segment_id = m_index.find(key);
     COUT_DEBUG("key: " << key << ", segment: " << segment_id);
+    m_storage.fetch(segment_id, 1);
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
     int64_t* __restrict values = m_storage.m_values + segment_id * m_storage.m_segment_capacity;
     size_t sz = m_storage.m_segment_sizes[segment_id];
@@ -169,6 +229,7 @@ int64_t PackedMemoryArray8::remove(int64_t key){
         size_t imin = m_storage.m_segment_capacity - sz, i;
         for(i = imin; i < m_storage.m_segment_capacity; i++){ if(keys[i] == key) break; }
         if(i < m_storage.m_segment_capacity){ // found ?
+            m_storage.prepare_write(segment_id, 1);
             value = values[i];
             // shift the rest of the elements by 1
             for(size_t j = i; j > imin; j--){
@@ -193,6 +254,7 @@ int64_t PackedMemoryArray8::remove(int64_t key){
         size_t i = 0;
         for( ; i < sz; i++){ if(keys[i] == key) break; }
         if(i < sz){ // found?
+            m_storage.prepare_write(segment_id, 1);
             value = values[i];
             // shift the rest of the elements by 1
             for(size_t j = i; j < sz - 1; j++){
@@ -211,10 +273,13 @@ int64_t PackedMemoryArray8::remove(int64_t key){
         } // end if (found)
     } // end if (odd segment)
 
+    if(value != -1 && m_density_controller){ m_density_controller->record_update(); }
+
     // shall we rebalance ?
     if(value != -1 && m_storage.m_number_segments > 1){
         // is the global density of the array less than 50% ?
         if(static_cast<double>(m_storage.m_cardinality) < 0.5 * m_storage.capacity()){
+            adapt_densities();
             auto plan = rebalance_plan(false, 0, 0, m_storage.m_cardinality, true);
             do_rebalance(plan);
         } else { // shal we rebalance the current segment?
@@ -239,6 +304,7 @@ int64_t PackedMemoryArray8::remove(int64_t key){
 void PackedMemoryArray8::rebalance(size_t segment_id, int64_t* key, int64_t* value){
     assert(((key && value) || (!key && !value)) && "Either both key & value are specified (insert) or none of them is (delete)");
     const bool is_insert = key != nullptr;
+    adapt_densities();
 
     int64_t window_start {0}, window_length {0}, cardinality {0};
     bool do_resize { false };
@@ -380,11 +446,11 @@ RebalanceMetadata PackedMemoryArray8::rebalance_plan(bool is_insert, int64_t win
 }
 
 void PackedMemoryArray8::do_rebalance(const RebalanceMetadata& action) {
-
-
+    if(m_density_controller){ m_density_controller->record_rebalance(action.get_cardinality_after()); }
 
     switch(action.m_operation){
     case RebalanceOperation::REBALANCE: {
+        m_storage.fetch(action.m_window_start, action.m_window_length); // page in the whole window with sequential reads
         if (action.m_window_length < m_storage.get_segments_per_extent()){
             spread_local(action); // local to the extent
         } else { // use rewiring
@@ -397,15 +463,27 @@ void PackedMemoryArray8::do_rebalance(const RebalanceMetadata& action) {
     case RebalanceOperation::RESIZE_REBALANCE: { // use rewiring
 //        COUT_DEBUG_FORCE("REBALANCE RESIZE: cardinality: " << action.get_cardinality_after() << ", " << m_storage.m_number_segments << " -> " << action.m_window_length);
         resize_rebalance(action);
+        m_storage.reset_cache();
         set_thresholds(m_storage.hyperheight());
     } break;
     case RebalanceOperation::RESIZE: {
         resize(action);
+        m_storage.reset_cache();
         set_thresholds(m_storage.hyperheight());
     } break;
     default:
         assert(0 && "Invalid operation");
     }
+
+    // the elements have been moved, refresh the Bloom filters of the window
+    if(m_bloom_filters){
+        if(action.m_operation == RebalanceOperation::REBALANCE){
+            bloom_filters_rebuild(action.m_window_start, action.m_window_length);
+        } else {
+            m_bloom_filters->resize((m_storage.m_number_segments +1) / 2);
+            bloom_filters_rebuild(0, m_storage.m_number_segments);
+        }
+    }
 }
 
 /*****************************************************************************
@@ -572,6 +650,7 @@ void PackedMemoryArray8::spread_local(const RebalanceMetadata& action){
     COUT_DEBUG("size: " << action.get_cardinality_after() << ", start: " << action.m_window_start << ", length: " << action.m_window_length << ", insertion segment: " << insert_segment_id);
     assert(action.m_window_start % 2 == 0 && "Expected to start from an even segment");
     assert(action.m_window_length % 2 == 0 && "Expected an even number of segments");
+    m_storage.prepare_write(action.m_window_start, action.m_window_length);
 
     // workspace
     using segment_size_t = remove_pointer_t<decltype(m_storage.m_segment_sizes)>;
@@ -738,7 +817,9 @@ int64_t PackedMemoryArray8::find(int64_t key) const {
     if(empty()) return -1;
 
     auto segment_id = m_index.find(key);
+    if(m_bloom_filters && !m_bloom_filters->contains(segment_id / 2, key)) return -1; // the key is certainly absent
 //    COUT_DEBUG("key: " << key << ", bucket: " << segment_id);
+    m_storage.fetch(segment_id, 1);
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
     size_t sz = m_storage.m_segment_sizes[segment_id];
 
@@ -779,114 +860,71 @@ unique_ptr<pma::Iterator> PackedMemoryArray8::iterator() const {
 
 /*****************************************************************************
  *                                                                           *
- *   Aggregate sum                                                           *
+ *   Snapshot                                                                *
  *                                                                           *
  *****************************************************************************/
-pma::Interface::SumResult PackedMemoryArray8::sum(int64_t min, int64_t max) const {
-    if((min > max) || empty()){ return SumResult{}; }
-    int64_t segment_start = m_index.find_first(min);
-    int64_t segment_end = m_index.find_last(max);
-    if(segment_end < segment_start){ return SumResult{}; }
-
-    int64_t* __restrict keys = m_storage.m_keys;
-
-    bool notfound = true;
-    ssize_t segment_id = segment_start;
-    bool segment_even = segment_id % 2 == 0;
-    ssize_t start = -1, stop = -1, offset = -1;
-
-    // start of the interval
-    while(notfound && segment_id < m_storage.m_number_segments){
-        if(segment_even){
-            stop = (segment_id +1) * m_storage.m_segment_capacity;
-            start = stop - m_storage.m_segment_sizes[segment_id];
-            COUT_DEBUG("lower interval, even segment, start: " << start << ", stop: " << stop);
-        } else { // odd
-            start = segment_id * m_storage.m_segment_capacity;
-            stop = start + m_storage.m_segment_sizes[segment_id];
-            COUT_DEBUG("lower interval, odd segment, start: " << start << ", stop: " << stop);
-        }
-        offset = start;
-
-        while(offset < stop && keys[offset] < min) {
-            COUT_DEBUG("lower interval, offset: " << offset << ", key: " << keys[offset] << ", key_min: " << min);
-            offset++;
-        }
+unique_ptr<Snapshot> PackedMemoryArray8::snapshot() const {
+    return make_unique<Snapshot>(m_index, m_storage);
+}
 
-        notfound = (offset == stop);
-        if(notfound){
-            segment_id++;
-            segment_even = !segment_even; // flip
-        }
-    }
+/*****************************************************************************
+ *                                                                           *
+ *   Persistence                                                             *
+ *                                                                           *
+ *****************************************************************************/
+static constexpr uint64_t PERSISTENCE_MAGIC = 0x38414D5052414D52; // "RMARPMA8" in little endian
 
-    if(segment_even && segment_id < (m_storage.m_number_segments -1)){
-        stop = (segment_id +1) * m_storage.m_segment_capacity + m_storage.m_segment_sizes[segment_id +1]; // +1 implicit
-    }
+void PackedMemoryArray8::set_storage_directory(const std::string& directory){
+    m_storage.set_directory(directory);
+}
 
-    if(notfound || keys[offset] > max){ return SumResult{}; }
-
-    ssize_t end;
-    { // find the last qualifying index
-        assert(segment_end < m_storage.m_number_segments);
-        auto interval_start_segment = segment_id;
-        ssize_t segment_id = segment_end;
-        bool segment_even = segment_id % 2 == 0;
-        notfound = true;
-        ssize_t offset, start, stop;
-
-        while(notfound && segment_id >= interval_start_segment){
-            if(segment_even){
-                start = (segment_id +1) * m_storage.m_segment_capacity -1;
-                stop = start - m_storage.m_segment_sizes[segment_id];
-            } else { // odd
-                stop = segment_id * m_storage.m_segment_capacity;
-                start = stop + m_storage.m_segment_sizes[segment_id] -1;
-            }
-            COUT_DEBUG("upper interval, " << (segment_even ? "even":"odd") << " segment, start: " << start << " [key=" << keys[start] << "], stop: " << stop);
-            offset = start;
+void PackedMemoryArray8::set_memory_budget(size_t budget){
+    m_storage.set_memory_budget(budget);
+}
 
-            while(offset >= stop && keys[offset] > max){
-                COUT_DEBUG("upper interval, offset: " << offset << ", key: " << keys[offset] << ", key_max: " << max);
-                offset--;
-            }
+void PackedMemoryArray8::save(const std::string& path) const {
+    // write the header in a temporary file first, so that a crash does not leave a truncated header behind
+    string path_tmp = path + ".tmp";
+    fstream out(path_tmp, ios::out | ios::binary | ios::trunc);
+    if(!out.good()) RAISE_EXCEPTION(Exception, "[PackedMemoryArray8::save] Cannot create the file `" << path_tmp << "'");
 
-            notfound = offset < stop;
-            if(notfound){
-                segment_id--;
-                segment_even = !segment_even; // flip
-            }
-        }
+    uint64_t header[4] = { PERSISTENCE_MAGIC, (uint64_t) m_index.node_size(), m_storage.m_segment_capacity, m_storage.m_pages_per_extent };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    m_storage.save(path, out);
+    m_index.save(out);
+    out.close();
+    if(out.fail()) RAISE_EXCEPTION(Exception, "[PackedMemoryArray8::save] Cannot write the file `" << path_tmp << "'");
 
-        end = offset +1;
-    }
+    if(rename(path_tmp.c_str(), path.c_str()) != 0) RAISE_EXCEPTION(Exception, "[PackedMemoryArray8::save] Cannot rename the file `" << path_tmp << "' into `" << path << "'");
+}
 
-    if(end <= offset) return SumResult{};
-    stop = std::min(stop, end);
+unique_ptr<PackedMemoryArray8> PackedMemoryArray8::restore(const std::string& path){
+    fstream in(path, ios::in | ios::binary);
+    if(!in.good()) RAISE_EXCEPTION(Exception, "[PackedMemoryArray8::restore] Cannot open the file `" << path << "'");
 
-    int64_t* __restrict values = m_storage.m_values;
-    SumResult sum;
-    sum.m_first_key = keys[offset];
+    uint64_t header[4];
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if(!in || header[0] != PERSISTENCE_MAGIC) RAISE_EXCEPTION(Exception, "[PackedMemoryArray8::restore] Invalid header for the file `" << path << "'");
 
-    while(offset < end){
-        sum.m_num_elements += (stop - offset);
-        while(offset < stop){
-            sum.m_sum_keys += keys[offset];
-            sum.m_sum_values += values[offset];
-            offset++;
-        }
+    auto pma = make_unique<PackedMemoryArray8>(/* index B */ header[1], /* segment capacity */ header[2], /* pages per extent */ header[3]);
+    pma->m_storage.load(path, in);
+    pma->m_index.load(in);
+    pma->set_thresholds(pma->m_storage.hyperheight());
+    COUT_DEBUG("path: " << path << ", cardinality: " << pma->size() << ", segments: " << pma->m_storage.m_number_segments);
 
-        segment_id += 1 + (segment_id % 2 == 0); // next even segment
-        if(segment_id < m_storage.m_number_segments){
-            ssize_t size_lhs = m_storage.m_segment_sizes[segment_id];
-            ssize_t size_rhs = m_storage.m_segment_sizes[segment_id +1];
-            offset = (segment_id +1) * m_storage.m_segment_capacity - size_lhs;
-            stop = std::min(end, offset + size_lhs + size_rhs);
-        }
-    }
-    sum.m_last_key = keys[end -1];
+    return pma;
+}
 
-    return sum;
+/*****************************************************************************
+ *                                                                           *
+ *   Aggregate sum                                                           *
+ *                                                                           *
+ *****************************************************************************/
+pma::Interface::SumResult PackedMemoryArray8::sum(int64_t min, int64_t max) const {
+    if((min > max) || empty()){ return SumResult{}; }
+    auto result = do_sum(m_storage, m_index.find_first(min), m_index.find_last(max), min, max);
+    if(m_density_controller){ m_density_controller->record_scan(result.m_num_elements); }
+    return result;
 }
 
 /*****************************************************************************
@@ -23,11 +23,13 @@
 #include "storage.hpp"
 #include "pma/density_bounds.hpp"
 #include "pma/interface.hpp"
+#include "pma/generic/bloom_filter.hpp"
 #include "pma/generic/static_index.hpp"
 
 namespace pma { namespace v8 {
 
 // Forward declaration
+class Snapshot;
 class SpreadWithRewiring;
 
 class PackedMemoryArray8 : public Interface {
@@ -38,6 +40,8 @@ private:
     CachedMemoryPool m_memory_pool;
     CachedDensityBounds m_density_bounds0; // user thresholds (for num_segments<=balanced_thresholds_cutoff())
     CachedDensityBounds m_density_bounds1; // primary thresholds (for num_segmnets>balanced_thresholds_cutoff())
+    std::unique_ptr<DensityController> m_density_controller; // tune the thresholds according to the workload, nullptr if disabled
+    std::unique_ptr<BloomFilterArray> m_bloom_filters; // one filter for each pair of segments, to skip the lookups of absent keys, nullptr if disabled
     bool m_segment_statistics = false; // record segment statistics at the end?
 
     // Insert the first element in the (empty) container
@@ -79,6 +83,12 @@ private:
     // Retrieve the number of segments after that the primary thresholds are used
     size_t balanced_thresholds_cutoff() const;
 
+    // With the adaptive densities, at the end of an epoch, move the thresholds according to the recent workload
+    void adapt_densities();
+
+    // Rebuild the Bloom filters of the segment pairs overlapping the window [segment_start, segment_start + num_segments)
+    void bloom_filters_rebuild(size_t segment_start, size_t num_segments);
+
     // Returns an empty iterator, i.e. with an empty record set!
     std::unique_ptr<pma::Iterator> empty_iterator() const;
 
@@ -130,6 +140,40 @@ public:
 
     // Memory footprint
     virtual size_t memory_footprint() const override;
+
+    // Create a read-only view of the current content, it can be scanned while this instance keeps being updated
+    std::unique_ptr<Snapshot> snapshot() const;
+
+    // Keep the keys & values in files created in the given directory (e.g. a SSD, tmpfs or DAX mount point), rather than in anonymous memory
+    void set_storage_directory(const std::string& directory);
+
+    // Keep at most `budget' bytes of keys & values resident in memory, paging out the rest to the files in the storage directory. 0 means unlimited.
+    // Scans (iterators and sums) are not accounted in the budget, their extents are paged in and out by the O.S.
+    void set_memory_budget(size_t budget);
+
+    // Retrieve the extent cache that enforces the memory budget, or nullptr if the budget is unlimited
+    const ExtentCache* get_extent_cache() const noexcept { return m_storage.get_cache(); }
+
+    // Persist the content of the PMA in the file `path', together with `path'.keys and `path'.values for the elements.
+    // It requires the storage directory to be set, unless the PMA is so small that it does not use memory rewiring.
+    void save(const std::string& path) const;
+
+    // Restore an instance previously persisted with #save, mapping the elements from their files
+    static std::unique_ptr<PackedMemoryArray8> restore(const std::string& path);
+
+    // Tune the density thresholds online, according to the recent mix of updates & scans and the cost of the rebalances.
+    // The new thresholds are applied at the next rebalance or resize.
+    void set_adaptive_densities(bool value);
+
+    // Retrieve the controller of the adaptive densities, or nullptr if disabled
+    const DensityController* get_density_controller() const noexcept { return m_density_controller.get(); }
+
+    // Keep a Bloom filter for each pair of segments, so that a lookup for an absent key can usually return without
+    // scanning, or paging in, its segment. The filters are updated on insert and rebuilt after each rebalance.
+    void set_bloom_filters(bool value);
+
+    // Retrieve the Bloom filters, or nullptr if disabled
+    const BloomFilterArray* get_bloom_filters() const noexcept { return m_bloom_filters.get(); }
 };
 
 // Dump
@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.hpp"
+
+#include <limits>
+#include "iterator.hpp"
+#include "sum.hpp"
+
+using namespace std;
+
+namespace pma { namespace v8 {
+
+Snapshot::Snapshot(const StaticIndex& index, const Storage& storage) : m_index(index), m_storage(storage) { }
+
+Snapshot::~Snapshot() { }
+
+size_t Snapshot::size() const noexcept {
+    return m_storage.m_cardinality;
+}
+
+bool Snapshot::empty() const noexcept {
+    return m_storage.m_cardinality == 0;
+}
+
+size_t Snapshot::memory_footprint() const noexcept {
+    return sizeof(Snapshot) + m_index.memory_footprint() + max<size_t>(2, m_storage.m_number_segments) * sizeof(m_storage.m_segment_sizes[0]);
+}
+
+int64_t Snapshot::find(int64_t key) const {
+    if(empty()) return -1;
+
+    auto segment_id = m_index.find(key);
+    const int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
+    size_t sz = m_storage.m_segment_sizes[segment_id];
+    size_t start = (segment_id % 2 == 0) ? m_storage.m_segment_capacity - sz : 0;
+    size_t stop = start + sz;
+
+    for(size_t i = start; i < stop; i++){
+        if(keys[i] == key){
+            return m_storage.m_values[segment_id * m_storage.m_segment_capacity + i];
+        }
+    }
+
+    return -1;
+}
+
+::pma::Interface::SumResult Snapshot::sum(int64_t min, int64_t max) const {
+    if((min > max) || empty()){ return ::pma::Interface::SumResult{}; }
+    return do_sum(m_storage, m_index.find_first(min), m_index.find_last(max), min, max);
+}
+
+unique_ptr<pma::Iterator> Snapshot::iterator() const {
+    if(empty()) return make_unique<pma::v8::Iterator>(m_storage);
+    return make_unique<pma::v8::Iterator> (m_storage, 0, m_storage.m_number_segments -1,
+            numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max()
+    );
+}
+
+}} // pma::v8
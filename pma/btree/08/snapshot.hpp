@@ -0,0 +1,87 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BTREE_08_SNAPSHOT_HPP_
+#define BTREE_08_SNAPSHOT_HPP_
+
+#include <memory>
+
+#include "storage.hpp"
+#include "pma/interface.hpp"
+#include "pma/generic/static_index.hpp"
+
+namespace pma { namespace v8 {
+
+// forward declaration
+class PackedMemoryArray8;
+
+/**
+ * A read-only view of a PackedMemoryArray8, frozen at the time of its creation. The index and the segment
+ * cardinalities are duplicated, while the extents of the keys & values are shared with the source through
+ * copy on write. The source can keep being updated, and even be destroyed, while the snapshot is alive.
+ *
+ * Create a snapshot with PackedMemoryArray8::snapshot().
+ */
+class Snapshot {
+    StaticIndex m_index;
+    Storage m_storage;
+
+public:
+    /**
+     * Create a snapshot of the given PMA
+     */
+    Snapshot(const StaticIndex& index, const Storage& storage);
+
+    /**
+     * Destructor
+     */
+    ~Snapshot();
+
+    /**
+     * Find the element with the given `key'. It returns its value if found, otherwise the value -1.
+     */
+    int64_t find(int64_t key) const;
+
+    /**
+     * Sum all elements in the interval [min, max]
+     */
+    ::pma::Interface::SumResult sum(int64_t min, int64_t max) const;
+
+    /**
+     * Return an iterator over all elements of the snapshot
+     */
+    std::unique_ptr<pma::Iterator> iterator() const;
+
+    /**
+     * The number of elements in the snapshot
+     */
+    size_t size() const noexcept;
+
+    /**
+     * Check whether the snapshot is empty
+     */
+    bool empty() const noexcept;
+
+    /**
+     * Memory footprint of the snapshot, excluding the extents shared with the source
+     */
+    size_t memory_footprint() const noexcept;
+};
+
+}} // pma::v8
+
+#endif /* BTREE_08_SNAPSHOT_HPP_ */
@@ -232,6 +232,7 @@ void SpreadWithRewiring::spread_extent(int64_t extent_id, size_t num_elements){
     if(!use_rewiring){
         COUT_DEBUG("without rewiring, extent_id: " << extent_id);
         // no need for rewiring, just spread in place as the source and destination refer to different extents
+        m_instance.m_storage.prepare_write(extent2segment(extent_id), m_segments_per_extent);
         spread_elements(get_start_address(m_instance.m_storage.m_keys, extent_id), get_start_address(m_instance.m_storage.m_values, extent_id), extent_id, num_elements);
     } else {
         // get some space from the rewiring facility
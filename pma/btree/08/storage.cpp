@@ -20,11 +20,16 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <memory>
+#include <vector>
+#include "aligned_memory.hpp"
 #include "buffered_rewired_memory.hpp"
+#include "extent_cache.hpp"
 #include "miscellaneous.hpp"
 #include "rewired_memory.hpp"
+#include "rewired_memory_snapshot.hpp"
 
 using namespace std;
 
@@ -63,7 +68,53 @@ Storage::Storage(size_t segment_size, size_t pages_per_extent) : m_segment_capac
     alloc_workspace(1, &m_keys, &m_values, &m_segment_sizes, &m_memory_keys, &m_memory_values, &m_memory_sizes);
 }
 
+Storage::Storage(const Storage& source) : m_segment_capacity(source.m_segment_capacity), m_cardinality(source.m_cardinality),
+        m_number_segments(source.m_number_segments), m_pages_per_extent(source.m_pages_per_extent) {
+    m_keys = m_values = nullptr;
+    m_segment_sizes = nullptr;
+
+    // release the acquired resources on error
+    auto onErrorDeleter = [this, &source](void*){
+        if(source.m_memory_keys == nullptr){ free(m_keys); free(m_values); }
+        m_keys = m_values = nullptr;
+        delete m_snapshot_keys; m_snapshot_keys = nullptr;
+        delete m_snapshot_values; m_snapshot_values = nullptr;
+        aligned_memory_free(m_segment_sizes); m_segment_sizes = nullptr;
+    };
+    unique_ptr<Storage, decltype(onErrorDeleter)> onError{this, onErrorDeleter};
+
+    if(source.m_memory_keys != nullptr){ // rewired memory, share the extents through copy on write
+        m_snapshot_keys = source.m_memory_keys->snapshot().release();
+        m_keys = (int64_t*) m_snapshot_keys->get_start_address();
+        m_snapshot_values = source.m_memory_values->snapshot().release();
+        m_values = (int64_t*) m_snapshot_values->get_start_address();
+    } else { // tiny PMA, duplicate the arrays
+        const size_t elts_space_required_bytes = capacity() * sizeof(m_keys[0]);
+        if(posix_memalign((void**) &m_keys, /* alignment */ 64,  /* size */ elts_space_required_bytes) != 0 ||
+           posix_memalign((void**) &m_values, /* alignment */ 64,  /* size */ elts_space_required_bytes) != 0){
+            RAISE_EXCEPTION(Exception, "[Storage::ctor] It cannot obtain a chunk of aligned memory. Requested size: " << elts_space_required_bytes);
+        }
+        memcpy(m_keys, source.m_keys, elts_space_required_bytes);
+        memcpy(m_values, source.m_values, elts_space_required_bytes);
+    }
+
+    // the segment sizes are always duplicated, they are a fraction of the keys & values
+    const size_t card_space_required_bytes = max<size_t>(2, m_number_segments) * sizeof(m_segment_sizes[0]);
+    m_segment_sizes = (uint16_t*) aligned_memory_allocate(card_space_required_bytes);
+    memcpy(m_segment_sizes, source.m_segment_sizes, card_space_required_bytes);
+
+    onError.release();
+}
+
 Storage::~Storage(){
+    delete m_cache; m_cache = nullptr;
+
+    if(m_snapshot_keys != nullptr || m_snapshot_values != nullptr){ // read-only copy
+        m_keys = m_values = nullptr; // do not release them with free()
+        delete m_snapshot_keys; m_snapshot_keys = nullptr;
+        delete m_snapshot_values; m_snapshot_values = nullptr;
+    }
+
     dealloc_workspace(&m_keys, &m_values, &m_segment_sizes, &m_memory_keys, &m_memory_values, &m_memory_sizes);
 }
 
@@ -93,9 +144,9 @@ void Storage::alloc_workspace(size_t num_segments, int64_t** keys, int64_t** val
                 ((card_space_required_bytes/extent_size) + (card_space_required_bytes%extent_size > 0))
                 : 1; // at least one segment for the cardinalities
 
-        *rewired_memory_keys = new BufferedRewiredMemory(m_pages_per_extent, elts_num_extents);
+        *rewired_memory_keys = new BufferedRewiredMemory(m_pages_per_extent, elts_num_extents, m_directory);
         *keys = (int64_t*) (*rewired_memory_keys)->get_start_address();
-        *rewired_memory_values = new BufferedRewiredMemory(m_pages_per_extent, elts_num_extents);
+        *rewired_memory_values = new BufferedRewiredMemory(m_pages_per_extent, elts_num_extents, m_directory);
         *values = (int64_t*) (*rewired_memory_values)->get_start_address();
         *rewired_memory_cardinalities = new RewiredMemory(m_pages_per_extent, card_num_extents, (*rewired_memory_keys)->get_max_memory() * sizeof(uint16_t) / sizeof(int64_t));
         *sizes = (uint16_t*) (*rewired_memory_cardinalities)->get_start_address();
@@ -114,11 +165,8 @@ void Storage::alloc_workspace(size_t num_segments, int64_t** keys, int64_t** val
                     "Requested size: " << elts_space_required_bytes);
         }
 
-        rc = posix_memalign((void**) sizes, /* alignment */ 64,  /* size */ card_space_required_bytes);
-        if(rc != 0) {
-            RAISE_EXCEPTION(Exception, "[Storage::alloc_workspace] It cannot obtain a chunk of aligned memory. " <<
-                    "Requested size: " << card_space_required_bytes);
-        }
+        // traversed by the calibrator tree, back it with huge pages if large enough
+        *sizes = (uint16_t*) aligned_memory_allocate(card_space_required_bytes);
     }
 
     // always allocate at least 2 segments, using the second segment as special mark with size = 0
@@ -223,11 +271,174 @@ void Storage::dealloc_workspace(int64_t** keys, int64_t** values, decltype(m_seg
         *sizes = nullptr;
         delete *rewired_memory_cardinalities; *rewired_memory_cardinalities = nullptr;
     } else {
-        free(*sizes); *sizes = nullptr;
+        aligned_memory_free(*sizes); *sizes = nullptr;
     }
 }
 
 
+/*****************************************************************************
+ *                                                                           *
+ *   Persistence                                                             *
+ *                                                                           *
+ *****************************************************************************/
+
+template<typename T>
+static void write_value(std::ostream& out, T value){
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+static T read_value(std::istream& in){
+    T value {0};
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    if(!in) RAISE_EXCEPTION(Exception, "[Storage::load] Unexpected end of the stream");
+    return value;
+}
+
+static void save_rewired_memory(BufferedRewiredMemory* memory, const string& path, std::ostream& out){
+    memory->save(path);
+
+    const auto& translation_map = memory->get_translation_map();
+    write_value<uint64_t>(out, memory->get_total_buffers());
+    write_value<uint64_t>(out, translation_map.size());
+    out.write(reinterpret_cast<const char*>(translation_map.data()), translation_map.size() * sizeof(translation_map[0]));
+}
+
+static BufferedRewiredMemory* load_rewired_memory(const string& path, size_t pages_per_extent, std::istream& in){
+    uint64_t num_buffers = read_value<uint64_t>(in);
+    vector<uint32_t> translation_map ( read_value<uint64_t>(in) );
+    in.read(reinterpret_cast<char*>(translation_map.data()), translation_map.size() * sizeof(translation_map[0]));
+    if(!in) RAISE_EXCEPTION(Exception, "[Storage::load] Cannot read the translation map for the file `" << path << "'");
+
+    return new BufferedRewiredMemory(path, pages_per_extent, translation_map, num_buffers);
+}
+
+void Storage::set_directory(const std::string& directory){
+    m_directory = directory;
+}
+
+void Storage::save(const std::string& path, std::ostream& out) const {
+    write_value<uint64_t>(out, m_segment_capacity);
+    write_value<uint64_t>(out, m_pages_per_extent);
+    write_value<uint64_t>(out, m_cardinality);
+    write_value<uint64_t>(out, m_number_segments);
+
+    // keys & values
+    bool use_rewired_memory = m_memory_keys != nullptr;
+    write_value<uint8_t>(out, use_rewired_memory);
+    if(use_rewired_memory){
+        save_rewired_memory(m_memory_keys, path + ".keys", out);
+        save_rewired_memory(m_memory_values, path + ".values", out);
+    } else { // tiny PMA, just copy the arrays
+        out.write(reinterpret_cast<const char*>(m_keys), capacity() * sizeof(m_keys[0]));
+        out.write(reinterpret_cast<const char*>(m_values), capacity() * sizeof(m_values[0]));
+    }
+
+    // cardinalities
+    out.write(reinterpret_cast<const char*>(m_segment_sizes), max<size_t>(2, m_number_segments) * sizeof(m_segment_sizes[0]));
+
+    if(!out) RAISE_EXCEPTION(Exception, "[Storage::save] Cannot write the output stream");
+}
+
+void Storage::load(const std::string& path, std::istream& in){
+    if(read_value<uint64_t>(in) != m_segment_capacity) RAISE_EXCEPTION(Exception, "[Storage::load] Segment capacity mismatch");
+    if(read_value<uint64_t>(in) != m_pages_per_extent) RAISE_EXCEPTION(Exception, "[Storage::load] Extent size mismatch");
+    uint64_t cardinality = read_value<uint64_t>(in);
+    uint64_t number_segments = read_value<uint64_t>(in);
+    if(number_segments == 0 || number_segments > numeric_limits<uint32_t>::max()) RAISE_EXCEPTION(Exception, "[Storage::load] Invalid number of segments: " << number_segments);
+
+    // release the current workspace
+    dealloc_workspace(&m_keys, &m_values, &m_segment_sizes, &m_memory_keys, &m_memory_values, &m_memory_sizes);
+    m_cardinality = cardinality;
+    m_number_segments = number_segments;
+
+    const size_t extent_size = m_pages_per_extent * get_memory_page_size();
+    const size_t card_space_required_bytes = max<size_t>(2, m_number_segments) * sizeof(m_segment_sizes[0]);
+    bool use_rewired_memory = read_value<uint8_t>(in);
+    if(use_rewired_memory){
+        m_memory_keys = load_rewired_memory(path + ".keys", m_pages_per_extent, in);
+        m_keys = (int64_t*) m_memory_keys->get_start_address();
+        m_memory_values = load_rewired_memory(path + ".values", m_pages_per_extent, in);
+        m_values = (int64_t*) m_memory_values->get_start_address();
+
+        const size_t card_num_extents = (card_space_required_bytes > extent_size) ?
+                ((card_space_required_bytes/extent_size) + (card_space_required_bytes%extent_size > 0))
+                : 1; // at least one segment for the cardinalities
+        m_memory_sizes = new RewiredMemory(m_pages_per_extent, card_num_extents, m_memory_keys->get_max_memory() * sizeof(uint16_t) / sizeof(int64_t));
+        m_segment_sizes = (uint16_t*) m_memory_sizes->get_start_address();
+    } else {
+        const size_t elts_space_required_bytes = capacity() * sizeof(m_keys[0]);
+        if(posix_memalign((void**) &m_keys, /* alignment */ 64,  /* size */ elts_space_required_bytes) != 0 ||
+           posix_memalign((void**) &m_values, /* alignment */ 64,  /* size */ elts_space_required_bytes) != 0){
+            RAISE_EXCEPTION(Exception, "[Storage::load] It cannot obtain a chunk of aligned memory. Requested size: " << elts_space_required_bytes);
+        }
+        m_segment_sizes = (uint16_t*) aligned_memory_allocate(card_space_required_bytes);
+        in.read(reinterpret_cast<char*>(m_keys), elts_space_required_bytes);
+        in.read(reinterpret_cast<char*>(m_values), elts_space_required_bytes);
+    }
+
+    // cardinalities
+    in.read(reinterpret_cast<char*>(m_segment_sizes), card_space_required_bytes);
+    if(!in) RAISE_EXCEPTION(Exception, "[Storage::load] Unexpected end of the stream");
+
+    // the files will be replaced by the next #save, keep the next workspaces in the same directory
+    auto pos = path.find_last_of('/');
+    if(pos == string::npos){
+        m_directory = ".";
+    } else if (pos == 0){
+        m_directory = "/";
+    } else {
+        m_directory = path.substr(0, pos);
+    }
+
+    reset_cache();
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Extent cache                                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+void Storage::set_memory_budget(size_t budget){
+    if(budget > 0 && m_directory.empty()) throw std::invalid_argument("[Storage::set_memory_budget] The storage directory is not set");
+    m_memory_budget = budget;
+
+    if(budget == 0){
+        delete m_cache; m_cache = nullptr;
+    } else {
+        // an extent of the cache is both an extent for the keys and one for the values
+        const size_t extent_size = m_pages_per_extent * get_memory_page_size();
+        const size_t capacity = max<size_t>(1, budget / (2 * extent_size));
+        if(m_cache == nullptr){
+            m_cache = new ExtentCache(capacity);
+            reset_cache();
+        } else {
+            m_cache->set_capacity(capacity);
+        }
+    }
+}
+
+void Storage::reset_cache(){
+    if(m_cache == nullptr) return;
+
+    if(m_memory_keys != nullptr && m_memory_keys->is_file_backed() && m_memory_values->is_file_backed()){
+        m_cache->attach({ m_memory_keys, m_memory_values }, get_number_extents());
+    } else { // tiny PMA, or the workspace was allocated before the directory was set
+        m_cache->detach();
+    }
+}
+
+void Storage::fetch_extents(size_t segment_start, size_t num_segments) const {
+    assert(m_cache != nullptr);
+    if(!m_cache->is_attached() || num_segments == 0) return;
+
+    const size_t segments_per_extent = get_segments_per_extent();
+    const size_t extent_start = segment_start / segments_per_extent;
+    const size_t extent_end = (segment_start + num_segments -1) / segments_per_extent +1; // excl.
+    m_cache->access(extent_start, extent_end - extent_start);
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Properties                                                              *
@@ -283,8 +494,18 @@ size_t Storage::memory_footprint() const noexcept {
  *                                                                           *
  *****************************************************************************/
 
-bool Storage::insert(size_t segment_id, int64_t key, int64_t value) noexcept {
+void Storage::prepare_write(size_t segment_start, size_t num_segments){
+    if(m_memory_keys == nullptr || !m_memory_keys->has_snapshots()) return; // nop
+
+    const size_t offset = segment_start * m_segment_capacity;
+    const size_t length = num_segments * m_segment_capacity * sizeof(m_keys[0]);
+    m_memory_keys->prepare_write(m_keys + offset, length);
+    m_memory_values->prepare_write(m_values + offset, length);
+}
+
+bool Storage::insert(size_t segment_id, int64_t key, int64_t value) {
     assert(m_segment_sizes[segment_id] < m_segment_capacity && "This segment is full!");
+    prepare_write(segment_id, 1);
 
     int64_t* __restrict keys = m_keys + segment_id * m_segment_capacity;
     int64_t* __restrict values = m_values + segment_id * m_segment_capacity;
@@ -20,22 +20,32 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "pma/interface.hpp"
 
 // forward declarations
 class BufferedRewiredMemory;
+class ExtentCache;
 class RewiredMemory;
+class RewiredMemorySnapshot;
 
 namespace pma { namespace v8 {
 
 // forward declarations
 class Iterator;
 class PackedMemoryArray8;
+class Snapshot;
 class SpreadWithRewiring;
 
 class Storage {
     friend class Iterator;
     friend class PackedMemoryArray8;
+    friend class Snapshot;
     friend class SpreadWithRewiring;
+    friend ::pma::Interface::SumResult do_sum(const Storage& storage, int64_t segment_start, int64_t segment_end, int64_t key_min, int64_t key_max);
 
     int64_t* m_keys; // pma for the keys
     int64_t* m_values; // pma for the values
@@ -47,6 +57,20 @@ class Storage {
     BufferedRewiredMemory* m_memory_keys = nullptr; // memory space used for the keys
     BufferedRewiredMemory* m_memory_values = nullptr; // memory space used for the values
     RewiredMemory* m_memory_sizes = nullptr; // memory space used for the segment cardinalities
+    RewiredMemorySnapshot* m_snapshot_keys = nullptr; // read-only view of the keys, only set in the copies created by a Snapshot
+    RewiredMemorySnapshot* m_snapshot_values = nullptr; // read-only view of the values, only set in the copies created by a Snapshot
+    std::string m_directory; // when not empty, the keys & values in rewired memory are backed by files in this directory
+    size_t m_memory_budget = 0; // max amount of memory, in bytes, for the resident keys & values. 0 means unlimited
+    ExtentCache* m_cache = nullptr; // keep the resident extents within the memory budget, only set when the budget is not 0
+
+    /**
+     * Create a read-only copy of `source', frozen at the time of the call. The keys & values in rewired memory are
+     * shared with `source' through copy on write, while all the rest is duplicated.
+     */
+    Storage(const Storage& source);
+
+    // Notify the extent cache the given segments are about to be accessed
+    void fetch_extents(size_t segment_start, size_t num_segments) const;
 
 public:
     Storage(uint64_t segment_size, uint64_t pages_per_extents);
@@ -73,11 +97,62 @@ public:
      */
     void shrink(size_t num_segment);
 
+    /**
+     * Back the keys & values in rewired memory with files in the given directory, rather than anonymous memory. It only
+     * affects the workspaces allocated after this call.
+     */
+    void set_directory(const std::string& directory);
+
+    /**
+     * Set the max amount of memory, in bytes, for the keys & values kept resident. The rest is paged out to their
+     * files, thus the directory must be set (see #set_directory). The budget becomes effective once the storage
+     * uses file backed rewired memory. A budget of 0 means unlimited.
+     */
+    void set_memory_budget(size_t budget);
+
+    /**
+     * Reassign the extent cache to the current workspace. To be invoked after the keys & values have been rebuilt.
+     */
+    void reset_cache();
+
+    /**
+     * Notify that the segments in [segment_start, segment_start + num_segments) are about to be accessed, paging in
+     * their extents if they are not resident.
+     */
+    void fetch(size_t segment_start, size_t num_segments) const {
+        if(m_cache != nullptr) fetch_extents(segment_start, num_segments);
+    }
+
+    /**
+     * Retrieve the extent cache, if a memory budget has been set, or nullptr otherwise
+     */
+    const ExtentCache* get_cache() const noexcept { return m_cache; }
+
+    /**
+     * Persist the content of the storage. The keys & values in rewired memory are made durable in the files `path'.keys
+     * and `path'.values, while the rest, including the translation maps and the segment cardinalities, is written
+     * in the binary stream `out'.
+     * Precondition: the rewired memory, if used, is backed by files (see #set_directory)
+     */
+    void save(const std::string& path, std::ostream& out) const;
+
+    /**
+     * Replace the content of the storage with the one previously persisted with #save. The keys & values are mapped
+     * from the files `path'.keys and `path'.values, without reading them.
+     */
+    void load(const std::string& path, std::istream& in);
+
+    /**
+     * Notify that the keys & values of the segments in [segment_start, segment_start + num_segments) are about to
+     * be altered. It copies the affected extents still referenced by a live snapshot.
+     */
+    void prepare_write(size_t segment_start, size_t num_segments);
+
     /**
      * Insert the given pair in the segment. Return true if the key becomes the new minimum of the segment.
      * Precondition: the segment is neither full nor empty
      */
-    bool insert(size_t segment_id, int64_t key, int64_t value) noexcept;
+    bool insert(size_t segment_id, int64_t key, int64_t value);
 
     /**
      * Retrieve the number of segments per extent
@@ -21,12 +21,19 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <emmintrin.h> // _mm_pause
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
+#include "pma/generic/concurrent_dynamic_index.hpp"
 #include "pma/generic/dynamic_index.hpp"
+#include "pma/generic/inplace_resize.hpp"
+#include "pma/generic/interleaved_lookup.hpp"
+#include "epoch_manager.hpp"
 #include "errorhandling.hpp"
+#include "mapped_memory.hpp"
 #include "miscellaneous.hpp"
 
 using namespace pma::btree_pma_v4_detail;
@@ -53,6 +60,7 @@ namespace pma {
  *                                                                           *
  *****************************************************************************/
 #define INDEX reinterpret_cast<DynamicIndex<int64_t, uint64_t>*>(m_index)
+#define CINDEX reinterpret_cast<ConcurrentDynamicIndex<int64_t, uint64_t>*>(m_index)
 static constexpr int STORAGE_MIN_CAPACITY = 8; // the minimum capacity of the underlying PMA
 
 BTreePMA_v4::BTreePMA_v4() : m_index(new DynamicIndex<int64_t, uint64_t>{}), m_storage(STORAGE_MIN_CAPACITY, /* fixed size segmnets ? */ false) {
@@ -65,10 +73,15 @@ BTreePMA_v4::BTreePMA_v4(uint64_t segment_capacity) : m_index(new DynamicIndex<i
 
 
 BTreePMA_v4::~BTreePMA_v4() {
-    delete INDEX; m_index = nullptr;
+    if(m_synchronized){
+        delete CINDEX;
+    } else {
+        delete INDEX;
+    }
+    m_index = nullptr;
 }
 
-btree_pma_v4_detail::PMA::PMA(size_t segment_size, bool has_fixed_segment_capacity) : m_segment_capacity( hyperceil(segment_size ) ), m_has_fixed_segment_capacity(has_fixed_segment_capacity){
+btree_pma_v4_detail::PMA::PMA(size_t segment_size, bool has_fixed_segment_capacity) : m_segment_capacity( hyperceil(segment_size ) ), m_has_fixed_segment_capacity(has_fixed_segment_capacity), m_mapped_memory(false){
     if(hyperceil(segment_size ) > numeric_limits<uint16_t>::max()) throw std::invalid_argument("segment size too big, maximum is " + std::to_string( numeric_limits<uint16_t>::max() ));
     if(m_segment_capacity < 8) throw std::invalid_argument("segment size too small, minimum is 8");
 
@@ -82,9 +95,47 @@ btree_pma_v4_detail::PMA::PMA(size_t segment_size, bool has_fixed_segment_capaci
 }
 
 btree_pma_v4_detail::PMA::~PMA(){
-    free(m_keys); m_keys = nullptr;
-    free(m_values); m_values = nullptr;
-    free(m_segment_cardinalities); m_segment_cardinalities = nullptr;
+    free_workspace();
+}
+
+void btree_pma_v4_detail::PMA::free_workspace(){
+    if(m_mapped_memory){
+        mapped_memory_free(m_keys, m_capacity * sizeof(m_keys[0]));
+        mapped_memory_free(m_values, m_capacity * sizeof(m_values[0]));
+        mapped_memory_free(m_segment_cardinalities, m_number_segments * sizeof(m_segment_cardinalities[0]));
+    } else {
+        free(m_keys);
+        free(m_values);
+        free(m_segment_cardinalities);
+    }
+    m_keys = nullptr;
+    m_values = nullptr;
+    m_segment_cardinalities = nullptr;
+}
+
+void btree_pma_v4_detail::PMA::set_mapped_memory(bool value){
+    if(m_mapped_memory == value) return;
+    if(m_cardinality > 0) RAISE_EXCEPTION(Exception, "[PMA::set_mapped_memory] The PMA must be empty");
+
+    free_workspace();
+    m_mapped_memory = value;
+    if(m_mapped_memory){
+        m_keys = (int64_t*) mapped_memory_allocate(m_capacity * sizeof(m_keys[0]));
+        m_values = (int64_t*) mapped_memory_allocate(m_capacity * sizeof(m_values[0]));
+        m_segment_cardinalities = (uint16_t*) mapped_memory_allocate(m_number_segments * sizeof(m_segment_cardinalities[0]));
+    } else {
+        alloc_workspace(m_number_segments, m_segment_capacity, &m_keys, &m_values, &m_segment_cardinalities);
+    }
+}
+
+void btree_pma_v4_detail::PMA::extend_mapped_workspace(size_t num_segments, size_t segment_capacity){
+    assert(m_mapped_memory && "The arrays have not been allocated with mmap");
+    assert(num_segments * segment_capacity >= m_capacity && "Only to increase the capacity");
+    size_t capacity = num_segments * segment_capacity;
+    m_keys = (int64_t*) mapped_memory_resize(m_keys, m_capacity * sizeof(m_keys[0]), capacity * sizeof(m_keys[0]));
+    m_values = (int64_t*) mapped_memory_resize(m_values, m_capacity * sizeof(m_values[0]), capacity * sizeof(m_values[0]));
+    m_segment_cardinalities = (uint16_t*) mapped_memory_resize(m_segment_cardinalities,
+            m_number_segments * sizeof(m_segment_cardinalities[0]), num_segments * sizeof(m_segment_cardinalities[0]));
 }
 
 void btree_pma_v4_detail::PMA::alloc_workspace(size_t num_segments, size_t segment_capacity, int64_t** keys, int64_t** values, decltype(m_segment_cardinalities)* cardinalities){
@@ -132,6 +183,40 @@ size_t BTreePMA_v4::segment_capacity() const{
     return m_storage.m_segment_capacity;
 }
 
+void BTreePMA_v4::set_mremap_growth(bool value){
+    if(!empty()) RAISE_EXCEPTION(Exception, "[BTreePMA_v4::set_mremap_growth] The container must be empty");
+    if(value && m_synchronized) RAISE_EXCEPTION(Exception, "[BTreePMA_v4::set_mremap_growth] Not supported with synchronisation, mremap may move the arrays while they are read");
+    m_storage.set_mapped_memory(value);
+}
+
+bool BTreePMA_v4::has_mremap_growth() const {
+    return m_storage.m_mapped_memory;
+}
+
+void BTreePMA_v4::set_synchronized(bool value){
+    if(m_synchronized == value) return;
+    if(!empty()) RAISE_EXCEPTION(Exception, "[BTreePMA_v4::set_synchronized] The container must be empty");
+    if(value && m_storage.m_mapped_memory) RAISE_EXCEPTION(Exception, "[BTreePMA_v4::set_synchronized] Not supported with the mremap growth");
+
+    if(value){
+        delete INDEX;
+        m_index = new ConcurrentDynamicIndex<int64_t, uint64_t>{};
+        m_segment_versions.reset(new atomic<uint64_t>[NUM_SEGMENT_VERSIONS]);
+        for(uint64_t i = 0; i < NUM_SEGMENT_VERSIONS; i++){ m_segment_versions[i] = 0; }
+        m_epoch.reset(new EpochManager());
+    } else {
+        delete CINDEX;
+        m_index = new DynamicIndex<int64_t, uint64_t>{};
+        m_segment_versions.reset();
+        m_epoch.reset();
+    }
+    m_synchronized = value;
+}
+
+bool BTreePMA_v4::is_synchronized() const {
+    return m_synchronized;
+}
+
 pair<double, double> BTreePMA_v4::thresholds(int height) {
     return thresholds(height, m_storage.m_height);
 }
@@ -167,17 +252,24 @@ uint64_t BTreePMA_v4::get_cardinality(uint64_t segment_id) const{
  *****************************************************************************/
 void BTreePMA_v4::insert(int64_t key, int64_t value){
     COUT_DEBUG("key: " << key << ", value: " << value);
+    unique_lock<mutex> lock(m_writer_lock, defer_lock);
+    if(m_synchronized) lock.lock();
 
     if(empty()){
+        storage_write_lock();
         insert_empty(key, value);
-        INDEX->insert(key, 0); // point to segment 0
+        index_insert(key, 0); // point to segment 0
+        storage_write_unlock();
     } else {
         auto segment_id = index_find_leq(key);
 
         // is this segment full ?
         bool element_inserted_on_rebalance = false ;
+        bool storage_locked = false; // whether a rebalance or a resize have been triggered
 
         if( get_cardinality(segment_id) == m_storage.m_segment_capacity ){
+            storage_write_lock();
+            storage_locked = true;
             element_inserted_on_rebalance = rebalance(segment_id, key, value);
 
             if(!element_inserted_on_rebalance){ // resize
@@ -186,15 +278,19 @@ void BTreePMA_v4::insert(int64_t key, int64_t value){
         }
 
         if(!element_inserted_on_rebalance){
+            if(!storage_locked) segment_write_lock(segment_id);
             int64_t pivot_old = get_minimum(segment_id);
             bool minimum_updated = insert_common(segment_id, key, value);
 
             // have we just updated the minimum ?
             if (minimum_updated){
                 int64_t pivot_new = get_minimum(segment_id);
-                index_update(pivot_old, pivot_new);
+                index_update(pivot_old, pivot_new, segment_id);
             }
+            if(!storage_locked) segment_write_unlock(segment_id);
         }
+
+        if(storage_locked) storage_write_unlock();
     }
 
 #if defined(DEBUG)
@@ -265,11 +361,73 @@ bool BTreePMA_v4::insert_common(uint64_t segment_id, int64_t key, int64_t value)
     return minimum;
 }
 
+void BTreePMA_v4::index_insert(int64_t key, uint64_t segment_id){
+    if(m_synchronized){
+        CINDEX->insert(key, segment_id);
+    } else {
+        INDEX->insert(key, segment_id);
+    }
+}
+
+void BTreePMA_v4::index_remove(int64_t key){
+    if(m_synchronized){
+        CINDEX->remove_any(key);
+    } else {
+        INDEX->remove_any(key);
+    }
+}
+
 // Change the separator key for a given entry in the index
-void BTreePMA_v4::index_update(int64_t key_old, int64_t key_new){
-    uint64_t segment_id =0;
-    INDEX->remove_any(key_old, &segment_id);
-    INDEX->insert(key_new, segment_id);
+void BTreePMA_v4::index_update(int64_t key_old, int64_t key_new, uint64_t segment_id){
+    // insert the new separator before removing the old one, so that concurrent readers always find an entry for the segment
+    index_insert(key_new, segment_id);
+    index_remove(key_old);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Synchronisation                                                         *
+ *                                                                           *
+ *****************************************************************************/
+// Seqlock protocol: the writers make the version odd before altering the protected data and even again afterwards. The readers
+// wait for an even version, read the data, and validate that the version has not changed in the meanwhile.
+static void seqlock_write_lock(atomic<uint64_t>& version){
+    version.store(version.load(memory_order_relaxed) +1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // the following writes cannot be reordered before the version change
+}
+
+static void seqlock_write_unlock(atomic<uint64_t>& version){
+    version.store(version.load(memory_order_relaxed) +1, memory_order_release);
+}
+
+static uint64_t seqlock_read_lock(const atomic<uint64_t>& version){
+    uint64_t value = version.load(memory_order_acquire);
+    while(value % 2 == 1){ // a writer is altering the data
+        _mm_pause();
+        value = version.load(memory_order_acquire);
+    }
+    return value;
+}
+
+static bool seqlock_check(const atomic<uint64_t>& version, uint64_t value){
+    atomic_thread_fence(memory_order_acquire); // the previous reads cannot be reordered after the check
+    return version.load(memory_order_relaxed) == value;
+}
+
+void BTreePMA_v4::storage_write_lock(){
+    if(m_synchronized) seqlock_write_lock(m_storage_version);
+}
+
+void BTreePMA_v4::storage_write_unlock(){
+    if(m_synchronized) seqlock_write_unlock(m_storage_version);
+}
+
+void BTreePMA_v4::segment_write_lock(uint64_t segment_id){
+    if(m_synchronized) seqlock_write_lock(m_segment_versions[segment_id % NUM_SEGMENT_VERSIONS]);
+}
+
+void BTreePMA_v4::segment_write_unlock(uint64_t segment_id){
+    if(m_synchronized) seqlock_write_unlock(m_segment_versions[segment_id % NUM_SEGMENT_VERSIONS]);
 }
 
 /*****************************************************************************
@@ -342,7 +500,7 @@ void BTreePMA_v4::spread(size_t cardinality_after, size_t window_start, size_t n
 
     // remove all keys related to this window from the index
     for(size_t i = 0; i < num_segments; i++){
-        INDEX->remove_any(get_minimum(window_start +i));
+        index_remove(get_minimum(window_start +i));
     }
 
     // workspace
@@ -494,7 +652,7 @@ void BTreePMA_v4::spread(size_t cardinality_after, size_t window_start, size_t n
 
     // update the tree
     for(size_t i = 0; i < num_segments; i++){
-        INDEX->insert(get_minimum(window_start + i), window_start + i);
+        index_insert(get_minimum(window_start + i), window_start + i);
     }
 }
 
@@ -528,6 +686,11 @@ void BTreePMA_v4::resize() {
 
     COUT_DEBUG(m_storage.m_capacity << " --> " << capacity << ", segment_capacity: " << segment_capacity << ", num_segments: " << num_segments << ", cardinality: " << cardinality);
 
+    if(m_storage.m_mapped_memory){
+        resize_inplace(capacity, segment_capacity, num_segments);
+        return;
+    }
+
     // rebuild the PMAs
     int64_t* ixKeys;
     int64_t* ixValues;
@@ -605,10 +768,44 @@ void BTreePMA_v4::resize() {
     m_storage.m_number_segments = num_segments;
     m_storage.m_height = log2(num_segments) +1;
 
-    // rebuild the index
-    INDEX->clear();
-    for(size_t i = 0; i < num_segments; i++){
-        INDEX->insert(get_minimum(i), i);
+    if(m_synchronized){ // concurrent readers may still be scanning the previous arrays
+        m_epoch->retire(ixKeys_ptr.release(), free);
+        m_epoch->retire(ixValues_ptr.release(), free);
+        m_epoch->retire(ixSizes_ptr.release(), free);
+    }
+
+    resize_rebuild_index();
+}
+
+void BTreePMA_v4::resize_inplace(size_t capacity, size_t segment_capacity, size_t num_segments){
+    // extend the arrays, the kernel only remaps the existing pages
+    m_storage.extend_mapped_workspace(num_segments, segment_capacity);
+
+    // redistribute the elements in the new segments
+    inplace_resize_clustered(m_storage.m_keys, m_storage.m_values, m_storage.m_segment_cardinalities,
+            m_storage.m_segment_capacity, m_storage.m_number_segments, segment_capacity, num_segments, m_storage.m_cardinality);
+
+    // update the PMA properties
+    m_storage.m_capacity = capacity;
+    m_storage.m_segment_capacity = segment_capacity;
+    m_storage.m_number_segments = num_segments;
+    m_storage.m_height = log2(num_segments) +1;
+
+    resize_rebuild_index();
+}
+
+void BTreePMA_v4::resize_rebuild_index(){
+    // rebuild the index, bottom-up from the minima of the segments
+    vector<int64_t> minima(m_storage.m_number_segments);
+    vector<uint64_t> segment_ids(m_storage.m_number_segments);
+    for(size_t i = 0; i < m_storage.m_number_segments; i++){
+        minima[i] = get_minimum(i);
+        segment_ids[i] = i;
+    }
+    if(m_synchronized){
+        CINDEX->load_sorted(minima.data(), segment_ids.data(), m_storage.m_number_segments);
+    } else {
+        INDEX->load_sorted(minima.data(), segment_ids.data(), m_storage.m_number_segments);
     }
 
     // side effect: regenerate the thresholds
@@ -622,7 +819,7 @@ void BTreePMA_v4::resize() {
  *****************************************************************************/
 uint64_t BTreePMA_v4::index_find_leq(int64_t key) const {
     uint64_t value = 0;
-    bool found = INDEX->find_first(key, nullptr, &value);
+    bool found = m_synchronized ? CINDEX->find_first(key, nullptr, &value) : INDEX->find_first(key, nullptr, &value);
     if(found){
         return value;
     } else {
@@ -632,6 +829,10 @@ uint64_t BTreePMA_v4::index_find_leq(int64_t key) const {
 
 uint64_t BTreePMA_v4::index_find_geq(int64_t key) const {
     uint64_t value = 0;
+    if(m_synchronized){ // the B-link tree returns the successor, if none, all segments precede `key'
+        bool found = CINDEX->find_successor(key, nullptr, &value);
+        return found ? value : m_storage.m_number_segments -1;
+    }
     bool found = INDEX->find_last(key, nullptr, &value);
     if(found){
         return value;
@@ -642,11 +843,17 @@ uint64_t BTreePMA_v4::index_find_geq(int64_t key) const {
 
 
 int64_t BTreePMA_v4::find(int64_t key) const {
+    if(m_synchronized) return find_synchronized(key);
     if(empty()) return -1;
     auto segment_id = index_find_leq(key);
 
     COUT_DEBUG("key: " << key << ", segment: " << segment_id);
 
+    int64_t position = segment_find(segment_id, key);
+    return (position >= 0) ? m_storage.m_values[position] : -1;
+}
+
+int64_t BTreePMA_v4::segment_find(uint64_t segment_id, int64_t key) const {
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
     size_t sz = m_storage.m_segment_cardinalities[segment_id];
     size_t start, stop;
@@ -660,13 +867,101 @@ int64_t BTreePMA_v4::find(int64_t key) const {
 
     for(size_t i = start; i < stop; i++){
         if(keys[i] == key){
-            return *(m_storage.m_values + segment_id * m_storage.m_segment_capacity + i);
+            return segment_id * m_storage.m_segment_capacity + i;
         }
     }
 
     return -1;
 }
 
+int64_t BTreePMA_v4::find_synchronized(int64_t key) const {
+    EpochManager::Guard guard(*m_epoch);
+
+    while(true){
+        // snapshot of the storage
+        uint64_t storage_version = seqlock_read_lock(m_storage_version);
+        const int64_t* keys = m_storage.m_keys;
+        const int64_t* values = m_storage.m_values;
+        const uint16_t* cardinalities = m_storage.m_segment_cardinalities;
+        const size_t segment_capacity = m_storage.m_segment_capacity;
+        const size_t num_segments = m_storage.m_number_segments;
+        const size_t cardinality = m_storage.m_cardinality;
+        if(!seqlock_check(m_storage_version, storage_version)) continue;
+        if(cardinality == 0) return -1;
+
+        // the index may refer to the segments of a storage being resized, validated below
+        uint64_t segment_id = std::min<uint64_t>(index_find_leq(key), num_segments -1);
+        const atomic<uint64_t>& segment_version = m_segment_versions[segment_id % NUM_SEGMENT_VERSIONS];
+        uint64_t segment_version_value = seqlock_read_lock(segment_version);
+
+        const int64_t* segment_keys = keys + segment_id * segment_capacity;
+        size_t sz = std::min<size_t>(cardinalities[segment_id], segment_capacity);
+        size_t start = (segment_id % 2 == 0) ? segment_capacity - sz : 0;
+        size_t stop = start + sz;
+        int64_t value = -1;
+        for(size_t i = start; i < stop; i++){
+            if(segment_keys[i] == key){
+                value = values[segment_id * segment_capacity + i];
+                break;
+            }
+        }
+
+        if(seqlock_check(segment_version, segment_version_value) && seqlock_check(m_storage_version, storage_version)){
+            return value;
+        }
+    }
+}
+
+void BTreePMA_v4::segment_prefetch(uint64_t segment_id) const {
+    int64_t* keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
+    size_t sz = m_storage.m_segment_cardinalities[segment_id];
+    if(segment_id % 2 == 0){ // even, the elements are at the end of the segment
+        pma::prefetch_range(keys + m_storage.m_segment_capacity - sz, sz * sizeof(int64_t));
+    } else { // odd, the elements are at the start of the segment
+        pma::prefetch_range(keys, sz * sizeof(int64_t));
+    }
+}
+
+void BTreePMA_v4::find_interleaved(const int64_t* keys, int64_t* values, size_t num_keys, size_t group_size) const {
+    if(m_synchronized){ // one lookup at the time, each validated on its own
+        Interface::find_interleaved(keys, values, num_keys, group_size);
+        return;
+    }
+
+    if(empty()){
+        std::fill(values, values + num_keys, -1);
+        return;
+    }
+
+    constexpr size_t chunk_size = 1024; // number of lookups processed at the time
+    uint64_t segments[chunk_size];
+    bool found[chunk_size];
+    const size_t distance = max<size_t>(1, group_size); // how far ahead to prefetch the segments
+
+    for(size_t chunk_start = 0; chunk_start < num_keys; chunk_start += chunk_size){
+        const size_t n = min(chunk_size, num_keys - chunk_start);
+        const int64_t* chunk_keys = keys + chunk_start;
+        int64_t* chunk_values = values + chunk_start;
+
+        // 1. traverse the index
+        INDEX->find_first_interleaved(chunk_keys, n, segments, found, group_size);
+
+        // 2. scan the segments. The cardinalities are prefetched 2 * distance lookups ahead, the keys distance lookups ahead
+        for(size_t i = 0; i < n; i++){
+            if(!found[i]) segments[i] = 0; // as in #index_find_leq
+        }
+        for(size_t i = 0; i < min(n, 2 * distance); i++){ PREFETCH(m_storage.m_segment_cardinalities + segments[i]); }
+        for(size_t i = 0; i < min(n, distance); i++){ segment_prefetch(segments[i]); }
+        for(size_t i = 0; i < n; i++){
+            if(i + 2 * distance < n){ PREFETCH(m_storage.m_segment_cardinalities + segments[i + 2 * distance]); }
+            if(i + distance < n){ segment_prefetch(segments[i + distance]); }
+
+            int64_t position = segment_find(segments[i], chunk_keys[i]);
+            chunk_values[i] = (position >= 0) ? m_storage.m_values[position] : -1;
+        }
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Iterator                                                                *
@@ -948,7 +1243,11 @@ void BTreePMA_v4::dump() const {
 void BTreePMA_v4::dump(std::ostream& out) const {
     bool integrity_check = true;
 
-    INDEX->dump(out);
+    if(m_synchronized){
+        CINDEX->dump(out);
+    } else {
+        INDEX->dump(out);
+    }
 
     out << "\n";
 
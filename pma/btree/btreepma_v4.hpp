@@ -23,9 +23,13 @@
 #include "pma/iterator.hpp"
 #include "memory_pool.hpp"
 
+#include <atomic>
 #include <cinttypes>
 #include <ostream>
 #include <memory> // unique_ptr
+#include <mutex>
+
+class EpochManager; // forward declaration
 
 namespace pma {
 
@@ -68,6 +72,7 @@ struct PMA {
     size_t m_height; // the height of the binary tree for elements
     size_t m_cardinality; // the number of elements contained
     const bool m_has_fixed_segment_capacity; // whether the max capacity of the segments is unaltered in resizes
+    bool m_mapped_memory; // whether the arrays have been allocated with mmap, so that they can be grown in place with mremap
 
     // Initialise the PMA for a given segment size
     PMA(size_t segment_capacity, bool has_fixed_segment_capacity);
@@ -77,6 +82,15 @@ struct PMA {
 
     // Allocate the arrays for the keys/values
     static void alloc_workspace(size_t num_segments, size_t segment_capacity, int64_t** keys, int64_t** values, decltype(m_segment_cardinalities)* cardinalities);
+
+    // Release the arrays for the keys/values/cardinalities
+    void free_workspace();
+
+    // Allocate the arrays with mmap (true) or posix_memalign (false). The PMA must be empty.
+    void set_mapped_memory(bool value);
+
+    // Extend, with mremap, the mapped arrays to hold `num_segments' segments of `segment_capacity' slots. The current content is preserved.
+    void extend_mapped_workspace(size_t num_segments, size_t segment_capacity);
 };
 
 /*****************************************************************************
@@ -107,12 +121,28 @@ public:
 /**
  * Clustered version of the baseline TPMA. The keys/values are split in separate arrays. Elements are packed at the extremes of a segments,
  * in the usual even/odd succession.
+ *
+ * With synchronisation (see #set_synchronized), the point lookups can run from multiple threads, concurrently to the writers. The index
+ * is replaced by a B-link tree and the lookups validate the segments read with a seqlock: a global version for the rebalances & the
+ * resizes, altering more segments at the time, and a version for each stripe of segments, for the insertions into a single segment.
  */
 class BTreePMA_v4 : public InterfaceRQ {
-    void* m_index; // pimpl, dynamic (a,b)-tree
+    void* m_index; // pimpl, dynamic (a,b)-tree, or a B-link tree with synchronisation
     btree_pma_v4_detail::PMA m_storage; // PMA
     CachedMemoryPool m_memory_pool;
     CachedDensityBounds m_density_bounds;
+    bool m_synchronized = false; // whether the point lookups can run concurrently to the writers
+    std::mutex m_writer_lock; // serialise the writers, with synchronisation
+    std::atomic<uint64_t> m_storage_version {0}; // seqlock, odd while a rebalance or a resize alters the storage, with synchronisation
+    std::unique_ptr<std::atomic<uint64_t>[]> m_segment_versions; // striped seqlocks, odd while an insertion alters a single segment, with synchronisation
+    std::unique_ptr<EpochManager> m_epoch; // defer the deallocation of the arrays replaced by a resize, with synchronisation
+    static constexpr uint64_t NUM_SEGMENT_VERSIONS = 1024; // number of stripes for the segment seqlocks
+
+    // Acquire / release the seqlock on the whole storage or on the stripe of the given segment. No-op without synchronisation.
+    void storage_write_lock();
+    void storage_write_unlock();
+    void segment_write_lock(uint64_t segment_id);
+    void segment_write_unlock(uint64_t segment_id);
 
     /**
      * Get the lower (out_a) and upper (out_b) threshold for the segments at the given `node_height'
@@ -132,8 +162,21 @@ class BTreePMA_v4 : public InterfaceRQ {
     // Find the segment having the smallest pivot that is greater or equal than the given key
     uint64_t index_find_geq(int64_t key) const;
 
-    // Change the separator key for a given entry in the index
-    void index_update(int64_t key_old, int64_t key_new);
+    // Retrieve the position of the key in the storage, scanning the given segment, or -1 if not present
+    int64_t segment_find(uint64_t segment_id, int64_t key) const;
+
+    // Prefetch the keys of the given segment, when the cardinality of the segment is already in the cache
+    void segment_prefetch(uint64_t segment_id) const;
+
+    // Add / remove a separator key in the index
+    void index_insert(int64_t key, uint64_t segment_id);
+    void index_remove(int64_t key);
+
+    // Change the separator key for the given segment in the index
+    void index_update(int64_t key_old, int64_t key_new, uint64_t segment_id);
+
+    // Point lookup with synchronisation, validating the segment scanned with the seqlocks
+    int64_t find_synchronized(int64_t key) const;
 
     // Return the current minimum for the given segment
     int64_t get_minimum(uint64_t segment_id) const;
@@ -154,6 +197,12 @@ class BTreePMA_v4 : public InterfaceRQ {
     // Resize the index, double the capacity of the PMA, rebuild the index
     void resize();
 
+    // Double the capacity of the PMA by growing the arrays with mremap and rebalancing the elements in place, without a second workspace
+    void resize_inplace(size_t capacity, size_t segment_capacity, size_t num_segments);
+
+    // Rebuild the index from the minima of the segments and regenerate the thresholds, after a resize
+    void resize_rebuild_index();
+
     // Returns an empty iterator, i.e. with an empty record set!
     std::unique_ptr<pma::Iterator> empty_iterator() const;
 
@@ -188,6 +237,12 @@ public:
      */
     virtual int64_t find(int64_t key) const override;
 
+    /**
+     * Batched lookup. It first interleaves the traversals of the index, then scans the segments
+     * reached, prefetching the segments of the following lookups.
+     */
+    virtual void find_interleaved(const int64_t* keys, int64_t* values, size_t num_keys, size_t group_size) const override;
+
     virtual std::unique_ptr<pma::Iterator> find(int64_t min, int64_t max) const override;
 
     // Return an iterator over all elements of the PMA
@@ -205,6 +260,18 @@ public:
     // Current maximum capacity of a segment in the PMA, in terms of number of elements
     size_t segment_capacity() const;
 
+    // Whether to allocate the PMA with mmap and, on resize, grow it with mremap, rebalancing the elements in place. The container must be empty.
+    void set_mremap_growth(bool value);
+
+    // Check whether the PMA is grown with mremap
+    bool has_mremap_growth() const;
+
+    // Whether to allow point lookups from multiple threads, concurrently to the writers. The container must be empty. It cannot be combined with the mremap growth.
+    void set_synchronized(bool value);
+
+    // Check whether the point lookups can run concurrently to the writers
+    bool is_synchronized() const;
+
     // Dump the content of the data structure to the given output stream (for debugging purposes)
     virtual void dump(std::ostream& out) const;
 
@@ -25,10 +25,13 @@
 #include <sstream>
 #include <string>
 
+#include "aligned_memory.hpp"
 #include "configuration.hpp"
 #include "database.hpp"
 #include "errorhandling.hpp"
+#include "mapped_memory.hpp"
 #include "miscellaneous.hpp"
+#include "pma/generic/inplace_resize.hpp"
 
 using namespace std;
 using namespace pma::btree_pmacc5_details;
@@ -428,16 +431,14 @@ BTreePMACC5::BTreePMACC5(size_t btree_block_size, size_t pma_segment_size) :
 BTreePMACC5::~BTreePMACC5() {
     if(m_segment_statistics) record_segment_statistics();
 
-    free(m_storage.m_keys); m_storage.m_keys = nullptr;
-    free(m_storage.m_values); m_storage.m_values = nullptr;
-    free(m_storage.m_segment_sizes); m_storage.m_segment_sizes = nullptr;
+    m_storage.free_workspace();
 
 #if defined(PROFILING)
     record_rebalancing_statistics();
 #endif
 }
 
-PMA::PMA(size_t segment_size) : m_segment_capacity( hyperceil(segment_size ) ){
+PMA::PMA(size_t segment_size) : m_segment_capacity( hyperceil(segment_size ) ), m_mapped_memory(false){
     if(hyperceil(segment_size ) > numeric_limits<uint16_t>::max()) throw std::invalid_argument("segment size too big, maximum is " + std::to_string( numeric_limits<uint16_t>::max() ));
     if(m_segment_capacity < 8) throw std::invalid_argument("segment size too small, minimum is 8");
 
@@ -456,6 +457,19 @@ void PMA::alloc_workspace(size_t num_segments, int64_t** keys, int64_t** values,
     *values = nullptr;
     *sizes = nullptr;
 
+    if(m_mapped_memory){
+        *keys = (int64_t*) mapped_memory_allocate(num_segments * m_segment_capacity * sizeof(m_keys[0]));
+        try {
+            *values = (int64_t*) mapped_memory_allocate(num_segments * m_segment_capacity * sizeof(m_values[0]));
+            *sizes = (uint16_t*) mapped_memory_allocate(num_segments * sizeof(m_segment_sizes[0]));
+        } catch (...) {
+            mapped_memory_free(*keys, num_segments * m_segment_capacity * sizeof(m_keys[0])); *keys = nullptr;
+            mapped_memory_free(*values, num_segments * m_segment_capacity * sizeof(m_values[0])); *values = nullptr;
+            throw;
+        }
+        return;
+    }
+
     int rc(0);
     rc = posix_memalign((void**) keys, /* alignment */ 64,  /* size */ num_segments * m_segment_capacity * sizeof(m_keys[0]));
     if(rc != 0) {
@@ -469,15 +483,55 @@ void PMA::alloc_workspace(size_t num_segments, int64_t** keys, int64_t** values,
                 "Requested size: " << m_segment_capacity * sizeof(m_values[0]));
     }
 
-    rc = posix_memalign((void**) sizes, /* alignment */ 64,  /* size */ num_segments * sizeof(m_segment_sizes[0]));
-    if(rc != 0) {
+    try {
+        // traversed by the calibrator tree, back it with huge pages if large enough. Release with #free_sizes
+        *sizes = (uint16_t*) aligned_memory_allocate(num_segments * sizeof(m_segment_sizes[0]));
+    } catch(...) {
         free(*keys); *keys = nullptr;
         free(*values); *values = nullptr;
-        RAISE_EXCEPTION(Exception, "[PMA::PMA] It cannot obtain a chunk of aligned memory. " <<
-                "Requested size: " << m_segment_capacity * sizeof(m_segment_sizes[0]));
+        throw;
     }
 }
 
+void PMA::free_array(void* ptr, size_t size){
+    if(m_mapped_memory){
+        mapped_memory_free(ptr, size);
+    } else {
+        free(ptr);
+    }
+}
+
+void PMA::free_sizes(void* ptr, size_t size){
+    if(m_mapped_memory){
+        mapped_memory_free(ptr, size);
+    } else {
+        aligned_memory_free(ptr);
+    }
+}
+
+void PMA::free_workspace(){
+    free_array(m_keys, m_capacity * sizeof(m_keys[0])); m_keys = nullptr;
+    free_array(m_values, m_capacity * sizeof(m_values[0])); m_values = nullptr;
+    free_sizes(m_segment_sizes, m_number_segments * sizeof(m_segment_sizes[0])); m_segment_sizes = nullptr;
+}
+
+void PMA::set_mapped_memory(bool value){
+    if(m_mapped_memory == value) return;
+    if(m_cardinality > 0) RAISE_EXCEPTION(Exception, "[PMA::set_mapped_memory] The PMA must be empty");
+
+    free_workspace();
+    m_mapped_memory = value;
+    alloc_workspace(m_number_segments, &m_keys, &m_values, &m_segment_sizes);
+}
+
+void PMA::resize_mapped_workspace(size_t num_segments){
+    assert(m_mapped_memory && "The arrays have not been allocated with mmap");
+    size_t capacity = num_segments * m_segment_capacity;
+    m_keys = (int64_t*) mapped_memory_resize(m_keys, m_capacity * sizeof(m_keys[0]), capacity * sizeof(m_keys[0]));
+    m_values = (int64_t*) mapped_memory_resize(m_values, m_capacity * sizeof(m_values[0]), capacity * sizeof(m_values[0]));
+    m_segment_sizes = (uint16_t*) mapped_memory_resize(m_segment_sizes, m_number_segments * sizeof(m_segment_sizes[0]), num_segments * sizeof(m_segment_sizes[0]));
+}
+
 size_t BTreePMACC5::size() const {
     return m_storage.m_cardinality;
 }
@@ -711,6 +765,11 @@ void BTreePMACC5::resize(int64_t* new_key, int64_t* new_value) {
     size_t odd_segments = m_storage.m_cardinality % num_segments;
     COUT_DEBUG(m_storage.m_capacity << " --> " << capacity << ", num_segments: " << num_segments);
 
+    if(m_storage.m_mapped_memory){
+        resize_inplace(new_key, new_value, num_segments);
+        return;
+    }
+
     // rebuild the PMAs
     int64_t* ixKeys;
     int64_t* ixValues;
@@ -723,7 +782,8 @@ void BTreePMACC5::resize(int64_t* new_key, int64_t* new_value) {
     auto xFreePtr = [](void* ptr){ free(ptr); };
     unique_ptr<int64_t, decltype(xFreePtr)> ixKeys_ptr { ixKeys, xFreePtr };
     unique_ptr<int64_t, decltype(xFreePtr)> ixValues_ptr{ ixValues, xFreePtr };
-    unique_ptr<remove_pointer_t<decltype(m_storage.m_segment_sizes)>, decltype(xFreePtr)> ixSizes_ptr{ ixSizes, xFreePtr };
+    auto xFreeSizes = [](void* ptr){ aligned_memory_free(ptr); };
+    unique_ptr<remove_pointer_t<decltype(m_storage.m_segment_sizes)>, decltype(xFreeSizes)> ixSizes_ptr{ ixSizes, xFreeSizes };
     int64_t* __restrict xKeys = m_storage.m_keys;
     int64_t* __restrict xValues = m_storage.m_values;
     decltype(m_storage.m_segment_sizes) __restrict xSizes = m_storage.m_segment_sizes;
@@ -827,6 +887,50 @@ void BTreePMACC5::resize(int64_t* new_key, int64_t* new_value) {
     thresholds(m_storage.m_height, m_storage.m_height);
 }
 
+void BTreePMACC5::resize_inplace(int64_t* new_key, int64_t* new_value, size_t num_segments){
+    const bool is_insert = new_key != nullptr;
+    const size_t segment_capacity = m_storage.m_segment_capacity;
+
+    // when growing, extend the arrays before rebalancing, when shrinking truncate them afterwards
+    if(is_insert){ m_storage.resize_mapped_workspace(num_segments); }
+    inplace_resize_clustered(m_storage.m_keys, m_storage.m_values, m_storage.m_segment_sizes,
+            segment_capacity, m_storage.m_number_segments, segment_capacity, num_segments, m_storage.m_cardinality);
+    if(!is_insert){ m_storage.resize_mapped_workspace(num_segments); }
+
+    // update the PMA properties
+    m_storage.m_capacity = num_segments * segment_capacity;
+    m_storage.m_number_segments = num_segments;
+    m_storage.m_height = log2(num_segments) +1;
+
+    // rebuild the index. The last segments can be empty only when shrinking, an empty segment takes the minimum of
+    // its successor, so that #find skips it
+    int64_t* __restrict keys = m_storage.m_keys;
+    auto* __restrict sizes = m_storage.m_segment_sizes;
+    unique_ptr<int64_t[]> separator_keys { new int64_t[num_segments] };
+    int64_t next_minimum = numeric_limits<int64_t>::max();
+    int64_t insert_segment_id = -1;
+    for(int64_t j = num_segments -1; j >= 0; j--){
+        if(sizes[j] > 0){
+            size_t start = j * segment_capacity + ((j % 2 == 0) ? segment_capacity - sizes[j] : 0);
+            next_minimum = keys[start];
+            if(is_insert && (insert_segment_id == -1 || *new_key < keys[start + sizes[j] -1])){
+                insert_segment_id = j; // the first segment whose maximum is greater than the new key, or the last non empty segment
+            }
+        }
+        separator_keys[j] = next_minimum;
+    }
+    m_index.rebuild(num_segments, separator_keys.get());
+
+    // insert the new element
+    if(is_insert){
+        auto min = storage_insert_unsafe(insert_segment_id, *new_key, *new_value);
+        if(min) m_index.set_separator_key(insert_segment_id, *new_key); // update the minimum in the B+ tree
+    }
+
+    // side effect: regenerate the thresholds
+    thresholds(m_storage.m_height, m_storage.m_height);
+}
+
 void BTreePMACC5::spread(size_t cardinality, size_t segment_start, size_t num_segments, spread_insert* spread_insertion){
     int64_t insert_segment_id = spread_insertion != nullptr ? static_cast<int64_t>(spread_insertion->m_segment_id) - segment_start : -1;
     COUT_DEBUG("size: " << cardinality << ", start: " << segment_start << ", length: " << num_segments << ", insertion segment: " << insert_segment_id);
@@ -1883,10 +1987,13 @@ void BTreePMACC5::load_resize(std::pair<int64_t, int64_t>* __restrict batch, siz
     swap(ixKeys, m_storage.m_keys);
     swap(ixValues, m_storage.m_values);
     swap(ixSizes, m_storage.m_segment_sizes);
-    auto xFreePtr = [](void* ptr){ free(ptr); };
-    unique_ptr<int64_t, decltype(xFreePtr)> ixKeys_ptr { ixKeys, xFreePtr };
-    unique_ptr<int64_t, decltype(xFreePtr)> ixValues_ptr{ ixValues, xFreePtr };
-    unique_ptr<remove_pointer_t<decltype(m_storage.m_segment_sizes)>, decltype(xFreePtr)> ixSizes_ptr{ ixSizes, xFreePtr };
+    const size_t ixCapacity = m_storage.m_capacity;
+    const size_t ixNumSegments = m_storage.m_number_segments;
+    auto xFreeElements = [this, ixCapacity](int64_t* ptr){ m_storage.free_array(ptr, ixCapacity * sizeof(ptr[0])); };
+    auto xFreeSizes = [this, ixNumSegments](uint16_t* ptr){ m_storage.free_sizes(ptr, ixNumSegments * sizeof(ptr[0])); };
+    unique_ptr<int64_t, decltype(xFreeElements)> ixKeys_ptr { ixKeys, xFreeElements };
+    unique_ptr<int64_t, decltype(xFreeElements)> ixValues_ptr{ ixValues, xFreeElements };
+    unique_ptr<remove_pointer_t<decltype(m_storage.m_segment_sizes)>, decltype(xFreeSizes)> ixSizes_ptr{ ixSizes, xFreeSizes };
     int64_t* __restrict output_keys = m_storage.m_keys;
     int64_t* __restrict output_values = m_storage.m_values;
     decltype(m_storage.m_segment_sizes) __restrict output_sizes = m_storage.m_segment_sizes;
@@ -2028,9 +2135,7 @@ void BTreePMACC5::load_empty_multi(std::pair<int64_t, int64_t>* __restrict array
     m_index.rebuild(num_segments);
 
     // 2) build the PMA
-    free(m_storage.m_segment_sizes);
-    free(m_storage.m_keys);
-    free(m_storage.m_values);
+    m_storage.free_workspace();
     m_storage.alloc_workspace(num_segments, &m_storage.m_keys, &m_storage.m_values, &m_storage.m_segment_sizes);
     int64_t* __restrict output_keys = m_storage.m_keys;
     int64_t* __restrict output_values = m_storage.m_values;
@@ -2221,6 +2326,15 @@ void BTreePMACC5::set_record_segment_statistics(bool value) {
     m_segment_statistics = value;
 }
 
+void BTreePMACC5::set_mremap_growth(bool value){
+    if(!empty()) RAISE_EXCEPTION(Exception, "[BTreePMACC5::set_mremap_growth] The container must be empty");
+    m_storage.set_mapped_memory(value);
+}
+
+bool BTreePMACC5::has_mremap_growth() const {
+    return m_storage.m_mapped_memory;
+}
+
 
 /*****************************************************************************
  *                                                                           *
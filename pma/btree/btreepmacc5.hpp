@@ -147,11 +147,27 @@ struct PMA {
     uint32_t m_cardinality; // the number of elements contained
     uint32_t m_capacity; // the size of the array elements
     uint32_t m_number_segments; // the total number of segments, i.e. capacity / segment_size
+    bool m_mapped_memory; // whether the arrays are allocated with mmap, so that they can be resized in place with mremap
 
     // Initialise the PMA for a given segment size
     PMA(size_t segment_size);
 
     void alloc_workspace(size_t num_segments, int64_t** keys, int64_t** values, decltype(m_segment_sizes)* sizes);
+
+    // Release an array obtained by #alloc_workspace, of the given size in bytes
+    void free_array(void* ptr, size_t size);
+
+    // Release the cardinalities of the segments obtained by #alloc_workspace, of the given size in bytes
+    void free_sizes(void* ptr, size_t size);
+
+    // Release the current arrays for the keys/values/sizes
+    void free_workspace();
+
+    // Allocate the arrays with mmap (true) or posix_memalign (false). The PMA must be empty.
+    void set_mapped_memory(bool value);
+
+    // Alter, with mremap, the capacity of the mapped arrays to `num_segments' segments. The content in common is preserved.
+    void resize_mapped_workspace(size_t num_segments);
 };
 
 /*****************************************************************************
@@ -243,6 +259,11 @@ private:
      */
     void resize(int64_t* insert_new_key, int64_t* insert_new_value);
 
+    /**
+     * Resize the capacity of the PMA with mremap, rebalancing the elements in place rather than copying them in a new workspace
+     */
+    void resize_inplace(int64_t* insert_new_key, int64_t* insert_new_value, size_t num_segments);
+
     /**
      * Spread the elements in the segments [segment_start, segment_start + num_segments)
      */
@@ -345,6 +366,12 @@ public:
 
     // Whether to save segment statistics, at the end, in the table `btree_leaf_statistics' ?
     void set_record_segment_statistics(bool value);
+
+    // Whether to allocate the PMA with mmap and resize it with mremap, rebalancing the elements in place. The container must be empty.
+    void set_mremap_growth(bool value);
+
+    // Check whether the PMA is resized with mremap
+    bool has_mremap_growth() const;
 };
 
 } // namespace pma
@@ -26,6 +26,7 @@
 #include <sstream>
 #include <string>
 
+#include "aligned_memory.hpp"
 #include "buffered_rewired_memory.hpp"
 #include "configuration.hpp"
 #include "database.hpp"
@@ -423,8 +424,8 @@ void BTreePMACC7::record_rebalancing_statistics() const {
 
 BTreePMACC7::BTreePMACC7(size_t pages_per_extent) : BTreePMACC7(/* B = */ 64, pages_per_extent) { }
 BTreePMACC7::BTreePMACC7(size_t btree_block_size, size_t pages_per_extent) : BTreePMACC7(btree_block_size, btree_block_size, pages_per_extent) { }
-BTreePMACC7::BTreePMACC7(size_t btree_block_size, size_t pma_segment_size, size_t pages_per_extent) :
-       m_index(btree_block_size),
+BTreePMACC7::BTreePMACC7(size_t btree_block_size, size_t pma_segment_size, size_t pages_per_extent, pma::StaticIndexLayout index_layout) :
+       m_index(btree_block_size, /* num segments */ 1, index_layout),
        m_storage(pma_segment_size, pages_per_extent) {
 }
 
@@ -502,11 +503,8 @@ void PMA::alloc_workspace(size_t num_segments, int64_t** keys, int64_t** values,
                     "Requested size: " << elts_space_required_bytes);
         }
 
-        rc = posix_memalign((void**) sizes, /* alignment */ 64,  /* size */ card_space_required_bytes);
-        if(rc != 0) {
-            RAISE_EXCEPTION(Exception, "[Storage::alloc_workspace] It cannot obtain a chunk of aligned memory. " <<
-                    "Requested size: " << card_space_required_bytes);
-        }
+        // traversed by the calibrator tree, back it with huge pages if large enough
+        *sizes = (uint16_t*) aligned_memory_allocate(card_space_required_bytes);
     }
 
     // always allocate at least 2 segments, using the second segment as special mark with size = 0
@@ -580,7 +578,7 @@ void PMA::dealloc_workspace(int64_t** keys, int64_t** values, decltype(m_segment
         *sizes = nullptr;
         delete *rewired_memory_cardinalities; *rewired_memory_cardinalities = nullptr;
     } else {
-        free(*sizes); *sizes = nullptr;
+        aligned_memory_free(*sizes); *sizes = nullptr;
     }
 }
 
@@ -629,6 +627,7 @@ void BTreePMACC7::insert_empty(int64_t key, int64_t value){
     m_storage.m_keys[pos] = key;
     m_storage.m_values[pos] = value;
     m_storage.m_cardinality = 1;
+    m_cardinality_tree.rebuild(m_storage.m_segment_sizes, m_storage.m_number_segments);
 }
 
 void BTreePMACC7::insert_common(size_t segment_id, int64_t key, int64_t value){
@@ -643,6 +642,7 @@ void BTreePMACC7::insert_common(size_t segment_id, int64_t key, int64_t value){
         rebalance(segment_id, &key, &value);
     } else { // find a spot where to insert this element
         bool minimum_updated = storage_insert_unsafe(segment_id, key, value);
+        m_cardinality_tree.update(segment_id, +1);
 
         // have we just updated the minimum ?
         if (minimum_updated) m_index.set_separator_key(segment_id, key);
@@ -740,6 +740,7 @@ class SpreadWithRewiring {
 
 // internal state
     int64_t m_position = -1; // current position in the source segment
+    bool m_update_separator_keys = true; // whether to set the separator keys of the index, otherwise the caller rebuilds the whole index
     struct Extent2Rewire{ int64_t m_extent_id; int64_t* m_buffer_keys; int64_t* m_buffer_values; };
     deque<Extent2Rewire> m_extents_to_rewire; // a list of extents to be rewired
 
@@ -960,6 +961,7 @@ class SpreadWithRewiring {
     void update_index(){
         size_t segment_id = m_window_start;
         for(size_t i = 0; i < m_window_length; i++){
+            if(!m_insert && !m_update_separator_keys) break; // nothing else to do
             int64_t minimum = m_instance.get_minimum(segment_id);
 
             if(m_insert){
@@ -974,7 +976,7 @@ class SpreadWithRewiring {
                 }
             }
 
-            m_instance.m_index.set_separator_key(segment_id, minimum);
+            if(m_update_separator_keys) m_instance.m_index.set_separator_key(segment_id, minimum);
 
             segment_id++;
         }
@@ -1004,6 +1006,10 @@ public:
         m_insert_value = value;
     }
 
+    void set_update_separator_keys(bool value){
+        m_update_separator_keys = value;
+    }
+
     void set_start_position(size_t position){
         // check that position is inside the current window
         int64_t segment_id = position2segment(static_cast<int64_t>(position) -1);
@@ -1051,6 +1057,7 @@ void BTreePMACC7::rebalance(size_t segment_id, int64_t* key, int64_t* value){
 
     COUT_DEBUG("segment_id: " << segment_id);
     size_t num_elements = is_insert ? m_storage.m_segment_capacity +1 : m_storage.m_segment_sizes[segment_id];
+    assert(m_cardinality_tree.size() == m_storage.m_number_segments && "The cardinality tree is not in sync with the storage");
     // these inits are only valid for the edge case that the calibrator tree has height 1, i.e. the data structure contains only one segment
     double rho = 0.0, theta = 1.0, density = static_cast<double>(num_elements)/m_storage.m_segment_capacity;
     size_t height = 1;
@@ -1061,10 +1068,6 @@ void BTreePMACC7::rebalance(size_t segment_id, int64_t* key, int64_t* value){
     int window_start = segment_id, window_end = segment_id;
 
     if(m_storage.m_height > 1){
-        // find the bounds of this window
-        int index_left = segment_id -1;
-        int index_right = segment_id +1;
-
         do {
             height++;
             window_length *= 2;
@@ -1075,15 +1078,8 @@ void BTreePMACC7::rebalance(size_t segment_id, int64_t* key, int64_t* value){
             rho = density_bounds.first;
             theta = density_bounds.second;
 
-            // find the number of elements in the interval
-            while(index_left >= window_start){
-                num_elements += m_storage.m_segment_sizes[index_left];
-                index_left--;
-            }
-            while(index_right < window_end){
-                num_elements += m_storage.m_segment_sizes[index_right];
-                index_right++;
-            }
+            // find the number of elements in the interval, in O(log n)
+            num_elements = m_cardinality_tree.sum(window_start, window_end) + (is_insert ? 1 : 0);
 
             COUT_DEBUG("num_elements: " << num_elements << ", window_start: " << window_start << ",  window_length: " << window_length << ",  segment_capacity: " << m_storage.m_segment_capacity);
             density = ((double) num_elements) / (window_length * m_storage.m_segment_capacity);
@@ -1145,14 +1141,19 @@ void BTreePMACC7::resize_rewire(int64_t* new_key, int64_t* new_value){
 
     // 1) Extend the PMA
     m_storage.extend(num_segments_before);
-    m_index.rebuild(num_segments_after);
 
     // 2) Spread
     SpreadWithRewiring rewiring_instance(this, 0, num_segments_after, m_storage.m_cardinality + (new_key != nullptr ? 1 : 0));
     if(new_key != nullptr){ rewiring_instance.set_element_to_insert(*new_key, *new_value); }
     size_t start_position = (num_segments_before -1) * m_storage.m_segment_capacity + m_storage.m_segment_sizes[num_segments_before -1];
     rewiring_instance.set_start_position(start_position);
+    rewiring_instance.set_update_separator_keys(false);
     rewiring_instance.execute();
+
+    // 3) Rebuild the index
+    rebuild_index();
+
+    m_cardinality_tree.rebuild(m_storage.m_segment_sizes, m_storage.m_number_segments);
 }
 
 void BTreePMACC7::resize_general(int64_t* new_key, int64_t* new_value) {
@@ -1184,8 +1185,6 @@ void BTreePMACC7::resize_general(int64_t* new_key, int64_t* new_value) {
     int64_t* __restrict xValues = m_storage.m_values;
     decltype(m_storage.m_segment_sizes) __restrict xSizes = m_storage.m_segment_sizes;
 
-    m_index.rebuild(num_segments);
-
     // fetch the first non-empty input segment
     size_t input_segment_id = 0;
     size_t input_size = ixSizes[0];
@@ -1215,7 +1214,6 @@ void BTreePMACC7::resize_general(int64_t* new_key, int64_t* new_value) {
         int64_t* output_keys = xKeys + output_canonical_index + output_offset;
         int64_t* output_values = xValues + output_canonical_index + output_offset;
         xSizes[j] = elements_to_copy;
-        m_index.set_separator_key(j, input_keys[0]);
 
         do {
             assert(elements_to_copy <= m_storage.m_segment_capacity && "Overflow");
@@ -1259,8 +1257,7 @@ void BTreePMACC7::resize_general(int64_t* new_key, int64_t* new_value) {
 
         // should we insert a new element in this bucket
         if(new_key && *new_key < output_keys[-1]){
-            auto min = storage_insert_unsafe(j, *new_key, *new_value);
-            if(min) m_index.set_separator_key(j, *new_key); // update the minimum in the B+ tree
+            storage_insert_unsafe(j, *new_key, *new_value); // the index is rebuilt at the end
             new_key = new_value = nullptr;
         }
 
@@ -1269,8 +1266,7 @@ void BTreePMACC7::resize_general(int64_t* new_key, int64_t* new_value) {
 
     // if the element hasn't been inserted yet, it means it has to be placed in the last segment
     if(new_key){
-        auto min = storage_insert_unsafe(num_segments -1, *new_key, *new_value);
-        if(min) m_index.set_separator_key(num_segments -1, *new_key); // update the minimum in the B+ tree
+        storage_insert_unsafe(num_segments -1, *new_key, *new_value); // the index is rebuilt at the end
         new_key = new_value = nullptr;
     }
 
@@ -1278,6 +1274,9 @@ void BTreePMACC7::resize_general(int64_t* new_key, int64_t* new_value) {
     m_storage.m_capacity = capacity;
     m_storage.m_number_segments = num_segments;
     m_storage.m_height = log2(num_segments) +1;
+
+    rebuild_index();
+    m_cardinality_tree.rebuild(m_storage.m_segment_sizes, m_storage.m_number_segments);
 }
 
 void BTreePMACC7::spread(size_t cardinality, size_t segment_start, size_t num_segments, spread_insert* spread_insertion){
@@ -1290,6 +1289,8 @@ void BTreePMACC7::spread(size_t cardinality, size_t segment_start, size_t num_se
     } else {
         spread_two_copies(cardinality, segment_start, num_segments, spread_insertion);
     }
+
+    m_cardinality_tree.refresh(m_storage.m_segment_sizes, segment_start, num_segments);
 }
 
 void BTreePMACC7::spread_two_copies(size_t cardinality, size_t segment_start, size_t num_segments, spread_insert* spread_insertion){
@@ -1469,6 +1470,7 @@ int64_t BTreePMACC7::remove(int64_t key){
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
             m_storage.m_cardinality--;
+            m_cardinality_tree.update(segment_id, -1);
 
             if(i == imin){ // update the pivot
                 if(m_storage.m_cardinality == 0){ // global minimum
@@ -1493,6 +1495,7 @@ int64_t BTreePMACC7::remove(int64_t key){
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
             m_storage.m_cardinality--;
+            m_cardinality_tree.update(segment_id, -1);
 
             // update the minimum
             if(i == 0 && sz > 0){ // sz > 0 => otherwise we are going to rebalance this segment anyway
@@ -2204,6 +2207,8 @@ void BTreePMACC7::load_sorted(std::pair<int64_t, int64_t>* array, size_t array_s
         }
     }
 
+    m_cardinality_tree.rebuild(m_storage.m_segment_sizes, m_storage.m_number_segments);
+
 #if defined(DEBUG)
     COUT_DEBUG("Load done");
 //    dump();
@@ -2906,6 +2911,17 @@ void BTreePMACC7::load_empty_multi(std::pair<int64_t, int64_t>* __restrict array
     thresholds(m_storage.m_height, m_storage.m_height);
 }
 
+void BTreePMACC7::rebuild_index(){
+    const size_t num_segments = m_storage.m_number_segments;
+    unique_ptr<int64_t[]> separator_keys { new int64_t[num_segments] };
+    int64_t next_minimum = numeric_limits<int64_t>::max();
+    for(int64_t i = num_segments -1; i >= 0; i--){ // an empty segment takes the minimum of its successor, so that #find skips it
+        if(m_storage.m_segment_sizes[i] > 0){ next_minimum = get_minimum(i); }
+        separator_keys[i] = next_minimum;
+    }
+    m_index.rebuild(num_segments, separator_keys.get(), m_index_build_threads);
+}
+
 int64_t BTreePMACC7::get_minimum(size_t segment_id) const {
     int64_t* __restrict keys = m_storage.m_keys;
     auto* __restrict sizes = m_storage.m_segment_sizes;
@@ -3058,6 +3074,10 @@ void BTreePMACC7::set_record_segment_statistics(bool value) {
     m_segment_statistics = value;
 }
 
+void BTreePMACC7::set_index_build_threads(uint64_t num_threads) {
+    m_index_build_threads = max<uint64_t>(num_threads, 1);
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Memory footprint                                                        *
@@ -3068,8 +3088,9 @@ size_t BTreePMACC7::memory_footprint() const {
     size_t space_index = m_index.memory_footprint();
     size_t space_elts = 2ull * m_storage.m_number_segments * m_storage.m_segment_capacity * sizeof(m_storage.m_keys);
     size_t space_cards = max<size_t>(2, m_storage.m_number_segments) * sizeof(m_storage.m_segment_sizes[0]);
+    size_t space_cardinality_tree = m_cardinality_tree.memory_footprint() - sizeof(m_cardinality_tree);
 
-    return sizeof(BTreePMACC7) + space_index + space_elts + space_cards;
+    return sizeof(BTreePMACC7) + space_index + space_elts + space_cards + space_cardinality_tree;
 }
 
 /*****************************************************************************
@@ -29,6 +29,7 @@
 #include "miscellaneous.hpp"
 #include "pma/bulk_loading.hpp"
 #include "pma/density_bounds.hpp"
+#include "pma/generic/fenwick_tree.hpp"
 #include "pma/generic/static_index.hpp"
 #include "pma/interface.hpp"
 #include "pma/iterator.hpp"
@@ -232,10 +233,12 @@ class BTreePMACC7 : public InterfaceRQ, public SortedBulkLoading {
 private:
     pma::StaticIndex m_index;
     btree_pmacc7_details::PMA m_storage;
+    pma::FenwickTree m_cardinality_tree; // cumulative cardinalities of the segments, to compute the density of a window in O(log n)
     btree_pmacc7_details::Instrumentation m_instrumentation;
     CachedMemoryPool m_memory_pool;
     CachedDensityBounds m_density_bounds;
     bool m_segment_statistics = false; // record segment statistics at the end?
+    uint64_t m_index_build_threads = 1; // max number of threads to rebuild the index after a resize
 
     // Insert an element in the given segment. It assumes that there is still room available
     // It returns true if the inserted key is the minimum in the interval
@@ -250,6 +253,9 @@ private:
     // Get the minimum of the given segment
     int64_t get_minimum(size_t segment_id) const;
 
+    // Rebuild the whole index from the minima of the segments, after a resize
+    void rebuild_index();
+
     /**
      * Get the lower (out_a) and upper (out_b) threshold for the segments at the given `node_height'
      */
@@ -331,7 +337,7 @@ public:
 
     BTreePMACC7(size_t pma_segment_size, size_t pages_per_extent);
 
-    BTreePMACC7(size_t index_B, size_t pma_segment_size, size_t pages_per_extent);
+    BTreePMACC7(size_t index_B, size_t pma_segment_size, size_t pages_per_extent, pma::StaticIndexLayout index_layout = pma::StaticIndexLayout::BTREE);
 
     virtual ~BTreePMACC7();
 
@@ -374,6 +380,9 @@ public:
     // Whether to save segment statistics, at the end, in the table `btree_leaf_statistics' ?
     void set_record_segment_statistics(bool value);
 
+    // Max number of threads to rebuild the index after a resize
+    void set_index_build_threads(uint64_t num_threads);
+
     // Memory footprint
     virtual size_t memory_footprint() const override;
 };
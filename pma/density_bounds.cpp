@@ -17,6 +17,9 @@
 
 #include "density_bounds.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include "configuration.hpp"
 #include "console_arguments.hpp"
 #include "errorhandling.hpp"
@@ -113,11 +116,63 @@ const DensityBounds& CachedDensityBounds::densities() const noexcept {
     return m_density_bounds;
 }
 
+void CachedDensityBounds::set_densities(const DensityBounds& densities){
+    m_density_bounds = densities;
+    int tree_height = m_cached_densities.size();
+    if(tree_height > 0){ rebuild_cached_densities(tree_height); }
+}
+
 
 int CachedDensityBounds::get_calibrator_tree_height() const noexcept {
     return m_cached_densities.size();
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   DensityController                                                       *
+ *                                                                           *
+ *****************************************************************************/
+
+DensityController::DensityController(double theta_h, double theta_min, double theta_max) :
+        m_theta_min(theta_min), m_theta_max(theta_max), m_theta(std::min(std::max(theta_h, theta_min), theta_max)) {
+    if(!(0 < theta_min && theta_min <= theta_max && theta_max < 1)) CONF_ERROR("Invalid range for the adaptive densities: [" << theta_min << ", " << theta_max << "]");
+}
+
+bool DensityController::update(uint64_t cardinality){
+    if(m_epoch_updates + m_epoch_scans < std::max<uint64_t>(cardinality / 4, 1024)) return false; // the epoch is not over yet
+
+    // the past epochs count half as much as the current one
+    m_num_updates = m_num_updates / 2 + m_epoch_updates;
+    m_num_scanned = m_num_scanned / 2 + m_epoch_scanned;
+    m_num_moved = m_num_moved / 2 + m_epoch_moved;
+    m_epoch_updates = m_epoch_scans = m_epoch_scanned = m_epoch_moved = 0;
+
+    // minimise cost(d) = scanned / d + updates * c / (1 - d), that is d = 1 / (1 + sqrt(updates * c / scanned))
+    double target = m_theta_max;
+    if(m_num_updates > 0){
+        double c = (m_num_moved / m_num_updates) * (1. - m_theta); // amortised cost of the rebalances, normalised to the current slack
+        if(m_num_scanned > 0){
+            target = 1. / (1. + std::sqrt(m_num_updates * c / m_num_scanned));
+        } else if(c > 0){
+            target = m_theta_min;
+        }
+    }
+    target = std::min(std::max(target, m_theta_min), m_theta_max);
+
+    // move halfway towards the target
+    double theta = (m_theta + target) / 2;
+    if(std::abs(theta - m_theta) < 0.01) return false;
+    m_theta = theta;
+    return true;
+}
+
+DensityBounds DensityController::adapt(const DensityBounds& densities) const {
+    double theta_h = std::min(m_theta, densities.theta_0 - 0.01);
+    double rho_h = std::min(densities.rho_h * theta_h / densities.theta_h, theta_h); // min(), against the rounding errors
+    if(!(densities.rho_0 < rho_h && theta_h > 0)) return densities; // we cannot scale the thresholds this far
+    return DensityBounds(densities.rho_0, rho_h, theta_h, densities.theta_0);
+}
+
 } // namespace pma
 
 
@@ -19,6 +19,7 @@
 #define PMA_DENSITY_BOUNDS_HPP_
 
 #include <cassert>
+#include <cinttypes>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -35,10 +36,10 @@ namespace pma {
  * 2 * rho_h < (<=?) theta_h : logic constraint for resizing, since C > theta_h => 2*C > rho_h
  */
 struct DensityBounds {
-    const double rho_0; // lower density at the lowest level of the tree
-    const double rho_h; // lower density at the highest level of the tree
-    const double theta_h; // upper density at the highest level of the tree
-    const double theta_0; // upper density at the lowest level of the tree
+    double rho_0; // lower density at the lowest level of the tree
+    double rho_h; // lower density at the highest level of the tree
+    double theta_h; // upper density at the highest level of the tree
+    double theta_0; // upper density at the lowest level of the tree
 
     /**
      * Automatically fetch the density bounds from the configuration/console params
@@ -119,6 +120,11 @@ public:
      */
     const DensityBounds& densities() const noexcept;
 
+    /**
+     * Replace the underlying thresholds, the cached densities are recomputed for the current height of the calibrator tree
+     */
+    void set_densities(const DensityBounds& densities);
+
     /**
      * Get the height of the current calibrator tree
      */
@@ -136,6 +142,73 @@ inline std::pair<double, double> CachedDensityBounds::thresholds(int current_hei
     return m_cached_densities[current_height -1];
 }
 
+/**
+ * Online tuning of the density bounds, according to the recent workload.
+ *
+ * Updates favour sparse arrays, where the rebalances move fewer elements, while scans favour dense arrays, where
+ * fewer slots need to be visited. The controller observes the number of updates, the number of scanned elements and
+ * the number of elements moved by the rebalances, in epochs of at least 1/4 of the cardinality of the array. At the
+ * end of each epoch it sets the upper density at the root, theta_h, to the value minimising the cost model:
+ *      cost(d) = scanned / d + updates * c / (1 - d)
+ * where c is the amortised cost of the rebalances observed at the current density. Older epochs weight half as much
+ * as the following ones, and the target is approached by half the distance at a time, to avoid oscillations.
+ */
+class DensityController {
+    const double m_theta_min; // the min value for theta_h
+    const double m_theta_max; // the max value for theta_h
+    double m_theta; // the current value for theta_h
+    double m_num_updates = 0; // number of updates in the past epochs, decayed
+    double m_num_scanned = 0; // number of scanned elements in the past epochs, decayed
+    double m_num_moved = 0; // number of elements moved by rebalances in the past epochs, decayed
+    uint64_t m_epoch_updates = 0; // number of updates in the current epoch
+    uint64_t m_epoch_scans = 0; // number of scans in the current epoch
+    uint64_t m_epoch_scanned = 0; // number of elements scanned in the current epoch
+    uint64_t m_epoch_moved = 0; // number of elements moved by the rebalances in the current epoch
+
+public:
+    /**
+     * Initialise the controller
+     * @param theta_h the initial upper density at the root
+     * @param theta_min the min upper density at the root, for update intensive workloads
+     * @param theta_max the max upper density at the root, for scan intensive workloads
+     */
+    DensityController(double theta_h, double theta_min = 0.6, double theta_max = 0.9);
+
+    /**
+     * Record an insertion or a deletion
+     */
+    void record_update() noexcept { m_epoch_updates++; }
+
+    /**
+     * Record a scan over the given number of elements
+     */
+    void record_scan(uint64_t num_elements) noexcept { m_epoch_scans++; m_epoch_scanned += num_elements; }
+
+    /**
+     * Record a rebalance or a resize, moving the given number of elements
+     */
+    void record_rebalance(uint64_t num_elements) noexcept { m_epoch_moved += num_elements; }
+
+    /**
+     * Close the current epoch, if it is long enough, and recompute the target for theta_h
+     * @param cardinality the number of elements in the array, to determine the length of an epoch
+     * @return true if theta_h has changed, false otherwise
+     */
+    bool update(uint64_t cardinality);
+
+    /**
+     * Retrieve the current value for theta_h
+     */
+    double theta() const noexcept { return m_theta; }
+
+    /**
+     * Derive the new density bounds from the given ones. Theta_h is set to the current value of the controller and
+     * rho_h is scaled by the same factor, preserving the constraints among rho_h and theta_h. The bounds are returned
+     * unaltered if the new thresholds would not be valid.
+     */
+    DensityBounds adapt(const DensityBounds& densities) const;
+};
+
 } // namespace pma
 
 #endif /* PMA_DENSITY_BOUNDS_HPP_ */
@@ -18,29 +18,38 @@
 #include "driver.hpp"
 
 #include <algorithm>
+#include <cassert>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "aligned_memory.hpp"
+#include "block_size_calibration.hpp"
 #include "configuration.hpp"
 #include "console_arguments.hpp"
+#include "database.hpp"
 #include "errorhandling.hpp"
 #include "experiment.hpp"
 #include "external.hpp"
 #include "factory.hpp"
 #include "interface.hpp"
 #include "miscellaneous.hpp"
+#include "timer.hpp"
 
 #include "experiments/aging.hpp"
+#include "experiments/bandwidth_budget.hpp"
 #include "experiments/bandwidth_idls.hpp"
 #include "experiments/bulk_loading.hpp"
 #include "experiments/idls.hpp"
 #include "experiments/insert_lookup.hpp"
+#include "experiments/parallel_lookup.hpp"
 #include "experiments/range_query.hpp"
 #include "experiments/step_idls.hpp"
 #include "experiments/step_insert_lookup.hpp"
 #include "experiments/step_insert_scan.hpp"
+#include "experiments/ycsb.hpp"
 
 #include "adaptive/basic/apma_baseline.hpp"
 
@@ -73,6 +82,11 @@ namespace pma {
 
 static bool initialised = false;
 
+// The file `name' in the directory of the parameter --rewired_memory_path
+static string rewired_memory_file(const string& name){
+    return ARGREF(string, "rewired_memory_path").get() + "/" + name;
+}
+
 void initialise() {
 //    if(initialised) RAISE_EXCEPTION(Exception, "Function pma::initialise() already called once");
     if(initialised) return;
@@ -80,6 +94,22 @@ void initialise() {
     PARAMETER(uint64_t, "inode_block_size").alias("iB");
     PARAMETER(uint64_t, "leaf_block_size").alias("lB");
     PARAMETER(uint64_t, "extent_size").descr("The size of an extent used for memory rewiring. It is defined as a multiple in terms of a page size.");
+    PARAMETER(string, "rewired_memory_path").hint("path").descr("Back the rewired memory with files in the given directory (e.g. a SSD, tmpfs or DAX mount point) rather than anonymous memory. Supported only by btreecc_pma8.");
+    PARAMETER(string, "rewired_memory_save").hint("name").descr("At the end of the experiment, persist the content of the data structure in the file <name> of the directory --rewired_memory_path. Supported only by btreecc_pma8.");
+    PARAMETER(string, "rewired_memory_restore").hint("name").descr("Start the experiment from the content previously persisted with --rewired_memory_save <name>, rather than from an empty data structure. The time to restore it is recorded in the table rewired_memory_persistence. The data structure remains backed by the saved files, thus its updates invalidate the snapshot unless it is saved again. Supported only by btreecc_pma8.");
+    PARAMETER(uint64_t, "memory_budget").hint("bytes").descr("Max amount of memory for the elements kept resident, the rest is paged out to the files in --rewired_memory_path. Supported only by btreecc_pma8.");
+    PARAMETER(string, "index_layout").hint("btree|eytzinger|learned").descr("The physical layout of the static index: `btree' uses nodes of --iB keys, `eytzinger' a complete binary tree that does not depend on the node size, `learned' piecewise linear models each covering --iB keys. Supported only by dense_array and btreecc_pma7b.")
+        .set_default("btree").validate_fn([](const string& value){ return value == "btree" || value == "eytzinger" || value == "learned"; });
+    PARAMETER(uint64_t, "index_build_threads").hint("N").descr("Number of threads used to rebuild the static index after a resize. Supported only by btreecc_pma7b and apma_int3.").set_default(1)
+        .validate_fn([](uint64_t value){ return value >= 1; });
+    PARAMETER(bool, "adaptive_densities").descr("Tune the density thresholds online, according to the recent mix of updates and scans and the cost of the rebalances. Supported only by btreecc_pma8 and apma_int3.");
+    PARAMETER(bool, "bloom_filters").descr("Keep a Bloom filter for each leaf, or pair of segments, to skip the lookups of absent keys. Supported only by btree_v2 and btreecc_pma8.");
+    PARAMETER(uint64_t, "weights_threads").hint("N").descr("Number of threads used to fetch and rank the timestamps of the detector, when the window to rebalance spans at least 8192 segments. Supported only by apma_int3.").set_default(1)
+        .validate_fn([](uint64_t value){ return value >= 1; });
+    PARAMETER(bool, "sketch_detector").descr("Detect the hammered segments with a count-min sketch and a fixed number of heavy hitters, rather than with a set of timestamps for each segment. Supported only by apma_int3.");
+    PARAMETER(bool, "mremap_growth").descr("Allocate the sparse arrays with mmap and resize them with mremap, rebalancing the elements in place rather than copying them into a new workspace. Supported only by pma_v4, btree_pma_v4a, btree_pma_v4b and btreecc_pma5b.");
+    PARAMETER(bool, "synchronized").descr("Allow point lookups from multiple threads, concurrently to the writers, with a B-link tree as index and seqlocks on the segments. It cannot be combined with --mremap_growth. Supported only by btree_pma_v4a and btree_pma_v4b.");
+    PARAMETER(bool, "metadata_small_pages").descr("Back the static indexes, the cardinalities of the segments and the detector with 4 KB pages, rather than 2 MB pages, as baseline to measure the TLB misses avoided. Supported by dense_array, btreecc_pma*, apma_int1, apma_int2 and apma_int3.");
 
     /**
      * Basic PMA implementations
@@ -111,7 +141,11 @@ void initialise() {
 #endif
 
     REGISTER_PMA("pma_v4", "Basic packed memory array, v4", [](){
-       return make_unique<PMA_Impl4>();
+       auto algorithm = make_unique<PMA_Impl4>();
+       bool mremap_growth { false };
+       ARGREF(bool, "mremap_growth").get(mremap_growth);
+       algorithm->set_mremap_growth(mremap_growth);
+       return algorithm;
     });
     REGISTER_PMA("btree_v2", "Dynamic AB-tree, version 2", [](){
         auto iB = ARGREF(uint64_t, "inode_block_size").get();
@@ -127,6 +161,26 @@ void initialise() {
         ARGREF(bool, "record_leaf_statistics").get(record_leaf_statistics);
         btree->set_record_leaf_statistics(record_leaf_statistics);
 
+        bool bloom_filters { false };
+        ARGREF(bool, "bloom_filters").get(bloom_filters);
+        btree->set_bloom_filters(bloom_filters);
+
+        bool slab_allocator { false };
+        ARGREF(bool, "abtree_slab_allocator").get(slab_allocator);
+        btree->set_slab_allocator(slab_allocator);
+
+        auto defrag_rate = ARGREF(uint64_t, "abtree_defrag_rate");
+        if(defrag_rate.is_set()){ btree->set_defragmentation_rate(defrag_rate.get()); }
+
+        bool simd_search { false };
+        ARGREF(bool, "abtree_simd").get(simd_search);
+        btree->set_simd_search(simd_search);
+
+        auto bulk_load_threads = ARGREF(uint64_t, "abtree_bulk_load_threads");
+        btree->set_bulk_load_threads(bulk_load_threads.is_set() ? bulk_load_threads.get() : thread::hardware_concurrency());
+        auto bulk_load_fill_factor = ARGREF(double, "abtree_bulk_load_fill_factor");
+        if(bulk_load_fill_factor.is_set()){ btree->set_bulk_load_fill_factor(bulk_load_fill_factor.get()); }
+
         return btree;
     });
 
@@ -141,16 +195,43 @@ void initialise() {
         return art;
     });
 
+    REGISTER_PMA("art_olc", "Same as `art', but with optimistic lock coupling on the nodes of the index and on the leaves. Lookups and scans can run from multiple threads, concurrently to a single writer.", [](){
+        auto lB = ARGREF(uint64_t, "leaf_block_size").get();
+        LOG_VERBOSE("[ART OLC] block size: " << lB);
+        return make_unique<abtree::ART>(lB, /* synchronized ? */ true);
+    });
+
     REGISTER_PMA("dense_array", "Static dense arrays. It can be used in conjunction with huge pages.", [](){
         auto iB = ARGREF(uint64_t, "inode_block_size").get();
         LOG_VERBOSE("[dense_array] Parameter inode_block_size ignored: " << iB);
         auto lB = ARGREF(uint64_t, "leaf_block_size").get();
-        LOG_VERBOSE("[dense_array] block size: " << lB << ", huge pages: " << (configuration::use_huge_pages() ? "true" : "false"));
-        return make_unique<abtree::DenseArray>(lB);
+        auto index_layout = static_index_layout(ARGREF(string, "index_layout").get());
+        LOG_VERBOSE("[dense_array] block size: " << lB << ", index layout: " << index_layout << ", huge pages: " << (configuration::use_huge_pages() ? "true" : "false"));
+        auto dense_array = make_unique<abtree::DenseArray>(lB, index_layout);
+        auto merge_threshold = ARGREF(uint64_t, "dense_array_merge_threshold");
+        if(merge_threshold.is_set()){ dense_array->set_merge_threshold(merge_threshold.get()); }
+        auto merge_threads = ARGREF(uint64_t, "dense_array_merge_threads");
+        dense_array->set_merge_threads(merge_threads.is_set() ? merge_threads.get() : thread::hardware_concurrency());
+        return dense_array;
     });
+    PARAMETER(uint64_t, "dense_array_merge_threshold").hint("N")
+        .descr("Merge the delta of the dense_array in the background, on a worker thread, whenever it reaches `N' elements. By default, the delta is only merged when the data structure is built.");
+    PARAMETER(uint64_t, "dense_array_merge_threads").hint("N")
+        .descr("Number of threads used by the dense_array to sort the delta, merge it and rebuild the index. Default: the number of cores.");
 
     PARAMETER(bool, "abtree_random_permutation")
         .descr("Randomly permute the nodes in the tree. Only significant for the baseline abtree implementation (btree_v2).");
+    PARAMETER(bool, "abtree_slab_allocator")
+        .descr("Allocate the nodes of the tree from slabs of 2 MB chunks, backed by transparent huge pages, rather than with a malloc for each node. Supported only by btree_v2.");
+    PARAMETER(uint64_t, "abtree_defrag_rate").hint("N")
+        .descr("Relocate `N' leaves in key order after each insertion or deletion, while the tree is fragmented, to defragment it online. Supported only by btree_v2.");
+    PARAMETER(bool, "abtree_simd")
+        .descr("Search the keys inside the nodes with AVX2 instructions and prefetch the next leaf in the iterators. Supported only by btree_v2.");
+    PARAMETER(uint64_t, "abtree_bulk_load_threads").hint("N")
+        .descr("Number of threads used to sort the elements and build the tree in a bulk load, e.g. with the experiment `bulk_loading'. Supported only by btree_v2. Default: the number of cores.");
+    PARAMETER(double, "abtree_bulk_load_fill_factor").hint("F")
+        .validate_fn([](double value){ return value > 0 && value <= 1; })
+        .descr("Target fill factor, in (0, 1], of the leaves created by a bulk load. Supported only by btree_v2. Default: 1.");
     PARAMETER(bool, "record_leaf_statistics")
         .descr("When deleting the index, record in the table `btree_leaf_statistics' the statistics related to the memory distance among consecutive leaves/segments. Supported only by the algorithms btree_v2, btreecc_pma4 and apma_clocked");
 
@@ -166,7 +247,14 @@ void initialise() {
         auto leaf_B = ARGREF(uint64_t, "lB");
         LOG_VERBOSE("[BTREE/PMA v4a] Parameters ignored: iB: " << index_B << ", lB: " << leaf_B);
         LOG_VERBOSE("[BTREE/PMA v4a] It uses a dynamic (a,b)-tree of node size fixed to 64");
-        return make_unique<BTreePMA_v4>();
+        auto algorithm = make_unique<BTreePMA_v4>();
+        bool mremap_growth { false };
+        ARGREF(bool, "mremap_growth").get(mremap_growth);
+        algorithm->set_mremap_growth(mremap_growth);
+        bool synchronized { false };
+        ARGREF(bool, "synchronized").get(synchronized);
+        algorithm->set_synchronized(synchronized);
+        return algorithm;
     });
     REGISTER_PMA("btree_pma_v4b", "Clustered elements, dynamic index, split key/values, fixed sized of the segments.", [](){
         auto iB = ARGREF(uint64_t, "inode_block_size").get();
@@ -174,7 +262,14 @@ void initialise() {
         LOG_VERBOSE("[BTREE/PMA v4b] Parameter inode_block_size ignored: " << iB);
         LOG_VERBOSE("[BTREE/PMA v4b] Segment size: " << lB);
 
-        return make_unique<BTreePMA_v4>(lB);
+        auto algorithm = make_unique<BTreePMA_v4>(lB);
+        bool mremap_growth { false };
+        ARGREF(bool, "mremap_growth").get(mremap_growth);
+        algorithm->set_mremap_growth(mremap_growth);
+        bool synchronized { false };
+        ARGREF(bool, "synchronized").get(synchronized);
+        algorithm->set_synchronized(synchronized);
+        return algorithm;
     });
 
     REGISTER_PMA("btree_stx", "STX B+ tree, external implementation by T. Bingmaan. Note: the B+ tree parameters need to be set at compile time: make EXTRA_CXXFLAGS=\"-DSTX_BTREE_INDEX_B=<iB> -DSTX_BTREE_LEAF_B=<lB>\"", []{
@@ -197,6 +292,11 @@ void initialise() {
         ARGREF(bool, "record_leaf_statistics").get(record_leaf_statistics);
         algorithm->set_record_segment_statistics(record_leaf_statistics);
 
+        // Grow with mremap?
+        bool mremap_growth { false };
+        ARGREF(bool, "mremap_growth").get(mremap_growth);
+        algorithm->set_mremap_growth(mremap_growth);
+
         return algorithm;
     });
     REGISTER_PMA("btreecc_pma7b", "Clustered PMA with memory rewiring. Set the size of an extent with the option --extent_size=N",
@@ -207,14 +307,16 @@ void initialise() {
         if(!param_extent_mult.is_set())
             RAISE_EXCEPTION(configuration::ConsoleArgumentError, "[btreecc_pma7] Mandatory parameter --extent size not set.");
         uint64_t extent_mult = param_extent_mult.get();
+        auto index_layout = static_index_layout(ARGREF(string, "index_layout").get());
         LOG_VERBOSE("[btreecc_pma7b] index block size (iB): " << iB << ", segment size (lB): " << lB << ", "
-                "extent size: " << extent_mult << " (" << get_memory_page_size() * extent_mult << " bytes)");
-        auto algorithm = make_unique<BTreePMACC7>(iB, lB, extent_mult);
+                "extent size: " << extent_mult << " (" << get_memory_page_size() * extent_mult << " bytes), index layout: " << index_layout);
+        auto algorithm = make_unique<BTreePMACC7>(iB, lB, extent_mult, index_layout);
 
         // Record leaf statistics?
         bool record_leaf_statistics { false };
         ARGREF(bool, "record_leaf_statistics").get(record_leaf_statistics);
         algorithm->set_record_segment_statistics(record_leaf_statistics);
+        algorithm->set_index_build_threads(ARGREF(uint64_t, "index_build_threads").get());
 
         return algorithm;
     });
@@ -228,13 +330,52 @@ void initialise() {
         uint64_t extent_mult = param_extent_mult.get();
         LOG_VERBOSE("[btreecc_pma8] index block size (iB): " << iB << ", segment size (lB): " << lB << ", "
                 "extent size: " << extent_mult << " (" << get_memory_page_size() * extent_mult << " bytes)");
-        auto algorithm = make_unique<v8::PackedMemoryArray8>(iB, lB, extent_mult);
+        unique_ptr<v8::PackedMemoryArray8> algorithm;
+
+        // Restore the content persisted by a previous execution?
+        auto param_rewired_memory_restore = ARGREF(string, "rewired_memory_restore");
+        if(param_rewired_memory_restore.is_set()){
+            string path = rewired_memory_file(param_rewired_memory_restore.get());
+            LOG_VERBOSE("[btreecc_pma8] restoring the content from: " << path);
+            Timer timer(true);
+            algorithm = v8::PackedMemoryArray8::restore(path);
+            timer.stop();
+            LOG_VERBOSE("[btreecc_pma8] " << algorithm->size() << " elements restored in " << timer.milliseconds() << " millisecs");
+            config().db()->add("rewired_memory_persistence")
+                    ("operation", "restore")
+                    ("cardinality", algorithm->size())
+                    ("time", timer.microseconds());
+        } else {
+            algorithm = make_unique<v8::PackedMemoryArray8>(iB, lB, extent_mult);
+        }
+
+        // File backed memory?
+        auto param_rewired_memory_path = ARGREF(string, "rewired_memory_path");
+        if(param_rewired_memory_path.is_set()){
+            LOG_VERBOSE("[btreecc_pma8] rewired memory path: " << param_rewired_memory_path.get());
+            algorithm->set_storage_directory(param_rewired_memory_path.get());
+        }
+        auto param_memory_budget = ARGREF(uint64_t, "memory_budget");
+        if(param_memory_budget.is_set()){
+            LOG_VERBOSE("[btreecc_pma8] memory budget: " << param_memory_budget.get() << " bytes");
+            algorithm->set_memory_budget(param_memory_budget.get());
+        }
 
         // Record leaf statistics?
         bool record_leaf_statistics { false };
         ARGREF(bool, "record_leaf_statistics").get(record_leaf_statistics);
         if(record_leaf_statistics){ std::cerr << "[btreecc_pma8] Warning: parameter --record_leaf_statistics ignored" << endl; }
 
+        // Tune the density thresholds according to the workload?
+        bool adaptive_densities { false };
+        ARGREF(bool, "adaptive_densities").get(adaptive_densities);
+        algorithm->set_adaptive_densities(adaptive_densities);
+
+        // Skip the lookups of absent keys with Bloom filters?
+        bool bloom_filters { false };
+        ARGREF(bool, "bloom_filters").get(bloom_filters);
+        algorithm->set_bloom_filters(bloom_filters);
+
         return algorithm;
     });
 
@@ -352,6 +493,18 @@ void initialise() {
         bool record_leaf_statistics { false };
         ARGREF(bool, "record_leaf_statistics").get(record_leaf_statistics);
         algorithm->set_record_segment_statistics(record_leaf_statistics);
+        algorithm->set_index_build_threads(ARGREF(uint64_t, "index_build_threads").get());
+
+        // Tune the density thresholds according to the workload?
+        bool adaptive_densities { false };
+        ARGREF(bool, "adaptive_densities").get(adaptive_densities);
+        algorithm->set_adaptive_densities(adaptive_densities);
+
+        // Bounded memory for the detector?
+        bool sketch_detector { false };
+        ARGREF(bool, "sketch_detector").get(sketch_detector);
+        algorithm->set_sketch_detector(sketch_detector);
+        algorithm->set_weights_threads(ARGREF(uint64_t, "weights_threads").get());
 
         return algorithm;
     });
@@ -390,21 +543,126 @@ void initialise() {
     /**
      * Experiment step_insert_lookup
      */
+    PARAMETER(uint64_t, "interleave").hint("N")
+            .descr("Perform the lookups in batches, keeping up to N lookups in flight at the same time to overlap their cache misses. Only for the experiments insert_lookup and step_insert_lookup.");
     REGISTER_EXPERIMENT("step_insert_lookup", "Insert the elements gradually, by doubling the size of the data structure, and measure at each step both the insert & search time",
             [](shared_ptr<Interface> interface){
         auto N_inserts = ARGREF(int64_t, "I");
         auto N_lookups = ARGREF(int64_t, "L");
-        return make_unique<ExperimentStepInsertLookup>(interface, N_inserts, N_lookups);
+        auto experiment = make_unique<ExperimentStepInsertLookup>(interface, N_inserts, N_lookups);
+        auto interleave = ARGREF(uint64_t, "interleave");
+        if(interleave.is_set()){ experiment->set_interleave(interleave.get()); }
+        return experiment;
     });
 
     /**
      * Experiment insert_lookup
      */
+    PARAMETER(double, "lookup_miss_ratio").hint("R").descr("Fraction of the lookups, in [0, 1], that search an absent key. When set, the keys of the distribution are doubled on insert, and a miss searches the odd key next to an element. Only for the experiment insert_lookup.")
+            .validate_fn([](double value){ return value >= 0 && value <= 1; });
     REGISTER_EXPERIMENT("insert_lookup", "Measure the time insert `num_insertions' elements in the data structure. Eventually perform `num_lookups' lookups of random chosen at random.",
             [](shared_ptr<Interface> interface){
         auto N_inserts = ARGREF(int64_t, "I");
         auto N_lookups = ARGREF(int64_t, "L");
-        return make_unique<ExperimentInsertLookup>(interface, N_inserts, N_lookups);
+        auto experiment = make_unique<ExperimentInsertLookup>(interface, N_inserts, N_lookups);
+        auto miss_ratio = ARGREF(double, "lookup_miss_ratio");
+        if(miss_ratio.is_set()){ experiment->set_miss_ratio(miss_ratio.get()); }
+        auto interleave = ARGREF(uint64_t, "interleave");
+        if(interleave.is_set()){ experiment->set_interleave(interleave.get()); }
+        return experiment;
+    });
+
+    /**
+     * Experiment parallel_lookup
+     */
+    PARAMETER(string, "lookup_threads").hint().set_default("1,2,4,8")
+            .descr("The number of reader threads to evaluate in the experiment `parallel_lookup', as a comma separated list");
+    PARAMETER(bool, "lookup_writer").descr("In the experiment `parallel_lookup', run a writer thread, removing and re-inserting random elements (or inserting further copies of them, if the data structure does not support deletions), concurrently to the readers");
+    REGISTER_EXPERIMENT("parallel_lookup", "Insert `num_insertions' elements in an art_olc or a btree_pma_v4 with --synchronized, then measure the throughput of `num_lookups' lookups split among the `lookup_threads' readers.",
+            [](shared_ptr<Interface> interface){
+        auto N_inserts = ARGREF(int64_t, "I");
+        auto N_lookups = ARGREF(int64_t, "L");
+
+        vector<uint64_t> threads;
+        string threads_str = ARGREF(string, "lookup_threads");
+        for(decltype(auto) num_threads_str : split(threads_str)){
+            size_t idx = 0;
+            int64_t num_threads = std::stoll(num_threads_str, &idx);
+            if(num_threads <= 0 || idx != num_threads_str.size()){
+                RAISE_EXCEPTION(configuration::ConsoleArgumentError, "Invalid number of threads: `" << num_threads_str << "'" <<
+                        " for the argument --lookup_threads: " << threads_str << ". Expected a comma separated list of positive integers.");
+            }
+            threads.push_back(num_threads);
+        }
+
+        LOG_VERBOSE("parallel_lookup, insertions: " << N_inserts << ", lookups: " << N_lookups << ", threads: " << threads_str);
+        auto experiment = make_unique<ExperimentParallelLookup>(interface, N_inserts, N_lookups, threads);
+        bool concurrent_writer { false };
+        ARGREF(bool, "lookup_writer").get(concurrent_writer);
+        experiment->set_concurrent_writer(concurrent_writer);
+        return experiment;
+    });
+
+    /**
+     * Experiment ycsb
+     */
+    PARAMETER(string, "ycsb_workload").hint("A|B|C|D|E|F").set_default("A")
+            .descr("The mix of operations in the experiment `ycsb': A = 50% reads, 50% updates; B = 95% reads, 5% updates; C = 100% reads; D = 95% reads, 5% inserts; E = 95% scans, 5% inserts; F = 50% reads, 50% read-modify-write, executed as updates")
+            .validate_fn([](const string& value){ return value.size() == 1 && value[0] >= 'A' && value[0] <= 'F'; });
+    PARAMETER(string, "ycsb_ratios").hint("read,update,insert,scan")
+            .descr("In the experiment `ycsb', explicitly set the proportion of each type of operation, as a comma separated list, replacing the mix of --ycsb_workload");
+    PARAMETER(string, "ycsb_keys").hint("uniform|zipf").set_default("zipf")
+            .descr("In the experiment `ycsb', how to choose the elements accessed by the reads, updates and scans")
+            .validate_fn([](const string& value){ return value == "uniform" || value == "zipf"; });
+    PARAMETER(double, "ycsb_zipf_alpha").hint().set_default(0.99).descr("In the experiment `ycsb', the parameter alpha of the zipf distribution");
+    PARAMETER(uint64_t, "ycsb_threads").hint("N").set_default(1).descr("The number of client threads in the experiment `ycsb'")
+            .validate_fn([](uint64_t value){ return value >= 1; });
+    PARAMETER(string, "ycsb_sync").hint("global|rwlock|native").set_default("global")
+            .descr("In the experiment `ycsb', how to synchronise the client threads: a single mutex for all operations (global), a readers-writer lock (rwlock), or lock-free reads relying on the data structure, supported only by art_olc and btree_pma_v4 with --synchronized (native)")
+            .validate_fn([](const string& value){ return value == "global" || value == "rwlock" || value == "native"; });
+    PARAMETER(uint64_t, "ycsb_scan_length").hint("N").set_default(100).descr("The number of elements visited by each scan in the experiment `ycsb'")
+            .validate_fn([](uint64_t value){ return value >= 1; });
+    REGISTER_EXPERIMENT("ycsb", "Insert `num_insertions' elements, then run `num_lookups' operations, split among `ycsb_threads' clients, with the mix of reads, updates, inserts and scans of --ycsb_workload. Record the throughput and the latency of each type of operation.",
+            [](shared_ptr<Interface> interface){
+        auto N_inserts = ARGREF(int64_t, "I");
+        auto N_operations = ARGREF(int64_t, "L");
+        uint64_t num_threads = ARGREF(uint64_t, "ycsb_threads");
+        auto sync = ExperimentYCSB::parse_sync(ARGREF(string, "ycsb_sync"));
+
+        // proportion of reads, updates, inserts and scans
+        double ratios[4] = {}; // no commas, this is a macro argument
+        string workload = ARGREF(string, "ycsb_workload");
+        switch(workload[0]){
+        case 'A': ratios[0] = 0.5; ratios[1] = 0.5; break;
+        case 'B': ratios[0] = 0.95; ratios[1] = 0.05; break;
+        case 'C': ratios[0] = 1; break;
+        case 'D': ratios[0] = 0.95; ratios[2] = 0.05; break;
+        case 'E': ratios[3] = 0.95; ratios[2] = 0.05; break;
+        case 'F': ratios[0] = 0.5; ratios[1] = 0.5; break;
+        }
+        auto param_ratios = ARGREF(string, "ycsb_ratios");
+        if(param_ratios.is_set()){
+            string ratios_str = param_ratios.get();
+            auto tokens = split(ratios_str);
+            if(tokens.size() != 4){
+                RAISE_EXCEPTION(configuration::ConsoleArgumentError, "Invalid argument --ycsb_ratios: " << ratios_str << ". Expected four comma separated values: read,update,insert,scan");
+            }
+            for(size_t i = 0; i < tokens.size(); i++){
+                size_t idx = 0;
+                double value = std::stod(tokens[i], &idx);
+                if(value < 0 || idx != tokens[i].size()){
+                    RAISE_EXCEPTION(configuration::ConsoleArgumentError, "Invalid ratio: `" << tokens[i] << "' for the argument --ycsb_ratios: " << ratios_str << ". Expected non negative numbers.");
+                }
+                ratios[i] = value;
+            }
+        }
+
+        LOG_VERBOSE("ycsb, insertions: " << N_inserts << ", operations: " << N_operations << ", threads: " << num_threads << ", sync: " << ExperimentYCSB::to_string(sync));
+        auto experiment = make_unique<ExperimentYCSB>(interface, N_inserts, N_operations, num_threads, sync);
+        experiment->set_ratios(ratios[0], ratios[1], ratios[2], ratios[3]);
+        experiment->set_zipf(ARGREF(string, "ycsb_keys").get() == "zipf", ARGREF(double, "ycsb_zipf_alpha"));
+        experiment->set_scan_length(ARGREF(uint64_t, "ycsb_scan_length"));
+        return experiment;
     });
 
     /**
@@ -482,6 +740,32 @@ void initialise() {
                 beta, seed);
     });
 
+    /**
+     * Experiment bandwidth_budget
+     */
+    PARAMETER(string, "memory_budgets").hint().set_default("0.05,0.1,0.25,0.5,1")
+            .descr("The memory budgets to evaluate in the experiment `bandwidth_budget', as a comma separated list of fractions, in (0, 1], of the memory footprint of the data structure");
+    REGISTER_EXPERIMENT("bandwidth_budget", "Insert `num_insertions' elements in an out-of-core btreecc_pma8, then measure the throughput of `num_lookups' lookups and updates for each of the `memory_budgets'. It requires the parameter --rewired_memory_path.",
+            [](shared_ptr<Interface> interface){
+        auto N_inserts = ARGREF(int64_t, "I");
+        auto N_operations = ARGREF(int64_t, "L");
+
+        vector<double> budgets;
+        string budgets_str = ARGREF(string, "memory_budgets");
+        for(decltype(auto) budget_str : split(budgets_str)){
+            size_t idx = 0;
+            double budget = std::stod(budget_str, &idx);
+            if(budget <= 0 || budget > 1 || idx != budget_str.size()){
+                RAISE_EXCEPTION(configuration::ConsoleArgumentError, "Invalid budget: `" << budget_str << "'" <<
+                        " for the argument --memory_budgets: " << budgets_str << ". Expected a comma separated list of numbers in (0, 1].");
+            }
+            budgets.push_back(budget);
+        }
+
+        LOG_VERBOSE("bandwidth_budget, insertions: " << N_inserts << ", operations per budget: " << N_operations << ", budgets: " << budgets_str);
+        return make_unique<ExperimentBandwidthBudget>(interface, N_inserts, N_operations, budgets);
+    });
+
     /**
      * Experiment step_idls
      */
@@ -514,6 +798,7 @@ void initialise() {
      */
     PARAMETER(uint64_t, "scan_warmup").hint("N").descr("Perform `N' non recorded warm-up scan iterations before starting the experiment").set_default(0);
     PARAMETER(string, "temp").hint("path").descr("Path to a temporary folder, for disk spilling.").set_default("/tmp");
+    PARAMETER(bool, "aging_defragment").descr("In each round of the experiment `aging', defragment the leaves of the tree after the scans and repeat them, to measure the scan bandwidth before and after.");
     REGISTER_EXPERIMENT("aging", "Similar to the IDLS experiment. Perform batches of insertions/deletions followed by full scans. The data structure to test has to be an ab-tree.",
         [](shared_ptr<Interface> interface){
         auto N_initial_inserts = ARGREF(int64_t, "initial_size");
@@ -531,7 +816,11 @@ void initialise() {
         auto tmpfolder = ARGREF(string, "temp");
 
         LOG_VERBOSE("aging, initial size: " << N_initial_inserts << ", total operations: " << N_insdel << ", consecutive operations (inserts/deletes): " << N_consecutive_operations << ", scans: " << N_scans);
-        return make_unique<ExperimentAging>(interface, N_initial_inserts, N_insdel, N_consecutive_operations, N_warmup, N_scans, tmpfolder, seed);
+        auto experiment = make_unique<ExperimentAging>(interface, N_initial_inserts, N_insdel, N_consecutive_operations, N_warmup, N_scans, tmpfolder, seed);
+        bool defragment { false };
+        ARGREF(bool, "aging_defragment").get(defragment);
+        experiment->set_defragment(defragment);
+        return experiment;
     });
 
     /**
@@ -610,6 +899,8 @@ void initialise() {
                         .descr("The block size for the intermediate nodes");
     PARAMETER(uint64_t, "leaf_block_size")["l"].hint().set_default(128)
                         .descr("The block size of the leaves");
+    PARAMETER(bool, "auto_block_size")
+                        .descr("Choose the block sizes -b and -l, unless explicitly set, according to the cache geometry of the host and a short calibration at startup. The chosen values are recorded in the database.");
 
     // IDLS experiment
     PARAMETER(int64_t, "idls_group_size").hint("N >= 1").set_default(1)
@@ -664,8 +955,26 @@ void execute(){
     shared_ptr<Experiment> experiment;
 
     // standard single-payload scenario
-    experiment = factory().make_experiment(name_experiment, factory().make_algorithm(name_algorithm));
+    shared_ptr<Interface> algorithm = factory().make_algorithm(name_algorithm);
+    experiment = factory().make_experiment(name_experiment, algorithm);
     experiment->execute();
+
+    // persist the content of the data structure, to restore it in a later execution with --rewired_memory_restore
+    auto param_rewired_memory_save = ARGREF(string, "rewired_memory_save");
+    if(param_rewired_memory_save.is_set()){
+        string path = rewired_memory_file(param_rewired_memory_save.get());
+        LOG_VERBOSE("[btreecc_pma8] saving the content into: " << path);
+        auto pma = dynamic_pointer_cast<v8::PackedMemoryArray8>(algorithm);
+        assert(pma.get() != nullptr && "Checked by #prepare_parameters");
+        Timer timer(true);
+        pma->save(path);
+        timer.stop();
+        LOG_VERBOSE("[btreecc_pma8] " << pma->size() << " elements saved in " << timer.milliseconds() << " millisecs");
+        config().db()->add("rewired_memory_persistence")
+                ("operation", "save")
+                ("cardinality", pma->size())
+                ("time", timer.microseconds());
+    }
 }
 
 
@@ -708,6 +1017,22 @@ static void prepare_parameters_btree_stx() {
     LOG_VERBOSE("[B+Tree STX] iB=" << iB << ", lB=" << lB);
 }
 
+/**
+ * The options --rewired_memory_save and --rewired_memory_restore refer to a file in the directory --rewired_memory_path,
+ * as the files for the keys & values are created alongside.
+ */
+static void prepare_parameters_rewired_memory_persistence(const string& algorithm){
+    for(const char* option : {"rewired_memory_save", "rewired_memory_restore"}){
+        if(!ARGREF(string, option).is_set()) continue;
+        if(algorithm != "btreecc_pma8"){
+            RAISE_EXCEPTION(configuration::ConsoleArgumentError, "The option --" << option << " is supported only by the algorithm btreecc_pma8");
+        }
+        if(!ARGREF(string, "rewired_memory_path").is_set()){
+            RAISE_EXCEPTION(configuration::ConsoleArgumentError, "The option --" << option << " requires the parameter --rewired_memory_path");
+        }
+    }
+}
+
 /**
  * For the experiment `bulk_loading' the number of insertions is effectively ignored. However we need to set
  * to properly initialise the distribution to use.
@@ -740,13 +1065,47 @@ static void prepare_parameters_bulk_loading(){
     arg_num_inserts.set_forced(num_inserts);
 }
 
+/**
+ * With the option --auto_block_size, replace the default block sizes (-b and -l) with those chosen by the calibration
+ * for the current host. Being forced, the chosen values are recorded in the database as the other parameters.
+ */
+static void prepare_parameters_auto_block_size(){
+    auto iB = PARAMETER(uint64_t, "iB");
+    auto lB = PARAMETER(uint64_t, "lB");
+    bool calibrate_iB = iB.is_default() || !iB.is_set();
+    bool calibrate_lB = lB.is_default() || !lB.is_set();
+    if(!calibrate_iB && !calibrate_lB) return; // both explicitly set
+
+    auto index_layout = static_index_layout(ARGREF(string, "index_layout").get());
+    auto calibration = calibrate_block_sizes(index_layout, calibrate_iB ? 0 : iB.get(), calibrate_lB ? 0 : lB.get());
+    LOG_VERBOSE("[auto_block_size] " << calibration);
+    if(calibrate_iB) iB.set_forced(calibration.m_inode_block_size);
+    if(calibrate_lB) lB.set_forced(calibration.m_leaf_block_size);
+}
+
 void prepare_parameters() {
     string algorithm = ARGREF(string, "algorithm");
     string experiment = ARGREF(string, "experiment");
 
+    bool auto_block_size { false };
+    ARGREF(bool, "auto_block_size").get(auto_block_size);
+    if(auto_block_size){
+        if(algorithm == "btree_stx"){
+            cout << "[WARNING] Option --auto_block_size ignored for the algorithm `btree_stx', its block sizes are set at compile time" << endl;
+        } else {
+            prepare_parameters_auto_block_size();
+        }
+    }
+
+    bool metadata_small_pages { false };
+    ARGREF(bool, "metadata_small_pages").get(metadata_small_pages);
+    aligned_memory_set_huge_pages(!metadata_small_pages);
+
     if(algorithm == "btree_stx")
         prepare_parameters_btree_stx();
 
+    prepare_parameters_rewired_memory_persistence(algorithm);
+
     if(experiment == "bulk_loading")
         prepare_parameters_bulk_loading();
 
@@ -274,6 +274,19 @@ void ExperimentAging::run(){
         t_scan.stop();
         ONLY_IF_PROFILING_ENABLED( auto profiler_snapshot = profiler.stop() );
 
+        // relocate the leaves in key order & repeat the scans
+        Timer t_defrag;
+        Timer t_scan_defrag;
+        if(m_defragment){
+            t_defrag.start();
+            m_instance->defragment();
+            t_defrag.stop();
+
+            t_scan_defrag.start();
+            run_scans(m_scan_trials);
+            t_scan_defrag.stop();
+        }
+
         // Read the keys to insert
         fill(input_insert, keys_insert, m_batch_size);
         // Perform `m_batch_size' inserts
@@ -293,7 +306,11 @@ void ExperimentAging::run(){
 
         cout << "[Round " << round << "] insertion time: " << t_insert.milliseconds() << " millisecs, deletion time: " <<
                 t_delete.milliseconds() << " millisecs, scan time [#" << m_scan_trials << "]: " << t_scan.milliseconds() << " milliseconds, "
-                        "leaf distance: " << stats.m_distance_avg << " bytes" << std::endl;
+                        "leaf distance: " << stats.m_distance_avg << " bytes";
+        if(m_defragment){
+            cout << ", defragmentation time: " << t_defrag.milliseconds() << " millisecs, scan time after the defragmentation: " << t_scan_defrag.milliseconds() << " millisecs";
+        }
+        cout << std::endl;
 
         config().db()->add("aging")
                         ("round", round)
@@ -305,6 +322,10 @@ void ExperimentAging::run(){
                         ("leaf_memdist_stddev", stats.m_distance_stddev)
                         ("leaf_cardinality_avg", stats.m_cardinality_avg)
                         ("leaf_cardinality_stddev", stats.m_cardinality_stddev)
+                        ("t_defrag_millisecs", t_defrag.milliseconds<uint64_t>())
+                        ("t_scans_defrag_millisecs", t_scan_defrag.milliseconds<uint64_t>())
+                        ("scan_bandwidth_mbps", scan_bandwidth(t_scan.microseconds<uint64_t>()))
+                        ("scan_bandwidth_defrag_mbps", scan_bandwidth(t_scan_defrag.microseconds<uint64_t>()))
                         ;
 
         ONLY_IF_PROFILING_ENABLED(
@@ -332,6 +353,16 @@ void ExperimentAging::run(){
     input_delete.close();
 }
 
+uint64_t ExperimentAging::scan_bandwidth(uint64_t t_microsecs) const {
+    if(t_microsecs == 0) return 0;
+    uint64_t bytes = m_initial_size * m_scan_trials * 2 * sizeof(int64_t); // key/value pairs
+    return bytes / t_microsecs; // bytes per microsec == MB/sec
+}
+
+void ExperimentAging::set_defragment(bool value){
+    m_defragment = value;
+}
+
 void ExperimentAging::postprocess(){
     if(m_thread_pinned){
         unpin_thread();
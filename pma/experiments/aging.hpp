@@ -36,6 +36,7 @@ namespace pma {
  *      2c- Perform `batch_size' insertions, set count += `batch_size'.
  *      2d- Perform `batch_size' deletions, set count += `batch_size'.
  *      2e- Perform `scan_num_trials' scans
+ *      2f- If requested, defragment the leaves of the tree and repeat the scans
  *      2d- Record the total time for insertions, deletions and scans, in the table aging
  *      2e- End while, goto 2b.
  */
@@ -47,6 +48,7 @@ class ExperimentAging : public Experiment {
     const size_t m_scan_warmup; // before starting the experiment, perform `m_scan_warmup' iterations to warm up the processor
     const size_t m_scan_trials; // the number of scans to perform each time
     bool m_thread_pinned = false; // record whether the thread has been pinned
+    bool m_defragment = false; // whether to defragment the tree after the scans of each round, and repeat the scans
 
     // distributions
     const std::string m_temporary_folder; // the folder where to save the generated keys
@@ -99,6 +101,11 @@ private:
      */
     void run_warmup();
 
+    /**
+     * Compute the bandwidth, in MB/sec, of `m_scan_trials' scans over the whole data structure, executed in `t_microsecs'
+     */
+    uint64_t scan_bandwidth(uint64_t t_microsecs) const;
+
 protected:
     /**
      * Initialise the experiment. Compute the keys required for the insert/delete/lookup/range queries operations.
@@ -122,6 +129,12 @@ public:
             uint64_t seed);
 
     ~ExperimentAging();
+
+    /**
+     * Whether to defragment the leaves of the tree in each round, after the scans, and then to repeat the scans
+     * to measure the difference in scan bandwidth. Default: false
+     */
+    void set_defragment(bool value);
 };
 
 }
@@ -0,0 +1,145 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bandwidth_budget.hpp"
+
+#include <iostream>
+#include <random>
+
+#include "configuration.hpp"
+#include "database.hpp"
+#include "errorhandling.hpp"
+#include "extent_cache.hpp"
+#include "miscellaneous.hpp"
+#include "timer.hpp"
+
+#include "distribution/distribution.hpp"
+#include "distribution/driver.hpp"
+#include "pma/btree/08/packed_memory_array.hpp"
+
+#define RAISE(message) RAISE_EXCEPTION(pma::ExperimentError, message)
+
+using namespace distribution;
+using namespace std;
+
+namespace pma {
+
+ExperimentBandwidthBudget::ExperimentBandwidthBudget(std::shared_ptr<Interface> pma, size_t N, size_t M, const std::vector<double>& budgets) :
+        m_pma(dynamic_pointer_cast<v8::PackedMemoryArray8>(pma)), N_inserts(N), N_operations(M), m_budgets(budgets) {
+    if(m_pma.get() == nullptr) RAISE("Invalid instance: it's not a btreecc_pma8");
+    if(N_inserts == 0) RAISE("Invalid number of insertions: " << N_inserts);
+    if(m_budgets.empty()) RAISE("No memory budgets given");
+    for(auto budget : m_budgets){
+        if(budget <= 0 || budget > 1) RAISE("Invalid memory budget: " << budget << ". Expected a fraction in (0, 1]");
+    }
+}
+
+ExperimentBandwidthBudget::~ExperimentBandwidthBudget() {
+    if(m_thread_pinned){ unpin_thread(); }
+}
+
+void ExperimentBandwidthBudget::preprocess() {
+    LOG_VERBOSE("Generating the set of elements to insert ... ");
+    m_distribution = generate_distribution();
+
+    pin_thread_to_cpu();
+    m_thread_pinned = true;
+    LOG_VERBOSE("Experiment ready to begin");
+}
+
+uint64_t ExperimentBandwidthBudget::run_lookups(uint64_t seed){
+    mt19937_64 random_generator(seed);
+    uniform_int_distribution<int64_t> distribution(0, N_inserts -1);
+
+    Timer timer(true);
+    for(size_t i = 0; i < N_operations; i++){
+        m_pma->find(m_distribution->get( distribution(random_generator) ).first);
+    }
+    timer.stop();
+    return timer.microseconds();
+}
+
+uint64_t ExperimentBandwidthBudget::run_updates(uint64_t seed){
+    mt19937_64 random_generator(seed);
+    uniform_int_distribution<int64_t> distribution(0, N_inserts -1);
+
+    Timer timer(true);
+    for(size_t i = 0; i < N_operations; i++){
+        auto element = m_distribution->get( distribution(random_generator) );
+        m_pma->remove(element.first);
+        m_pma->insert(element.first, element.second);
+    }
+    timer.stop();
+    return timer.microseconds();
+}
+
+void ExperimentBandwidthBudget::run() {
+    Timer timer;
+
+    if(!m_pma->empty()){ // restored with --rewired_memory_restore, the time to restore it is recorded by the driver
+        if(m_pma->size() != N_inserts) RAISE("The restored PMA contains " << m_pma->size() << " elements, expected: " << N_inserts << ". Save and restore it with the same parameters");
+        cout << "Skipping the insertions, the PMA has been restored with " << m_pma->size() << " elements" << endl;
+    } else {
+        cout << "Inserting " << N_inserts << " elements ..." << endl;
+        timer.start();
+        for(size_t i = 0; i < N_inserts; i++){
+            auto p = m_distribution->get(i);
+            m_pma->insert(p.first, p.second);
+        }
+        timer.stop();
+        cout << "# Insertion time: " << timer.milliseconds() << " millisecs" << endl;
+        config().db()->add("bandwidth_budget")
+                ("type", "insert")
+                ("budget", (int64_t) 0)
+                ("budget_fraction", 1.0)
+                ("operations", N_inserts)
+                ("time", timer.microseconds())
+                ("hits", (int64_t) 0)
+                ("misses", (int64_t) 0)
+                ("evictions", (int64_t) 0);
+    }
+
+    const size_t footprint = m_pma->memory_footprint();
+    uint64_t seed = ARGREF(uint64_t, "seed_lookups");
+    for(auto fraction : m_budgets){
+        const size_t budget = fraction * footprint;
+        cout << "Memory budget: " << to_string_with_unit_suffix(budget) << " (" << fraction * 100 << "% of " << to_string_with_unit_suffix(footprint) << ")" << endl;
+        m_pma->set_memory_budget(budget);
+        const ExtentCache* cache = m_pma->get_extent_cache();
+        if(cache == nullptr || !cache->is_attached()) RAISE("The PMA does not page its extents to a file. Set the parameter --rewired_memory_path");
+
+        for(string type : {"lookup", "update"}){
+            uint64_t hits = cache->num_hits(), misses = cache->num_misses(), evictions = cache->num_evictions();
+            uint64_t time = (type == "lookup") ? run_lookups(seed++) : run_updates(seed++);
+            hits = cache->num_hits() - hits; misses = cache->num_misses() - misses; evictions = cache->num_evictions() - evictions;
+
+            double throughput = time > 0 ? static_cast<double>(N_operations) * 1000000 / time : 0;
+            cout << "# " << type << ", throughput: " << (uint64_t) throughput << " ops/sec, extent hits: " << hits << ", misses: " << misses << ", evictions: " << evictions << endl;
+            config().db()->add("bandwidth_budget")
+                    ("type", type)
+                    ("budget", budget)
+                    ("budget_fraction", fraction)
+                    ("operations", N_operations)
+                    ("time", time)
+                    ("hits", hits)
+                    ("misses", misses)
+                    ("evictions", evictions);
+        }
+    }
+}
+
+} /* namespace pma */
@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PMA_EXPERIMENTS_BANDWIDTH_BUDGET_HPP_
+#define PMA_EXPERIMENTS_BANDWIDTH_BUDGET_HPP_
+
+#include "pma/experiment.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace distribution { class Distribution; }
+
+namespace pma {
+class Interface;
+namespace v8 { class PackedMemoryArray8; }
+
+/**
+ * Insert `N' elements in an out-of-core PMA (btreecc_pma8 with a storage directory), then measure the throughput
+ * of `M' lookups and `M' updates for each given memory budget. A budget is expressed as a fraction of the memory
+ * footprint of the data structure after the insertions. When the PMA has been restored with --rewired_memory_restore,
+ * the insertions are skipped, to evaluate the budgets on a cold start.
+ */
+class ExperimentBandwidthBudget : public Experiment {
+private:
+    std::shared_ptr<v8::PackedMemoryArray8> m_pma; // the data structure to evaluate
+    const size_t N_inserts; // number of elements to insert
+    const size_t N_operations; // number of lookups & updates to perform for each budget
+    const std::vector<double> m_budgets; // the memory budgets to evaluate, as fractions of the memory footprint
+    std::unique_ptr<distribution::Distribution> m_distribution; // the elements to insert
+    bool m_thread_pinned = false; // keep track if we have pinned the thread
+
+    // Perform `N_operations' lookups, return the elapsed time in microseconds
+    uint64_t run_lookups(uint64_t seed);
+
+    // Perform `N_operations' updates, i.e. a removal followed by the insertion of the same element. Return the elapsed time in microseconds
+    uint64_t run_updates(uint64_t seed);
+
+protected:
+    /**
+     * Initialise the distribution
+     */
+    void preprocess() override;
+
+    /**
+     * Execute the experiment
+     */
+    void run() override;
+
+public:
+    /**
+     * Initialise the experiment
+     * @param pma the data structure to evaluate, it must be an instance of btreecc_pma8
+     * @param N the number of elements to insert
+     * @param M the number of lookups & updates to perform for each budget
+     * @param budgets the memory budgets to evaluate, as fractions in (0, 1] of the memory footprint
+     */
+    ExperimentBandwidthBudget(std::shared_ptr<Interface> pma, size_t N, size_t M, const std::vector<double>& budgets);
+
+    /**
+     * Destructor
+     */
+    virtual ~ExperimentBandwidthBudget();
+};
+
+} /* namespace pma */
+
+#endif /* PMA_EXPERIMENTS_BANDWIDTH_BUDGET_HPP_ */
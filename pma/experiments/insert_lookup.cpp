@@ -17,15 +17,18 @@
 
 #include "insert_lookup.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <random>
+#include <vector>
 
 #include "configuration.hpp"
 #include "console_arguments.hpp"
 #include "database.hpp"
 #include "errorhandling.hpp"
 #include "miscellaneous.hpp"
+#include "profiler.hpp"
 #include "timer.hpp"
 
 #include "distribution/distribution.hpp"
@@ -49,6 +52,15 @@ ExperimentInsertLookup::~ExperimentInsertLookup() {
     if(thread_pinned){ unpin_thread(); }
 }
 
+void ExperimentInsertLookup::set_miss_ratio(double value){
+    if(value < 0 || value > 1) RAISE("Invalid miss ratio: " << value << ", expected a value in [0, 1]");
+    miss_ratio = value;
+}
+
+void ExperimentInsertLookup::set_interleave(size_t group_size){
+    interleave = group_size;
+}
+
 void ExperimentInsertLookup::preprocess() {
     auto initial_size = ARGREF(int64_t, "initial_size");
     if(initial_size.is_set() && initial_size > 0){
@@ -65,9 +77,10 @@ void ExperimentInsertLookup::preprocess() {
 }
 
 void ExperimentInsertLookup::do_inserts(Interface* pma, Distribution* distribution){
+    const int64_t scale = miss_ratio < 0 ? 1 : 2; // with a miss ratio, leave a gap after each key for the misses
     for(size_t i = 0; i < N_inserts; i++){
         auto p = distribution->get(i);
-        pma->insert(p.first, p.second);
+        pma->insert(scale * p.first, p.second);
     }
 }
 
@@ -75,19 +88,57 @@ void ExperimentInsertLookup::do_lookups(Interface* pma, Distribution* permutatio
     mt19937_64 random_generator(seed);
     uniform_int_distribution<int64_t> distribution(0, pma->size() == 0 ? 0 : pma->size() -1);
 
-    for(size_t i = 0; i < N_lookups; i++){
-        pma->find(permutation->get( distribution(random_generator) ).first +1 );
+    bernoulli_distribution miss(miss_ratio < 0 ? 0 : miss_ratio);
+    auto next_key = [&]() -> int64_t {
+        if(miss_ratio < 0){
+            return permutation->get( distribution(random_generator) ).first +1;
+        } else {
+            int64_t key = 2 * permutation->get( distribution(random_generator) ).first;
+            if(miss(random_generator)) key++; // absent
+            return key;
+        }
+    };
+
+    if(interleave == 0){
+        for(size_t i = 0; i < N_lookups; i++){
+            pma->find(next_key());
+        }
+    } else {
+        constexpr size_t batch_size = 4096;
+        vector<int64_t> keys(batch_size), values(batch_size);
+        for(size_t i = 0; i < N_lookups; i += batch_size){
+            size_t n = min(batch_size, N_lookups - i);
+            for(size_t j = 0; j < n; j++){ keys[j] = next_key(); }
+            pma->find_interleaved(keys.data(), values.data(), n, interleave);
+        }
     }
 }
 
+#if defined(PROFILING)
+// the misses in the TLB show the effect of backing the static index & the cardinalities with huge pages: run the same
+// experiment twice, with and without --metadata_small_pages, and compare the rows of profiler_insert_lookup_caches
+static void save_caches_profile(const char* type, uint64_t num_elements, uint64_t time, const CachesSnapshot& snapshot){
+    LOG_VERBOSE("# Profiler " << type << ": " << snapshot);
+    config().db()->add("profiler_insert_lookup_caches")
+                    ("type", type)
+                    ("elements", num_elements)
+                    ("time", time)
+                    ("l1_misses", snapshot.m_cache_l1_misses)
+                    ("llc_misses", snapshot.m_cache_llc_misses)
+                    ("tlb_misses", snapshot.m_cache_tlb_misses);
+}
+#endif
+
 void ExperimentInsertLookup::run() {
     auto pma = interface.get();
     Timer aux_timer;
 
     cout << "Inserting " << N_inserts << " elements ..." << endl;
+    ONLY_IF_PROFILING_ENABLED( CachesProfiler profiler_inserts; profiler_inserts.start() );
     aux_timer.reset(true);
     do_inserts(pma, distribution.get());
     aux_timer.stop();
+    ONLY_IF_PROFILING_ENABLED( auto snapshot_inserts = profiler_inserts.stop() );
     size_t t_insert = aux_timer.milliseconds();
     cout << "# Insertion time: " << t_insert << " millisecs" << endl;
 
@@ -97,7 +148,7 @@ void ExperimentInsertLookup::run() {
                     ("initial_size", (size_t) 0)
                     ("elements", N_inserts)
                     ("time", t_insert);
-
+    ONLY_IF_PROFILING_ENABLED( save_caches_profile("insert", N_inserts, t_insert, snapshot_inserts) );
 
     aux_timer.reset(true);
     pma->build(); // in case of the Static-ABTree we build the tree only after calling #build()
@@ -111,9 +162,11 @@ void ExperimentInsertLookup::run() {
     if(N_lookups > 0){
         size_t seed_lookups = ARGREF(uint64_t, "seed_lookups");
         cout << "Searching " << N_lookups << " elements ..." << endl;
+        ONLY_IF_PROFILING_ENABLED( CachesProfiler profiler_lookups; profiler_lookups.start() );
         aux_timer.reset(true);
         do_lookups(pma, distribution.get(), seed_lookups);
         aux_timer.stop();
+        ONLY_IF_PROFILING_ENABLED( auto snapshot_lookups = profiler_lookups.stop() );
         uint64_t t_lookup = aux_timer.milliseconds();
         cout << "# Lookup time: " << t_lookup << " millisecs" << endl;
 
@@ -122,6 +175,7 @@ void ExperimentInsertLookup::run() {
                         ("initial_size", N_inserts)
                         ("elements", N_lookups)
                         ("time", t_lookup);
+        ONLY_IF_PROFILING_ENABLED( save_caches_profile("search", N_lookups, t_lookup, snapshot_lookups) );
     }
 }
 
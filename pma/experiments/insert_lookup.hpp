@@ -38,6 +38,8 @@ private:
     const size_t N_lookups; // number of look up to perform
     std::unique_ptr<distribution::Distribution> distribution;
     bool thread_pinned = false; // keep track if we have pinned the thread
+    double miss_ratio = -1; // fraction of the lookups for absent keys, or < 0 to always search the successor key+1 of an element
+    size_t interleave = 0; // number of lookups in flight with Interface::find_interleaved, or 0 to perform the lookups one at the time
 
 
     void do_inserts(Interface* pma, distribution::Distribution* distribution);
@@ -68,6 +70,19 @@ public:
      * Destructor
      */
     virtual ~ExperimentInsertLookup();
+
+    /**
+     * Set the fraction of lookups, in [0, 1], that search an absent key. To ensure the absent keys
+     * are spread among the present ones, the keys of the distribution are doubled on insert and a miss
+     * searches the odd key 2*k+1 next to the element with key 2*k.
+     */
+    void set_miss_ratio(double value);
+
+    /**
+     * Perform the lookups in batches with Interface::find_interleaved, keeping up to `group_size' of them in flight at the same time.
+     * A group size of 0 performs the lookups one at the time with Interface::find.
+     */
+    void set_interleave(size_t group_size);
 };
 
 } /* namespace pma */
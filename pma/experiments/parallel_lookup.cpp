@@ -0,0 +1,148 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "parallel_lookup.hpp"
+
+#include <future>
+#include <iostream>
+#include <random>
+
+#include "configuration.hpp"
+#include "database.hpp"
+#include "errorhandling.hpp"
+#include "miscellaneous.hpp"
+#include "timer.hpp"
+
+#include "abtree/art.hpp"
+#include "pma/btree/btreepma_v4.hpp"
+#include "distribution/distribution.hpp"
+#include "distribution/driver.hpp"
+
+#define RAISE(message) RAISE_EXCEPTION(pma::ExperimentError, message)
+
+using namespace distribution;
+using namespace std;
+
+namespace pma {
+
+ExperimentParallelLookup::ExperimentParallelLookup(std::shared_ptr<Interface> pma, size_t N, size_t M, const std::vector<uint64_t>& threads) :
+        m_tree(pma), N_inserts(N), N_lookups(M), m_threads(threads) {
+    auto art = dynamic_pointer_cast<abtree::ART>(pma);
+    auto btree_pma = dynamic_pointer_cast<BTreePMA_v4>(pma);
+    if(art.get() != nullptr && art->is_synchronized()){
+        m_supports_remove = true;
+    } else if(btree_pma.get() != nullptr && btree_pma->is_synchronized()){
+        m_supports_remove = false;
+    } else {
+        RAISE("Invalid instance: it's neither an art_olc nor a btree_pma_v4 with --synchronized");
+    }
+    if(N_inserts == 0) RAISE("Invalid number of insertions: " << N_inserts);
+    if(m_threads.empty()) RAISE("No number of threads given");
+    for(auto num_threads : m_threads){
+        if(num_threads == 0) RAISE("Invalid number of threads: " << num_threads);
+    }
+}
+
+ExperimentParallelLookup::~ExperimentParallelLookup() { }
+
+void ExperimentParallelLookup::set_concurrent_writer(bool value){
+    m_concurrent_writer = value;
+}
+
+void ExperimentParallelLookup::preprocess() {
+    LOG_VERBOSE("Generating the set of elements to insert ... ");
+    m_distribution = generate_distribution();
+
+    // do not pin the thread, the readers would inherit its affinity
+    LOG_VERBOSE("Experiment ready to begin");
+}
+
+uint64_t ExperimentParallelLookup::do_lookups(uint64_t seed, uint64_t num_lookups){
+    mt19937_64 random_generator(seed);
+    uniform_int_distribution<int64_t> distribution(0, N_inserts -1);
+
+    uint64_t num_found = 0;
+    for(size_t i = 0; i < num_lookups; i++){
+        num_found += m_tree->find(m_distribution->get( distribution(random_generator) ).first) >= 0;
+    }
+    return num_found;
+}
+
+uint64_t ExperimentParallelLookup::do_updates(uint64_t seed, const std::atomic<bool>& done){
+    mt19937_64 random_generator(seed);
+    uniform_int_distribution<int64_t> distribution(0, N_inserts -1);
+
+    uint64_t num_updates = 0;
+    while(!done){
+        auto element = m_distribution->get( distribution(random_generator) );
+        if(m_supports_remove){ m_tree->remove(element.first); }
+        m_tree->insert(element.first, element.second);
+        num_updates++;
+    }
+    return num_updates;
+}
+
+void ExperimentParallelLookup::run() {
+    Timer timer;
+
+    cout << "Inserting " << N_inserts << " elements ..." << endl;
+    timer.reset(true);
+    for(size_t i = 0; i < N_inserts; i++){
+        auto p = m_distribution->get(i);
+        m_tree->insert(p.first, p.second);
+    }
+    timer.stop();
+    cout << "# Insertion time: " << timer.milliseconds() << " millisecs" << endl;
+
+    uint64_t seed = ARGREF(uint64_t, "seed_lookups");
+    for(auto num_threads : m_threads){
+        cout << "Searching " << N_lookups << " elements with " << num_threads << " thread(s)" << (m_concurrent_writer ? " and a concurrent writer" : "") << " ..." << endl;
+        atomic<bool> done = false;
+        future<uint64_t> writer;
+        if(m_concurrent_writer){ writer = async(launch::async, &ExperimentParallelLookup::do_updates, this, seed++, std::cref(done)); }
+
+        vector<future<uint64_t>> readers;
+        timer.reset(true);
+        for(uint64_t i = 0; i < num_threads; i++){
+            uint64_t num_lookups = N_lookups / num_threads + (i < N_lookups % num_threads);
+            readers.push_back( async(launch::async, &ExperimentParallelLookup::do_lookups, this, seed++, num_lookups) );
+        }
+        uint64_t num_found = 0;
+        for(auto& reader : readers){ num_found += reader.get(); }
+        timer.stop();
+        done = true;
+        uint64_t num_updates = m_concurrent_writer ? writer.get() : 0;
+
+        uint64_t time = timer.microseconds();
+        double throughput = time > 0 ? static_cast<double>(N_lookups) * 1000000 / time : 0;
+        cout << "# Threads: " << num_threads << ", time: " << timer.milliseconds() << " millisecs, throughput: " << (uint64_t) throughput << " lookups/sec";
+        if(m_concurrent_writer) { cout << ", concurrent updates: " << num_updates; }
+        cout << endl;
+        // with a concurrent writer, a lookup may miss an element in between its removal and its re-insertion
+        if((!m_concurrent_writer || !m_supports_remove) && num_found != N_lookups) RAISE("Lookups failed: " << (N_lookups - num_found) << " elements not found");
+
+        config().db()->add("parallel_lookup")
+                ("threads", num_threads)
+                ("writer", m_concurrent_writer)
+                ("elements", N_inserts)
+                ("lookups", N_lookups)
+                ("updates", num_updates)
+                ("time", time);
+    }
+}
+
+} /* namespace pma */
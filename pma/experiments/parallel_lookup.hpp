@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PMA_PARALLEL_LOOKUP_HPP_
+#define PMA_PARALLEL_LOOKUP_HPP_
+
+#include "pma/experiment.hpp"
+
+#include <atomic>
+#include <cinttypes>
+#include <memory>
+#include <vector>
+
+namespace distribution { class Distribution; }
+
+namespace pma {
+class Interface;
+
+/**
+ * Insert `N' elements in a synchronised data structure (art_olc, or btree_pma_v4 with --synchronized),
+ * then, for each of the given number of reader threads, measure the throughput of `M' lookups split
+ * among the readers. Optionally a single writer thread keeps updating the elements while the readers
+ * run: it removes and re-inserts them, or, if the data structure does not support deletions, it
+ * inserts further copies of them.
+ */
+class ExperimentParallelLookup : public Experiment {
+    std::shared_ptr<Interface> m_tree; // the data structure to evaluate
+    bool m_supports_remove = false; // whether the data structure supports deletions
+    const size_t N_inserts; // number of elements to insert
+    const size_t N_lookups; // total number of lookups to perform, for each number of threads
+    const std::vector<uint64_t> m_threads; // the number of reader threads to evaluate
+    bool m_concurrent_writer = false; // whether to run a writer concurrently to the readers
+    std::unique_ptr<distribution::Distribution> m_distribution; // the elements to insert
+
+    // Perform `num_lookups' lookups of random elements in the tree, return the number of elements found
+    uint64_t do_lookups(uint64_t seed, uint64_t num_lookups);
+
+    // Remove and re-insert, or insert a copy of, random elements until `done' is set, return the number of updates performed
+    uint64_t do_updates(uint64_t seed, const std::atomic<bool>& done);
+
+protected:
+    /**
+     * Initialise the distribution
+     */
+    void preprocess() override;
+
+    /**
+     * Execute the experiment
+     */
+    void run() override;
+
+public:
+    /**
+     * Initialise the experiment
+     * @param pma the data structure to evaluate, it must be an art_olc or a synchronised btree_pma_v4
+     * @param N the number of inserts to perform
+     * @param M the number of lookups to perform for each number of threads
+     * @param threads the number of reader threads to evaluate
+     */
+    ExperimentParallelLookup(std::shared_ptr<Interface> pma, size_t N, size_t M, const std::vector<uint64_t>& threads);
+
+    /**
+     * Destructor
+     */
+    virtual ~ExperimentParallelLookup();
+
+    /**
+     * Whether to run a writer thread, updating the elements, concurrently to the readers
+     */
+    void set_concurrent_writer(bool value);
+};
+
+} /* namespace pma */
+
+#endif /* PMA_PARALLEL_LOOKUP_HPP_ */
@@ -17,9 +17,11 @@
 
 #include "step_insert_lookup.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <random>
+#include <vector>
 
 #include "configuration.hpp"
 #include "console_arguments.hpp"
@@ -48,6 +50,10 @@ ExperimentStepInsertLookup::~ExperimentStepInsertLookup(){
     if(thread_pinned){ unpin_thread(); }
 }
 
+void ExperimentStepInsertLookup::set_interleave(size_t group_size){
+    interleave = group_size;
+}
+
 void ExperimentStepInsertLookup::preprocess() {
     auto initial_size = ARGREF(int64_t, "initial_size");
     if(initial_size.is_set() && initial_size > 0){
@@ -77,12 +83,22 @@ static void step_insert(Interface* pma, Distribution* elements){
  * Perform `num_lookup' searches into the given pma. Use the first N elements of the permutation for the keys to search,
  * where N = pma->size();
  */
-static void step_lookup(Interface* pma, Distribution* permutation, uint64_t num_lookups, uint64_t random_seed) {
+static void step_lookup(Interface* pma, Distribution* permutation, uint64_t num_lookups, uint64_t random_seed, size_t interleave) {
     mt19937_64 random_generator(random_seed);
     uniform_int_distribution<int64_t> distribution(0, pma->size() == 0 ? 0 : pma->size() -1);
 
-    for(size_t i = 0; i < num_lookups; i++){
-        pma->find(permutation->get( distribution(random_generator) ).first +1 );
+    if(interleave == 0){
+        for(size_t i = 0; i < num_lookups; i++){
+            pma->find(permutation->get( distribution(random_generator) ).first +1 );
+        }
+    } else {
+        constexpr size_t batch_size = 4096;
+        vector<int64_t> keys(batch_size), values(batch_size);
+        for(size_t i = 0; i < num_lookups; i += batch_size){
+            size_t n = min<size_t>(batch_size, num_lookups - i);
+            for(size_t j = 0; j < n; j++){ keys[j] = permutation->get( distribution(random_generator) ).first +1; }
+            pma->find_interleaved(keys.data(), values.data(), n, interleave);
+        }
     }
 }
 
@@ -122,7 +138,7 @@ void ExperimentStepInsertLookup::run() {
         if(N_lookups > 0){
             cout << "[" << interface->size() << "] Searching " << N_lookups << " elements ..." << endl;
             aux_timer.reset(true);
-            step_lookup(pma, distribution.get(), N_lookups, random_lookups(random_generator) + 13);
+            step_lookup(pma, distribution.get(), N_lookups, random_lookups(random_generator) + 13, interleave);
             aux_timer.stop();
             uint64_t t_search = aux_timer.milliseconds();
             cout << "[" << interface->size() << "] # Search time (total): " << t_search << endl;
@@ -46,6 +46,7 @@ class ExperimentStepInsertLookup : public Experiment {
     const size_t N_lookups; // number of look up to perform
     std::unique_ptr<distribution::Distribution> distribution;
     bool thread_pinned = false; // keep track if we have pinned the thread
+    size_t interleave = 0; // number of lookups in flight with Interface::find_interleaved, or 0 to perform the lookups one at the time
 
 protected:
     void preprocess() override;
@@ -56,6 +57,12 @@ public:
     ExperimentStepInsertLookup(std::shared_ptr<Interface> pma, size_t N, size_t M);
 
     ~ExperimentStepInsertLookup();
+
+    /**
+     * Perform the lookups in batches with Interface::find_interleaved, keeping up to `group_size' of them in flight at the same time.
+     * A group size of 0 performs the lookups one at the time with Interface::find.
+     */
+    void set_interleave(size_t group_size);
 };
 
 } // namespace pma
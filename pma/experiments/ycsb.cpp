@@ -0,0 +1,351 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ycsb.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+
+#include "configuration.hpp"
+#include "cpu_topology.hpp"
+#include "database.hpp"
+#include "errorhandling.hpp"
+#include "miscellaneous.hpp"
+#include "timer.hpp"
+
+#include "abtree/art.hpp"
+#include "pma/btree/btreepma_v4.hpp"
+#include "pma/btree/08/packed_memory_array.hpp"
+#include "distribution/distribution.hpp"
+#include "distribution/driver.hpp"
+#include "distribution/zipf_distribution.hpp"
+
+#define RAISE(message) RAISE_EXCEPTION(pma::ExperimentError, message)
+
+using namespace distribution;
+using namespace std;
+
+namespace pma {
+
+static const char* OPERATION_NAMES[] = { "read", "update", "insert", "scan" };
+
+/*****************************************************************************
+ *                                                                           *
+ *   Synchronisation wrapper                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+class ExperimentYCSB::Wrapper {
+    Interface* m_tree;
+    InterfaceRQ* m_tree_rq; // the same data structure, if it supports range queries, otherwise nullptr
+    const Sync m_sync;
+    const bool m_supports_remove;
+    mutex m_global_lock; // Sync::GLOBAL
+    shared_mutex m_rw_lock; // Sync::RWLOCK and Sync::NATIVE
+
+public:
+    Wrapper(Interface* tree, Sync sync, bool supports_remove) : m_tree(tree), m_tree_rq(dynamic_cast<InterfaceRQ*>(tree)), m_sync(sync), m_supports_remove(supports_remove) { }
+
+    bool read(int64_t key){
+        switch(m_sync){
+        case Sync::GLOBAL: { lock_guard<mutex> lock(m_global_lock); return m_tree->find(key) >= 0; }
+        case Sync::RWLOCK: { shared_lock<shared_mutex> lock(m_rw_lock); return m_tree->find(key) >= 0; }
+        default: return m_tree->find(key) >= 0; // the data structure synchronises the readers with the writers
+        }
+    }
+
+    // replace the value of an existing element, or insert a further copy of it if the data structure does not support deletions
+    bool update(int64_t key, int64_t value){
+        unique_lock<mutex> lock_global(m_global_lock, defer_lock);
+        unique_lock<shared_mutex> lock_rw(m_rw_lock, defer_lock);
+        if(m_sync == Sync::GLOBAL) lock_global.lock(); else lock_rw.lock();
+
+        bool found = true;
+        if(m_supports_remove){
+            int64_t old_value = m_tree->remove(key);
+            found = old_value >= 0;
+            if(found) value = old_value +1;
+        }
+        m_tree->insert(key, value);
+        return found;
+    }
+
+    void insert(int64_t key, int64_t value){
+        unique_lock<mutex> lock_global(m_global_lock, defer_lock);
+        unique_lock<shared_mutex> lock_rw(m_rw_lock, defer_lock);
+        if(m_sync == Sync::GLOBAL) lock_global.lock(); else lock_rw.lock();
+        m_tree->insert(key, value);
+    }
+
+    // visit up to `length' elements starting from `key', return the number of elements actually visited. Without support
+    // for range queries, it falls back to the sum of the keys in [key, key + 2 * length -1], i.e. the interval holding
+    // `length' elements when no insertions took place. The scans are not synchronised by any implementation, even with Sync::NATIVE
+    uint64_t scan(int64_t key, uint64_t length){
+        unique_lock<mutex> lock_global(m_global_lock, defer_lock);
+        shared_lock<shared_mutex> lock_rw(m_rw_lock, defer_lock);
+        if(m_sync == Sync::GLOBAL) lock_global.lock(); else lock_rw.lock();
+        if(m_tree_rq == nullptr) return m_tree->sum(key, key + 2 * length -1).m_num_elements;
+
+        uint64_t count = 0;
+        auto it = m_tree_rq->find(key, numeric_limits<int64_t>::max());
+        while(count < length && it->hasNext()){ it->next(); count++; }
+        return count;
+    }
+};
+
+struct ExperimentYCSB::Client {
+    vector<uint32_t> m_latencies[NUM_OPERATION_TYPES]; // in nanosecs
+    uint64_t m_found[NUM_OPERATION_TYPES] = {0}; // elements found by the reads & updates, elements visited by the scans
+};
+
+/*****************************************************************************
+ *                                                                           *
+ *   Experiment                                                              *
+ *                                                                           *
+ *****************************************************************************/
+
+ExperimentYCSB::ExperimentYCSB(std::shared_ptr<Interface> pma, size_t N, size_t M, uint64_t num_threads, Sync sync) :
+        m_tree(pma), N_inserts(N), N_operations(M), m_num_threads(num_threads), m_sync(sync) {
+    if(pma.get() == nullptr) RAISE("The pointer data structure is NULL");
+    if(N_inserts == 0) RAISE("Invalid number of insertions: " << N_inserts);
+    if(N_operations == 0) RAISE("Invalid number of operations: " << N_operations);
+    if(N_operations >= (1ull << 32)) RAISE("Invalid number of operations: " << N_operations << ", expected less than 2^32");
+    if(m_num_threads == 0) RAISE("Invalid number of threads: " << m_num_threads);
+    if(m_sync == Sync::NATIVE){
+        auto art = dynamic_pointer_cast<abtree::ART>(pma);
+        auto btree_pma = dynamic_pointer_cast<BTreePMA_v4>(pma);
+        if(!(art.get() != nullptr && art->is_synchronized()) && !(btree_pma.get() != nullptr && btree_pma->is_synchronized())){
+            RAISE("Native synchronisation requires an art_olc or a btree_pma_v4 with --synchronized");
+        }
+    } else if(m_sync == Sync::RWLOCK){ // the readers share the lock, they must not alter the data structure
+        auto pma8 = dynamic_pointer_cast<v8::PackedMemoryArray8>(pma);
+        if(pma8.get() != nullptr && pma8->get_extent_cache() != nullptr){
+            RAISE("The synchronisation rwlock is not supported with a --memory_budget: the lookups update the extent cache");
+        }
+    }
+}
+
+ExperimentYCSB::~ExperimentYCSB() { }
+
+void ExperimentYCSB::set_ratios(double read, double update, double insert, double scan){
+    double ratios[NUM_OPERATION_TYPES] = { read, update, insert, scan };
+    double sum = 0;
+    for(int i = 0; i < NUM_OPERATION_TYPES; i++){
+        if(ratios[i] < 0) RAISE("Invalid ratio for the operation " << OPERATION_NAMES[i] << ": " << ratios[i]);
+        sum += ratios[i];
+    }
+    if(sum <= 0) RAISE("All ratios are zero");
+    for(int i = 0; i < NUM_OPERATION_TYPES; i++){ m_ratios[i] = ratios[i] / sum; }
+}
+
+void ExperimentYCSB::set_zipf(bool value, double alpha){
+    if(value && alpha <= 0) RAISE("Invalid parameter alpha for the zipf distribution: " << alpha);
+    m_zipf = value;
+    m_zipf_alpha = alpha;
+}
+
+void ExperimentYCSB::set_scan_length(uint64_t value){
+    if(value == 0) RAISE("Invalid scan length: " << value);
+    m_scan_length = value;
+}
+
+ExperimentYCSB::Sync ExperimentYCSB::parse_sync(const std::string& value){
+    if(value == "global") return Sync::GLOBAL;
+    else if(value == "rwlock") return Sync::RWLOCK;
+    else if(value == "native") return Sync::NATIVE;
+    else RAISE("Invalid synchronisation: `" << value << "', expected either global, rwlock or native");
+}
+
+std::string ExperimentYCSB::to_string(Sync sync){
+    switch(sync){
+    case Sync::GLOBAL: return "global";
+    case Sync::RWLOCK: return "rwlock";
+    case Sync::NATIVE: return "native";
+    default: return "unknown";
+    }
+}
+
+void ExperimentYCSB::init_cpus(){
+    try {
+        auto& topology = get_cpu_topology();
+        m_cpus = topology.get_threads(/* interleaved ? */ false, /* smt ? */ false);
+        if(m_cpus.size() < m_num_threads){ m_cpus = topology.get_threads(false, true); }
+        if(m_cpus.size() < m_num_threads){
+            cout << "[WARNING] Only " << m_cpus.size() << " cpus available for " << m_num_threads << " client threads, some threads will share the same cpu" << endl;
+        }
+    } catch(cpu_topology_exception& e){
+        LOG_VERBOSE("[ExperimentYCSB] Cannot read the cpu topology, the client threads will not be pinned. Reason: " << e.what());
+        m_cpus.clear();
+    }
+}
+
+void ExperimentYCSB::preprocess() {
+    LOG_VERBOSE("Generating the set of elements to insert ... ");
+    m_distribution = generate_distribution();
+    if(m_distribution->size() < N_inserts) RAISE("The distribution generated only " << m_distribution->size() << " elements, expected: " << N_inserts);
+
+    if(m_zipf){
+        LOG_VERBOSE("Generating the keys accessed, zipf distribution with alpha: " << m_zipf_alpha << " ... ");
+        m_zipf_ranks = make_zipf(m_zipf_alpha, N_operations, N_inserts, ARGREF(uint64_t, "seed_lookups"));
+    }
+
+    // do not pin the main thread, the clients would inherit its affinity
+    init_cpus();
+    LOG_VERBOSE("Experiment ready to begin");
+}
+
+void ExperimentYCSB::do_operations(Wrapper* wrapper, Client* client, uint64_t thread_id, uint64_t num_operations, uint64_t first_operation, std::atomic<uint64_t>* num_ready, const std::atomic<bool>* start){
+    try {
+        if(!m_cpus.empty()){ pin_thread_to_cpu(m_cpus[thread_id % m_cpus.size()], /* verbose */ false); }
+    } catch(...){
+        (*num_ready)++; // do not block the main thread
+        throw;
+    }
+
+    mt19937_64 random_generator(ARGREF(uint64_t, "seed_lookups") + thread_id);
+    discrete_distribution<int> choose_operation(begin(m_ratios), end(m_ratios));
+    uniform_int_distribution<uint64_t> choose_element(0, N_inserts -1);
+    uint64_t num_inserts = 0;
+    for(int i = 0; i < NUM_OPERATION_TYPES; i++){ client->m_latencies[i].reserve(num_operations * m_ratios[i] * 1.1); }
+
+    // wait for the other clients
+    (*num_ready)++;
+    while(!(*start)){ this_thread::yield(); }
+
+    for(uint64_t i = 0; i < num_operations; i++){
+        int type = choose_operation(random_generator);
+
+        // the loaded keys are even, the inserted keys are odd
+        uint64_t index;
+        if(type == INSERT){
+            index = thread_id + num_inserts * m_num_threads; // each client inserts its own subset of the keys
+            if(index >= N_inserts) RAISE("Too many insertions, all keys have been inserted. Increase the number of elements to load (-I) or decrease the ratio of the insertions");
+            num_inserts++;
+        } else if(m_zipf){
+            index = ((m_zipf_ranks->key(first_operation + i) -1) >> 32) -1; // the rank is in [1, N]
+        } else {
+            index = choose_element(random_generator);
+        }
+        auto element = m_distribution->get(index);
+        int64_t key = 2 * element.first;
+
+        auto t0 = chrono::steady_clock::now();
+        switch(type){
+        case READ: client->m_found[READ] += wrapper->read(key); break;
+        case UPDATE: client->m_found[UPDATE] += wrapper->update(key, element.second); break;
+        case INSERT: wrapper->insert(key +1, element.second); client->m_found[INSERT]++; break;
+        case SCAN: client->m_found[SCAN] += wrapper->scan(key, m_scan_length); break;
+        }
+        auto t1 = chrono::steady_clock::now();
+        uint64_t latency = chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count();
+        client->m_latencies[type].push_back(min<uint64_t>(latency, numeric_limits<uint32_t>::max()));
+    }
+}
+
+void ExperimentYCSB::run() {
+    Timer timer;
+
+    cout << "Loading " << N_inserts << " elements ..." << endl;
+    timer.reset(true);
+    for(size_t i = 0; i < N_inserts; i++){
+        auto p = m_distribution->get(i);
+        m_tree->insert(2 * p.first, p.second);
+    }
+    timer.stop();
+    cout << "# Load time: " << timer.milliseconds() << " millisecs" << endl;
+
+    // check whether the updates can remove the old elements
+    if(m_ratios[UPDATE] > 0){
+        auto p = m_distribution->get(0);
+        try {
+            int64_t value = m_tree->remove(2 * p.first);
+            m_tree->insert(2 * p.first, value);
+        } catch(Exception& e){
+            LOG_VERBOSE("[ExperimentYCSB] The data structure does not support deletions, the updates will insert further copies of the elements");
+            m_supports_remove = false;
+        }
+    }
+
+    cout << "Executing " << N_operations << " operations with " << m_num_threads << " thread(s), sync: " << to_string(m_sync) << ", " <<
+            "read: " << m_ratios[READ] << ", update: " << m_ratios[UPDATE] << ", insert: " << m_ratios[INSERT] << ", scan: " << m_ratios[SCAN] << ", " <<
+            "keys: " << (m_zipf ? "zipf" : "uniform") << " ..." << endl;
+    Wrapper wrapper(m_tree.get(), m_sync, m_supports_remove);
+    vector<Client> clients(m_num_threads);
+    atomic<uint64_t> num_ready = 0;
+    atomic<bool> start = false;
+    vector<future<void>> threads;
+    for(uint64_t i = 0, first_operation = 0; i < m_num_threads; i++){
+        uint64_t num_operations = N_operations / m_num_threads + (i < N_operations % m_num_threads);
+        threads.push_back( async(launch::async, &ExperimentYCSB::do_operations, this, &wrapper, &clients[i], i, num_operations, first_operation, &num_ready, &start) );
+        first_operation += num_operations;
+    }
+    while(num_ready < m_num_threads){ this_thread::yield(); }
+    timer.reset(true);
+    start = true;
+    for(auto& t : threads){ t.wait(); }
+    timer.stop();
+    for(auto& t : threads){ t.get(); } // propagate the errors
+    uint64_t time = timer.microseconds();
+    cout << "# Execution time: " << timer.milliseconds() << " millisecs, throughput: " << (uint64_t) (time > 0 ? static_cast<double>(N_operations) * 1000000 / time : 0) << " ops/sec" << endl;
+
+    // save the results, for each type of operation
+    for(int type = 0; type < NUM_OPERATION_TYPES; type++){
+        vector<uint32_t> latencies;
+        uint64_t found = 0;
+        for(auto& client : clients){
+            latencies.insert(end(latencies), begin(client.m_latencies[type]), end(client.m_latencies[type]));
+            found += client.m_found[type];
+        }
+        if(latencies.empty()) continue;
+        sort(begin(latencies), end(latencies));
+        uint64_t sum = 0;
+        for(auto latency : latencies) sum += latency;
+        auto percentile = [&latencies](double p) -> uint64_t { return latencies[min<size_t>(latencies.size() * p, latencies.size() -1)]; };
+        double throughput = time > 0 ? static_cast<double>(latencies.size()) * 1000000 / time : 0;
+        double latency_avg = static_cast<double>(sum) / latencies.size();
+
+        cout << "# " << OPERATION_NAMES[type] << ": " << latencies.size() << " operations, throughput: " << (uint64_t) throughput << " ops/sec, " <<
+                "latency avg: " << (uint64_t) latency_avg << " ns, p50: " << percentile(0.5) << " ns, p99: " << percentile(0.99) << " ns, max: " << latencies.back() << " ns";
+        if(type == SCAN){ cout << ", elements visited per scan: " << static_cast<double>(found) / latencies.size(); }
+        cout << endl;
+
+        config().db()->add("ycsb")
+                ("type", OPERATION_NAMES[type])
+                ("threads", m_num_threads)
+                ("sync", to_string(m_sync))
+                ("keys", m_zipf ? "zipf" : "uniform")
+                ("elements", N_inserts)
+                ("operations", latencies.size())
+                ("found", found)
+                ("time", time)
+                ("throughput", throughput)
+                ("latency_avg", latency_avg)
+                ("latency_p50", percentile(0.5))
+                ("latency_p90", percentile(0.9))
+                ("latency_p99", percentile(0.99))
+                ("latency_p999", percentile(0.999))
+                ("latency_max", (uint64_t) latencies.back());
+    }
+}
+
+} /* namespace pma */
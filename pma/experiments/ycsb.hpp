@@ -0,0 +1,133 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PMA_YCSB_HPP_
+#define PMA_YCSB_HPP_
+
+#include "pma/experiment.hpp"
+
+#include <atomic>
+#include <cinttypes>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace distribution { class Distribution; }
+
+namespace pma {
+class Interface;
+
+/**
+ * YCSB-like mixed workload. Load `N' elements in the data structure, then run `M' operations split among a number of
+ * client threads, each pinned to its own cpu. Each operation is a point lookup (read), the replacement of the value
+ * of an existing element (update), the insertion of a new element (insert) or a range scan of a given number of
+ * elements (scan), chosen at random according to the given ratios. The scans iterate over the next `scan_length'
+ * elements, if the data structure supports range queries, otherwise they sum the keys in an interval expected to
+ * contain `scan_length' elements. The number of elements actually visited is recorded as `found'. The keys are picked either uniformly or following
+ * a zipf distribution over the loaded elements. It records the throughput and the latency of each type of operation.
+ *
+ * The access to the data structure is mediated by a synchronisation wrapper:
+ * - global: a single mutex for all operations;
+ * - rwlock: the reads and the scans share a readers-writer lock, the updates and the inserts acquire it exclusively;
+ * - native: the reads rely on the synchronisation of the data structure (art_olc, or btree_pma_v4 with --synchronized)
+ *   and do not take any lock, while the scans and the writers still go through the readers-writer lock.
+ */
+class ExperimentYCSB : public Experiment {
+public:
+    enum class Sync { GLOBAL, RWLOCK, NATIVE };
+    enum OperationType { READ = 0, UPDATE = 1, INSERT = 2, SCAN = 3, NUM_OPERATION_TYPES = 4 };
+
+private:
+    class Wrapper; // synchronisation of the operations
+    struct Client; // results of a single client thread
+
+    std::shared_ptr<Interface> m_tree; // the data structure to evaluate
+    const size_t N_inserts; // number of elements to load before running the workload
+    const size_t N_operations; // total number of operations to perform
+    const uint64_t m_num_threads; // number of client threads
+    const Sync m_sync; // synchronisation wrapper
+    double m_ratios[NUM_OPERATION_TYPES] = {1, 0, 0, 0}; // proportion of each operation type
+    bool m_zipf = false; // whether to choose the keys with a zipf distribution, or uniformly
+    double m_zipf_alpha = 0.99; // parameter of the zipf distribution
+    uint64_t m_scan_length = 100; // number of elements visited by each scan, at most
+    bool m_supports_remove = true; // whether the updates can remove the old element, rather than inserting a further copy
+    std::unique_ptr<distribution::Distribution> m_distribution; // the elements to load
+    std::unique_ptr<distribution::Distribution> m_zipf_ranks; // with a zipf distribution, the rank of the element accessed by each operation
+    std::vector<int> m_cpus; // the cpus where to pin the client threads, if empty the threads are not pinned
+
+    // Execute the operations of a single client thread
+    void do_operations(Wrapper* wrapper, Client* client, uint64_t thread_id, uint64_t num_operations, uint64_t first_operation, std::atomic<uint64_t>* num_ready, const std::atomic<bool>* start);
+
+    // Retrieve the cpus where to pin the client threads
+    void init_cpus();
+
+protected:
+    /**
+     * Initialise the distributions
+     */
+    void preprocess() override;
+
+    /**
+     * Execute the experiment
+     */
+    void run() override;
+
+public:
+    /**
+     * Initialise the experiment
+     * @param pma the data structure to evaluate. With Sync::NATIVE, it must be an art_olc or a synchronised btree_pma_v4
+     * @param N the number of elements to load
+     * @param M the total number of operations to perform
+     * @param num_threads the number of client threads
+     * @param sync the synchronisation wrapper
+     */
+    ExperimentYCSB(std::shared_ptr<Interface> pma, size_t N, size_t M, uint64_t num_threads, Sync sync);
+
+    /**
+     * Destructor
+     */
+    virtual ~ExperimentYCSB();
+
+    /**
+     * Set the proportion of reads, updates, inserts and scans. They are normalised to their sum.
+     */
+    void set_ratios(double read, double update, double insert, double scan);
+
+    /**
+     * Choose the keys uniformly (default) or with a zipf distribution of the given alpha
+     */
+    void set_zipf(bool value, double alpha = 0.99);
+
+    /**
+     * Set the number of elements visited by each scan
+     */
+    void set_scan_length(uint64_t value);
+
+    /**
+     * Parse the name of a synchronisation wrapper: global, rwlock or native
+     */
+    static Sync parse_sync(const std::string& value);
+
+    /**
+     * Retrieve the name of a synchronisation wrapper
+     */
+    static std::string to_string(Sync sync);
+};
+
+} /* namespace pma */
+
+#endif /* PMA_YCSB_HPP_ */
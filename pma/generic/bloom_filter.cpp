@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bloom_filter.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+namespace pma {
+
+/*****************************************************************************
+ *                                                                           *
+ *   BloomFilter                                                             *
+ *                                                                           *
+ *****************************************************************************/
+constexpr uint32_t BloomFilter::SALT[8];
+
+size_t BloomFilter::num_blocks(size_t num_keys, size_t bits_per_key){
+    constexpr size_t bits_per_block = sizeof(Block) * 8;
+    size_t result = (num_keys * bits_per_key + bits_per_block -1) / bits_per_block;
+    return result > 0 ? result : 1;
+}
+
+void BloomFilter::clear(Block* filter, size_t num_blocks){
+    memset(filter, 0, num_blocks * sizeof(Block));
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   BloomFilterArray                                                        *
+ *                                                                           *
+ *****************************************************************************/
+BloomFilterArray::BloomFilterArray(size_t keys_per_filter, size_t bits_per_key) :
+        m_blocks(nullptr), m_blocks_per_filter(BloomFilter::num_blocks(keys_per_filter, bits_per_key)), m_num_filters(0), m_capacity(0) {
+
+}
+
+BloomFilterArray::~BloomFilterArray(){
+    free(m_blocks); m_blocks = nullptr;
+}
+
+void BloomFilterArray::resize(size_t num_filters){
+    if(num_filters > m_capacity || num_filters < m_capacity / 4){ // avoid wasting too much space after a shrink
+        free(m_blocks); m_blocks = nullptr; m_capacity = 0;
+        if(num_filters > 0){
+            int rc = posix_memalign((void**) &m_blocks, /* alignment */ 64, num_filters * m_blocks_per_filter * sizeof(BloomFilter::Block));
+            if(rc != 0) throw bad_alloc();
+        }
+        m_capacity = num_filters;
+    }
+    m_num_filters = num_filters;
+    if(m_num_filters > 0) BloomFilter::clear(m_blocks, m_num_filters * m_blocks_per_filter);
+}
+
+void BloomFilterArray::clear(size_t filter_id){
+    assert(filter_id < m_num_filters && "Invalid filter");
+    BloomFilter::clear(m_blocks + filter_id * m_blocks_per_filter, m_blocks_per_filter);
+}
+
+size_t BloomFilterArray::memory_footprint() const {
+    return sizeof(BloomFilterArray) + m_capacity * m_blocks_per_filter * sizeof(BloomFilter::Block);
+}
+
+} // namespace pma
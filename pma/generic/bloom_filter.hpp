@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERIC_BLOOM_FILTER_HPP_
+#define GENERIC_BLOOM_FILTER_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+
+namespace pma {
+
+/**
+ * A split block Bloom filter: the filter is an array of blocks of 256 bits, a key is mapped to a single block and
+ * sets one bit in each of the 8 words of the block. A lookup touches a single cache line and never returns a false
+ * negative. Elements cannot be removed, the filter needs to be rebuilt to purge the deleted keys.
+ *
+ * The class only provides the operations over an array of blocks owned by the caller, e.g. embedded in the leaves
+ * of a tree, see BloomFilterArray for a set of filters with their own storage.
+ */
+class BloomFilter {
+public:
+    struct alignas(32) Block {
+        uint32_t m_words[8];
+    };
+
+private:
+    static constexpr uint32_t SALT[8] = { 0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+
+    // Hash of the key, the higher 32 bits select the block, the lower 32 bits the bits inside the block
+    static uint64_t hash(int64_t key) noexcept {
+        uint64_t h = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 29);
+    }
+
+    static size_t block_index(uint64_t hash, size_t num_blocks) noexcept {
+        return ((hash >> 32) * num_blocks) >> 32;
+    }
+
+public:
+    /**
+     * The number of blocks required to store `num_keys' with the given budget of bits per key
+     */
+    static size_t num_blocks(size_t num_keys, size_t bits_per_key);
+
+    /**
+     * Reset the filter
+     */
+    static void clear(Block* filter, size_t num_blocks);
+
+    /**
+     * Add the given key to the filter
+     */
+    static void insert(Block* filter, size_t num_blocks, int64_t key) noexcept {
+        uint64_t h = hash(key);
+        uint32_t* __restrict words = filter[block_index(h, num_blocks)].m_words;
+        for(int i = 0; i < 8; i++){
+            words[i] |= 1u << ((static_cast<uint32_t>(h) * SALT[i]) >> 27);
+        }
+    }
+
+    /**
+     * Check whether the given key may have been added to the filter. If false, the key has not been added.
+     */
+    static bool contains(const Block* filter, size_t num_blocks, int64_t key) noexcept {
+        uint64_t h = hash(key);
+        const uint32_t* __restrict words = filter[block_index(h, num_blocks)].m_words;
+        bool result = true;
+        for(int i = 0; i < 8; i++){
+            result &= (words[i] >> ((static_cast<uint32_t>(h) * SALT[i]) >> 27)) & 1u;
+        }
+        return result;
+    }
+};
+
+/**
+ * A sequence of Bloom filters of the same size, e.g. one for each pair of segments of a PMA, allocated in a single
+ * chunk of memory.
+ */
+class BloomFilterArray {
+    BloomFilter::Block* m_blocks; // the filters, one after the other
+    const size_t m_blocks_per_filter; // number of blocks in each filter
+    size_t m_num_filters; // number of filters in use
+    size_t m_capacity; // number of filters allocated
+
+public:
+    /**
+     * Create an empty sequence of filters, each able to hold `keys_per_filter' with the given budget of bits per key
+     */
+    BloomFilterArray(size_t keys_per_filter, size_t bits_per_key);
+
+    /**
+     * Destructor
+     */
+    ~BloomFilterArray();
+
+    /**
+     * Set the number of filters. All filters are reset.
+     */
+    void resize(size_t num_filters);
+
+    /**
+     * Reset the given filter
+     */
+    void clear(size_t filter_id);
+
+    /**
+     * Add the key to the given filter
+     */
+    void insert(size_t filter_id, int64_t key) noexcept {
+        BloomFilter::insert(m_blocks + filter_id * m_blocks_per_filter, m_blocks_per_filter, key);
+    }
+
+    /**
+     * Check whether the key may be contained in the given filter
+     */
+    bool contains(size_t filter_id, int64_t key) const noexcept {
+        return BloomFilter::contains(m_blocks + filter_id * m_blocks_per_filter, m_blocks_per_filter, key);
+    }
+
+    /**
+     * The number of filters
+     */
+    size_t size() const noexcept { return m_num_filters; }
+
+    /**
+     * Memory footprint, in bytes
+     */
+    size_t memory_footprint() const;
+};
+
+} // namespace pma
+
+#endif /* GENERIC_BLOOM_FILTER_HPP_ */
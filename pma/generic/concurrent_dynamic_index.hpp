@@ -0,0 +1,798 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERIC_CONCURRENT_DYNAMIC_INDEX_HPP_
+#define GENERIC_CONCURRENT_DYNAMIC_INDEX_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cinttypes>
+#include <cstddef>
+#include <emmintrin.h> // _mm_pause
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "epoch_manager.hpp"
+
+namespace pma {
+
+/**
+ * Concurrent variant of the DynamicIndex, as a B-link tree (Lehman & Yao). Each node stores the fence keys of its
+ * interval [low, high) and a link to its right sibling at the same level. The readers do not acquire any latch: they
+ * read a node optimistically and validate its version afterwards, restarting on a conflict. A reader reaching a
+ * node that has been split in the meanwhile retrieves the keys moved to the new sibling by following the right link.
+ * The writers latch one node at the time, bottom-up and left-to-right, so that any number of them can operate
+ * concurrently, together with the readers.
+ *
+ * The nodes are never merged: a removal only deletes the entry from its leaf. The methods #load_sorted and #clear
+ * replace the whole tree and cannot run concurrently to the other writers, but they can run concurrently to the
+ * readers. The nodes replaced are deallocated by an epoch manager, once no reader can access them anymore.
+ *
+ * In case of duplicates, the keys equal to a separator may be stored on both sides of the split. The lookups return
+ * any of the qualifying elements.
+ */
+template<typename K, typename V, int inode_b = 64, int leaf_b = 64>
+class ConcurrentDynamicIndex {
+    static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value, "The readers copy the keys and values optimistically");
+    static_assert(inode_b >= 2 && leaf_b >= 2, "Nodes too small");
+    ConcurrentDynamicIndex(const ConcurrentDynamicIndex&) = delete;
+    ConcurrentDynamicIndex& operator= (ConcurrentDynamicIndex&) = delete;
+
+    static constexpr uint32_t max_height = 64; // upper bound for the number of levels in the tree
+
+    struct Node {
+        std::atomic<uint64_t> m_version {0}; // optimistic latch, bit 1 = locked, incremented by 0b10 on each lock and unlock
+        uint32_t m_level = 0; // 0 for the leaves, the height of the subtree rooted in this node minus 1 for the internal nodes
+        uint32_t m_count = 0; // number of elements in a leaf, number of children in an internal node
+        bool m_has_low_key = false; // false for the leftmost node of each level, whose interval is unbounded on the left
+        bool m_has_high_key = false; // false for the rightmost node of each level, whose interval is unbounded on the right
+        K m_low_key {}; // lower fence key, inclusive
+        K m_high_key {}; // upper fence key, exclusive
+        Node* m_right = nullptr; // right sibling at the same level
+    };
+
+    struct InternalNode : public Node {
+        K m_keys[inode_b]; // separator keys, the child `i' covers the interval [m_keys[i-1], m_keys[i])
+        Node* m_children[inode_b +1];
+    };
+
+    struct Leaf : public Node {
+        K m_keys[leaf_b];
+        V m_values[leaf_b];
+    };
+
+    std::atomic<Node*> m_root; // current root
+    std::atomic<uint64_t> m_cardinality {0}; // number of elements in the index
+    mutable std::atomic<uint64_t> m_num_inodes {0}; // number of internal nodes allocated, to compute the memory footprint
+    mutable std::atomic<uint64_t> m_num_leaves {0}; // number of leaves allocated, to compute the memory footprint
+    std::unique_ptr<EpochManager> m_epoch; // release the nodes replaced by #load_sorted and #clear
+
+    // Create a new internal node / leaf
+    InternalNode* create_inode(uint32_t level) const;
+    Leaf* create_leaf() const;
+
+    // Deallocate all nodes of the given tree. There must be no readers accessing it.
+    void delete_tree(Node* root) const;
+
+    // Defer the deallocation of the given tree, already unlinked, until no reader can access it
+    void retire_tree(Node* root);
+
+    // Optimistic lock coupling
+    static uint64_t read_lock(const Node* node); // wait for the node to be unlocked and return its version
+    static bool check(const Node* node, uint64_t version); // whether the node has not been altered since it was read with the given version
+    static bool upgrade_to_write_lock(Node* node, uint64_t version); // acquire the latch if the node is still at the given version
+    static void write_lock(Node* node);
+    static void write_unlock(Node* node);
+
+    // Whether the interval of the node is before the given key. With `strict', check whether the node is before the keys less than `key'.
+    static bool must_move_right(const Node* node, const K& key, bool strict);
+
+    // Given a latched node, move right, latching the siblings, until reaching the node whose interval contains the key
+    static Node* lock_move_right(Node* node, const K& key, bool strict);
+
+    // Descend the tree along the path of `key', or of the greatest keys less than `key' with `strict', up to the node at
+    // the given level. It returns the node reached and the version it has been read with. When `path' is not null, it
+    // stores the rightmost internal node visited at each level.
+    Node* descend(const K& key, bool strict, uint32_t level, uint64_t& out_version, Node** path) const;
+
+    // Insert the element in a latched leaf with room for it
+    static void leaf_insert(Leaf* leaf, const K& key, const V& value);
+
+    // Insert the pair <separator, child> in a latched internal node with room for it
+    static void inode_insert(InternalNode* inode, const K& separator, Node* child);
+
+    // Split the latched, full, leaf and insert the given element. Return the new sibling, and the separator key for the parent in `out_separator'.
+    Leaf* split_leaf(Leaf* leaf, const K& key, const V& value, K& out_separator);
+
+    // Split the latched, full, internal node and insert the given pair <separator, child>. Return the new sibling, and the separator key for the parent in `out_separator'.
+    InternalNode* split_inode(InternalNode* inode, const K& separator, Node* child, K& out_separator);
+
+    // Add the pair <separator, sibling> to the parent of the latched `node', after `node' has been split. It releases the latch of `node'.
+    void insert_separator(Node* node, K separator, Node* sibling, Node** path);
+
+    // Dump the content of the given node
+    void dump_node(std::ostream& out, const Node* node) const;
+
+public:
+    /**
+     * Constructor
+     */
+    ConcurrentDynamicIndex();
+
+    /**
+     * Destructor. There must be no concurrent accesses.
+     */
+    ~ConcurrentDynamicIndex();
+
+    /**
+     * Insert the given pair in the index
+     */
+    void insert(const K key, const V& value);
+
+    /**
+     * Remove all elements with the given `key'
+     */
+    void remove(const K key);
+
+    /**
+     * Remove an element with the given `key'. If an element has been removed, return true and set `out_value' to its
+     * payload, otherwise return false.
+     */
+    bool remove_any(const K key, V* out_value = nullptr);
+
+    /**
+     * Find an element with the given `key'. Return `true' if found, `false' otherwise.
+     */
+    bool find_any(const K key, V* output_value) const;
+
+    /**
+     * Return the greatest entry less or equal than the given key.
+     */
+    bool find_first(const K key, K* output_key, V* output_value) const;
+
+    /**
+     * Return the smallest entry greater or equal than the given key. Mind this is not the counterpart of
+     * DynamicIndex::find_last, which returns the last entry less or equal than the given key.
+     */
+    bool find_successor(const K key, K* output_key, V* output_value) const;
+
+    /**
+     * Retrieve the current cardinality of the index
+     */
+    uint64_t size() const;
+
+    /**
+     * Check whether the index is empty
+     */
+    bool empty() const;
+
+    /**
+     * Remove all entries in the index. It cannot run concurrently to the other writers.
+     */
+    void clear();
+
+    /**
+     * Replace the content of the index with the given `size' elements, sorted by key, building the tree bottom-up.
+     * The leaves and the internal nodes are filled up to the given `fill_factor' in (0, 1]. It cannot run concurrently
+     * to the other writers.
+     */
+    void load_sorted(const K* keys, const V* values, uint64_t size, double fill_factor = 1.0);
+
+    /**
+     * Retrieve the memory footprint of this index, in bytes
+     */
+    uint64_t memory_footprint() const;
+
+    /**
+     * Dump the content of the index
+     */
+    void dump() const;
+    void dump(std::ostream& out) const;
+};
+
+/*****************************************************************************
+ *                                                                           *
+ *   Implementation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+template<typename K, typename V, int inode_b, int leaf_b>
+ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::ConcurrentDynamicIndex() : m_root(nullptr), m_epoch(new EpochManager()) {
+    m_root = create_leaf();
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::~ConcurrentDynamicIndex() {
+    delete_tree(m_root.load()); m_root = nullptr;
+    m_epoch.reset(); // release the trees retired
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+typename ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::InternalNode* ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::create_inode(uint32_t level) const {
+    assert(level > 0);
+    InternalNode* inode = new InternalNode();
+    inode->m_level = level;
+    m_num_inodes++;
+    return inode;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+typename ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::Leaf* ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::create_leaf() const {
+    Leaf* leaf = new Leaf();
+    m_num_leaves++;
+    return leaf;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::delete_tree(Node* root) const {
+    // all nodes of a level can be reached from the leftmost node through the right links
+    Node* leftmost = root;
+    while(leftmost != nullptr){
+        Node* next_level = (leftmost->m_level > 0) ? static_cast<InternalNode*>(leftmost)->m_children[0] : nullptr;
+        Node* node = leftmost;
+        while(node != nullptr){
+            Node* right = node->m_right;
+            if(node->m_level > 0){
+                delete static_cast<InternalNode*>(node);
+                m_num_inodes--;
+            } else {
+                delete static_cast<Leaf*>(node);
+                m_num_leaves--;
+            }
+            node = right;
+        }
+        leftmost = next_level;
+    }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::retire_tree(Node* root) {
+    // retire the whole tree as a single item
+    struct RetiredTree { const ConcurrentDynamicIndex* m_index; Node* m_root; };
+    m_epoch->retire(new RetiredTree{this, root}, [](void* pointer){
+        RetiredTree* tree = reinterpret_cast<RetiredTree*>(pointer);
+        tree->m_index->delete_tree(tree->m_root);
+        delete tree;
+    });
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+uint64_t ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::read_lock(const Node* node) {
+    uint64_t version = node->m_version.load(std::memory_order_acquire);
+    while(version & 0b10){ // locked
+        _mm_pause();
+        version = node->m_version.load(std::memory_order_acquire);
+    }
+    return version;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::check(const Node* node, uint64_t version) {
+    std::atomic_thread_fence(std::memory_order_acquire); // the previous reads cannot be reordered after the check
+    return node->m_version.load(std::memory_order_relaxed) == version;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::upgrade_to_write_lock(Node* node, uint64_t version) {
+    assert((version & 0b10) == 0 && "Expected an unlocked version");
+    if(!node->m_version.compare_exchange_strong(version, version + 0b10, std::memory_order_acq_rel)) return false;
+    std::atomic_thread_fence(std::memory_order_release); // the following changes must not be visible before the lock
+    return true;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::write_lock(Node* node) {
+    while(!upgrade_to_write_lock(node, read_lock(node))){ _mm_pause(); }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::write_unlock(Node* node) {
+    node->m_version.fetch_add(0b10, std::memory_order_release);
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::must_move_right(const Node* node, const K& key, bool strict) {
+    if(!node->m_has_high_key) return false;
+    return strict ? node->m_high_key < key : !(key < node->m_high_key);
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+typename ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::Node* ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::lock_move_right(Node* node, const K& key, bool strict) {
+    while(must_move_right(node, key, strict)){
+        Node* right = node->m_right;
+        assert(right != nullptr && "The node has a high fence key, it must have a right sibling");
+        write_lock(right);
+        write_unlock(node);
+        node = right;
+    }
+    return node;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+typename ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::Node* ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::descend(const K& key, bool strict, uint32_t level, uint64_t& out_version, Node** path) const {
+restart:
+    Node* node = m_root.load(std::memory_order_acquire);
+    uint64_t version = read_lock(node);
+    if(node->m_level < level){ // the tree is being grown by a writer
+        _mm_pause();
+        goto restart;
+    }
+
+    while(true){
+        if(must_move_right(node, key, strict)){
+            Node* right = node->m_right;
+            if(!check(node, version)) goto restart;
+            node = right;
+            version = read_lock(node);
+            continue;
+        }
+
+        uint32_t node_level = node->m_level; // immutable
+        if(node_level == level) break;
+        if(path != nullptr) path[node_level] = node;
+
+        // find the child to visit
+        const InternalNode* inode = static_cast<const InternalNode*>(node);
+        uint32_t num_children = std::min<uint32_t>(inode->m_count, inode_b +1);
+        if(num_children == 0){ // inconsistent read
+            if(!check(node, version)) goto restart;
+            assert(false && "Empty internal node");
+        }
+        const K* keys = inode->m_keys;
+        size_t i = strict ? std::lower_bound(keys, keys + num_children -1, key) - keys : std::upper_bound(keys, keys + num_children -1, key) - keys;
+        Node* child = inode->m_children[i];
+        if(!check(node, version)) goto restart;
+
+        node = child;
+        version = read_lock(node);
+    }
+
+    out_version = version;
+    return node;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::leaf_insert(Leaf* leaf, const K& key, const V& value){
+    assert(leaf->m_count < leaf_b && "The leaf is full");
+    size_t count = leaf->m_count;
+    size_t i = std::upper_bound(leaf->m_keys, leaf->m_keys + count, key) - leaf->m_keys;
+    std::copy_backward(leaf->m_keys + i, leaf->m_keys + count, leaf->m_keys + count +1);
+    std::copy_backward(leaf->m_values + i, leaf->m_values + count, leaf->m_values + count +1);
+    leaf->m_keys[i] = key;
+    leaf->m_values[i] = value;
+    leaf->m_count = count +1;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::inode_insert(InternalNode* inode, const K& separator, Node* child){
+    assert(inode->m_count < inode_b +1 && "The node is full");
+    size_t num_keys = inode->m_count -1;
+    size_t i = std::upper_bound(inode->m_keys, inode->m_keys + num_keys, separator) - inode->m_keys;
+    std::copy_backward(inode->m_keys + i, inode->m_keys + num_keys, inode->m_keys + num_keys +1);
+    std::copy_backward(inode->m_children + i +1, inode->m_children + num_keys +1, inode->m_children + num_keys +2);
+    inode->m_keys[i] = separator;
+    inode->m_children[i +1] = child;
+    inode->m_count++;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+typename ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::Leaf* ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::split_leaf(Leaf* leaf, const K& key, const V& value, K& out_separator){
+    assert(leaf->m_count == leaf_b && "Only full leaves are split");
+    const K* keys = leaf->m_keys;
+
+    // avoid separating the duplicates, when possible
+    size_t split_point = leaf_b / 2;
+    for(size_t distance = 0; distance < leaf_b / 2; distance++){
+        if(split_point - distance >= 1 && keys[split_point - distance -1] < keys[split_point - distance]){
+            split_point -= distance; break;
+        } else if (split_point + distance < leaf_b && keys[split_point + distance -1] < keys[split_point + distance]){
+            split_point += distance; break;
+        }
+    }
+
+    // the sibling is not reachable until the link from the leaf is set
+    Leaf* sibling = create_leaf();
+    std::copy(leaf->m_keys + split_point, leaf->m_keys + leaf_b, sibling->m_keys);
+    std::copy(leaf->m_values + split_point, leaf->m_values + leaf_b, sibling->m_values);
+    sibling->m_count = leaf_b - split_point;
+    out_separator = sibling->m_keys[0];
+    sibling->m_has_low_key = true;
+    sibling->m_low_key = out_separator;
+    sibling->m_has_high_key = leaf->m_has_high_key;
+    sibling->m_high_key = leaf->m_high_key;
+    sibling->m_right = leaf->m_right;
+    leaf->m_count = split_point;
+    leaf->m_has_high_key = true;
+    leaf->m_high_key = out_separator;
+    if(key < out_separator){
+        leaf_insert(leaf, key, value);
+    } else {
+        leaf_insert(sibling, key, value);
+    }
+    leaf->m_right = sibling;
+    return sibling;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+typename ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::InternalNode* ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::split_inode(InternalNode* inode, const K& separator, Node* child, K& out_separator){
+    assert(inode->m_count == inode_b +1 && "Only full nodes are split");
+
+    // merge the new pair in a temporary copy of the node
+    constexpr size_t num_children = inode_b +2;
+    K keys[num_children -1];
+    Node* children[num_children];
+    size_t i = std::upper_bound(inode->m_keys, inode->m_keys + inode_b, separator) - inode->m_keys;
+    std::copy(inode->m_keys, inode->m_keys + i, keys);
+    keys[i] = separator;
+    std::copy(inode->m_keys + i, inode->m_keys + inode_b, keys + i +1);
+    std::copy(inode->m_children, inode->m_children + i +1, children);
+    children[i +1] = child;
+    std::copy(inode->m_children + i +1, inode->m_children + inode_b +1, children + i +2);
+
+    // the node retains the children [0, split_point), the sibling the children [split_point, num_children)
+    size_t split_point = num_children / 2;
+    out_separator = keys[split_point -1];
+    InternalNode* sibling = create_inode(inode->m_level);
+    std::copy(keys + split_point, keys + num_children -1, sibling->m_keys);
+    std::copy(children + split_point, children + num_children, sibling->m_children);
+    sibling->m_count = num_children - split_point;
+    sibling->m_has_low_key = true;
+    sibling->m_low_key = out_separator;
+    sibling->m_has_high_key = inode->m_has_high_key;
+    sibling->m_high_key = inode->m_high_key;
+    sibling->m_right = inode->m_right;
+
+    std::copy(keys, keys + split_point -1, inode->m_keys);
+    std::copy(children, children + split_point, inode->m_children);
+    inode->m_count = split_point;
+    inode->m_has_high_key = true;
+    inode->m_high_key = out_separator;
+    inode->m_right = sibling;
+    return sibling;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::insert_separator(Node* node, K separator, Node* sibling, Node** path){
+    while(true){
+        if(m_root.load(std::memory_order_acquire) == node){ // increase the height of the tree
+            InternalNode* root = create_inode(node->m_level +1);
+            root->m_keys[0] = separator;
+            root->m_children[0] = node;
+            root->m_children[1] = sibling;
+            root->m_count = 2;
+            m_root.store(root, std::memory_order_release);
+            write_unlock(node);
+            return;
+        }
+
+        // find the parent, moving right from the node visited in the descent
+        uint32_t level = node->m_level +1;
+        Node* parent = (level < max_height) ? path[level] : nullptr;
+        if(parent == nullptr){ // the tree has been grown after the descent
+            uint64_t version;
+            parent = descend(separator, /* strict ? */ false, level, version, nullptr);
+        }
+        write_lock(parent);
+        parent = lock_move_right(parent, separator, /* strict ? */ false);
+        write_unlock(node);
+
+        InternalNode* inode = static_cast<InternalNode*>(parent);
+        if(inode->m_count < inode_b +1){
+            inode_insert(inode, separator, sibling);
+            write_unlock(inode);
+            return;
+        }
+
+        // split the parent as well
+        K separator_parent;
+        sibling = split_inode(inode, separator, sibling, separator_parent);
+        separator = separator_parent;
+        node = inode;
+    }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::insert(const K key, const V& value){
+    EpochManager::Guard guard(*m_epoch);
+    Node* path[max_height];
+
+    // latch the leaf
+    Leaf* leaf = nullptr;
+    do {
+        std::fill(path, path + max_height, nullptr);
+        uint64_t version;
+        leaf = static_cast<Leaf*>(descend(key, /* strict ? */ false, /* level */ 0, version, path));
+        if(!upgrade_to_write_lock(leaf, version)) leaf = nullptr;
+    } while(leaf == nullptr);
+    leaf = static_cast<Leaf*>(lock_move_right(leaf, key, /* strict ? */ false));
+    m_cardinality++;
+
+    if(leaf->m_count < leaf_b){
+        leaf_insert(leaf, key, value);
+        write_unlock(leaf);
+    } else {
+        K separator;
+        Leaf* sibling = split_leaf(leaf, key, value, separator);
+        insert_separator(leaf, separator, sibling, path);
+    }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::remove_any(const K key, V* out_value){
+    EpochManager::Guard guard(*m_epoch);
+
+    // the duplicates of a separator key can be spread over several consecutive leaves, starting from the leaf with the
+    // greatest keys less than `key'
+    Leaf* leaf = nullptr;
+    do {
+        uint64_t version;
+        leaf = static_cast<Leaf*>(descend(key, /* strict ? */ true, /* level */ 0, version, nullptr));
+        if(!upgrade_to_write_lock(leaf, version)) leaf = nullptr;
+    } while(leaf == nullptr);
+    leaf = static_cast<Leaf*>(lock_move_right(leaf, key, /* strict ? */ true));
+
+    while(true){
+        size_t count = leaf->m_count;
+        size_t i = std::lower_bound(leaf->m_keys, leaf->m_keys + count, key) - leaf->m_keys;
+        if(i < count && !(key < leaf->m_keys[i])){ // found
+            if(out_value != nullptr) *out_value = leaf->m_values[i];
+            std::copy(leaf->m_keys + i +1, leaf->m_keys + count, leaf->m_keys + i);
+            std::copy(leaf->m_values + i +1, leaf->m_values + count, leaf->m_values + i);
+            leaf->m_count = count -1;
+            m_cardinality--;
+            write_unlock(leaf);
+            return true;
+        }
+
+        if(!must_move_right(leaf, key, /* strict ? */ false)){ // the following leaves only contain keys greater than `key'
+            write_unlock(leaf);
+            return false;
+        }
+
+        Leaf* right = static_cast<Leaf*>(leaf->m_right);
+        write_lock(right);
+        write_unlock(leaf);
+        leaf = right;
+    }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::remove(const K key){
+    while(remove_any(key, nullptr)) { /* nop */ };
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::find_any(const K key, V* out_value) const {
+    K key_found;
+    V value_found;
+    if(!find_first(key, &key_found, &value_found) || key_found < key) return false;
+    if(out_value != nullptr) *out_value = value_found;
+    return true;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::find_first(const K key, K* out_key, V* out_value) const {
+    if(out_value == nullptr){ throw std::invalid_argument("Output value is null"); }
+    EpochManager::Guard guard(*m_epoch);
+    K search_key = key;
+    bool strict = false;
+    const Node* stop = nullptr; // the first leaf already inspected by the previous round
+
+    while(true){
+        uint64_t version;
+        const Node* start = descend(search_key, strict, /* level */ 0, version, nullptr);
+        const Node* node = start;
+        bool start_has_low_key = start->m_has_low_key;
+        K start_low_key = start->m_low_key;
+        bool found = false;
+        K key_found {};
+        V value_found {};
+        bool restart = false;
+
+        // the leaves with an interval ending at or before `key' may still contain the duplicates of their high fence key
+        while(true){
+            const Leaf* leaf = static_cast<const Leaf*>(node);
+            size_t count = std::min<uint32_t>(leaf->m_count, leaf_b);
+            size_t i = std::upper_bound(leaf->m_keys, leaf->m_keys + count, key) - leaf->m_keys;
+            if(i > 0){
+                found = true;
+                key_found = leaf->m_keys[i -1];
+                value_found = leaf->m_values[i -1];
+            }
+            const Node* right = leaf->m_right;
+            bool move_right = must_move_right(leaf, key, /* strict ? */ false) && right != stop;
+            if(!check(leaf, version)){ restart = true; break; }
+            if(!move_right) break;
+            node = right;
+            version = read_lock(node);
+        }
+        if(restart) continue;
+
+        if(found){
+            if(out_key) *out_key = key_found;
+            *out_value = value_found;
+            return true;
+        }
+
+        // all keys in the inspected leaves are greater than `key', move to the previous leaves
+        if(!start_has_low_key) return false; // the searched key is smaller than all keys stored in the whole tree
+        search_key = start_low_key;
+        strict = true;
+        stop = start;
+    }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::find_successor(const K key, K* out_key, V* out_value) const {
+    if(out_value == nullptr){ throw std::invalid_argument("Output value is null"); }
+    EpochManager::Guard guard(*m_epoch);
+
+restart:
+    uint64_t version;
+    // start from the leaf with the greatest keys less than `key', as it may contain the duplicates of its high fence key
+    const Node* node = descend(key, /* strict ? */ true, /* level */ 0, version, nullptr);
+    while(true){
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        size_t count = std::min<uint32_t>(leaf->m_count, leaf_b);
+        size_t i = std::lower_bound(leaf->m_keys, leaf->m_keys + count, key) - leaf->m_keys;
+        if(i < count){
+            K key_found = leaf->m_keys[i];
+            V value_found = leaf->m_values[i];
+            if(!check(leaf, version)) goto restart;
+            if(out_key) *out_key = key_found;
+            *out_value = value_found;
+            return true;
+        }
+
+        // all keys in the leaf are less than `key', move to the next leaf
+        const Node* right = leaf->m_right;
+        if(!check(leaf, version)) goto restart;
+        if(right == nullptr) return false; // the searched key is greater than all keys stored in the whole tree
+        node = right;
+        version = read_lock(node);
+    }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+uint64_t ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::size() const {
+    return m_cardinality.load(std::memory_order_relaxed);
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::empty() const {
+    return size() == 0;
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::clear() {
+    Node* previous = m_root.exchange(create_leaf(), std::memory_order_acq_rel);
+    m_cardinality = 0;
+    retire_tree(previous);
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::load_sorted(const K* keys, const V* values, uint64_t size, double fill_factor){
+    if(fill_factor <= 0 || fill_factor > 1){ throw std::invalid_argument("The fill factor must be in (0, 1]"); }
+    const uint64_t leaf_target = std::max<uint64_t>(1, fill_factor * leaf_b);
+    const uint64_t inode_target = std::max<uint64_t>(2, fill_factor * (inode_b +1));
+
+    // build the leaves, each level is linked from left to right and the fence keys are the minima of the nodes
+    std::vector<Node*> level;
+    std::vector<K> minima;
+    uint64_t num_nodes = std::max<uint64_t>(1, (size + leaf_target -1) / leaf_target);
+    level.reserve(num_nodes);
+    minima.reserve(num_nodes);
+    for(uint64_t i = 0; i < num_nodes; i++){
+        uint64_t start = i * size / num_nodes, end = (i +1) * size / num_nodes;
+        Leaf* leaf = create_leaf();
+        std::copy(keys + start, keys + end, leaf->m_keys);
+        std::copy(values + start, values + end, leaf->m_values);
+        leaf->m_count = end - start;
+        if(i > 0){
+            Node* previous = level.back();
+            previous->m_right = leaf;
+            previous->m_has_high_key = leaf->m_has_low_key = true;
+            previous->m_high_key = leaf->m_low_key = keys[start];
+        }
+        level.push_back(leaf);
+        if(end > start) minima.push_back(keys[start]);
+    }
+
+    // build the internal levels, bottom-up
+    uint32_t height = 0;
+    while(level.size() > 1){
+        height++;
+        std::vector<Node*> parents;
+        std::vector<K> parents_minima;
+        num_nodes = (level.size() + inode_target -1) / inode_target;
+        for(uint64_t i = 0; i < num_nodes; i++){
+            uint64_t start = i * level.size() / num_nodes, end = (i +1) * level.size() / num_nodes;
+            InternalNode* inode = create_inode(height);
+            std::copy(level.begin() + start, level.begin() + end, inode->m_children);
+            std::copy(minima.begin() + start +1, minima.begin() + end, inode->m_keys);
+            inode->m_count = end - start;
+            if(i > 0){
+                Node* previous = parents.back();
+                previous->m_right = inode;
+                previous->m_has_high_key = inode->m_has_low_key = true;
+                previous->m_high_key = inode->m_low_key = minima[start];
+            }
+            parents.push_back(inode);
+            parents_minima.push_back(minima[start]);
+        }
+        level.swap(parents);
+        minima.swap(parents_minima);
+    }
+
+    // replace the current tree
+    Node* previous = m_root.exchange(level[0], std::memory_order_acq_rel);
+    m_cardinality = size;
+    retire_tree(previous);
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+uint64_t ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::memory_footprint() const {
+    return sizeof(*this) + m_num_inodes * sizeof(InternalNode) + m_num_leaves * sizeof(Leaf);
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::dump_node(std::ostream& out, const Node* node) const {
+    out << "[" << node << "] level: " << node->m_level << ", count: " << node->m_count << ", low: ";
+    if(node->m_has_low_key) out << node->m_low_key; else out << "-inf";
+    out << ", high: ";
+    if(node->m_has_high_key) out << node->m_high_key; else out << "+inf";
+    out << ", right: " << node->m_right << "\n    ";
+    if(node->m_level > 0){
+        const InternalNode* inode = static_cast<const InternalNode*>(node);
+        for(size_t i = 0; i < inode->m_count; i++){
+            if(i > 0) out << " <" << inode->m_keys[i -1] << "> ";
+            out << inode->m_children[i];
+        }
+    } else {
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        for(size_t i = 0; i < leaf->m_count; i++){
+            if(i > 0) out << ", ";
+            out << "<" << leaf->m_keys[i] << ", " << leaf->m_values[i] << ">";
+        }
+    }
+    out << "\n";
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::dump(std::ostream& out) const {
+    out << "[Concurrent B-link tree] cardinality: " << size() << ", inodes: " << m_num_inodes << ", leaves: " << m_num_leaves << ", memory footprint: " << memory_footprint() << " bytes\n";
+    const Node* leftmost = m_root.load();
+    while(leftmost != nullptr){
+        for(const Node* node = leftmost; node != nullptr; node = node->m_right){
+            dump_node(out, node);
+        }
+        leftmost = (leftmost->m_level > 0) ? static_cast<const InternalNode*>(leftmost)->m_children[0] : nullptr;
+    }
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+void ConcurrentDynamicIndex<K, V, inode_b, leaf_b>::dump() const {
+    dump(std::cout);
+}
+
+} // namespace pma
+
+#endif /* GENERIC_CONCURRENT_DYNAMIC_INDEX_HPP_ */
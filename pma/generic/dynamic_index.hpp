@@ -18,9 +18,11 @@
 #ifndef GENERIC_DYNAMIC_INDEX_HPP_
 #define GENERIC_DYNAMIC_INDEX_HPP_
 
+#include <algorithm>
 #include <cassert>
 #include <cinttypes>
 #include <cstdlib> // posix_memalign
+#include <future>
 #include <iomanip>
 #include <iostream>
 #if defined(HAVE_LIBNUMA)
@@ -29,8 +31,10 @@
 #include <sched.h>
 #endif
 #include <stdexcept>
+#include <vector>
 
 #include "miscellaneous.hpp" // to_string_with_unit_suffix
+#include "pma/generic/interleaved_lookup.hpp"
 
 namespace pma {
 
@@ -136,6 +140,9 @@ class DynamicIndex {
     // Remove a single element from the tree. Return true if an element has been set and the argument value is set to the value of that element
     bool remove_any(Node* node, const K key, V* out_value, int depth, K* omin_key);
 
+    // Base case of #find_first, search the key in the leaf reached by the traversal
+    bool find_first_leaf(const Leaf* leaf, const K key, K* output_key, V* output_value) const;
+
     // Dump the content of the B-Tree in the given output stream
     void dump_data(std::ostream&, Node* node, int depth) const;
 
@@ -181,6 +188,13 @@ public:
      */
     bool find_first(const K key, K* output_key, V* output_value) const;
 
+    /**
+     * Batched variant of #find_first, for the keys in keys[0, num_keys). It interleaves up to `group_size' traversals
+     * at the time, prefetching the next node of each traversal before switching to the following one. For each key,
+     * out_found[i] is set to whether an entry was found and, if so, out_values[i] to the value of that entry.
+     */
+    void find_first_interleaved(const K* keys, uint64_t num_keys, V* out_values, bool* out_found, uint64_t group_size) const;
+
     /**
      * Return the last entry greater or equal than the given key.
      */
@@ -201,6 +215,13 @@ public:
      */
     void clear();
 
+    /**
+     * Replace the content of the index with the given `size' elements, sorted by key. The tree is
+     * built bottom-up: first the leaves, filled up to the given `fill_factor' in (0, 1], then the
+     * internal levels. Each level is split in chunks among up to `num_threads' threads.
+     */
+    void load_sorted(const K* keys, const V* values, uint64_t size, double fill_factor = 1.0, uint64_t num_threads = 1);
+
     /**
      * Retrieve the memory footprint of this index, in bytes
      */
@@ -342,6 +363,86 @@ void DynamicIndex<K, V, inode_b, leaf_b>::clear() {
     m_height = 1;
 }
 
+template<typename K, typename V, int inode_b, int leaf_b>
+void DynamicIndex<K, V, inode_b, leaf_b>::load_sorted(const K* keys, const V* values, uint64_t size, double fill_factor, uint64_t num_threads){
+    clear();
+
+    // single root?
+    if(size <= leaf_b){
+        Leaf* leaf = reinterpret_cast<Leaf*>(m_root);
+        std::copy(keys, keys + size, KEYS(leaf));
+        std::copy(values, values + size, VALUES(leaf));
+        leaf->N = m_cardinality = size;
+        return;
+    }
+    delete_node(m_root, 0); m_root = nullptr;
+
+    // process the items [0, num_items) in chunks, with one thread for each 64k elements at least
+    auto parallel_for = [num_threads](uint64_t num_items, uint64_t num_elements, auto fn){
+        constexpr uint64_t min_elements_per_thread = 1ull << 16;
+        uint64_t num_workers = std::max<uint64_t>(1, std::min<uint64_t>({ num_threads, num_elements / min_elements_per_thread, num_items }));
+        if(num_workers == 1){ fn(0, num_items); return; }
+        std::vector<std::future<void>> tasks;
+        for(uint64_t i = 0; i < num_workers; i++){
+            tasks.push_back( std::async(std::launch::async, fn, num_items * i / num_workers, num_items * (i +1) / num_workers) );
+        }
+        for(auto& t : tasks) t.get();
+    };
+
+    // leaves, filled up to the fill factor, but with at least leaf_b/2 elements each
+    const uint64_t leaf_a = std::max(1, leaf_b / 2);
+    const uint64_t leaf_target = std::max<uint64_t>(leaf_a, std::min<uint64_t>(leaf_b, fill_factor * leaf_b));
+    uint64_t num_leaves = (size + leaf_target -1) / leaf_target;
+    if(size / num_leaves < leaf_a) num_leaves = size / leaf_a;
+
+    std::vector<Node*> children(num_leaves);
+    std::vector<K> first_keys(num_leaves); // the minimum of each child
+    Leaf* leaf_previous = nullptr;
+    for(uint64_t i = 0; i < num_leaves; i++){
+        Leaf* leaf = create_leaf();
+        leaf->previous = leaf_previous;
+        if(leaf_previous != nullptr) leaf_previous->next = leaf;
+        children[i] = leaf_previous = leaf;
+    }
+    parallel_for(num_leaves, size, [&](uint64_t leaf_start, uint64_t leaf_end){
+        for(uint64_t i = leaf_start; i < leaf_end; i++){
+            Leaf* leaf = reinterpret_cast<Leaf*>(children[i]);
+            uint64_t offset = size * i / num_leaves; // spread the elements evenly
+            leaf->N = size * (i +1) / num_leaves - offset;
+            std::copy(keys + offset, keys + offset + leaf->N, KEYS(leaf));
+            std::copy(values + offset, values + offset + leaf->N, VALUES(leaf));
+            first_keys[i] = keys[offset];
+        }
+    });
+    m_height = 1;
+
+    // internal nodes, bottom-up
+    while(children.size() > 1){
+        const uint64_t num_children = children.size();
+        const uint64_t num_nodes = (num_children + inode_b -1) / inode_b;
+        std::vector<Node*> parents(num_nodes);
+        std::vector<K> parents_first_keys(num_nodes);
+        for(uint64_t i = 0; i < num_nodes; i++){ parents[i] = create_inode(); }
+        parallel_for(num_nodes, num_children, [&](uint64_t node_start, uint64_t node_end){
+            for(uint64_t i = node_start; i < node_end; i++){
+                InternalNode* inode = reinterpret_cast<InternalNode*>(parents[i]);
+                uint64_t offset = num_children * i / num_nodes;
+                inode->N = num_children * (i +1) / num_nodes - offset;
+                std::copy(children.begin() + offset, children.begin() + offset + inode->N, CHILDREN(inode));
+                std::copy(first_keys.begin() + offset +1, first_keys.begin() + offset + inode->N, KEYS(inode));
+                parents_first_keys[i] = first_keys[offset];
+            }
+        });
+
+        children.swap(parents);
+        first_keys.swap(parents_first_keys);
+        m_height++;
+    }
+
+    m_root = children[0];
+    m_cardinality = size;
+}
+
 template<typename K, typename V, int inode_b, int leaf_b>
 uint64_t DynamicIndex<K, V, inode_b, leaf_b>::memory_footprint() const {
     return sizeof(*this) + m_num_inodes * memsize_inode() + m_num_leaves * memsize_leaf();
@@ -1127,7 +1228,11 @@ bool DynamicIndex<K, V, inode_b, leaf_b>::find_first(const K key, K* out_key, V*
         node = CHILDREN(inode)[i];
     }
 
-    Leaf* leaf = reinterpret_cast<Leaf*>(node);
+    return find_first_leaf(reinterpret_cast<Leaf*>(node), key, out_key, out_value);
+}
+
+template<typename K, typename V, int inode_b, int leaf_b>
+bool DynamicIndex<K, V, inode_b, leaf_b>::find_first_leaf(const Leaf* leaf, const K key, K* out_key, V* out_value) const {
     size_t i = 0, N = leaf->N;
     K* __restrict keys = KEYS(leaf);
     while(i < N && keys[i] < key) i++;
@@ -1150,6 +1255,50 @@ bool DynamicIndex<K, V, inode_b, leaf_b>::find_first(const K key, K* out_key, V*
     }
 }
 
+template<typename K, typename V, int inode_b, int leaf_b>
+void DynamicIndex<K, V, inode_b, leaf_b>::find_first_interleaved(const K* keys, uint64_t num_keys, V* out_values, bool* out_found, uint64_t group_size) const {
+    if(out_values == nullptr || out_found == nullptr){ throw std::invalid_argument("Output array is null"); }
+    struct State {
+        const Node* m_node; // the node to visit in the next step
+        int m_depth; // the depth of m_node
+        uint64_t m_index; // index of the lookup, in the arrays keys/out_values/out_found
+    };
+    const int leaf_depth = m_height -1;
+    auto prefetch_node = [&](const Node* node, int depth){
+        if(depth < leaf_depth){
+            pma::prefetch_range(node, sizeof(InternalNode) + sizeof(K) * inode_b); // header + keys
+        } else {
+            pma::prefetch_range(node, sizeof(Leaf) + sizeof(K) * leaf_b); // header + keys
+        }
+    };
+
+    auto start = [&](State& state, uint64_t index){
+        state.m_node = m_root;
+        state.m_depth = 0;
+        state.m_index = index;
+        prefetch_node(state.m_node, state.m_depth);
+    };
+
+    auto step = [&](State& state){
+        const K key = keys[state.m_index];
+        if(state.m_depth < leaf_depth){
+            const InternalNode* inode = reinterpret_cast<const InternalNode*>(state.m_node);
+            size_t i = 0, N = inode->N -1;
+            const K* __restrict inode_keys = KEYS(inode);
+            while(i < N && inode_keys[i] < key) i++;
+            state.m_node = CHILDREN(inode)[i];
+            state.m_depth++;
+            prefetch_node(state.m_node, state.m_depth);
+            return false;
+        } else {
+            out_found[state.m_index] = find_first_leaf(reinterpret_cast<const Leaf*>(state.m_node), key, nullptr, out_values + state.m_index);
+            return true;
+        }
+    };
+
+    interleave_lookups<State>(num_keys, group_size, start, step);
+}
+
 template<typename K, typename V, int inode_b, int leaf_b>
 bool DynamicIndex<K, V, inode_b, leaf_b>::find_last(const K key, K* out_key, V* out_value) const {
     if(out_value == nullptr){ throw std::invalid_argument("Output value is null"); }
@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fenwick_tree.hpp"
+
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+namespace pma {
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+FenwickTree::FenwickTree() : m_tree(nullptr), m_size(0), m_capacity(0) { }
+
+FenwickTree::~FenwickTree(){
+    delete[] m_tree; m_tree = nullptr;
+}
+
+void FenwickTree::rebuild(const uint16_t* segment_sizes, size_t num_segments){
+    if(num_segments > m_capacity || num_segments < m_capacity / 4){ // avoid wasting too much space after a shrink
+        delete[] m_tree; m_tree = nullptr;
+        m_tree = new int64_t[num_segments +1];
+        m_capacity = num_segments;
+    }
+    m_size = num_segments;
+
+    // linear construction, each node forwards its partial sum to its parent
+    m_tree[0] = 0;
+    for(size_t i = 1; i <= m_size; i++){ m_tree[i] = segment_sizes[i -1]; }
+    for(size_t i = 1; i <= m_size; i++){
+        size_t parent = i + (i & (-i));
+        if(parent <= m_size) m_tree[parent] += m_tree[i];
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Updates                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+void FenwickTree::update(size_t segment_id, int64_t diff){
+    assert(segment_id < m_size && "Invalid segment");
+    for(size_t i = segment_id +1; i <= m_size; i += (i & (-i))){
+        m_tree[i] += diff;
+    }
+}
+
+void FenwickTree::refresh(const uint16_t* segment_sizes, size_t window_start, size_t window_length){
+    assert(window_start + window_length <= m_size && "Window out of bounds");
+    for(size_t segment_id = window_start, end = window_start + window_length; segment_id < end; segment_id++){
+        int64_t diff = static_cast<int64_t>(segment_sizes[segment_id]) - get(segment_id);
+        if(diff != 0) update(segment_id, diff);
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Queries                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+int64_t FenwickTree::prefix_sum(size_t segment_end) const {
+    assert(segment_end <= m_size && "Invalid segment");
+    int64_t result = 0;
+    for(size_t i = segment_end; i > 0; i -= (i & (-i))){
+        result += m_tree[i];
+    }
+    return result;
+}
+
+int64_t FenwickTree::sum(size_t window_start, size_t window_end) const {
+    assert(window_start <= window_end);
+    return prefix_sum(window_end) - prefix_sum(window_start);
+}
+
+int64_t FenwickTree::get(size_t segment_id) const {
+    // m_tree[i] minus the nodes covering (i - lsb(i), i -1]
+    size_t i = segment_id +1;
+    int64_t result = m_tree[i];
+    size_t stop = i - (i & (-i));
+    for(size_t j = i -1; j > stop; j -= (j & (-j))){
+        result -= m_tree[j];
+    }
+    return result;
+}
+
+size_t FenwickTree::memory_footprint() const {
+    return sizeof(FenwickTree) + (m_tree != nullptr ? (m_capacity +1) * sizeof(m_tree[0]) : 0);
+}
+
+} // namespace pma
@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERIC_FENWICK_TREE_HPP_
+#define GENERIC_FENWICK_TREE_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+
+namespace pma {
+
+/**
+ * A binary indexed tree (Fenwick tree) over the cardinalities of the segments of a PMA. It answers the number of
+ * elements in any window of segments in O(log n), rather than re-summing the cardinality of each segment in the window.
+ *
+ * The tree mirrors an array of segment sizes owned by the PMA, it is up to the owner to keep it in sync with
+ * #update, after a single insertion or deletion, #refresh, after a window has been rebalanced, and #rebuild,
+ * after a resize.
+ */
+class FenwickTree {
+    int64_t* m_tree; // 1-indexed, m_tree[i] = sum of the segments in (i - lsb(i), i]
+    size_t m_size; // the number of segments tracked
+    size_t m_capacity; // the number of slots allocated in m_tree, minus 1
+
+    // The value of a single segment
+    int64_t get(size_t segment_id) const;
+
+public:
+    /**
+     * Create an empty tree
+     */
+    FenwickTree();
+
+    /**
+     * Destructor
+     */
+    ~FenwickTree();
+
+    /**
+     * Rebuild the whole tree from the given array of segment sizes, in O(n)
+     */
+    void rebuild(const uint16_t* segment_sizes, size_t num_segments);
+
+    /**
+     * Add `diff' to the cardinality of the given segment, in O(log n)
+     */
+    void update(size_t segment_id, int64_t diff);
+
+    /**
+     * Realign the tree after the cardinalities of the segments in [window_start, window_start + window_length) have been
+     * altered, e.g. due to a spread. Only the segments whose cardinality changed are updated, each in O(log n).
+     */
+    void refresh(const uint16_t* segment_sizes, size_t window_start, size_t window_length);
+
+    /**
+     * Retrieve the number of elements in the segments [0, segment_end)
+     */
+    int64_t prefix_sum(size_t segment_end) const;
+
+    /**
+     * Retrieve the number of elements in the segments [window_start, window_end)
+     */
+    int64_t sum(size_t window_start, size_t window_end) const;
+
+    /**
+     * The number of segments tracked
+     */
+    size_t size() const noexcept { return m_size; }
+
+    /**
+     * Memory footprint, in bytes
+     */
+    size_t memory_footprint() const;
+};
+
+} // namespace pma
+
+#endif /* GENERIC_FENWICK_TREE_HPP_ */
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "inplace_resize.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace pma {
+
+/*****************************************************************************
+ *                                                                           *
+ *   DEBUG                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) std::cout << "[inplace_resize::" << __FUNCTION__ << "] " << msg << std::endl
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+/*****************************************************************************
+ *                                                                           *
+ *   Implementation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+// position of the first element of a segment in the clustered layout
+static size_t segment_offset(size_t segment_id, size_t segment_capacity, size_t segment_size){
+    return segment_id * segment_capacity + ((segment_id % 2 == 0) ? segment_capacity - segment_size : 0);
+}
+
+static void move_elements(int64_t* keys, int64_t* values, size_t destination, size_t source, size_t num_elements){
+    if(destination == source || num_elements == 0) return;
+    memmove(keys + destination, keys + source, num_elements * sizeof(keys[0]));
+    memmove(values + destination, values + source, num_elements * sizeof(values[0]));
+}
+
+void inplace_resize_clustered(int64_t* keys, int64_t* values, uint16_t* sizes, size_t old_segment_capacity, size_t old_num_segments, size_t new_segment_capacity, size_t new_num_segments, size_t cardinality){
+    const size_t old_capacity = old_segment_capacity * old_num_segments;
+    const size_t new_capacity = new_segment_capacity * new_num_segments;
+    const size_t elements_per_segment = cardinality / new_num_segments;
+    const size_t odd_segments = cardinality % new_num_segments;
+    COUT_DEBUG("capacity: " << old_capacity << " -> " << new_capacity << ", segment capacity: " << old_segment_capacity << " -> " << new_segment_capacity << ", cardinality: " << cardinality);
+    assert(cardinality <= old_capacity && cardinality <= new_capacity);
+
+    if(new_capacity >= old_capacity){ // grow
+        // 1) compact all elements at the end of the new array, from right to left. The destination of a segment
+        // is never before its source, and all segments on its left have not been touched yet
+        size_t position = new_capacity;
+        for(size_t i = old_num_segments; i > 0; i--){
+            size_t segment_size = sizes[i -1];
+            position -= segment_size;
+            move_elements(keys, values, position, segment_offset(i -1, old_segment_capacity, segment_size), segment_size);
+        }
+        assert(position == new_capacity - cardinality);
+
+        // 2) spread the elements in the new segments, from left to right. The final position of an element is
+        // never after its compacted position
+        for(size_t j = 0; j < new_num_segments; j++){
+            size_t segment_size = elements_per_segment + (j < odd_segments);
+            move_elements(keys, values, segment_offset(j, new_segment_capacity, segment_size), position, segment_size);
+            sizes[j] = segment_size;
+            position += segment_size;
+        }
+    } else { // shrink
+        // 1) compact all elements at the start of the array, from left to right
+        size_t position = 0;
+        for(size_t i = 0; i < old_num_segments; i++){
+            size_t segment_size = sizes[i];
+            move_elements(keys, values, position, segment_offset(i, old_segment_capacity, segment_size), segment_size);
+            position += segment_size;
+        }
+        assert(position == cardinality);
+
+        // 2) spread the elements in the new segments, from right to left
+        for(size_t j = new_num_segments; j > 0; j--){
+            size_t segment_size = elements_per_segment + ((j -1) < odd_segments);
+            position -= segment_size;
+            move_elements(keys, values, segment_offset(j -1, new_segment_capacity, segment_size), position, segment_size);
+            sizes[j -1] = segment_size;
+        }
+    }
+}
+
+} // namespace pma
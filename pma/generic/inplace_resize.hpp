@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERIC_INPLACE_RESIZE_HPP_
+#define GENERIC_INPLACE_RESIZE_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+
+namespace pma {
+
+/**
+ * Redistribute in place the elements of a clustered PMA, where the elements of the even segments are
+ * stored at the end of the segment and those of the odd segments at the start, from a layout of
+ * `old_num_segments' segments of `old_segment_capacity' slots to `new_num_segments' segments of
+ * `new_segment_capacity' slots. Each new segment receives an equal share of the `cardinality' elements.
+ *
+ * The arrays `keys', `values' and `sizes' must be large enough to contain both the old and the new layout,
+ * that is, when growing they must have already been extended (e.g. with mremap) and when shrinking they
+ * can be truncated only afterwards. No auxiliary buffer is used: the elements are first compacted at the
+ * far end of the array (right to left when growing, left to right when shrinking) and then spread to
+ * their final position in the opposite direction, so that a move never overwrites an element not read yet.
+ */
+void inplace_resize_clustered(int64_t* keys, int64_t* values, uint16_t* sizes,
+        size_t old_segment_capacity, size_t old_num_segments,
+        size_t new_segment_capacity, size_t new_num_segments, size_t cardinality);
+
+} // namespace pma
+
+#endif /* GENERIC_INPLACE_RESIZE_HPP_ */
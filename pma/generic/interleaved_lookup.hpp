@@ -0,0 +1,75 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERIC_INTERLEAVED_LOOKUP_HPP_
+#define GENERIC_INTERLEAVED_LOOKUP_HPP_
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pma {
+
+/**
+ * Run `num_lookups' lookups, keeping up to `group_size' of them in flight at the same time, to overlap
+ * their cache misses. Each lookup is a state machine of type State, driven by two functions:
+ * - start(State& state, uint64_t i): initialise the state for the i-th lookup and prefetch the first node to visit;
+ * - step(State& state): visit the node prefetched by the previous step, then either prefetch the next node
+ *   and return false, or store the result of the lookup and return true.
+ * After each step, the lookup is suspended and the next one of the group is resumed, round-robin, so that
+ * the prefetch is likely completed by the time the lookup is resumed. A completed lookup is replaced by
+ * the next one to start. With group_size = 1, the lookups are executed one after the other.
+ */
+template<typename State, typename Start, typename Step>
+void interleave_lookups(uint64_t num_lookups, uint64_t group_size, Start&& start, Step&& step){
+    if(num_lookups == 0) return;
+    group_size = std::max<uint64_t>(1, std::min(group_size, num_lookups));
+    std::vector<State> states(group_size);
+
+    uint64_t next = 0; // the next lookup to start
+    uint64_t num_active = 0; // the lookups in flight are in states[0, num_active)
+    while(num_active < group_size){ start(states[num_active++], next++); }
+
+    uint64_t i = 0;
+    while(num_active > 0){
+        if(!step(states[i])){
+            i++;
+        } else if(next < num_lookups){ // reuse the slot for the next lookup
+            start(states[i++], next++);
+        } else { // shrink the group
+            states[i] = states[--num_active];
+        }
+        if(i >= num_active) i = 0;
+    }
+}
+
+/**
+ * Prefetch the cache lines in [address, address + length)
+ */
+inline void prefetch_range(const void* address, size_t length){
+    uintptr_t start = reinterpret_cast<uintptr_t>(address) & ~static_cast<uintptr_t>(63);
+    uintptr_t end = reinterpret_cast<uintptr_t>(address) + length;
+    for(uintptr_t line = start; line < end; line += 64){
+        __builtin_prefetch(reinterpret_cast<const void*>(line), /* read only */ 0);
+    }
+}
+
+} // namespace pma
+
+#endif /* GENERIC_INTERLEAVED_LOOKUP_HPP_ */
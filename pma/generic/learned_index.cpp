@@ -0,0 +1,272 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "learned_index.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace pma {
+
+/*****************************************************************************
+ *                                                                           *
+ *   DEBUG                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) std::cout << "[LearnedIndex::" << __FUNCTION__ << "] " << msg << std::endl
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+LearnedIndex::LearnedIndex(uint64_t piece_size, uint64_t num_segments) :
+        m_piece_size(piece_size), m_capacity(0), m_num_pieces(0), m_keys(nullptr), m_piece_keys(nullptr), m_models(nullptr),
+        m_root{0, 0., 0} {
+    if(piece_size < 2){ throw std::invalid_argument("Invalid piece size: it must be at least 2"); }
+    rebuild(num_segments);
+}
+
+LearnedIndex::LearnedIndex(const LearnedIndex& index) :
+        m_piece_size(index.m_piece_size), m_capacity(0), m_num_pieces(0), m_keys(nullptr), m_piece_keys(nullptr), m_models(nullptr),
+        m_root(index.m_root) {
+    allocate(index.m_capacity);
+    memcpy(m_keys, index.m_keys, m_capacity * sizeof(m_keys[0]));
+    memcpy(m_piece_keys, index.m_piece_keys, m_num_pieces * sizeof(m_piece_keys[0]));
+    memcpy(m_models, index.m_models, m_num_pieces * sizeof(m_models[0]));
+}
+
+LearnedIndex::~LearnedIndex(){
+    release();
+}
+
+void LearnedIndex::allocate(uint64_t N){
+    assert(m_keys == nullptr && m_piece_keys == nullptr && m_models == nullptr && "Arrays already allocated");
+    m_capacity = N;
+    m_num_pieces = (N -1 + m_piece_size -1) / m_piece_size;
+
+    int rc = posix_memalign((void**) &m_keys, /* alignment */ 64,  /* size */ N * sizeof(m_keys[0]));
+    if(rc != 0) { throw std::bad_alloc(); }
+    rc = posix_memalign((void**) &m_piece_keys, /* alignment */ 64,  /* size */ max<uint64_t>(m_num_pieces, 1) * sizeof(m_piece_keys[0]));
+    if(rc != 0) { release(); throw std::bad_alloc(); }
+    rc = posix_memalign((void**) &m_models, /* alignment */ 64,  /* size */ max<uint64_t>(m_num_pieces, 1) * sizeof(m_models[0]));
+    if(rc != 0) { release(); throw std::bad_alloc(); }
+}
+
+void LearnedIndex::release(){
+    free(m_keys); m_keys = nullptr;
+    free(m_piece_keys); m_piece_keys = nullptr;
+    free(m_models); m_models = nullptr;
+}
+
+void LearnedIndex::rebuild(uint64_t N){
+    if(N == 0) throw std::invalid_argument("Invalid number of keys: 0");
+    if(N != m_capacity){
+        release();
+        allocate(N);
+    }
+    COUT_DEBUG("capacity: " << m_capacity << ", pieces: " << m_num_pieces);
+
+    // keep the keys sorted until they are set by the caller
+    m_keys[0] = numeric_limits<int64_t>::min();
+    std::fill(m_keys +1, m_keys + m_capacity, numeric_limits<int64_t>::max());
+    refit_all();
+}
+
+size_t LearnedIndex::memory_footprint() const {
+    return m_capacity * sizeof(m_keys[0]) + m_num_pieces * (sizeof(m_piece_keys[0]) + sizeof(m_models[0]));
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Separator keys                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+void LearnedIndex::set_separator_key(uint64_t segment_id, int64_t key){
+    assert(segment_id > 0 && "The segment 0 is not explicitly stored");
+    assert(segment_id < m_capacity && "Invalid slot");
+    m_keys[segment_id] = key;
+
+    uint64_t piece = (segment_id -1) / m_piece_size;
+    refit_piece(piece);
+
+    if((segment_id -1) % m_piece_size == 0){ // first key of the piece
+        m_piece_keys[piece] = key;
+        refit_root();
+    }
+}
+
+void LearnedIndex::set_separator_keys(const int64_t* keys){
+    memcpy(m_keys +1, keys +1, (m_capacity -1) * sizeof(m_keys[0]));
+    refit_all();
+}
+
+int64_t LearnedIndex::get_separator_key(uint64_t segment_id) const {
+    assert(segment_id > 0 && "The segment 0 is not explicitly stored");
+    assert(segment_id < m_capacity && "Invalid slot");
+    return m_keys[segment_id];
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Models                                                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+LearnedIndex::Model LearnedIndex::fit(const int64_t* keys, uint64_t start, uint64_t end){
+    assert(start < end);
+    Model model { keys[start], 0., 0 };
+
+    // the line through the first and the last key of the interval
+    double range = static_cast<double>(keys[end -1]) - static_cast<double>(keys[start]);
+    if(range > 0){ model.m_slope = (end - start -1) / range; }
+
+    double error = 0;
+    for(uint64_t i = start; i < end; i++){
+        double prediction = start + model.m_slope * (static_cast<double>(keys[i]) - static_cast<double>(model.m_key));
+        error = max(error, fabs(prediction - i));
+    }
+    model.m_error = ceil(error) +1; // +1 to absorb the rounding of the predictions
+
+    return model;
+}
+
+void LearnedIndex::refit_piece(uint64_t piece){
+    assert(piece < m_num_pieces && "Invalid piece");
+    uint64_t start = 1 + piece * m_piece_size;
+    uint64_t end = min(start + m_piece_size, m_capacity);
+    m_models[piece] = fit(m_keys, start, end);
+}
+
+void LearnedIndex::refit_root(){
+    if(m_num_pieces > 0) m_root = fit(m_piece_keys, 0, m_num_pieces);
+}
+
+void LearnedIndex::refit_all(){
+    COUT_DEBUG("pieces: " << m_num_pieces);
+    for(uint64_t piece = 0; piece < m_num_pieces; piece++){
+        m_piece_keys[piece] = m_keys[1 + piece * m_piece_size];
+        refit_piece(piece);
+    }
+    refit_root();
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Find                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+template<bool upper>
+uint64_t LearnedIndex::search(const int64_t* keys, uint64_t start, uint64_t end, const Model& model, int64_t key) noexcept {
+    // clamp the prediction before converting it, it can be far off for the keys outside the interval of the model
+    double prediction = start + model.m_slope * (static_cast<double>(key) - static_cast<double>(model.m_key));
+    prediction = max<double>(start, min<double>(end, prediction));
+    uint64_t position = prediction;
+
+    // as the model is monotone, the position searched is at most `error' slots away from the prediction
+    uint64_t window_start = (position > start + model.m_error) ? position - model.m_error : start;
+    uint64_t window_end = min<uint64_t>(end, position + model.m_error +1);
+    const int64_t* result = upper ? std::upper_bound(keys + window_start, keys + window_end, key) : std::lower_bound(keys + window_start, keys + window_end, key);
+
+    assert((result == keys + start || (upper ? result[-1] <= key : result[-1] < key)) && "The window is not large enough");
+    assert((result == keys + end || (upper ? result[0] > key : result[0] >= key)) && "The window is not large enough");
+    return result - keys;
+}
+
+template<bool upper>
+uint64_t LearnedIndex::find(int64_t key) const noexcept {
+    if(m_num_pieces == 0) return 0;
+
+    // find the last piece whose first key is <= key (upper) or < key (lower)
+    uint64_t piece = search<upper>(m_piece_keys, 0, m_num_pieces, m_root, key);
+    if(piece == 0) return 0;
+    piece--;
+
+    uint64_t start = 1 + piece * m_piece_size;
+    uint64_t end = min(start + m_piece_size, m_capacity);
+    return search<upper>(m_keys, start, end, m_models[piece], key) -1;
+}
+
+uint64_t LearnedIndex::find_first(int64_t key) const noexcept {
+    return find</* upper */ false>(key);
+}
+
+uint64_t LearnedIndex::find_last(int64_t key) const noexcept {
+    return find</* upper */ true>(key);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Persistence                                                             *
+ *                                                                           *
+ *****************************************************************************/
+
+void LearnedIndex::save(std::ostream& out) const {
+    out.write(reinterpret_cast<const char*>(m_keys +1), (m_capacity -1) * sizeof(m_keys[0]));
+}
+
+void LearnedIndex::load(std::istream& in){
+    in.read(reinterpret_cast<char*>(m_keys +1), (m_capacity -1) * sizeof(m_keys[0]));
+    if(!in){ throw std::runtime_error("[LearnedIndex::load] Cannot read the separator keys"); }
+    refit_all();
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Dump                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+void LearnedIndex::dump(std::ostream& out, bool* integrity_check) const {
+    out << "[Learned index] piece size: " << m_piece_size << ", capacity: " << m_capacity << ", pieces: " << m_num_pieces << "\n";
+    out << "root, key: " << m_root.m_key << ", slope: " << m_root.m_slope << ", error: " << m_root.m_error << "\n";
+    for(uint64_t piece = 0; piece < m_num_pieces; piece++){
+        uint64_t start = 1 + piece * m_piece_size;
+        uint64_t end = min(start + m_piece_size, m_capacity);
+        const Model& model = m_models[piece];
+        out << "[" << piece << "] segments: [" << start << ", " << end << "), key: " << model.m_key << ", slope: " << model.m_slope << ", error: " << model.m_error << "\n";
+        out << "keys: ";
+        for(uint64_t i = start; i < end; i++){
+            if(i > start) out << ", ";
+            out << i << ": " << m_keys[i];
+            if(i > 1 && m_keys[i] < m_keys[i -1]){
+                out << " (ERROR: sorted order not respected: " << m_keys[i-1] << " > " << m_keys[i] << ")";
+                if(integrity_check) *integrity_check = false;
+            }
+        }
+        out << "\n";
+    }
+}
+
+} // namespace pma
@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERIC_LEARNED_INDEX_HPP_
+#define GENERIC_LEARNED_INDEX_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+
+namespace pma {
+
+/**
+ * A learned index over the separator keys of a PMA, i.e. the minima of its segments, used by the StaticIndex with
+ * the layout StaticIndexLayout::LEARNED.
+ *
+ * The keys are kept in a plain array, indexed by the segment id, and split into pieces of fixed size. Each piece is
+ * covered by a linear model, and a root linear model maps a key to its piece. Every model records its maximum error,
+ * so that a search only needs a binary search in the window [prediction - error, prediction + error] around the
+ * predicted position.
+ *
+ * The models are refitted by the updates: #set_separator_key refits the piece of the altered key, and the root model
+ * only when the first key of the piece changes. The searches only read the index, but this class is not thread safe
+ * for concurrent readers and writers.
+ */
+class LearnedIndex {
+    struct Model {
+        int64_t m_key; // the first key covered by the model
+        double m_slope; // the number of positions per unit of key
+        uint64_t m_error; // the max distance between a predicted and an actual position
+    };
+
+    const uint64_t m_piece_size; // the number of keys covered by each linear model
+    uint64_t m_capacity; // the number of segments indexed
+    uint64_t m_num_pieces; // the number of linear models
+    int64_t* m_keys; // the separator keys, indexed by the segment id. The slot 0 is not used.
+    int64_t* m_piece_keys; // the first key of each piece
+    Model* m_models; // the linear models of each piece
+    Model m_root; // the linear model on top of m_piece_keys
+
+    // Allocate the arrays for the given number of segments
+    void allocate(uint64_t num_segments);
+
+    // Release the allocated arrays
+    void release();
+
+    // Refit the model of the given piece
+    void refit_piece(uint64_t piece);
+
+    // Refit the root model, on top of the first key of each piece
+    void refit_root();
+
+    // Reload the first key of each piece and refit all models, after the whole array of keys has been replaced
+    void refit_all();
+
+    // Fit a linear model over keys[start, end)
+    static Model fit(const int64_t* keys, uint64_t start, uint64_t end);
+
+    // Retrieve the first position in [start, end] whose key is > key (upper = true) or >= key (upper = false)
+    template<bool upper>
+    static uint64_t search(const int64_t* keys, uint64_t start, uint64_t end, const Model& model, int64_t key) noexcept;
+
+    // Retrieve the number of separator keys <= key (upper = true) or < key (upper = false)
+    template<bool upper>
+    uint64_t find(int64_t key) const noexcept;
+
+public:
+    /**
+     * Initialise the index, where each linear model covers `piece_size' segments
+     */
+    LearnedIndex(uint64_t piece_size, uint64_t num_segments = 1);
+
+    /**
+     * Copy constructor, it duplicates the whole content of the index
+     */
+    LearnedIndex(const LearnedIndex& index);
+
+    LearnedIndex& operator=(const LearnedIndex&) = delete;
+
+    /**
+     * Destructor
+     */
+    ~LearnedIndex();
+
+    /**
+     * Rebuild the index to contain `num_segments'
+     */
+    void rebuild(uint64_t num_segments);
+
+    /**
+     * Set the separator key associated to the given segment, with segment_id > 0
+     */
+    void set_separator_key(uint64_t segment_id, int64_t key);
+
+    /**
+     * Set the separator keys of all segments but the segment 0, where keys[i] is the separator key of the segment i
+     */
+    void set_separator_keys(const int64_t* keys);
+
+    /**
+     * Get the separator key associated to the given segment, with segment_id > 0
+     */
+    int64_t get_separator_key(uint64_t segment_id) const;
+
+    /**
+     * Retrieve the number of separator keys, excluding the segment 0, that are less or equal than the given key
+     */
+    uint64_t find_last(int64_t key) const noexcept;
+
+    /**
+     * Retrieve the number of separator keys, excluding the segment 0, that are strictly less than the given key
+     */
+    uint64_t find_first(int64_t key) const noexcept;
+
+    /**
+     * Retrieve the memory footprint of this index, in bytes
+     */
+    size_t memory_footprint() const;
+
+    /**
+     * Serialise the separator keys in the given (binary) output stream
+     */
+    void save(std::ostream& out) const;
+
+    /**
+     * Read the separator keys previously serialised with #save. The index must have been already rebuilt with the
+     * same number of segments.
+     */
+    void load(std::istream& in);
+
+    /**
+     * Dump the keys and the models of the index
+     */
+    void dump(std::ostream& out, bool* integrity_check = nullptr) const;
+};
+
+} // namespace pma
+
+#endif /* GENERIC_LEARNED_INDEX_HPP_ */
@@ -16,13 +16,21 @@
  */
 
 #include "static_index.hpp"
+#include "learned_index.hpp"
 #include <cassert>
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <future>
 #include <limits>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
+#include <vector>
+
+#include "aligned_memory.hpp"
 
 using namespace std;
 
@@ -48,14 +56,26 @@ namespace pma {
  *                                                                           *
  *****************************************************************************/
 
-StaticIndex::StaticIndex(uint64_t node_size, uint64_t num_segments) :
-        m_node_size(node_size), m_height(0), m_capacity(0), m_keys(nullptr), m_key_minimum(numeric_limits<int64_t>::max()) {
+StaticIndex::StaticIndex(uint64_t node_size, uint64_t num_segments, StaticIndexLayout layout) :
+        m_node_size(node_size), m_layout(layout), m_height(0), m_capacity(0), m_keys(nullptr), m_allocated_slots(0), m_key_minimum(numeric_limits<int64_t>::max()), m_learned(nullptr) {
     if(node_size > (uint64_t) numeric_limits<uint16_t>::max()){ throw std::invalid_argument("Invalid node size: too big"); }
+    if(layout == StaticIndexLayout::LEARNED){ m_learned = new LearnedIndex(node_size, num_segments); }
     rebuild(num_segments);
 }
 
+StaticIndex::StaticIndex(const StaticIndex& index) :
+        m_node_size(index.m_node_size), m_layout(index.m_layout), m_height(index.m_height), m_capacity(index.m_capacity), m_keys(nullptr), m_allocated_slots(0), m_key_minimum(index.m_key_minimum), m_learned(nullptr) {
+    if(index.m_learned != nullptr){ m_learned = new LearnedIndex(*index.m_learned); }
+    uint64_t tree_sz = num_slots();
+    m_keys = (int64_t*) aligned_memory_allocate(max<uint64_t>(tree_sz, 1) * sizeof(int64_t));
+    m_allocated_slots = tree_sz;
+    if(tree_sz > 0){ memcpy(m_keys, index.m_keys, tree_sz * sizeof(int64_t)); }
+    memcpy(m_rightmost, index.m_rightmost, sizeof(m_rightmost));
+}
+
 StaticIndex::~StaticIndex(){
-    free(m_keys); m_keys = nullptr;
+    aligned_memory_free(m_keys); m_keys = nullptr;
+    delete m_learned; m_learned = nullptr;
 }
 
 int64_t StaticIndex::node_size() const noexcept {
@@ -63,18 +83,45 @@ int64_t StaticIndex::node_size() const noexcept {
     return m_node_size;
 }
 
+StaticIndexLayout StaticIndex::layout() const noexcept {
+    return m_layout;
+}
+
+uint64_t StaticIndex::num_slots() const {
+    if(m_layout == StaticIndexLayout::LEARNED){
+        return 0; // the keys are stored in m_learned
+    } else if(m_layout == StaticIndexLayout::EYTZINGER){
+        return (m_height == 0) ? 0 : (1ull << m_height); // the slot 0 is not used
+    } else {
+        return pow(node_size(), m_height) -1;
+    }
+}
+
+void StaticIndex::ensure_allocated_slots(uint64_t num_slots){
+    // when the index grows or shrinks by a few levels, keep using the same buffer
+    if(num_slots > m_allocated_slots || num_slots < m_allocated_slots / 4){
+        aligned_memory_free(m_keys); m_keys = nullptr;
+        m_allocated_slots = 0;
+        m_keys = (int64_t*) aligned_memory_allocate(max<uint64_t>(num_slots, 1) * sizeof(int64_t)); // backed by huge pages, if large enough
+        m_allocated_slots = num_slots;
+    }
+}
+
 void StaticIndex::rebuild(uint64_t N){
     if(N == 0) throw std::invalid_argument("Invalid number of keys: 0");
+    if(m_layout == StaticIndexLayout::EYTZINGER){ rebuild_eytzinger(N); return; }
+    if(m_layout == StaticIndexLayout::LEARNED){
+        m_learned->rebuild(N);
+        m_capacity = N;
+        m_height = (N > 1) ? 2 : 0; // root model + models of the pieces
+        return;
+    }
     int height = ceil( log2(N) / log2(node_size()) );
     if(height > m_rightmost_sz){ throw std::invalid_argument("Invalid number of keys/segments: too big"); }
     uint64_t tree_sz = pow(node_size(), height) -1; // don't store the minimum, segment 0
 
-    if(height != m_height){
-        free(m_keys); m_keys = nullptr;
-        int rc = posix_memalign((void**) &m_keys, /* alignment */ 64,  /* size */ tree_sz * sizeof(int64_t));
-        if(rc != 0) { throw std::bad_alloc(); }
-        m_height = height;
-    }
+    ensure_allocated_slots(tree_sz);
+    m_height = height;
     m_capacity = N;
     COUT_DEBUG("capacity: " << m_capacity << ", height: " << m_height);
 
@@ -109,9 +156,139 @@ int StaticIndex::height() const noexcept {
 
 
 size_t StaticIndex::memory_footprint() const {
-    return (pow(node_size(), height()) -1) * sizeof(int64_t);
+    return num_slots() * sizeof(int64_t) + (m_learned != nullptr ? m_learned->memory_footprint() : 0);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Bulk loading                                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+void StaticIndex::rebuild(uint64_t num_segments, const int64_t* keys, uint64_t num_threads){
+    rebuild(num_segments);
+    m_key_minimum = keys[0];
+    fill(keys, max<uint64_t>(num_threads, 1));
+}
+
+void StaticIndex::fill_subtree(int64_t* root, int height, bool rightmost, const int64_t* keys){
+    // mirror of #get_slot, where keys[0] is the first segment indexed by the subtree
+    while(height > 0){
+        uint64_t root_sz = (rightmost) ? m_rightmost[height -1].m_root_sz : node_size() -1; // full
+        uint64_t subtree_sz = pow(node_size(), height -1);
+        for(uint64_t i = 0; i < root_sz; i++){
+            root[i] = keys[(i +1) * subtree_sz];
+        }
+        if(height == 1) return; // leaf
+
+        int64_t* base = root + node_size() -1;
+        for(uint64_t i = 0; i < root_sz; i++){
+            fill_subtree(base + i * (subtree_sz -1), height -1, false, keys + i * subtree_sz);
+        }
+
+        // continue with the last child, without recursion
+        root = base + root_sz * (subtree_sz -1);
+        keys += root_sz * subtree_sz;
+        height = rightmost ? m_rightmost[height -1].m_right_height : height -1;
+    }
+}
+
+void StaticIndex::fill(const int64_t* keys, uint64_t num_threads){
+    constexpr uint64_t min_keys_per_thread = 1ull << 16; // below this threshold, the cost of the threads is not worth it
+    num_threads = max<uint64_t>(1, min<uint64_t>(num_threads, m_capacity / min_keys_per_thread));
+    COUT_DEBUG("capacity: " << m_capacity << ", num_threads: " << num_threads);
+
+    if(m_layout == StaticIndexLayout::LEARNED){
+        m_learned->set_separator_keys(keys);
+    } else if(m_layout == StaticIndexLayout::EYTZINGER){
+        // each slot is computed in O(1), split the segments in ranges
+        auto fill_range = [this, keys](uint64_t start, uint64_t end){
+            for(uint64_t i = start; i < end; i++){ get_slot(i)[0] = keys[i]; }
+        };
+        if(num_threads == 1){
+            fill_range(1, m_capacity);
+        } else {
+            std::vector<future<void>> tasks;
+            uint64_t range_sz = (m_capacity -1) / num_threads;
+            for(uint64_t i = 0; i < num_threads; i++){
+                uint64_t start = 1 + i * range_sz;
+                uint64_t end = (i == num_threads -1) ? m_capacity : start + range_sz;
+                tasks.push_back( async(launch::async, fill_range, start, end) );
+            }
+            for(auto& t: tasks) t.get();
+        }
+    } else if(m_height > 0){
+        if(num_threads == 1 || m_height == 1){
+            fill_subtree(m_keys, m_height, true, keys);
+        } else {
+            // set the keys in the root, then distribute its children among the workers
+            uint64_t root_sz = m_rightmost[m_height -1].m_root_sz;
+            uint64_t subtree_sz = pow(node_size(), m_height -1);
+            for(uint64_t i = 0; i < root_sz; i++){ m_keys[i] = keys[(i +1) * subtree_sz]; }
+            int64_t* base = m_keys + node_size() -1;
+
+            auto fill_children = [this, keys, base, root_sz, subtree_sz](uint64_t start, uint64_t end){
+                for(uint64_t i = start; i < end; i++){
+                    bool rightmost = (i == root_sz);
+                    int height = rightmost ? m_rightmost[m_height -1].m_right_height : m_height -1;
+                    fill_subtree(base + i * (subtree_sz -1), height, rightmost, keys + i * subtree_sz);
+                }
+            };
+
+            std::vector<future<void>> tasks;
+            uint64_t num_children = root_sz +1;
+            num_threads = min(num_threads, num_children);
+            uint64_t children_per_thread = num_children / num_threads;
+            uint64_t odd_children = num_children % num_threads;
+            uint64_t start = 0;
+            for(uint64_t i = 0; i < num_threads; i++){
+                uint64_t end = start + children_per_thread + (i < odd_children);
+                tasks.push_back( async(launch::async, fill_children, start, end) );
+                start = end;
+            }
+            for(auto& t: tasks) t.get();
+        }
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Eytzinger layout                                                        *
+ *                                                                           *
+ *****************************************************************************/
+// The keys are stored as a complete binary tree, padded with +inf up to the next power of 2. The children of the
+// node k are in the slots 2k and 2k+1, the root is in the slot 1. As the tree is perfect, the position reached by a
+// descent of exactly `height' steps yields the rank of the key searched, with no need to track the path.
+
+void StaticIndex::rebuild_eytzinger(uint64_t N){
+    uint64_t num_keys = N -1; // don't store the minimum, segment 0
+    int height = (num_keys == 0) ? 0 : 64 - __builtin_clzll(num_keys);
+    if(height >= 32){ throw std::invalid_argument("Invalid number of keys/segments: too big"); }
+
+    ensure_allocated_slots((height == 0) ? 0 : (1ull << height));
+    m_height = height;
+    m_capacity = N;
+    COUT_DEBUG("capacity: " << m_capacity << ", height: " << m_height);
+
+    // the padding must compare greater than any key
+    std::fill(m_keys, m_keys + num_slots(), numeric_limits<int64_t>::max());
 }
 
+template<bool upper>
+uint64_t StaticIndex::find_eytzinger(int64_t key) const noexcept {
+    const int64_t* __restrict keys = m_keys;
+    uint64_t k = 1;
+    for(int i = 0; i < m_height; i++){
+        // with aligned 8-byte keys, the 8 great-grandchildren of the node k are all in the same cache line
+        __builtin_prefetch(keys + 8 * k);
+        k = 2 * k + (upper ? (keys[k] <= key) : (keys[k] < key));
+    }
+
+    // a search for +inf may also land in the padding
+    return min<uint64_t>(k - (1ull << m_height), m_capacity -1);
+}
+
+
 /*****************************************************************************
  *                                                                           *
  *   Separator keys                                                          *
@@ -122,6 +299,12 @@ int64_t* StaticIndex::get_slot(uint64_t segment_id) const {
     assert(segment_id > 0 && "The segment 0 is not explicitly stored");
     assert(segment_id < static_cast<uint64_t>(m_capacity) && "Invalid slot");
 
+    if(m_layout == StaticIndexLayout::EYTZINGER){
+        // in-order position -> breadth-first position: the number of trailing zeros gives the depth from the leaves
+        int tz = __builtin_ctzll(segment_id);
+        return m_keys + (1ull << (m_height -1 - tz)) + (segment_id >> (tz +1));
+    }
+
     int64_t* __restrict base = m_keys;
     int64_t offset = segment_id;
     int height = m_height;
@@ -160,6 +343,8 @@ int64_t* StaticIndex::get_slot(uint64_t segment_id) const {
 void StaticIndex::set_separator_key(uint64_t segment_id, int64_t key){
     if(segment_id == 0) {
         m_key_minimum = key;
+    } else if(m_layout == StaticIndexLayout::LEARNED){
+        m_learned->set_separator_key(segment_id, key);
     } else {
         get_slot(segment_id)[0] = key;
     }
@@ -170,6 +355,8 @@ void StaticIndex::set_separator_key(uint64_t segment_id, int64_t key){
 int64_t StaticIndex::get_separator_key(uint64_t segment_id) const {
     if(segment_id == 0)
         return m_key_minimum;
+    else if(m_layout == StaticIndexLayout::LEARNED)
+        return m_learned->get_separator_key(segment_id);
     else
         return get_slot(segment_id)[0];
 }
@@ -182,6 +369,8 @@ int64_t StaticIndex::get_separator_key(uint64_t segment_id) const {
 uint64_t StaticIndex::find(int64_t key) const noexcept {
     COUT_DEBUG("key: " << key);
     if(key <= m_key_minimum) return 0; // easy!
+    if(m_layout == StaticIndexLayout::EYTZINGER) return find_eytzinger</* upper */ true>(key);
+    if(m_layout == StaticIndexLayout::LEARNED) return m_learned->find_last(key);
 
     int64_t* __restrict base = m_keys;
     int64_t offset = 0;
@@ -217,6 +406,8 @@ uint64_t StaticIndex::find(int64_t key) const noexcept {
 
 uint64_t StaticIndex::find_first(int64_t key) const noexcept {
     if(key < m_key_minimum) return 0; // easy!
+    if(m_layout == StaticIndexLayout::EYTZINGER) return find_eytzinger</* upper */ false>(key);
+    if(m_layout == StaticIndexLayout::LEARNED) return m_learned->find_first(key);
 
     int64_t* __restrict base = m_keys;
     int64_t offset = 0;
@@ -248,6 +439,8 @@ uint64_t StaticIndex::find_first(int64_t key) const noexcept {
 
 uint64_t StaticIndex::find_last(int64_t key) const noexcept {
     if(key < m_key_minimum) return 0; // easy!
+    if(m_layout == StaticIndexLayout::EYTZINGER) return find_eytzinger</* upper */ true>(key);
+    if(m_layout == StaticIndexLayout::LEARNED) return m_learned->find_last(key);
 
     int64_t* __restrict base = m_keys;
     int64_t offset = 0;
@@ -281,6 +474,47 @@ int64_t StaticIndex::minimum() const noexcept {
     return m_key_minimum;
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   Persistence                                                             *
+ *                                                                           *
+ *****************************************************************************/
+
+void StaticIndex::save(std::ostream& out) const {
+    uint64_t node_size = m_node_size;
+    uint64_t capacity = m_capacity;
+    uint64_t layout = static_cast<uint64_t>(m_layout);
+    uint64_t tree_sz = num_slots();
+    out.write(reinterpret_cast<const char*>(&node_size), sizeof(node_size));
+    out.write(reinterpret_cast<const char*>(&layout), sizeof(layout));
+    out.write(reinterpret_cast<const char*>(&capacity), sizeof(capacity));
+    out.write(reinterpret_cast<const char*>(&m_key_minimum), sizeof(m_key_minimum));
+    out.write(reinterpret_cast<const char*>(m_keys), tree_sz * sizeof(m_keys[0]));
+    if(m_learned != nullptr) m_learned->save(out);
+}
+
+void StaticIndex::load(std::istream& in){
+    uint64_t node_size = 0;
+    uint64_t layout = 0;
+    uint64_t capacity = 0;
+    in.read(reinterpret_cast<char*>(&node_size), sizeof(node_size));
+    in.read(reinterpret_cast<char*>(&layout), sizeof(layout));
+    in.read(reinterpret_cast<char*>(&capacity), sizeof(capacity));
+    if(!in){ throw std::runtime_error("[StaticIndex::load] Cannot read the header of the index"); }
+    if(node_size != m_node_size){ throw std::invalid_argument("[StaticIndex::load] Node size mismatch: " + to_string(node_size) + " != " + to_string(m_node_size)); }
+    if(layout != static_cast<uint64_t>(m_layout)){
+        stringstream ss; ss << "[StaticIndex::load] Layout mismatch: " << static_cast<StaticIndexLayout>(layout) << " != " << m_layout;
+        throw std::invalid_argument(ss.str());
+    }
+
+    rebuild(capacity);
+    uint64_t tree_sz = num_slots();
+    in.read(reinterpret_cast<char*>(&m_key_minimum), sizeof(m_key_minimum));
+    in.read(reinterpret_cast<char*>(m_keys), tree_sz * sizeof(m_keys[0]));
+    if(m_learned != nullptr) m_learned->load(in);
+    if(!in){ throw std::runtime_error("[StaticIndex::load] Cannot read the content of the index"); }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Dump                                                                    *
@@ -356,11 +590,31 @@ void StaticIndex::dump_subtree(std::ostream& out, int64_t* root, int height, boo
     }
 }
 
+void StaticIndex::dump_eytzinger(std::ostream& out, bool* integrity_check) const {
+    out << "keys: ";
+    for(int64_t i = 1; i < m_capacity; i++){
+        int64_t key = get_slot(i)[0];
+        if(i > 1) out << ", ";
+        out << i << " => k:" << (get_slot(i) - m_keys) << ", v:" << key;
+
+        int64_t previous = (i == 1) ? m_key_minimum : get_slot(i -1)[0];
+        if(key < previous){
+            out << " (ERROR: sorted order not respected: " << previous << " > " << key << ")";
+            if(integrity_check) *integrity_check = false;
+        }
+    }
+    out << "\n";
+}
+
 void StaticIndex::dump(std::ostream& out, bool* integrity_check) const {
-    out << "[Index] block size: " << node_size() << ", height: " << height() <<
+    out << "[Index] layout: " << layout() << ", block size: " << node_size() << ", height: " << height() <<
             ", capacity (number of entries indexed): " << m_capacity << ", minimum: " << minimum() << "\n";
 
-    if(m_capacity > 1)
+    if(m_layout == StaticIndexLayout::EYTZINGER)
+        dump_eytzinger(out, integrity_check);
+    else if(m_layout == StaticIndexLayout::LEARNED)
+        m_learned->dump(out, integrity_check);
+    else if(m_capacity > 1)
         dump_subtree(out, m_keys, height(), true, m_key_minimum, numeric_limits<int64_t>::max(), integrity_check);
 }
 
@@ -368,6 +622,27 @@ void StaticIndex::dump() const {
     dump(cout);
 }
 
+StaticIndexLayout static_index_layout(const std::string& name){
+    if(name == "btree"){
+        return StaticIndexLayout::BTREE;
+    } else if(name == "eytzinger"){
+        return StaticIndexLayout::EYTZINGER;
+    } else if(name == "learned"){
+        return StaticIndexLayout::LEARNED;
+    } else {
+        throw std::invalid_argument("Invalid layout for the static index: `" + name + "', expected either `btree', `eytzinger' or `learned'");
+    }
+}
+
+std::ostream& operator<<(std::ostream& out, StaticIndexLayout layout){
+    switch(layout){
+    case StaticIndexLayout::BTREE: out << "btree"; break;
+    case StaticIndexLayout::EYTZINGER: out << "eytzinger"; break;
+    case StaticIndexLayout::LEARNED: out << "learned"; break;
+    }
+    return out;
+}
+
 std::ostream& operator<<(std::ostream& out, const StaticIndex& index){
     index.dump(out);
     return out;
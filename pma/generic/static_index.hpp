@@ -19,10 +19,30 @@
 #define GENERIC_STATIC_INDEX_HPP_
 
 #include <cinttypes>
+#include <istream>
 #include <ostream>
+#include <string>
 
 namespace pma {
 
+class LearnedIndex; // forward declaration
+
+/**
+ * The physical layout of the separator keys in a StaticIndex
+ */
+enum class StaticIndexLayout {
+    BTREE, // nodes of B -1 keys, stored in breadth-first order
+    EYTZINGER, // a single complete binary tree, stored in breadth-first order. The node size B is ignored.
+    LEARNED // piecewise linear models, each covering B keys, see LearnedIndex
+};
+
+/**
+ * Parse the name of a layout, either "btree", "eytzinger" or "learned"
+ */
+StaticIndexLayout static_index_layout(const std::string& name);
+
+std::ostream& operator<<(std::ostream& out, StaticIndexLayout layout);
+
 /**
  * A static index with a fixed number of indexed entries. To change the number of entries
  * the whole index needs to be rebuilt (#rebuild(N)) providing the new size of entries.
@@ -30,13 +50,24 @@ namespace pma {
  * The node size B is determined on initialisation. A node size B actually requires B -1 slots
  * in terms of space, so it is recommended to set B to a power of 2 + 1 (e.g. 65) to fully
  * exploit aligned accesses to the cache.
+ *
+ * With the Eytzinger layout, the separator keys are rather stored as a complete binary tree, padded to the next
+ * power of 2. The descent is branchless and prefetches the great-grandchildren of the current node, which all
+ * reside in the same cache line. This layout does not depend on B, and it does not need to be tuned for the
+ * cache of the host machine.
+ *
+ * With the learned layout, the keys and the search are delegated to a LearnedIndex, where B is the number of keys
+ * covered by each linear model.
  */
 class StaticIndex {
     const uint16_t m_node_size; // number of keys per node
+    const StaticIndexLayout m_layout; // the physical layout of the keys
     int16_t m_height; // the height of this tree
     int32_t m_capacity; // the number of segments/keys in the tree
     int64_t* m_keys; // the container of the keys
+    uint64_t m_allocated_slots; // the number of slots allocated for m_keys, it can be greater than num_slots()
     int64_t m_key_minimum; // the minimum stored in the tree
+    LearnedIndex* m_learned; // the actual index with the learned layout, nullptr otherwise
 
     /**
      * Keep track of the cardinality and the height of the rightmost subtrees
@@ -52,14 +83,43 @@ protected:
     // Retrieve the slot associated to the given segment
     int64_t* get_slot(uint64_t segment_id) const;
 
+    // The number of slots allocated in the array m_keys
+    uint64_t num_slots() const;
+
+    // Ensure m_keys has at least `num_slots' slots. A buffer that is large enough is kept, unless it is much bigger than needed.
+    void ensure_allocated_slots(uint64_t num_slots);
+
+    // Eytzinger layout, set the height of the tree and pad its content
+    void rebuild_eytzinger(uint64_t num_segments);
+
+    // B-Tree layout, set the keys of the given subtree, where keys[0] is the first segment covered by the subtree
+    void fill_subtree(int64_t* root, int height, bool rightmost, const int64_t* keys);
+
+    // Set all separator keys, using up to `num_threads' workers
+    void fill(const int64_t* keys, uint64_t num_threads);
+
+    // Eytzinger layout, retrieve the number of separator keys <= key (upper = true) or < key (upper = false)
+    template<bool upper>
+    uint64_t find_eytzinger(int64_t key) const noexcept;
+
     // Dump the content of the given subtree
     void dump_subtree(std::ostream& out, int64_t* root, int height, bool rightmost, int64_t fence_min, int64_t fence_max, bool* integrity_check) const;
 
+    // Dump the separator keys stored with the Eytzinger layout
+    void dump_eytzinger(std::ostream& out, bool* integrity_check) const;
+
 public:
     /**
      * Initialise the AB-Tree with the given node size and capacity
      */
-    StaticIndex(uint64_t node_size, uint64_t num_segments = 1);
+    StaticIndex(uint64_t node_size, uint64_t num_segments = 1, StaticIndexLayout layout = StaticIndexLayout::BTREE);
+
+    /**
+     * Copy constructor, it duplicates the whole content of the index
+     */
+    StaticIndex(const StaticIndex& index);
+
+    StaticIndex& operator=(const StaticIndex&) = delete;
 
     /**
      * Destructor
@@ -71,6 +131,13 @@ public:
      */
     void rebuild(uint64_t num_segments);
 
+    /**
+     * Rebuild the tree to contain `num_segments' and set all the separator keys at once, where keys[i] is the separator
+     * key of the segment i. The keys are filled bottom-up, without traversing the tree from the root for each key, and
+     * distributed among up to `num_threads' workers when the index is large enough.
+     */
+    void rebuild(uint64_t num_segments, const int64_t* keys, uint64_t num_threads = 1);
+
     /**
      * Set the separator key associated to the given segment
      */
@@ -113,11 +180,26 @@ public:
      */
     int64_t node_size() const noexcept;
 
+    /**
+     * Retrieve the physical layout of the keys
+     */
+    StaticIndexLayout layout() const noexcept;
+
     /**
      * Retrieve the memory footprint of this index, in bytes
      */
     size_t memory_footprint() const;
 
+    /**
+     * Serialise the content of the index in the given (binary) output stream
+     */
+    void save(std::ostream& out) const;
+
+    /**
+     * Replace the content of the index with the one previously serialised with #save. The node size and the layout must match.
+     */
+    void load(std::istream& in);
+
     /**
      * Dump the fields of the index
      */
@@ -30,6 +30,12 @@ Interface::~Interface() { }
 void Interface::build(){ };
 
 
+void Interface::find_interleaved(const int64_t* keys, int64_t* values, size_t num_keys, size_t group_size) const {
+    for(size_t i = 0; i < num_keys; i++){
+        values[i] = find(keys[i]);
+    }
+}
+
 int64_t Interface::remove(int64_t key){
     RAISE_EXCEPTION(Exception, "Method ::remove(int64_t key) not supported!");
 }
@@ -19,6 +19,7 @@
 #define PMA_INTERFACE_HPP_
 
 #include <cinttypes>
+#include <cstddef>
 #include <memory>
 #include <ostream>
 #include <utility>
@@ -75,6 +76,13 @@ public:
      */
     virtual int64_t find(int64_t key) const = 0;
 
+    /**
+     * Batched lookup: store in values[i] the value associated to keys[i], or -1 if not present.
+     * Implementations based on pointer chasing may overlap the cache misses of up to `group_size'
+     * lookups at the time. By default it performs one lookup after the other with #find.
+     */
+    virtual void find_interleaved(const int64_t* keys, int64_t* values, std::size_t num_keys, std::size_t group_size) const;
+
     /**
      * Remove the element with the given `key' from the PMA. Supported only by few implementations.
      * Returns the value associated to the given `key', or -1 if not found.
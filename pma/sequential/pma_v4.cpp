@@ -27,6 +27,9 @@
 #include <stdexcept>
 #include <vector>
 
+#include "errorhandling.hpp"
+#include "mapped_memory.hpp"
+
 namespace pma {
 
 /*****************************************************************************
@@ -70,23 +73,26 @@ size_t PMA_Impl4::get_num_segments() const{
  *   Initialization                                                          *
  *                                                                           *
  *****************************************************************************/
-PMA_Impl4::PMA_Impl4() : m_elements(nullptr), m_workspace(nullptr) {
+PMA_Impl4::PMA_Impl4() : m_elements(nullptr), m_segments(nullptr), m_workspace(nullptr), m_mapped_memory(false) {
     initialize(min_capacity);
 }
 
 PMA_Impl4::~PMA_Impl4() {
-    delete[] m_elements; m_elements = nullptr;
+    free_arrays();
     delete[] m_workspace; m_workspace = nullptr;
-    delete[] m_segments; m_segments = nullptr;
 }
 
 void PMA_Impl4::initialize(size_t capacity) {
+    free_arrays();
     m_capacity = hyperceil(capacity);
     m_segment_capacity = m_capacity;
     m_height = 1;
-    if(m_elements != nullptr) { delete[] m_elements; m_elements = nullptr; }
     try {
-        m_elements = new element_t[m_capacity];
+        if(m_mapped_memory){
+            m_elements = (element_t*) mapped_memory_allocate(m_capacity * sizeof(element_t));
+        } else {
+            m_elements = new element_t[m_capacity];
+        }
     } catch( const std::bad_alloc& e){
         std::cerr << "[PMA_Impl4::initialize] Cannot allocate a new array of capacity: " << this->m_capacity << std::endl;
         throw;
@@ -96,18 +102,48 @@ void PMA_Impl4::initialize(size_t capacity) {
     if(capacity >= std::numeric_limits<uint16_t>::max()){
         throw std::runtime_error("Invalid minimum capacity");
     }
-    m_segments = new uint16_t[1]();
+    if(m_mapped_memory){
+        m_segments = (uint16_t*) mapped_memory_allocate(sizeof(uint16_t)); // zero filled
+    } else {
+        m_segments = new uint16_t[1]();
+    }
 
     m_workspace = new element_t[workspace_max_size];
 }
 
 
 
+void PMA_Impl4::free_arrays(){
+    if(m_mapped_memory){
+        mapped_memory_free(m_elements, m_capacity * sizeof(element_t));
+        mapped_memory_free(m_segments, get_num_segments() * sizeof(uint16_t));
+    } else {
+        delete[] m_elements;
+        delete[] m_segments;
+    }
+    m_elements = nullptr;
+    m_segments = nullptr;
+}
+
 void PMA_Impl4::clear(){
     m_cardinality = 0;
     initialize(min_capacity);
 }
 
+void PMA_Impl4::set_mremap_growth(bool value){
+    if(m_mapped_memory == value) return;
+    if(!empty()) RAISE_EXCEPTION(Exception, "[PMA_Impl4::set_mremap_growth] The container must be empty");
+
+    free_arrays();
+    m_mapped_memory = value;
+    delete[] m_workspace; m_workspace = nullptr; // reallocated by #initialize
+    initialize(min_capacity);
+}
+
+bool PMA_Impl4::has_mremap_growth() const {
+    return m_mapped_memory;
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Rebalance                                                               *
@@ -180,6 +216,10 @@ void PMA_Impl4::resize(){
     size_t capacity = m_capacity *2;
     COUT_DEBUG("new capacity: " << capacity);
     size_t segment_size = hyperceil(log2(capacity));
+    if(m_mapped_memory){
+        resize_inplace(capacity, segment_size);
+        return;
+    }
     size_t num_segments = capacity / segment_size;
     std::unique_ptr<element_t[]> elements_ptr{ new element_t[capacity] };
     auto* __restrict elements = elements_ptr.get();
@@ -214,6 +254,38 @@ void PMA_Impl4::resize(){
     m_height = log2(capacity / segment_size) +1;
 }
 
+void PMA_Impl4::resize_inplace(size_t capacity, size_t segment_size){
+    const size_t old_num_segments = get_num_segments();
+    const size_t num_segments = capacity / segment_size;
+    m_elements = (element_t*) mapped_memory_resize(m_elements, m_capacity * sizeof(element_t), capacity * sizeof(element_t));
+    m_segments = (uint16_t*) mapped_memory_resize(m_segments, old_num_segments * sizeof(uint16_t), num_segments * sizeof(uint16_t));
+    element_t* __restrict elements = m_elements;
+    uint16_t* __restrict segments = m_segments;
+
+    // 1) compact the elements at the end of the extended array, from right to left. The destination of a segment is never
+    // before its source, and the segments on its left have not been moved yet
+    size_t position = capacity;
+    for(size_t i = old_num_segments; i > 0; i--){
+        position -= segments[i -1];
+        element_t* source = elements + (i -1) * m_segment_capacity;
+        std::move_backward(source, source + segments[i -1], elements + position + segments[i -1]);
+    }
+    assert(position == capacity - m_cardinality);
+
+    // 2) spread the elements in the new segments, from left to right
+    size_t elements_per_segments = m_cardinality / num_segments;
+    size_t odd_segments = m_cardinality % num_segments;
+    for(size_t i = 0; i < num_segments; i++){
+        segments[i] = elements_per_segments + (i < odd_segments);
+        std::move(elements + position, elements + position + segments[i], elements + i * segment_size);
+        position += segments[i];
+    }
+
+    m_capacity = capacity;
+    m_segment_capacity = segment_size;
+    m_height = log2(capacity / segment_size) +1;
+}
+
 void PMA_Impl4::spread(size_t num_elements, size_t window_start, size_t window_length){
     std::unique_ptr<element_t[]> tmp_ptr; // delete[] tmp* when it goes out of scope
     element_t* tmp (nullptr);
@@ -42,6 +42,7 @@ private:
     size_t m_cardinality; // the number of elements contained
 
     element_t* m_workspace; // empty array used to spread elements
+    bool m_mapped_memory; // whether the arrays m_elements and m_segments are allocated with mmap, to be grown in place with mremap
 
     static const size_t min_capacity = 8; // the minimum capacity of the PMA
     static constexpr double r_0 = 0.5; // highest threshold for the lower bound
@@ -53,6 +54,11 @@ private:
      */
     void initialize(size_t capacity);
 
+    /**
+     * Release the arrays m_elements and m_segments
+     */
+    void free_arrays();
+
     /**
      * The total number of segments in the PMA
      */
@@ -81,6 +87,11 @@ private:
      */
     void resize();
 
+    /**
+     * Double the capacity of the storage by growing the arrays with mremap and moving the elements in place
+     */
+    void resize_inplace(size_t capacity, size_t segment_size);
+
     /**
      * Equally spread the elements in the interval [window_start, window_start + window_length)
      */
@@ -182,6 +193,17 @@ public:
      * Remove all elements in the array
      */
     virtual void clear();
+
+    /**
+     * Whether to allocate the storage with mmap and, on resize, grow it with mremap, moving the elements in place.
+     * The container must be empty.
+     */
+    void set_mremap_growth(bool value);
+
+    /**
+     * Check whether the storage is grown with mremap
+     */
+    bool has_mremap_growth() const;
 };
 
 } // namespace pma
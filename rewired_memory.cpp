@@ -17,17 +17,22 @@
 
 #include "rewired_memory.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h> // fallocate
 #include <iostream>
+#include <linux/falloc.h>
 #include <linux/memfd.h>
 #include <string>
 #include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
 #include <unistd.h>
 #include "configuration.hpp"
 #include "errorhandling.hpp"
 #include "miscellaneous.hpp"
+#include "rewired_memory_snapshot.hpp"
 
 using namespace std;
 
@@ -53,9 +58,9 @@ using namespace std;
  *****************************************************************************/
 static int g_internal_id = 0;
 
-RewiredMemory::RewiredMemory(size_t pages_per_extent, size_t num_extents, size_t max_memory) :
+RewiredMemory::RewiredMemory(size_t pages_per_extent, size_t num_extents, size_t max_memory, const string& directory) :
         m_page_size(get_memory_page_size()), m_num_pages_per_extent(pages_per_extent), m_start_address(nullptr),
-        m_handle_physical_memory(-1), m_max_memory(max_memory){
+        m_handle_physical_memory(-1), m_max_memory(max_memory), m_physical_extents(num_extents){
     // validate the user parameters
     if(pages_per_extent <= 0){ throw invalid_argument("[RewiredMemory::ctor] pages_per_extent <= 0"); }
     if(num_extents <= 0){ throw invalid_argument("[RewiredMemory::ctor] num_extents <= 0"); }
@@ -68,17 +73,75 @@ RewiredMemory::RewiredMemory(size_t pages_per_extent, size_t num_extents, size_t
     }
 
     // create the handle to the physical memory
-    string id = "rewired_memory_";
-    id += to_string(g_internal_id++);
-    m_handle_physical_memory = memfd_create(id.c_str(), configuration::use_huge_pages() ? MFD_HUGETLB : 0); // miscellaneous.hpp
-    if(m_handle_physical_memory < 0){ RAISE("Cannot allocate the physical memory. memfd_create error: " << strerror(errno) << "(" << errno << ")"); }
+    if(directory.empty()){
+        string id = "rewired_memory_";
+        id += to_string(g_internal_id++);
+        m_handle_physical_memory = memfd_create(id.c_str(), configuration::use_huge_pages() ? MFD_HUGETLB : 0); // miscellaneous.hpp
+        if(m_handle_physical_memory < 0){ RAISE("Cannot allocate the physical memory. memfd_create error: " << strerror(errno) << "(" << errno << ")"); }
+    } else {
+        // the file does not have a name until #save is invoked, so that it is automatically removed if the process terminates
+        m_handle_physical_memory = open(directory.c_str(), O_TMPFILE | O_RDWR, S_IRUSR | S_IWUSR);
+        if(m_handle_physical_memory < 0){ RAISE("Cannot create the physical memory in the directory `" << directory << "'. open error: " << strerror(errno) << "(" << errno << ")"); }
+        m_file_backed = true;
+    }
 
     // allocate the physical memory
     COUT_DEBUG("Pages per extent: " << pages_per_extent << ", num_extents: " << num_extents << ", extent size: " << get_extent_size() << " bytes, physical memory requested: " << size_physical_memory << ", virtual memory reserved: " << get_max_memory() << " bytes");
     rc = ftruncate(m_handle_physical_memory, size_physical_memory);
-    if(rc != 0){ RAISE("Cannot allocate the physical memory. ftruncate error: " << strerror(errno) << "(" << errno << ")"); }
+    if(rc != 0){
+        close(m_handle_physical_memory); m_handle_physical_memory = -1;
+        RAISE("Cannot allocate the physical memory. ftruncate error: " << strerror(errno) << "(" << errno << ")");
+    }
+
+    // create the translation map
+    m_translation_map.reserve(num_extents);
+    for(size_t i = 0; i < num_extents; i++){
+        m_translation_map.push_back(i);
+    }
+    m_physical_refcount.assign(num_extents, 1);
 
     // memory map the physical memory to a virtual address
+    map_virtual_memory();
+}
+
+RewiredMemory::RewiredMemory(const string& path, size_t pages_per_extent, const vector<uint32_t>& translation_map, size_t max_memory) :
+        m_page_size(get_memory_page_size()), m_num_pages_per_extent(pages_per_extent), m_start_address(nullptr),
+        m_handle_physical_memory(-1), m_translation_map(translation_map), m_max_memory(max_memory), m_physical_extents(0), m_file_backed(true){
+    // validate the user parameters
+    if(pages_per_extent <= 0){ throw invalid_argument("[RewiredMemory::ctor] pages_per_extent <= 0"); }
+    if(translation_map.empty()){ throw invalid_argument("[RewiredMemory::ctor] empty translation map"); }
+    if(get_allocated_memory_size() > get_max_memory()){
+        RAISE("Cannot map " << get_allocated_memory_size() << " bytes. The maximum amount of reserved virtual memory specified for this instance is: " << get_max_memory() << " bytes.");
+    }
+
+    m_handle_physical_memory = open(path.c_str(), O_RDWR);
+    if(m_handle_physical_memory < 0){ RAISE("Cannot open the file `" << path << "': " << strerror(errno) << "(" << errno << ")"); }
+    auto onErrorDeleter = [this](void*){ close(m_handle_physical_memory); m_handle_physical_memory = -1; };
+    unique_ptr<RewiredMemory, decltype(onErrorDeleter)> onError{this, onErrorDeleter};
+
+    struct stat file_info;
+    if(fstat(m_handle_physical_memory, &file_info) != 0){ RAISE("Cannot retrieve the size of the file `" << path << "': " << strerror(errno) << "(" << errno << ")"); }
+    if(file_info.st_size % get_extent_size() != 0){ RAISE("The size of the file `" << path << "' is not a multiple of the extent size: " << file_info.st_size << " bytes"); }
+    m_physical_extents = file_info.st_size / get_extent_size();
+
+    // rebuild the reference counts from the translation map. The extents that were only referenced by snapshots become free
+    m_physical_refcount.assign(m_physical_extents, 0);
+    for(auto pextent : m_translation_map){
+        if(pextent >= m_physical_extents){ RAISE("Invalid translation map for the file `" << path << "': physical extent " << pextent << " out of bounds"); }
+        if(m_physical_refcount[pextent] > 0){ RAISE("Invalid translation map for the file `" << path << "': physical extent " << pextent << " mapped twice"); }
+        m_physical_refcount[pextent] = 1;
+    }
+    for(size_t pextent = m_physical_extents; pextent-- > 0; ){
+        if(m_physical_refcount[pextent] == 0){ m_physical_free_list.push_back(pextent); }
+    }
+
+    map_virtual_memory();
+    COUT_DEBUG("path: " << path << ", virtual extents: " << get_allocated_extents() << ", physical extents: " << m_physical_extents << ", free extents: " << m_physical_free_list.size());
+
+    onError.release();
+}
+
+void RewiredMemory::map_virtual_memory(){
     void* mmap_ret = mmap(
         /* starting address, NULL means arbitrary */ NULL,
         /* length in bytes */ get_max_memory(),
@@ -93,15 +156,31 @@ RewiredMemory::RewiredMemory(size_t pages_per_extent, size_t num_extents, size_t
      * the kernel will throw a SIGBUS interruption
      */
 
-    // create the translation map
-    m_translation_map.reserve(num_extents);
-    for(size_t i = 0; i < num_extents; i++){
-        m_translation_map.push_back(i);
+    // the region is mapped with the identity, fix the virtual extents that refer to a different physical extent,
+    // coalescing the consecutive extents into a single mmap
+    const size_t extent_size = get_extent_size();
+    size_t i = 0;
+    while(i < m_translation_map.size()){
+        if(m_translation_map[i] == i){ i++; continue; }
+        size_t j = i +1;
+        while(j < m_translation_map.size() && m_translation_map[j] == m_translation_map[i] + (j - i)){ j++; }
+
+        char* vaddress = (char*) m_start_address + i * extent_size;
+        mmap_ret = mmap(vaddress, (j - i) * extent_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_handle_physical_memory, m_translation_map[i] * extent_size);
+        if(mmap_ret == MAP_FAILED){
+            munmap(m_start_address, get_max_memory()); m_start_address = nullptr;
+            RAISE("rewiring failed: " << (void*) vaddress << " -> physical extent " << m_translation_map[i] << ", " << strerror(errno) << " (" << errno << ")");
+        }
+
+        i = j;
     }
 }
 
-
 RewiredMemory::~RewiredMemory(){
+    // the snapshots keep their own mapping of the physical memory, they only need to stop referring to this instance
+    for(auto snapshot : m_snapshots){ snapshot->detach(); }
+    m_snapshots.clear();
+
     // release the managed virtual memory
     if(m_start_address != nullptr){
         int rc = munmap(m_start_address, get_max_memory());
@@ -191,13 +270,170 @@ void RewiredMemory::extend(size_t num_extents){
                "Allocated size: " << get_allocated_memory_size() << " bytes, requested size: " << memory_in_bytes);
     }
 
-    int rc = ftruncate(m_handle_physical_memory, memory_in_bytes);
-    if(rc != 0){ RAISE("Cannot allocate the physical memory: " << memory_in_bytes << " bytes. ftruncate error: " << strerror(errno) << "(" << errno << ")"); }
+    // the physical extent with the same offset of a new virtual extent may be already in use by a snapshot or
+    // a copy on write. In this case, recycle a free extent, or append a new one, and rewire it explicitly
+    const size_t start_fd = m_translation_map.size();
+    size_t physical_extents = m_physical_extents;
+    size_t free_list_sz = m_physical_free_list.size();
+    std::vector<uint32_t> plan; plan.reserve(num_extents);
+    for(size_t i = 0; i < num_extents; i++){
+        size_t vextent = start_fd + i;
+        if(vextent >= physical_extents || free_list_sz == 0){
+            plan.push_back(physical_extents++);
+        } else {
+            plan.push_back(m_physical_free_list[--free_list_sz]);
+        }
+    }
+
+    if(physical_extents > m_physical_extents){
+        int rc = ftruncate(m_handle_physical_memory, physical_extents * get_extent_size());
+        if(rc != 0){ RAISE("Cannot allocate the physical memory: " << physical_extents * get_extent_size() << " bytes. ftruncate error: " << strerror(errno) << "(" << errno << ")"); }
+        m_physical_extents = physical_extents;
+        m_physical_refcount.resize(physical_extents, 0);
+    }
+    m_physical_free_list.resize(free_list_sz);
 
-    size_t start_fd = m_translation_map.size();
     m_translation_map.reserve(get_allocated_extents() + num_extents);
     for(size_t i = 0; i < num_extents; i++){
-        m_translation_map.push_back(start_fd +i);
+        size_t pextent = plan[i];
+        if(pextent != start_fd + i){ remap((char*) get_start_address() + (start_fd + i) * get_extent_size(), pextent); }
+        m_translation_map.push_back(pextent);
+        m_physical_refcount[pextent] = 1;
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Snapshots                                                               *
+ *                                                                           *
+ *****************************************************************************/
+
+void RewiredMemory::remap(void* address, size_t physical_extent){
+    void* mmap_ret = mmap(address, get_extent_size(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_handle_physical_memory, physical_extent * get_extent_size());
+    if(mmap_ret == MAP_FAILED){
+        RAISE("rewiring failed: " << address << " -> physical extent " << physical_extent << ", " << strerror(errno) << " (" << errno << ")");
+    }
+}
+
+size_t RewiredMemory::acquire_physical_extent(){
+    size_t result;
+    if(!m_physical_free_list.empty()){
+        result = m_physical_free_list.back();
+        m_physical_free_list.pop_back();
+    } else {
+        int rc = ftruncate(m_handle_physical_memory, (m_physical_extents +1) * get_extent_size());
+        if(rc != 0){ RAISE("Cannot allocate the physical memory: " << (m_physical_extents +1) * get_extent_size() << " bytes. ftruncate error: " << strerror(errno) << "(" << errno << ")"); }
+        result = m_physical_extents++;
+        m_physical_refcount.push_back(0);
+    }
+
+    assert(m_physical_refcount[result] == 0 && "The physical extent is still referenced");
+    m_physical_refcount[result] = 1;
+    return result;
+}
+
+void RewiredMemory::release_physical_extent(size_t physical_extent){
+    assert(physical_extent < m_physical_extents);
+    assert(m_physical_refcount[physical_extent] > 0 && "Not referenced");
+    m_physical_refcount[physical_extent]--;
+
+    if(m_physical_refcount[physical_extent] == 0){
+        // give the memory back to the O.S., the content of the extent is not needed anymore
+        int rc = fallocate(m_handle_physical_memory, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, physical_extent * get_extent_size(), get_extent_size());
+        if(rc != 0){ COUT_DEBUG("fallocate error: " << strerror(errno) << " (" << errno << ")"); } // not critical, the extent is recycled anyway
+
+        m_physical_free_list.push_back(physical_extent);
+    }
+}
+
+void RewiredMemory::copy_on_write(void* address, size_t length, bool preserve_content){
+    if(length == 0) return;
+    char* start_address = (char*) get_start_address();
+    size_t extent_start = ((char*) address - start_address) / get_extent_size();
+    size_t extent_end = ((char*) address - start_address + length + get_extent_size() -1) / get_extent_size(); // excl.
+    if((char*) address < start_address || extent_end > get_allocated_extents()){
+        RAISE("Invalid range: [" << address << ", " << (void*) ((char*) address + length) << ") is not mapped. Start address: " << (void*) start_address << ", " <<
+                "end address: " << (void*) (start_address + get_allocated_memory_size()));
+    }
+
+    for(size_t vextent = extent_start; vextent < extent_end; vextent++){
+        size_t pextent_old = m_translation_map[vextent];
+        if(m_physical_refcount[pextent_old] == 1) continue; // the extent is not shared with any snapshot
+        COUT_DEBUG("copy on write, virtual extent: " << vextent << ", physical extent: " << pextent_old);
+
+        char* vaddress = start_address + vextent * get_extent_size();
+        size_t pextent_new = acquire_physical_extent();
+        if(preserve_content){
+            void* copy = mmap(NULL, get_extent_size(), PROT_READ | PROT_WRITE, MAP_SHARED, m_handle_physical_memory, pextent_new * get_extent_size());
+            if(copy == MAP_FAILED){ RAISE("Cannot map the physical extent " << pextent_new << ": " << strerror(errno) << " (" << errno << ")"); }
+            memcpy(copy, vaddress, get_extent_size());
+            munmap(copy, get_extent_size());
+        }
+        remap(vaddress, pextent_new);
+        m_translation_map[vextent] = pextent_new;
+        release_physical_extent(pextent_old); // still referenced by the snapshot
+    }
+}
+
+std::unique_ptr<RewiredMemorySnapshot> RewiredMemory::snapshot(size_t num_extents){
+    return make_unique<RewiredMemorySnapshot>(this, num_extents);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Persistence                                                             *
+ *                                                                           *
+ *****************************************************************************/
+
+void RewiredMemory::save(const string& path){
+    if(!is_file_backed()) RAISE("The physical memory is not backed by a file");
+    int rc = 0;
+
+    // flush the dirty pages
+    rc = msync(get_start_address(), get_allocated_memory_size(), MS_SYNC);
+    if(rc != 0){ RAISE("Cannot flush the memory mapping. msync error: " << strerror(errno) << " (" << errno << ")"); }
+    rc = fsync(m_handle_physical_memory);
+    if(rc != 0){ RAISE("Cannot flush the physical memory. fsync error: " << strerror(errno) << " (" << errno << ")"); }
+
+    // give a name to the file. Link it to a temporary name first, as linkat() cannot replace an existing file
+    string path_tmp = path + ".tmp";
+    string path_fd = "/proc/self/fd/" + to_string(m_handle_physical_memory);
+    unlink(path_tmp.c_str()); // leftover of a previous attempt
+    rc = linkat(AT_FDCWD, path_fd.c_str(), AT_FDCWD, path_tmp.c_str(), AT_SYMLINK_FOLLOW);
+    if(rc != 0){ RAISE("Cannot link the physical memory to the file `" << path_tmp << "'. linkat error: " << strerror(errno) << " (" << errno << ")"); }
+    rc = rename(path_tmp.c_str(), path.c_str());
+    if(rc != 0){ RAISE("Cannot rename the file `" << path_tmp << "' into `" << path << "'. rename error: " << strerror(errno) << " (" << errno << ")"); }
+    unlink(path_tmp.c_str()); // rename() is a nop when both names already refer to the same file
+
+    COUT_DEBUG("path: " << path << ", virtual extents: " << get_allocated_extents() << ", physical extents: " << m_physical_extents);
+}
+
+void RewiredMemory::prefetch(void* address, size_t length){
+    int rc = madvise(address, length, MADV_WILLNEED);
+    if(rc != 0){ COUT_DEBUG("madvise error: " << strerror(errno) << " (" << errno << ")"); } // only a hint
+}
+
+void RewiredMemory::evict(void* address, size_t length, bool writeback){
+    if(!is_file_backed()) RAISE("The physical memory is not backed by a file");
+    validate_address(address);
+    if(length % get_extent_size() != 0) RAISE("The length is not a multiple of the extent size: " << length);
+    int rc = 0;
+
+    if(writeback){
+        rc = msync(address, length, MS_SYNC);
+        if(rc != 0){ RAISE("Cannot flush the memory mapping. msync error: " << strerror(errno) << " (" << errno << ")"); }
+    }
+
+    // remove the pages from the address space of the process ...
+    rc = madvise(address, length, MADV_DONTNEED);
+    if(rc != 0){ RAISE("Cannot release the memory mapping. madvise error: " << strerror(errno) << " (" << errno << ")"); }
+
+    // ... and from the page cache. Dirty pages are not dropped by the kernel, they are only released once written back
+    size_t extent_start = ((char*) address - (char*) get_start_address()) / get_extent_size();
+    size_t extent_end = extent_start + length / get_extent_size();
+    for(size_t vextent = extent_start; vextent < extent_end; vextent++){
+        rc = posix_fadvise(m_handle_physical_memory, m_translation_map[vextent] * get_extent_size(), get_extent_size(), POSIX_FADV_DONTNEED);
+        if(rc != 0){ COUT_DEBUG("fadvise error: " << strerror(rc) << " (" << rc << ")"); } // only a hint
     }
 }
 
@@ -226,3 +462,7 @@ size_t RewiredMemory::get_max_memory() const noexcept {
     return m_max_memory;
 }
 
+size_t RewiredMemory::get_physical_memory_size() const noexcept {
+    return (m_physical_extents - m_physical_free_list.size()) * get_extent_size();
+}
+
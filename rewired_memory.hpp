@@ -19,24 +19,35 @@
 
 #include <cinttypes>
 #include <cstddef>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "errorhandling.hpp"
 
 DEFINE_EXCEPTION(RewiredMemoryException);
 
+class RewiredMemorySnapshot; // forward decl.
+
 /**
  * It represents a single large section of memory mapped memory. The memory is split in extents, multiple
  * of a virtual page. Extents within the mapped memory can be rewired, exchanging the mapping
  * between their virtual addresses and the underlying physical memory.
  */
 class RewiredMemory{
+    friend class RewiredMemorySnapshot;
+
     const size_t m_page_size; // virtual memory page size, for the underlying architecture
     const size_t m_num_pages_per_extent; // number of pages that compose an extent
     void* m_start_address; // the start address in virtual memory of the reserved region
     int m_handle_physical_memory; // the handle to the allocated physical memory, as file descriptor
     std::vector<uint32_t> m_translation_map; // an array, given an offset in virtual memory, returns the offset
     const size_t m_max_memory; // the maximum amount of virtual memory reserved for the memory mapping, in bytes
+    size_t m_physical_extents; // the number of extents allocated in the physical memory, it can be greater than the virtual extents while snapshots are alive
+    std::vector<uint32_t> m_physical_refcount; // for each physical extent, the number of references from the translation map and the live snapshots
+    std::vector<uint32_t> m_physical_free_list; // physical extents that are not referenced anymore and can be recycled
+    std::vector<RewiredMemorySnapshot*> m_snapshots; // the snapshots currently alive
+    bool m_file_backed = false; // whether the physical memory is a file on disk, rather than anonymous memory
 
     /**
      * Raise an exception if the given address is not valid:
@@ -44,14 +55,52 @@ class RewiredMemory{
      * - it is not part of the memory space handled by this instance
      */
     void validate_address(void* address);
+
+    /**
+     * Map the physical extent `physical_extent' to the virtual address `address'
+     */
+    void remap(void* address, size_t physical_extent);
+
+    /**
+     * Get a physical extent not referenced by anyone, either from the free list or extending the physical memory
+     */
+    size_t acquire_physical_extent();
+
+    /**
+     * Decrease the reference count of the given physical extent, recycling it when it is not referenced anymore
+     */
+    void release_physical_extent(size_t physical_extent);
+
+    /**
+     * Move the extents in the range [address, address + length) to private physical extents, as they are
+     * shared with a live snapshot.
+     */
+    void copy_on_write(void* address, size_t length, bool preserve_content);
+
+    /**
+     * Reserve the virtual memory region and map the physical memory according to the translation map
+     */
+    void map_virtual_memory();
+
 public:
     /**
      * Allocate a single segment of mapped memory
      * @param pages_per_extent it defines the size of a single extents, in terms of virtual pages
      * @param the amount of extents to allocate
      * @param max_memory the maximum amount of virtual memory that can be reserved by this instance, in bytes
+     * @param directory when not empty, the physical memory is backed by an unnamed file in the given directory (e.g. a
+     *        SSD, tmpfs or DAX mount point) rather than anonymous memory. The file can be made persistent with #save
+     */
+    RewiredMemory(size_t pages_per_extent, size_t num_extents, size_t max_memory = (1ull << 35) /* 2^35 = 32 GB */, const std::string& directory = "");
+
+    /**
+     * Restore the memory region previously persisted with #save in the file `path'
+     * @param path the file containing the physical memory
+     * @param pages_per_extent the size of a single extent, it must be the same used when the file was saved
+     * @param translation_map the translation map of the instance at the time it was saved
+     * @param max_memory the maximum amount of virtual memory that can be reserved by this instance, in bytes
      */
-    RewiredMemory(size_t pages_per_extent, size_t num_extents, size_t max_memory = (1ull << 35) /* 2^35 = 32 GB */);
+    RewiredMemory(const std::string& path, size_t pages_per_extent, const std::vector<uint32_t>& translation_map, size_t max_memory = (1ull << 35) /* 2^35 = 32 GB */);
 
     /**
      * Destructor. Release the managed resources
@@ -92,6 +141,63 @@ public:
      * Retrieve the maximum amount of memory that can be allocated, in bytes
      */
     size_t get_max_memory() const noexcept;
+
+    /**
+     * Retrieve the amount of physical memory in use, in bytes. It includes the extents only referenced by the live snapshots.
+     */
+    size_t get_physical_memory_size() const noexcept;
+
+    /**
+     * Create a read-only view of the first `num_extents' extents, as they are at the time of this call.
+     * While the snapshot is alive, the writer must invoke #prepare_write before altering the content
+     * of an extent.
+     */
+    std::unique_ptr<RewiredMemorySnapshot> snapshot(size_t num_extents);
+
+    /**
+     * Check whether there are live snapshots of this memory region
+     */
+    bool has_snapshots() const noexcept { return !m_snapshots.empty(); }
+
+    /**
+     * Notify that the extents in the range [address, address + length) are about to be modified. If any
+     * of these extents is still referenced by a live snapshot, the writer is moved to a private copy of it.
+     * When `preserve_content' is false, the content of the private copy is left undefined.
+     */
+    void prepare_write(void* address, size_t length, bool preserve_content = true){
+        if(has_snapshots()) copy_on_write(address, length, preserve_content);
+    }
+
+    /**
+     * Check whether the physical memory is backed by a file, rather than anonymous memory
+     */
+    bool is_file_backed() const noexcept { return m_file_backed; }
+
+    /**
+     * Flush the physical memory to its file and make it durable under the name `path', replacing any existing file.
+     * The current translation map, see #get_translation_map, is required to restore the instance.
+     * Precondition: the physical memory is backed by a file
+     */
+    void save(const std::string& path);
+
+    /**
+     * Retrieve the current mapping between virtual extents and physical extents
+     */
+    const std::vector<uint32_t>& get_translation_map() const noexcept { return m_translation_map; }
+
+    /**
+     * Hint the kernel to read ahead the extents in the range [address, address + length), issuing sequential reads
+     * of the underlying file. It is only a hint, the content is loaded anyway on the first access.
+     */
+    void prefetch(void* address, size_t length);
+
+    /**
+     * Release the pages of the extents in the range [address, address + length) from main memory. When `writeback'
+     * is true, the content is first flushed to the underlying file. The content is not lost, it is read back from the
+     * file on the next access.
+     * Precondition: the physical memory is backed by a file
+     */
+    void evict(void* address, size_t length, bool writeback = true);
 };
 
 
@@ -0,0 +1,129 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rewired_memory_snapshot.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h> // mmap
+#include "errorhandling.hpp"
+#include "rewired_memory.hpp"
+
+using namespace std;
+
+#define RAISE(msg) RAISE_EXCEPTION(RewiredMemoryException, msg)
+
+/*****************************************************************************
+ *                                                                           *
+ *   Debug                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) std::cout << "[RewiredMemorySnapshot::" << __FUNCTION__ << "] " << msg << std::endl
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+RewiredMemorySnapshot::RewiredMemorySnapshot(RewiredMemory* instance, size_t num_extents) :
+        m_instance(instance), m_start_address(nullptr), m_extent_size(instance != nullptr ? instance->get_extent_size() : 0) {
+    if(instance == nullptr){ throw invalid_argument("[RewiredMemorySnapshot::ctor] null instance"); }
+    if(num_extents == 0){ throw invalid_argument("[RewiredMemorySnapshot::ctor] num_extents == 0"); }
+    if(num_extents > instance->get_allocated_extents()){
+        RAISE("Cannot create a snapshot of " << num_extents << " extents, the source only contains " << instance->get_allocated_extents() << " extents");
+    }
+    const int fd = instance->m_handle_physical_memory;
+
+    // freeze the translation map
+    m_translation_map.assign(instance->m_translation_map.begin(), instance->m_translation_map.begin() + num_extents);
+
+    // reserve the virtual space with a mapping of the same file, to obtain an address aligned as the (possibly huge) pages of the source
+    void* mmap_ret = mmap(NULL, get_size(), PROT_READ, MAP_SHARED, fd, 0);
+    if(mmap_ret == MAP_FAILED){ RAISE("Cannot reserve the virtual memory: " << get_size() << " bytes. mmap error: " << strerror(errno) << "(" << errno << ")"); }
+    m_start_address = mmap_ret;
+
+    // map the physical extents, coalescing the runs of consecutive extents
+    size_t i = 0;
+    while(i < num_extents){
+        size_t j = i +1;
+        while(j < num_extents && m_translation_map[j] == m_translation_map[j -1] +1) j++;
+        COUT_DEBUG("virtual extents [" << i << ", " << j << ") -> physical extents [" << m_translation_map[i] << ", " << m_translation_map[i] + (j - i) << ")");
+
+        if(m_translation_map[i] != i){ // otherwise already mapped by the reservation
+            mmap_ret = mmap((char*) m_start_address + i * m_extent_size, (j - i) * m_extent_size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, m_translation_map[i] * m_extent_size);
+            if(mmap_ret == MAP_FAILED){
+                munmap(m_start_address, get_size()); m_start_address = nullptr;
+                RAISE("Cannot map the physical extents [" << m_translation_map[i] << ", " << m_translation_map[i] + (j - i) << "): " << strerror(errno) << "(" << errno << ")");
+            }
+        }
+
+        i = j;
+    }
+
+    // pin the physical extents, from now on the writer needs to copy them before altering their content
+    for(auto pextent : m_translation_map){ instance->m_physical_refcount[pextent]++; }
+    instance->m_snapshots.push_back(this);
+}
+
+RewiredMemorySnapshot::~RewiredMemorySnapshot(){
+    if(m_start_address != nullptr){
+        int rc = munmap(m_start_address, get_size());
+        if(rc < 0){
+            cerr << "[RewiredMemorySnapshot::dtor] Error in releasing the virtual memory, munmap error: " << strerror(errno) << " (" << errno << ")" << endl;
+        }
+        m_start_address = nullptr;
+    }
+
+    if(m_instance != nullptr){
+        for(auto pextent : m_translation_map){ m_instance->release_physical_extent(pextent); }
+        auto& snapshots = m_instance->m_snapshots;
+        snapshots.erase(std::remove(begin(snapshots), end(snapshots), this), end(snapshots));
+        m_instance = nullptr;
+    }
+}
+
+void RewiredMemorySnapshot::detach() noexcept {
+    m_instance = nullptr;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Observers                                                               *
+ *                                                                           *
+ *****************************************************************************/
+
+const void* RewiredMemorySnapshot::get_start_address() const noexcept {
+    return m_start_address;
+}
+
+size_t RewiredMemorySnapshot::get_size() const noexcept {
+    return get_num_extents() * m_extent_size;
+}
+
+size_t RewiredMemorySnapshot::get_num_extents() const noexcept {
+    return m_translation_map.size();
+}
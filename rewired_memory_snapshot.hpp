@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef REWIRED_MEMORY_SNAPSHOT_HPP_
+#define REWIRED_MEMORY_SNAPSHOT_HPP_
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+class RewiredMemory; // forward decl.
+
+/**
+ * A read-only view of a RewiredMemory instance, frozen at the time of its creation. The snapshot maps the same
+ * physical extents of the source a second time. While the snapshot is alive, the source moves the writer to a
+ * private copy of an extent before modifying it (see RewiredMemory::prepare_write), so that the content seen
+ * through the snapshot never changes.
+ *
+ * The snapshot can outlive its source: the physical memory is released by the O.S. only once both the source
+ * and all its snapshots have been unmapped.
+ */
+class RewiredMemorySnapshot {
+    friend class RewiredMemory;
+
+    RewiredMemory* m_instance; // the source of this snapshot, or nullptr if it has already been destroyed
+    void* m_start_address; // the start address of the read-only mapping
+    const size_t m_extent_size; // the size of a single extent, in bytes
+    std::vector<uint32_t> m_translation_map; // the frozen translation map, from the virtual to the physical extents
+
+    /**
+     * Invoked by the source when it is about to be destroyed
+     */
+    void detach() noexcept;
+
+public:
+    /**
+     * Create a snapshot of the first `num_extents' extents of the given instance. Use RewiredMemory::snapshot.
+     */
+    RewiredMemorySnapshot(RewiredMemory* instance, size_t num_extents);
+
+    /**
+     * Destructor. Release the physical extents still pinned in the source
+     */
+    ~RewiredMemorySnapshot();
+
+    /**
+     * Retrieve the start address of the read-only view
+     */
+    const void* get_start_address() const noexcept;
+
+    /**
+     * Retrieve the size of the view, in bytes
+     */
+    size_t get_size() const noexcept;
+
+    /**
+     * Retrieve the number of extents in the view
+     */
+    size_t get_num_extents() const noexcept;
+};
+
+#endif /* REWIRED_MEMORY_SNAPSHOT_HPP_ */
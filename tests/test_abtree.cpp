@@ -7,14 +7,20 @@
  *      Author: dleo@cwi.nl
  */
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <random>
 #include <utility>
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include "third-party/catch/catch.hpp"
 
 #include "abtree/abtree.hpp"
+#include "abtree/slab_allocator.hpp"
 
 using namespace abtree;
 using namespace pma;
@@ -231,3 +237,312 @@ TEST_CASE("Delete_Sequential"){
 
     REQUIRE(b.size() == 0);
 }
+
+TEST_CASE("Bloom_filters"){
+    const int64_t cardinality = 10000;
+    ABTree b{4, 8, 8, 16};
+    b.set_bloom_filters(true);
+
+    // insert the odd keys in a random order
+    vector<int64_t> keys;
+    for(int64_t i = 0; i < cardinality; i++){ keys.push_back(2 * i + 1); }
+    mt19937_64 random_generator{42};
+    shuffle(keys.begin(), keys.end(), random_generator);
+    for(auto key : keys){ b.insert(key, key * 10); }
+    REQUIRE(b.size() == cardinality);
+
+    // no false negatives, the even keys are absent
+    for(int64_t key = 0; key <= 2 * cardinality; key++){
+        REQUIRE(b.find(key) == ((key % 2 == 1) ? key * 10 : -1));
+    }
+
+    // merges & rotations move the keys among the leaves
+    for(int64_t i = 0; i < cardinality / 2; i++){ REQUIRE(b.remove(keys[i]) == keys[i] * 10); }
+    b.remove(cardinality, cardinality + cardinality / 4);
+    for(int64_t i = 0; i < cardinality; i++){
+        int64_t key = keys[i];
+        bool removed = i < cardinality / 2 || (key >= cardinality && key <= cardinality + cardinality / 4);
+        REQUIRE(b.find(key) == (removed ? -1 : key * 10));
+    }
+
+    // bulk load
+    REQUIRE_THROWS(b.set_bloom_filters(false)); // not empty
+    ABTree b2{4, 8, 8, 16};
+    b2.set_bloom_filters(true);
+    vector<pair<int64_t, int64_t>> elements;
+    for(int64_t i = 0; i < cardinality; i++){ elements.emplace_back(2 * i + 1, (2 * i + 1) * 10); }
+    b2.load(elements.data(), elements.size());
+    for(int64_t key = 0; key <= 2 * cardinality; key++){
+        REQUIRE(b2.find(key) == ((key % 2 == 1) ? key * 10 : -1));
+    }
+}
+
+TEST_CASE("Slab_allocator"){
+    { // the allocator alone
+        SlabAllocator allocator { 100 };
+        vector<void*> objects;
+        for(int i = 0; i < 20000; i++){
+            objects.push_back(allocator.allocate());
+            REQUIRE(reinterpret_cast<uintptr_t>(objects.back()) % 64 == 0);
+            memset(objects.back(), 0xFF, 100);
+        }
+        REQUIRE(allocator.num_chunks() == 2); // 128 bytes per object, 16383 objects per chunk
+
+        // the released objects are recycled LIFO
+        allocator.deallocate(objects[10]);
+        allocator.deallocate(objects[20]);
+        REQUIRE(allocator.allocate(objects[5]) == objects[20]);
+        REQUIRE(allocator.allocate(objects[5]) == objects[10]);
+
+        // empty chunks are released
+        for(auto object : objects){ allocator.deallocate(object); }
+        REQUIRE(allocator.num_chunks() == 1);
+    }
+
+    // a tree backed by the slab allocator
+    const int64_t cardinality = 100000;
+    ABTree b{4, 8, 8, 16};
+    b.set_slab_allocator(true);
+    vector<int64_t> keys;
+    for(int64_t i = 1; i <= cardinality; i++){ keys.push_back(i); }
+    mt19937_64 random_generator{42};
+    shuffle(keys.begin(), keys.end(), random_generator);
+    for(auto key : keys){ b.insert(key, key * 10); }
+    b.validate();
+    for(int64_t key = 1; key <= cardinality; key++){ REQUIRE(b.find(key) == key * 10); }
+    for(int64_t i = 0; i < cardinality / 2; i++){ REQUIRE(b.remove(keys[i]) == keys[i] * 10); }
+    b.validate();
+    auto sum = b.sum(0, cardinality);
+    REQUIRE(sum.m_num_elements == cardinality / 2);
+    for(int64_t i = cardinality / 2; i < cardinality; i++){ REQUIRE(b.remove(keys[i]) == keys[i] * 10); }
+    REQUIRE(b.size() == 0);
+
+    // bulk load, with both the slab allocator and the Bloom filters
+    ABTree b2{4, 8, 8, 16};
+    b2.set_slab_allocator(true);
+    b2.set_bloom_filters(true);
+    vector<pair<int64_t, int64_t>> elements;
+    for(int64_t i = 1; i <= cardinality; i++){ elements.emplace_back(2 * i, 2 * i * 10); }
+    b2.load(elements.data(), elements.size());
+    for(int64_t key = 1; key <= 2 * cardinality; key++){ REQUIRE(b2.find(key) == ((key % 2 == 0) ? key * 10 : -1)); }
+}
+
+TEST_CASE("Defragmentation"){
+    { // sequential allocations from the slab allocator
+        SlabAllocator allocator { 100 };
+        vector<void*> objects;
+        for(int i = 0; i < 1000; i++){ objects.push_back(allocator.allocate()); }
+        char* previous = reinterpret_cast<char*>(allocator.allocate_sequential());
+        for(int i = 0; i < 1000; i++){
+            allocator.deallocate(previous); // the released slots are not reused until the end of the sequence
+            char* current = reinterpret_cast<char*>(allocator.allocate_sequential());
+            REQUIRE(current == previous + 128);
+            previous = current;
+        }
+        allocator.end_sequential();
+        REQUIRE(allocator.allocate(previous) != previous + 128); // no longer reserved
+        for(auto object : objects){ allocator.deallocate(object); }
+    }
+
+    const int64_t cardinality = 100000;
+    ABTree b{4, 8, 8, 16};
+    b.set_slab_allocator(true);
+    b.set_bloom_filters(true);
+    vector<int64_t> keys;
+    for(int64_t i = 1; i <= cardinality; i++){ keys.push_back(i); }
+    mt19937_64 random_generator{42};
+    shuffle(keys.begin(), keys.end(), random_generator);
+
+    // interleave the updates with the online defragmentation
+    b.set_defragmentation_rate(2);
+    for(auto key : keys){ b.insert(key, key * 10); }
+    for(int64_t i = 0; i < cardinality / 2; i++){ REQUIRE(b.remove(keys[i]) == keys[i] * 10); }
+    b.validate();
+    for(int64_t i = 0; i < cardinality; i++){ REQUIRE(b.find(keys[i]) == ((i < cardinality / 2) ? -1 : keys[i] * 10)); }
+    auto sum = b.sum(0, cardinality);
+    REQUIRE(sum.m_num_elements == cardinality / 2);
+
+    // a whole pass places the leaves at ascending addresses
+    b.set_defragmentation_rate(0);
+    for(int64_t i = 0; i < cardinality / 2; i++){ b.insert(keys[i], keys[i] * 10); }
+    auto stats_before = b.get_stats_leaf_distance();
+    b.defragment();
+    b.validate();
+    auto stats_after = b.get_stats_leaf_distance();
+    REQUIRE(stats_after.m_num_leaves == stats_before.m_num_leaves);
+    REQUIRE(stats_after.m_distance_avg < stats_before.m_distance_avg);
+    REQUIRE(stats_after.m_distance_median <= 320); // the size of a slot
+    for(int64_t key = 1; key <= cardinality; key++){ REQUIRE(b.find(key) == key * 10); }
+    sum = b.sum(0, cardinality);
+    REQUIRE(sum.m_num_elements == cardinality);
+    REQUIRE(sum.m_sum_keys == cardinality * (cardinality +1) / 2);
+
+    // the updates do not start a new pass as long as the tree is not fragmented
+    b.set_defragmentation_rate(2);
+    for(int64_t i = 0; i < 100; i++){
+        REQUIRE(b.remove(keys[i]) == keys[i] * 10);
+        b.insert(keys[i], keys[i] * 10);
+    }
+    auto stats_updates = b.get_stats_leaf_distance();
+    REQUIRE(stats_updates.m_distance_avg == stats_after.m_distance_avg);
+    REQUIRE(stats_updates.m_distance_median == stats_after.m_distance_median);
+
+    // tree without the slab allocator, the root is a leaf
+    ABTree b2{4, 8, 8, 16};
+    for(int64_t key = 1; key <= 10; key++){ b2.insert(key, key * 10); }
+    REQUIRE(b2.defragment(1) == true);
+    for(int64_t key = 1; key <= 10; key++){ REQUIRE(b2.find(key) == key * 10); }
+}
+
+TEST_CASE("SIMD_search"){
+    const int64_t cardinality = 100000;
+    ABTree b1{32, 64, 32, 64}; // scalar search
+    ABTree b2{32, 64, 32, 64}; // vectorised search
+    b2.set_simd_search(true);
+
+    // only the even keys, including the negative ones
+    vector<int64_t> keys;
+    for(int64_t i = 0; i < cardinality; i++){ keys.push_back(2 * (i - cardinality / 2)); }
+    mt19937_64 random_generator{42};
+    shuffle(keys.begin(), keys.end(), random_generator);
+    for(auto key : keys){ b1.insert(key, key * 10); b2.insert(key, key * 10); }
+    b2.validate();
+
+    for(int64_t key = -cardinality -2; key <= cardinality +2; key++){
+        REQUIRE(b2.find(key) == b1.find(key));
+    }
+
+    uniform_int_distribution<int64_t> distribution{ -cardinality -10, cardinality +10 };
+    for(int i = 0; i < 1000; i++){
+        int64_t min = distribution(random_generator);
+        int64_t max = min + distribution(random_generator) % 500 + 500;
+        auto sum1 = b1.sum(min, max);
+        auto sum2 = b2.sum(min, max);
+        REQUIRE(sum2.m_num_elements == sum1.m_num_elements);
+        REQUIRE(sum2.m_sum_keys == sum1.m_sum_keys);
+        REQUIRE(sum2.m_sum_values == sum1.m_sum_values);
+        if(sum1.m_num_elements > 0){
+            REQUIRE(sum2.m_first_key == sum1.m_first_key);
+            REQUIRE(sum2.m_last_key == sum1.m_last_key);
+        }
+
+        auto it1 = b1.find(min, max);
+        auto it2 = b2.find(min, max);
+        while(it1->hasNext()){
+            REQUIRE(it2->hasNext());
+            REQUIRE(it2->next() == it1->next());
+        }
+        REQUIRE(!it2->hasNext());
+    }
+
+    // whole scan
+    auto sum = b2.sum(numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max());
+    REQUIRE(sum.m_num_elements == cardinality);
+    REQUIRE(sum.m_first_key == -cardinality);
+    REQUIRE(sum.m_last_key == cardinality -2);
+}
+
+TEST_CASE("Parallel_bulk_load"){
+    const int64_t cardinality = 1000000;
+    vector<pair<int64_t, int64_t>> elements;
+    for(int64_t i = 1; i <= cardinality; i++){ elements.emplace_back(2 * i, 2 * i * 10); }
+    mt19937_64 random_generator{42};
+
+    for(double fill_factor : {1.0, 0.75, 0.5, 0.1}){
+        for(size_t num_threads : {1, 4}){
+            ABTree b{4, 8, 8, 16};
+            b.set_bulk_load_fill_factor(fill_factor);
+            b.set_bulk_load_threads(num_threads);
+            b.set_slab_allocator(num_threads > 1);
+            auto batch = elements;
+            shuffle(batch.begin(), batch.end(), random_generator);
+            b.bulk_load(batch.data(), batch.size());
+            REQUIRE(b.size() == cardinality);
+            b.validate();
+
+            // all elements in order
+            auto it = b.iterator();
+            int64_t expected = 2;
+            while(it->hasNext()){
+                auto p = it->next();
+                REQUIRE(p.first == expected);
+                REQUIRE(p.second == expected * 10);
+                expected += 2;
+            }
+            REQUIRE(expected == 2 * cardinality + 2);
+            for(int64_t key = 0; key <= 1000; key++){ REQUIRE(b.find(key) == ((key % 2 == 0 && key > 0) ? key * 10 : -1)); }
+
+            // a large batch is merged, rebuilding the tree
+            vector<pair<int64_t, int64_t>> odd_keys;
+            for(int64_t i = 0; i < cardinality / 2; i++){ odd_keys.emplace_back(2 * i + 1, (2 * i + 1) * 10); }
+            shuffle(odd_keys.begin(), odd_keys.end(), random_generator);
+            b.bulk_load(odd_keys.data(), odd_keys.size());
+            REQUIRE(b.size() == cardinality + cardinality / 2);
+            b.validate();
+
+            // a small batch is inserted
+            vector<pair<int64_t, int64_t>> small_batch;
+            for(int64_t i = cardinality / 2; i < cardinality / 2 + 100; i++){ small_batch.emplace_back(2 * i + 1, (2 * i + 1) * 10); }
+            b.bulk_load(small_batch.data(), small_batch.size());
+            REQUIRE(b.size() == cardinality + cardinality / 2 + 100);
+            b.validate();
+            for(int64_t key = 1; key <= cardinality + 200; key++){ REQUIRE(b.find(key) == key * 10); }
+            auto sum = b.sum(0, 2 * cardinality);
+            REQUIRE(sum.m_num_elements == cardinality + cardinality / 2 + 100);
+        }
+    }
+
+    // the bounds are respected for any size
+    for(int64_t size : {0, 1, 16, 17, 31, 33, 129, 1000}){
+        for(double fill_factor : {1.0, 0.5, 0.2}){
+            ABTree b{4, 8, 8, 16};
+            b.set_bulk_load_fill_factor(fill_factor);
+            vector<pair<int64_t, int64_t>> batch(elements.begin(), elements.begin() + size);
+            b.bulk_load(batch.data(), batch.size());
+            REQUIRE(b.size() == size);
+            b.validate();
+            for(int64_t i = 1; i <= size; i++){ REQUIRE(b.find(2 * i) == 2 * i * 10); }
+        }
+    }
+
+    ABTree b{4, 8, 8, 16};
+    REQUIRE_THROWS(b.set_bulk_load_fill_factor(0));
+    REQUIRE_THROWS(b.set_bulk_load_fill_factor(1.5));
+}
+
+TEST_CASE("Interleaved_lookups"){
+    const int64_t cardinality = 50000;
+    mt19937_64 random_generator{42};
+
+    // the keys to search, both present (even) and absent (odd or out of range)
+    vector<int64_t> queries;
+    for(int64_t key = -10; key <= 2 * cardinality + 10; key++){ queries.push_back(key); }
+    shuffle(queries.begin(), queries.end(), random_generator);
+
+    for(bool bloom_filters : {false, true}){
+        for(bool simd_search : {false, true}){
+            ABTree b{4, 8, 8, 16};
+            b.set_bloom_filters(bloom_filters);
+            b.set_simd_search(simd_search);
+            vector<int64_t> keys;
+            for(int64_t i = 1; i <= cardinality; i++){ keys.push_back(2 * i); }
+            shuffle(keys.begin(), keys.end(), random_generator);
+            for(auto key : keys){ b.insert(key, key * 10); }
+
+            for(size_t group_size : {1, 8, 32}){
+                vector<int64_t> values(queries.size(), -2);
+                b.find_interleaved(queries.data(), values.data(), queries.size(), group_size);
+                for(size_t i = 0; i < queries.size(); i++){
+                    REQUIRE(values[i] == b.find(queries[i]));
+                }
+            }
+        }
+    }
+
+    // a tree with a single leaf
+    ABTree b{4, 8, 8, 16};
+    for(int64_t key = 1; key <= 5; key++){ b.insert(key, key * 10); }
+    vector<int64_t> values(queries.size());
+    b.find_interleaved(queries.data(), values.data(), queries.size(), 4);
+    for(size_t i = 0; i < queries.size(); i++){ REQUIRE(values[i] == ((queries[i] >= 1 && queries[i] <= 5) ? queries[i] * 10 : -1)); }
+}
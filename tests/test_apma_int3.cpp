@@ -11,6 +11,7 @@
 #include "distribution/random_permutation.hpp"
 #include "pma/driver.hpp"
 #include "pma/adaptive/int3/packed_memory_array.hpp"
+#include "pma/adaptive/int3/sketch_detector.hpp"
 
 #include <vector>
 
@@ -1759,3 +1760,145 @@ TEST_CASE("unibig"){
     }
 }
 
+
+TEST_CASE("adaptive_densities"){
+    initialise();
+
+    const int64_t cardinality = 20000;
+    PackedMemoryArray pma { /* segment size */ 32, /* pages per extent */ 2 };
+    pma.set_adaptive_densities(true);
+    REQUIRE(pma.get_density_controller() != nullptr);
+    const double theta_initial = pma.get_density_controller()->theta();
+    distribution::RandomPermutationParallel sampler{ cardinality, /* seed */ 7 };
+
+    // write intensive
+    for(int64_t i = 0; i < cardinality; i++){
+        auto key = 2 * sampler.get_raw_key(i) + 1;
+        pma.insert(key, key * 10);
+    }
+    const double theta_writes = pma.get_density_controller()->theta();
+    REQUIRE(theta_writes < theta_initial);
+
+    // scan intensive
+    for(int64_t i = 0; i < cardinality; i++){
+        auto key = 2 * sampler.get_raw_key(i) + 2;
+        pma.insert(key, key * 10);
+        pma.sum(key, key + 1000);
+    }
+    REQUIRE(pma.get_density_controller()->theta() > theta_writes);
+
+    // validate the content
+    auto sum = pma.sum(0, 2 * cardinality);
+    REQUIRE(sum.m_num_elements == 2 * cardinality);
+    REQUIRE(sum.m_sum_keys == cardinality * (2 * cardinality + 1));
+    for(int64_t key = 1; key <= 2 * cardinality; key++){ REQUIRE(pma.find(key) == key * 10); }
+    for(int64_t key = 1; key <= 2 * cardinality; key++){ REQUIRE(pma.remove(key) == key * 10); }
+    REQUIRE(pma.empty());
+}
+
+TEST_CASE("sketch_detector"){
+    initialise();
+
+    { // the detector in isolation
+        Knobs knobs;
+        SketchDetector detector{ knobs, /* heavy hitters */ 16, /* sketch width */ 256, /* sketch depth */ 4 };
+        const size_t footprint = detector.memory_footprint();
+
+        // hammer the segment 7, always inserting after the same key
+        for(int i = 0; i < 100; i++){ detector.insert(7, 1000, 1001 + i); }
+        // background noise, one update for each segment
+        for(int i = 0; i < 100000; i++){ detector.insert(100 + i, i, i + 1); }
+        for(int i = 0; i < 100; i++){ detector.insert(7, 1000, 1101 + i); }
+
+        vector<SketchDetector::Entry> hammered;
+        detector.hammered(0, 200000, hammered);
+        REQUIRE(hammered.size() == 1);
+        REQUIRE(hammered[0].segment() == 7);
+        REQUIRE(hammered[0].m_count_segment > (int) knobs.get_segment_threshold());
+        REQUIRE(hammered[0].m_count_fwd >= (int) knobs.get_sequence_threshold());
+        REQUIRE(hammered[0].m_key_fwd == 1000);
+        detector.hammered(8, 100, hammered);
+        REQUIRE(hammered.empty());
+        REQUIRE(detector.memory_footprint() == footprint); // fixed memory
+        REQUIRE(detector.size() <= 16);
+
+        // move the recordings to another segment
+        SketchDetector::Entry entry;
+        REQUIRE(detector.extract(7, &entry));
+        REQUIRE(!detector.extract(7, &entry));
+        detector.restore(42, entry);
+        detector.hammered(0, 200000, hammered);
+        REQUIRE(hammered.size() == 1);
+        REQUIRE(hammered[0].segment() == 42);
+
+        // deletions reverse the sign
+        for(int i = 0; i < 100; i++){ detector.remove(42, 5000, 5001 + i); }
+        detector.hammered(0, 200000, hammered);
+        REQUIRE(hammered.size() == 1);
+        REQUIRE(hammered[0].m_count_segment < -((int) knobs.get_segment_threshold()));
+
+        detector.clear(42);
+        detector.hammered(0, 200000, hammered);
+        REQUIRE(hammered.empty());
+    }
+
+    { // within the PMA, mix sequential insertions in a few spots with random insertions
+        const int64_t cardinality = 100000;
+        PackedMemoryArray pma { /* segment size */ 32, /* pages per extent */ 2 };
+        pma.set_sketch_detector(true);
+        REQUIRE(pma.sketch_detector() != nullptr);
+        distribution::RandomPermutationParallel sampler{ cardinality, /* seed */ 11 };
+        int64_t hammered_key = 0;
+        for(int64_t i = 0; i < cardinality; i++){
+            int64_t key = (i % 2 == 0) ? 10 * (sampler.get_raw_key(i) +1) : 10 * cardinality + (++hammered_key);
+            pma.insert(key, key * 10);
+        }
+        REQUIRE(pma.size() == cardinality);
+
+        for(int64_t i = 0; i < cardinality; i++){
+            int64_t key = (i % 2 == 0) ? 10 * (sampler.get_raw_key(i) +1) : 10 * cardinality + (i +1) / 2;
+            REQUIRE(pma.find(key) == key * 10);
+        }
+        for(int64_t i = 0; i < cardinality; i++){
+            int64_t key = (i % 2 == 0) ? 10 * (sampler.get_raw_key(i) +1) : 10 * cardinality + (i +1) / 2;
+            REQUIRE(pma.remove(key) == key * 10);
+        }
+        REQUIRE(pma.empty());
+    }
+}
+
+TEST_CASE("weights_threads"){
+    initialise();
+
+    // the windows spanning at least 8192 segments are processed by multiple threads, the outcome must be the same
+    const int64_t cardinality = 600000;
+    PackedMemoryArray pma1 { /* segment size */ 32, /* pages per extent */ 2 };
+    PackedMemoryArray pma4 { /* segment size */ 32, /* pages per extent */ 2 };
+    pma4.set_weights_threads(4);
+    distribution::RandomPermutationParallel sampler{ cardinality, /* seed */ 13 };
+    int64_t hammered_key = 0;
+    for(int64_t i = 0; i < cardinality; i++){
+        int64_t key = (i % 4 != 0) ? 10 * (sampler.get_raw_key(i) +1) : 10 * cardinality + (++hammered_key);
+        pma1.insert(key, key * 10);
+        pma4.insert(key, key * 10);
+    }
+    REQUIRE(pma4.size() == cardinality);
+    REQUIRE(pma4.memory_footprint() == pma1.memory_footprint());
+
+    for(int64_t i = 0; i < cardinality; i += 2){
+        int64_t key = (i % 4 != 0) ? 10 * (sampler.get_raw_key(i) +1) : 10 * cardinality + i / 4 +1;
+        REQUIRE(pma1.remove(key) == key * 10);
+        REQUIRE(pma4.remove(key) == key * 10);
+    }
+    REQUIRE(pma4.size() == cardinality / 2);
+    REQUIRE(pma4.memory_footprint() == pma1.memory_footprint());
+
+    auto it1 = pma1.iterator(), it4 = pma4.iterator();
+    while(it1->hasNext()){
+        REQUIRE(it4->hasNext());
+        auto p1 = it1->next(); auto p4 = it4->next();
+        REQUIRE(p1.first == p4.first);
+        REQUIRE(p1.second == p4.second);
+    }
+    REQUIRE(!it4->hasNext());
+}
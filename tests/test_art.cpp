@@ -2,9 +2,14 @@
  * test_art.cpp
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <iostream>
+#include <random>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include "third-party/catch/catch.hpp"
@@ -1848,3 +1853,171 @@ TEST_CASE("uniform"){
 
     autocheck(keys, 64);
 }
+
+TEST_CASE("optimistic_lock_coupling"){
+    const int64_t cardinality = 20000;
+    mt19937_64 random_generator{42};
+
+    { // single thread, same results of the unsynchronised variant
+        ART tree1{16};
+        ART tree2{16, /* synchronized ? */ true};
+        REQUIRE(tree2.is_synchronized());
+        vector<int64_t> keys;
+        for(int64_t i = 1; i <= cardinality; i++){ keys.push_back(i); }
+        shuffle(begin(keys), end(keys), random_generator);
+        for(auto key : keys){ tree1.insert(key, key * 10); tree2.insert(key, key * 10); }
+        for(int64_t i = 0; i < cardinality / 2; i++){ REQUIRE(tree2.remove(keys[i]) == tree1.remove(keys[i])); }
+        REQUIRE(tree2.size() == tree1.size());
+
+        for(int64_t key = 0; key <= cardinality +1; key++){ REQUIRE(tree2.find(key) == tree1.find(key)); }
+        uniform_int_distribution<int64_t> distribution{0, cardinality};
+        for(int i = 0; i < 1000; i++){
+            int64_t min = distribution(random_generator);
+            int64_t max = min + distribution(random_generator) % 200;
+            auto sum1 = tree1.sum(min, max);
+            auto sum2 = tree2.sum(min, max);
+            REQUIRE(sum2.m_num_elements == sum1.m_num_elements);
+            REQUIRE(sum2.m_sum_keys == sum1.m_sum_keys);
+            REQUIRE(sum2.m_sum_values == sum1.m_sum_values);
+            if(sum1.m_num_elements > 0){
+                REQUIRE(sum2.m_first_key == sum1.m_first_key);
+                REQUIRE(sum2.m_last_key == sum1.m_last_key);
+            }
+
+            auto it1 = tree1.find(min, max);
+            auto it2 = tree2.find(min, max);
+            while(it1->hasNext()){
+                REQUIRE(it2->hasNext());
+                REQUIRE(it2->next() == it1->next());
+            }
+            REQUIRE(!it2->hasNext());
+        }
+
+        auto it = tree2.iterator();
+        int64_t count = 0;
+        while(it->hasNext()){ it->next(); count++; }
+        REQUIRE(count == cardinality - cardinality / 2);
+    }
+
+    { // readers concurrent to a writer
+        ART tree{16, /* synchronized ? */ true};
+        for(int64_t key = 2; key <= 2 * cardinality; key += 2){ tree.insert(key, key * 10); } // the even keys are never removed
+        atomic<bool> done = false;
+
+        // the writer inserts and removes the odd keys
+        thread writer([&](){
+            mt19937_64 random_generator{1};
+            vector<int64_t> keys;
+            for(int64_t key = 1; key < 2 * cardinality; key += 2){ keys.push_back(key); }
+            for(int round = 0; round < 4; round++){
+                shuffle(begin(keys), end(keys), random_generator);
+                for(auto key : keys){ tree.insert(key, key * 10); }
+                shuffle(begin(keys), end(keys), random_generator);
+                for(auto key : keys){ tree.remove(key); }
+            }
+            done = true;
+        });
+
+        const int num_readers = 3;
+        vector<thread> readers;
+        atomic<int64_t> num_errors = 0;
+        for(int i = 0; i < num_readers; i++){
+            readers.emplace_back([&, i](){
+                mt19937_64 random_generator(i + 100);
+                uniform_int_distribution<int64_t> distribution{1, cardinality};
+                while(!done){
+                    int64_t key = 2 * distribution(random_generator);
+                    if(tree.find(key) != key * 10){ num_errors++; }
+
+                    // all even keys in the interval must be visited, in order
+                    int64_t min = key, max = key + 100;
+                    int64_t next_even = min; // the next even key expected
+                    int64_t previous = min -1;
+                    auto it = tree.find(min, max);
+                    while(it->hasNext()){
+                        auto p = it->next();
+                        if(p.first <= previous || p.first > max || p.second != p.first * 10){ num_errors++; }
+                        if(p.first % 2 == 0){
+                            if(p.first != next_even){ num_errors++; } // skipped an even key
+                            next_even = p.first + 2;
+                        }
+                        previous = p.first;
+                    }
+                    if(next_even <= std::min(max, 2 * cardinality)){ num_errors++; }
+
+                    auto sum = tree.sum(min, max);
+                    if(sum.m_sum_values != sum.m_sum_keys * 10 || sum.m_first_key != min){ num_errors++; }
+                }
+            });
+        }
+
+        writer.join();
+        for(auto& t : readers){ t.join(); }
+        REQUIRE(num_errors == 0);
+        REQUIRE(tree.size() == cardinality);
+        for(int64_t key = 1; key <= 2 * cardinality; key++){
+            REQUIRE(tree.find(key) == ((key % 2 == 0) ? key * 10 : -1));
+        }
+    }
+}
+
+TEST_CASE("optimistic_duplicates"){
+    for(bool synchronized : {false, true}){
+        ART tree{4, synchronized};
+        // the leaf [10, 20, 20, 20] is split in [10, 20] and [20, 20], then the last 20 is inserted in the second leaf:
+        // the duplicates of 20 span two leaves
+        for(int64_t key : {10, 20, 20, 20, 20}){ tree.insert(key, key * 10); }
+        tree.insert(30, 300);
+        REQUIRE(tree.size() == 6);
+
+        auto sum = tree.sum(15, 20);
+        REQUIRE(sum.m_num_elements == 4);
+        REQUIRE(sum.m_first_key == 20);
+        REQUIRE(sum.m_last_key == 20);
+        REQUIRE(sum.m_sum_keys == 80);
+        sum = tree.sum(0, 100);
+        REQUIRE(sum.m_num_elements == 6);
+        REQUIRE(sum.m_sum_keys == 120);
+
+        auto it = tree.find(15, 20);
+        int64_t count = 0;
+        while(it->hasNext()){ REQUIRE(it->next().first == 20); count++; }
+        REQUIRE(count == 4);
+
+        it = tree.iterator();
+        vector<int64_t> keys;
+        while(it->hasNext()){ keys.push_back(it->next().first); }
+        REQUIRE((keys == vector<int64_t>{10, 20, 20, 20, 20, 30}));
+    }
+}
+
+TEST_CASE("interleaved_lookups"){
+    const int64_t cardinality = 50000;
+    mt19937_64 random_generator{42};
+
+    // the keys to search, both present (multiples of 3) and absent
+    vector<int64_t> queries;
+    for(int64_t key = 0; key <= 3 * cardinality + 10; key++){ queries.push_back(key); }
+    shuffle(queries.begin(), queries.end(), random_generator);
+
+    for(uint64_t leaf_block_size : {4, 64}){
+        ART tree{leaf_block_size};
+        vector<int64_t> empty_values(queries.size());
+        tree.find_interleaved(queries.data(), empty_values.data(), queries.size(), 8);
+        for(auto value : empty_values){ REQUIRE(value == -1); }
+
+        vector<int64_t> keys;
+        for(int64_t i = 1; i <= cardinality; i++){ keys.push_back(3 * i); }
+        shuffle(keys.begin(), keys.end(), random_generator);
+        for(auto key : keys){ tree.insert(key, key * 10); }
+
+        for(size_t group_size : {1, 8, 32}){
+            vector<int64_t> values(queries.size(), -2);
+            tree.find_interleaved(queries.data(), values.data(), queries.size(), group_size);
+            for(size_t i = 0; i < queries.size(); i++){
+                int64_t key = queries[i];
+                REQUIRE(values[i] == ((key > 0 && key % 3 == 0 && key <= 3 * cardinality) ? key * 10 : -1));
+            }
+        }
+    }
+}
@@ -7,7 +7,10 @@
 
 
 
+#include <algorithm>
 #include <climits>
+#include <random>
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include "third-party/catch/catch.hpp"
@@ -403,6 +406,65 @@ TEST_CASE("predictor"){
     }
 }
 
+/**
+ * Validate the hash index of the predictor against a naive implementation of the same queue, where the
+ * elements are simply kept in a vector ordered from the tail to the head
+ */
+TEST_CASE("predictor_index"){
+    const size_t max_count = 8;
+    size_t capacity = 16;
+    Predictor predictor{capacity, max_count};
+    vector<pair<uint64_t, uint64_t>> expected; // pointer, count
+
+    auto expected_decrease_tail = [&](){
+        if(--expected[0].second == 0){ expected.erase(expected.begin()); }
+    };
+    auto validate = [&](){
+        auto v = predictor.items(numeric_limits<size_t>::min(), numeric_limits<size_t>::max());
+        auto e = expected;
+        sort(begin(e), end(e));
+        REQUIRE(v.size() == e.size());
+        for(size_t i = 0; i < v.size(); i++){
+            REQUIRE(v[i].m_pointer == e[i].first);
+            REQUIRE(v[i].m_count == e[i].second);
+        }
+    };
+
+    mt19937_64 random_generator{42};
+    for(size_t round = 0; round < 20; round++){
+        for(size_t i = 0; i < 2000; i++){
+            uint64_t pointer = uniform_int_distribution<uint64_t>{0, 2 * capacity}(random_generator);
+            predictor.update(pointer);
+
+            auto it = find_if(begin(expected), end(expected), [pointer](auto& e){ return e.first == pointer; });
+            if(it != end(expected)){
+                size_t pos = it - begin(expected);
+                if(pos + 1 < expected.size()){ swap(expected[pos], expected[pos +1]); pos++; }
+                if(expected[pos].second < max_count){ expected[pos].second++; } else { expected_decrease_tail(); }
+            } else if (expected.size() == capacity){
+                expected_decrease_tail();
+            } else {
+                expected.emplace_back(pointer, 1);
+            }
+        }
+        validate();
+
+        // double all pointers, as the rebalancer does when the PMA is resized
+        if(round % 5 == 4){
+            auto items = predictor.items(numeric_limits<size_t>::min(), numeric_limits<size_t>::max());
+            for(auto& item : items){ predictor.reset_ptr(item.m_permuted_position, item.m_pointer * 2); }
+            for(auto& e : expected){ e.first *= 2; }
+            validate();
+        }
+
+        // alter the capacity of the circular buffer
+        size_t new_capacity = max<size_t>(expected.size(), uniform_int_distribution<size_t>{4, 64}(random_generator));
+        predictor.resize(new_capacity);
+        capacity = new_capacity;
+        validate();
+    }
+}
+
 // copy & paste from test_static_abtree.cpp
 TEST_CASE("sanity"){
     initialise();
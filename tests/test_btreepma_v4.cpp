@@ -8,7 +8,11 @@
 #define CATCH_CONFIG_MAIN
 #include "third-party/catch/catch.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <random>
+#include <thread>
 #include <vector>
 
 #include "pma/driver.hpp"
@@ -1914,3 +1918,129 @@ TEST_CASE("sum_fixed_size_segments"){
 }
 
 
+TEST_CASE("mremap_growth"){
+    initialise();
+
+    for(size_t segment_capacity : {0, 8, 64}){ // 0 => segments of variable size
+        unique_ptr<BTreePMA_v4> tree { segment_capacity == 0 ? new BTreePMA_v4{} : new BTreePMA_v4{segment_capacity} };
+        tree->set_mremap_growth(true);
+        REQUIRE(tree->has_mremap_growth());
+
+        // insert the keys alternating from both ends, to trigger resizes with uneven segments
+        const int64_t sz = 20000;
+        for(int64_t i = 1; i <= sz / 2; i++){
+            tree->insert(i, i * 10);
+            tree->insert(sz - i + 1, (sz - i + 1) * 10);
+        }
+        REQUIRE(tree->size() == sz);
+        REQUIRE_THROWS(tree->set_mremap_growth(false));
+
+        for(int64_t key = 1; key <= sz; key++){
+            REQUIRE(tree->find(key) == key * 10);
+        }
+        REQUIRE(tree->find(sz +1) == -1);
+
+        auto it = tree->iterator();
+        int64_t expected = 1;
+        while(it->hasNext()){
+            auto p = it->next();
+            REQUIRE(p.first == expected);
+            REQUIRE(p.second == expected * 10);
+            expected++;
+        }
+        REQUIRE(expected == sz +1);
+    }
+}
+
+TEST_CASE("interleaved_lookups"){
+    initialise();
+
+    for(size_t segment_capacity : {0, 8, 64}){ // 0 => segments of variable size
+        unique_ptr<BTreePMA_v4> tree { segment_capacity == 0 ? new BTreePMA_v4{} : new BTreePMA_v4{segment_capacity} };
+
+        // the keys to search, both present (even) and absent (odd)
+        const int64_t sz = 20000;
+        vector<int64_t> queries;
+        for(int64_t key = -5; key <= 2 * sz + 5; key++){ queries.push_back(key); }
+        vector<int64_t> values(queries.size(), -2);
+        tree->find_interleaved(queries.data(), values.data(), queries.size(), 8);
+        for(auto value : values){ REQUIRE(value == -1); }
+
+        for(int64_t i = sz; i >= 1; i--){ tree->insert(2 * i, 2 * i * 10); }
+        REQUIRE(tree->size() == sz);
+
+        for(size_t group_size : {1, 8, 32}){
+            std::fill(values.begin(), values.end(), -2);
+            tree->find_interleaved(queries.data(), values.data(), queries.size(), group_size);
+            for(size_t i = 0; i < queries.size(); i++){
+                int64_t key = queries[i];
+                REQUIRE(values[i] == ((key > 0 && key % 2 == 0 && key <= 2 * sz) ? key * 10 : -1));
+            }
+        }
+    }
+}
+
+TEST_CASE("synchronized"){
+    initialise();
+
+    for(size_t segment_capacity : {0, 8, 64}){ // 0 => segments of variable size
+        unique_ptr<BTreePMA_v4> tree { segment_capacity == 0 ? new BTreePMA_v4{} : new BTreePMA_v4{segment_capacity} };
+        tree->set_synchronized(true);
+        REQUIRE(tree->is_synchronized());
+        REQUIRE_THROWS(tree->set_mremap_growth(true));
+
+        // the even keys are inserted before starting the readers
+        const int64_t sz = 20000;
+        for(int64_t key = 2; key <= 2 * sz; key += 2){ tree->insert(key, key * 10); }
+        REQUIRE_THROWS(tree->set_synchronized(false));
+
+        // the writer inserts the odd keys, causing rebalances and resizes
+        atomic<bool> done = false;
+        thread writer([&](){
+            mt19937_64 random_generator{1};
+            vector<int64_t> keys;
+            for(int64_t key = 1; key < 2 * sz; key += 2){ keys.push_back(key); }
+            shuffle(begin(keys), end(keys), random_generator);
+            for(auto key : keys){ tree->insert(key, key * 10); }
+            done = true;
+        });
+
+        const int num_readers = 2;
+        vector<thread> readers;
+        atomic<int64_t> num_errors = 0;
+        for(int i = 0; i < num_readers; i++){
+            readers.emplace_back([&, i](){
+                mt19937_64 random_generator(i + 100);
+                uniform_int_distribution<int64_t> distribution{1, 2 * sz};
+                while(!done){
+                    int64_t key = distribution(random_generator);
+                    int64_t value = tree->find(key);
+                    if(key % 2 == 0){ // always present
+                        if(value != key * 10){ num_errors++; }
+                    } else { // it may or may not have been inserted yet
+                        if(value != key * 10 && value != -1){ num_errors++; }
+                    }
+                }
+            });
+        }
+
+        writer.join();
+        for(auto& t : readers){ t.join(); }
+        REQUIRE(num_errors == 0);
+
+        REQUIRE(tree->size() == 2 * sz);
+        for(int64_t key = 0; key <= 2 * sz + 1; key++){
+            REQUIRE(tree->find(key) == ((key >= 1 && key <= 2 * sz) ? key * 10 : -1));
+        }
+
+        auto it = tree->iterator();
+        int64_t expected = 1;
+        while(it->hasNext()){
+            auto p = it->next();
+            REQUIRE(p.first == expected);
+            REQUIRE(p.second == expected * 10);
+            expected++;
+        }
+        REQUIRE(expected == 2 * sz +1);
+    }
+}
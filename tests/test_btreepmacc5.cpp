@@ -840,3 +840,55 @@ TEST_CASE("sum"){
         }
     }
 }
+
+TEST_CASE("mremap_growth"){
+    initialise();
+    BTreePMACC5 tree{8};
+    tree.set_mremap_growth(true);
+    REQUIRE(tree.has_mremap_growth());
+    int64_t sz = 4096;
+
+    // grow
+    for(int64_t i = sz; i > 0; i--){
+        tree.insert(i, i * 100);
+    }
+    REQUIRE(tree.size() == sz);
+    REQUIRE_THROWS(tree.set_mremap_growth(false));
+    for(int64_t key = 1; key <= sz; key++){
+        REQUIRE(tree.find(key) == key * 100);
+    }
+
+    // shrink
+    for(int64_t key = 1; key <= sz; key += 2){
+        REQUIRE(tree.remove(key) == key * 100);
+    }
+    for(int64_t key = sz; key > sz / 4; key -= 2){
+        REQUIRE(tree.remove(key) == key * 100);
+    }
+    for(int64_t key = 1; key <= sz; key++){
+        int64_t expected = (key % 2 == 0 && key <= sz / 4) ? key * 100 : -1;
+        REQUIRE(tree.find(key) == expected);
+    }
+
+    auto it = tree.iterator();
+    int64_t expected = 2;
+    while(it->hasNext()){
+        auto p = it->next();
+        REQUIRE(p.first == expected);
+        REQUIRE(p.second == expected * 100);
+        expected += 2;
+    }
+    REQUIRE(expected == sz / 4 + 2);
+
+    // empty the container and grow it again
+    for(int64_t key = 2; key <= sz / 4; key += 2){
+        REQUIRE(tree.remove(key) == key * 100);
+    }
+    REQUIRE(tree.empty());
+    for(int64_t key = 1; key <= sz; key++){
+        tree.insert(key, key * 100);
+    }
+    for(int64_t key = 1; key <= sz; key++){
+        REQUIRE(tree.find(key) == key * 100);
+    }
+}
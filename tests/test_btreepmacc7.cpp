@@ -17,10 +17,10 @@
 using namespace pma;
 using namespace std;
 
-void check(const vector<int64_t>& entries, size_t block_size = 32){
+void check(const vector<int64_t>& entries, size_t block_size = 32, StaticIndexLayout index_layout = StaticIndexLayout::BTREE){
     initialise();
 
-    BTreePMACC7 tree{block_size, 2};
+    BTreePMACC7 tree{block_size, block_size, 2, index_layout};
     REQUIRE(tree.size() == 0);
     REQUIRE(tree.empty());
 
@@ -52,6 +52,26 @@ TEST_CASE("sequential"){
     check(keys);
 }
 
+TEST_CASE("sequential_eytzinger"){
+    const size_t cardinality = 10000;
+    vector<int64_t> keys;
+    keys.reserve(cardinality);
+    for(size_t i = 1; i <= cardinality; i++){
+        keys.push_back(i);
+    }
+    check(keys, 32, StaticIndexLayout::EYTZINGER);
+}
+
+TEST_CASE("uniform_learned"){
+    const size_t cardinality = 10000;
+    vector<int64_t> keys;
+    keys.reserve(cardinality);
+    for(size_t i = 1; i <= cardinality; i++){
+        keys.push_back((i * 7919) % 100003);  // a permutation of non consecutive keys
+    }
+    check(keys, 32, StaticIndexLayout::LEARNED);
+}
+
 TEST_CASE("sequential_rev"){
     const size_t cardinality = 10000;
     vector<int64_t> keys;
@@ -2149,4 +2169,3 @@ TEST_CASE("bulk_loading_sequential"){
     }
 }
 
-
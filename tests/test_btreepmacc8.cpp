@@ -10,8 +10,17 @@
 #include "third-party/catch/catch.hpp"
 
 #include "pma/driver.hpp"
+#include "pma/iterator.hpp"
 #include "pma/btree/08/packed_memory_array.hpp"
+#include "pma/btree/08/snapshot.hpp"
+#include "buffered_rewired_memory.hpp"
+#include "extent_cache.hpp"
+#include "miscellaneous.hpp"
 
+#include <algorithm>
+#include <cstdlib> // mkdtemp
+#include <random>
+#include <unistd.h> // unlink, rmdir
 #include <vector>
 
 using namespace pma;
@@ -1740,3 +1749,305 @@ TEST_CASE("sum"){
         }
     }
 }
+
+TEST_CASE("snapshot"){
+    initialise();
+
+    const int64_t cardinality = 50000;
+    unique_ptr<PackedMemoryArray8> pma { new PackedMemoryArray8{32, 2} };
+    for(int64_t i = 1; i <= cardinality; i++){ pma->insert(i * 2, i * 20); }
+
+    auto validate = [&](const Snapshot& snapshot){
+        REQUIRE(snapshot.size() == cardinality);
+        auto sum = snapshot.sum(0, numeric_limits<int64_t>::max());
+        REQUIRE(sum.m_num_elements == cardinality);
+        REQUIRE(sum.m_first_key == 2);
+        REQUIRE(sum.m_last_key == cardinality * 2);
+        REQUIRE(sum.m_sum_keys == cardinality * (cardinality +1));
+        REQUIRE(sum.m_sum_values == cardinality * (cardinality +1) * 10);
+
+        auto it = snapshot.iterator();
+        int64_t expected = 2;
+        while(it->hasNext()){
+            auto p = it->next();
+            REQUIRE(p.first == expected);
+            REQUIRE(p.second == expected * 10);
+            expected += 2;
+        }
+        REQUIRE(expected == (cardinality +1) * 2);
+
+        REQUIRE(snapshot.find(2) == 20);
+        REQUIRE(snapshot.find(3) == -1);
+    };
+
+    auto snapshot = pma->snapshot();
+    validate(*snapshot);
+
+    // update the source, while the snapshot is alive
+    for(int64_t i = 0; i <= cardinality; i++){ pma->insert(i * 2 +1, i * 20 + 10); }
+    for(int64_t i = 1; i <= cardinality; i += 3){ REQUIRE(pma->remove(i * 2) == i * 20); }
+    validate(*snapshot);
+    REQUIRE(pma->find(3) == 30);
+    REQUIRE(pma->find(2) == -1);
+
+    // the snapshot outlives its source
+    pma.reset();
+    validate(*snapshot);
+}
+
+TEST_CASE("persistence"){
+    initialise();
+
+    char directory[] = "/tmp/test_btreepmacc8_XXXXXX";
+    REQUIRE(mkdtemp(directory) != nullptr);
+    string path = string(directory) + "/pma";
+
+    const int64_t cardinality = 50000;
+    auto validate = [&](const PackedMemoryArray8& pma, int64_t num_elements){
+        REQUIRE(pma.size() == num_elements);
+        auto it = pma.iterator();
+        int64_t expected = 1;
+        while(it->hasNext()){
+            auto p = it->next();
+            REQUIRE(p.first == expected);
+            REQUIRE(p.second == expected * 10);
+            expected++;
+        }
+        REQUIRE(expected == num_elements +1);
+        for(int64_t i = 1; i <= num_elements; i++){ REQUIRE(pma.find(i) == i * 10); }
+        REQUIRE(pma.find(num_elements +1) == -1);
+    };
+
+    { // tiny PMA, without rewiring
+        unique_ptr<PackedMemoryArray8> pma { new PackedMemoryArray8{32, 2} };
+        for(int64_t i = 1; i <= 10; i++){ pma->insert(i, i * 10); }
+        pma->save(path);
+        auto restored = PackedMemoryArray8::restore(path);
+        validate(*restored, 10);
+    }
+
+    { // file backed rewired memory
+        unique_ptr<PackedMemoryArray8> pma { new PackedMemoryArray8{32, 2} };
+        pma->set_storage_directory(directory);
+        for(int64_t i = cardinality; i >= 1; i -= 2){ pma->insert(i, i * 10); }
+        for(int64_t i = 1; i <= cardinality; i += 2){ pma->insert(i, i * 10); }
+        pma->save(path);
+        pma.reset();
+
+        auto restored = PackedMemoryArray8::restore(path);
+        validate(*restored, cardinality);
+
+        // keep updating the restored instance and save it again
+        for(int64_t i = cardinality +1; i <= 2 * cardinality; i++){ restored->insert(i, i * 10); }
+        validate(*restored, 2 * cardinality);
+        restored->save(path);
+        restored.reset();
+
+        restored = PackedMemoryArray8::restore(path);
+        validate(*restored, 2 * cardinality);
+    }
+
+    unlink(path.c_str());
+    unlink((path + ".keys").c_str());
+    unlink((path + ".values").c_str());
+    rmdir(directory);
+}
+
+TEST_CASE("memory_budget"){
+    initialise();
+
+    char directory[] = "/tmp/test_btreepmacc8_XXXXXX";
+    REQUIRE(mkdtemp(directory) != nullptr);
+
+    const int64_t cardinality = 50000;
+    unique_ptr<PackedMemoryArray8> pma { new PackedMemoryArray8{32, 2} };
+    pma->set_storage_directory(directory);
+    const size_t extent_size = 2 * get_memory_page_size();
+    pma->set_memory_budget(/* 4 extents for the keys & 4 for the values */ 8 * extent_size);
+    auto cache = pma->get_extent_cache();
+    REQUIRE(cache != nullptr);
+    REQUIRE(cache->capacity() == 4);
+
+    // insert the elements in a random order
+    vector<int64_t> keys;
+    for(int64_t i = 1; i <= cardinality; i++){ keys.push_back(i); }
+    mt19937_64 random_generator{42};
+    shuffle(keys.begin(), keys.end(), random_generator);
+    for(auto key : keys){
+        pma->insert(key, key * 10);
+        REQUIRE(cache->num_resident() <= cache->capacity());
+    }
+    REQUIRE(cache->is_attached());
+    REQUIRE(cache->num_evictions() > 0);
+
+    // lookups & removals
+    for(auto key : keys){ REQUIRE(pma->find(key) == key * 10); }
+    for(int64_t key = 1; key <= cardinality; key += 2){ REQUIRE(pma->remove(key) == key * 10); }
+    REQUIRE(cache->num_resident() <= cache->capacity());
+
+    // scan
+    auto it = pma->iterator();
+    int64_t expected = 2;
+    while(it->hasNext()){
+        auto p = it->next();
+        REQUIRE(p.first == expected);
+        REQUIRE(p.second == expected * 10);
+        expected += 2;
+    }
+    REQUIRE(expected == cardinality + 2);
+
+    // remove the budget
+    pma->set_memory_budget(0);
+    REQUIRE(pma->get_extent_cache() == nullptr);
+    REQUIRE(pma->find(4) == 40);
+
+    pma.reset();
+    rmdir(directory);
+}
+
+TEST_CASE("adaptive_densities"){
+    initialise();
+
+    { // the controller alone: updates lower theta_h, scans raise it
+        DensityController controller { /* theta_h */ 0.75, /* min */ 0.6, /* max */ 0.9 };
+        REQUIRE(controller.update(1000) == false); // the epoch is not over yet
+        for(int i = 0; i < 1024; i++){ controller.record_update(); controller.record_rebalance(16); }
+        REQUIRE(controller.update(1000) == true);
+        REQUIRE(controller.theta() < 0.75);
+        for(int i = 0; i < 10; i++){
+            for(int j = 0; j < 1024; j++){ controller.record_update(); controller.record_rebalance(16); }
+            controller.update(1000);
+        }
+        REQUIRE(controller.theta() >= 0.6);
+        REQUIRE(controller.theta() < 0.62);
+        for(int i = 0; i < 20; i++){
+            for(int j = 0; j < 1024; j++){ controller.record_scan(1000); }
+            controller.update(1000);
+        }
+        REQUIRE(controller.theta() > 0.85);
+        REQUIRE(controller.theta() <= 0.9);
+
+        // rho_h scales with theta_h
+        auto densities = controller.adapt(DensityBounds{0.08, 0.3, 0.75, 1.0});
+        REQUIRE(densities.theta_h == controller.theta());
+        REQUIRE(densities.rho_h == Approx(0.3 * controller.theta() / 0.75));
+        REQUIRE(densities.rho_0 == 0.08);
+        REQUIRE(densities.theta_0 == 1.0);
+    }
+
+    const int64_t cardinality = 20000;
+    unique_ptr<PackedMemoryArray8> pma { new PackedMemoryArray8{32, 2} };
+    pma->set_adaptive_densities(true);
+    REQUIRE(pma->get_density_controller() != nullptr);
+    const double theta_initial = pma->get_density_controller()->theta();
+    mt19937_64 random_generator{42};
+
+    // write intensive: insert the odd keys in a random order
+    vector<int64_t> keys;
+    for(int64_t i = 0; i < cardinality; i++){ keys.push_back(2 * i + 1); }
+    shuffle(keys.begin(), keys.end(), random_generator);
+    for(auto key : keys){ pma->insert(key, key * 10); }
+    const double theta_writes = pma->get_density_controller()->theta();
+    REQUIRE(theta_writes < theta_initial);
+
+    // scan intensive: insert the even keys, each followed by the scan of ~1000 elements
+    keys.clear();
+    for(int64_t i = 1; i <= cardinality; i++){ keys.push_back(2 * i); }
+    shuffle(keys.begin(), keys.end(), random_generator);
+    uniform_int_distribution<int64_t> distribution{1, 2 * cardinality};
+    for(auto key : keys){
+        pma->insert(key, key * 10);
+        int64_t min = distribution(random_generator);
+        pma->sum(min, min + 1000);
+    }
+    REQUIRE(pma->get_density_controller()->theta() > theta_writes);
+
+    // validate the content
+    auto sum = pma->sum(0, 2 * cardinality);
+    REQUIRE(sum.m_num_elements == 2 * cardinality);
+    REQUIRE(sum.m_first_key == 1);
+    REQUIRE(sum.m_last_key == 2 * cardinality);
+    REQUIRE(sum.m_sum_keys == cardinality * (2 * cardinality + 1));
+    for(int64_t key = 1; key <= 2 * cardinality; key++){ REQUIRE(pma->find(key) == key * 10); }
+    for(int64_t key = 1; key <= 2 * cardinality; key++){ REQUIRE(pma->remove(key) == key * 10); }
+    REQUIRE(pma->empty());
+}
+
+TEST_CASE("bloom_filters"){
+    initialise();
+
+    const int64_t cardinality = 20000;
+    unique_ptr<PackedMemoryArray8> pma { new PackedMemoryArray8{32, 64} };
+    pma->set_bloom_filters(true);
+    REQUIRE(pma->get_bloom_filters() != nullptr);
+    mt19937_64 random_generator{42};
+
+    // insert the odd keys in a random order
+    vector<int64_t> keys;
+    for(int64_t i = 0; i < cardinality; i++){ keys.push_back(2 * i + 1); }
+    shuffle(keys.begin(), keys.end(), random_generator);
+    for(auto key : keys){ pma->insert(key, key * 10); }
+    REQUIRE(pma->get_bloom_filters()->size() > 1);
+
+    // no false negatives, the even keys are absent
+    for(int64_t key = 1; key <= 2 * cardinality; key++){
+        REQUIRE(pma->find(key) == ((key % 2 == 1) ? key * 10 : -1));
+    }
+
+    // remove the first half of the keys
+    for(int64_t i = 0; i < cardinality / 2; i++){ REQUIRE(pma->remove(keys[i]) == keys[i] * 10); }
+    for(int64_t i = 0; i < cardinality; i++){ REQUIRE(pma->find(keys[i]) == (i < cardinality / 2 ? -1 : keys[i] * 10)); }
+
+    // enable the filters on a non empty PMA
+    pma->set_bloom_filters(false);
+    REQUIRE(pma->get_bloom_filters() == nullptr);
+    pma->set_bloom_filters(true);
+    for(int64_t i = 0; i < cardinality; i++){ REQUIRE(pma->find(keys[i]) == (i < cardinality / 2 ? -1 : keys[i] * 10)); }
+
+    for(int64_t i = cardinality / 2; i < cardinality; i++){ REQUIRE(pma->remove(keys[i]) == keys[i] * 10); }
+    REQUIRE(pma->empty());
+    REQUIRE(pma->find(1) == -1);
+}
+
+TEST_CASE("extent_cache_window"){
+    initialise();
+
+    char directory[] = "/tmp/test_btreepmacc8_XXXXXX";
+    REQUIRE(mkdtemp(directory) != nullptr);
+
+    const size_t num_extents = 16;
+    unique_ptr<BufferedRewiredMemory> memory { new BufferedRewiredMemory(/* pages per extent */ 1, num_extents, directory) };
+    const size_t extent_size = memory->get_extent_size();
+    int64_t* content = (int64_t*) memory->get_start_address();
+    const size_t elts_per_extent = extent_size / sizeof(content[0]);
+    for(size_t i = 0; i < num_extents * elts_per_extent; i++){ content[i] = i; }
+
+    ExtentCache cache { 4 };
+    cache.attach({ memory.get() }, num_extents);
+    REQUIRE(cache.num_resident() == 4);
+
+    // a window that fits the capacity evicts the extents outside of it only
+    cache.access(8, 4);
+    REQUIRE(cache.num_resident() == 4);
+    REQUIRE(cache.num_misses() == 4);
+    cache.access(8, 4);
+    REQUIRE(cache.num_hits() == 4);
+    REQUIRE(cache.num_misses() == 4);
+
+    // a window larger than the capacity does not evict its own extents while reading it ahead, then it is trimmed
+    uint64_t num_evictions = cache.num_evictions();
+    cache.access(2, 10);
+    REQUIRE(cache.num_resident() == 4);
+    REQUIRE(cache.num_hits() == 8);
+    REQUIRE(cache.num_misses() == 10);
+    REQUIRE(cache.num_evictions() == num_evictions + 6);
+    cache.access(8, 4); // the last extents of the window are still resident
+    REQUIRE(cache.num_hits() == 12);
+
+    // the evicted extents are read back from the file
+    for(size_t i = 0; i < num_extents * elts_per_extent; i++){ REQUIRE(content[i] == (int64_t) i); }
+
+    cache.detach();
+    memory.reset();
+    rmdir(directory);
+}
@@ -0,0 +1,218 @@
+/*
+ * test_concurrent_dynamic_index.cpp
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include "third-party/catch/catch.hpp"
+
+#include "pma/generic/concurrent_dynamic_index.hpp"
+
+using namespace pma;
+using namespace std;
+
+// check find_first / find_successor against the content of a std::map
+template<typename Index>
+static void validate(const Index& index, const map<int64_t, int64_t>& expected, int64_t max_key){
+    REQUIRE(index.size() == expected.size());
+    for(int64_t key = -1; key <= max_key + 1; key++){
+        int64_t k = -1, v = -1;
+
+        // find_first: the greatest key <= `key'
+        auto it = expected.upper_bound(key);
+        bool found = index.find_first(key, &k, &v);
+        if(it == expected.begin()){
+            REQUIRE(!found);
+        } else {
+            --it;
+            REQUIRE(found);
+            REQUIRE(k == it->first);
+            REQUIRE(v == it->second);
+        }
+
+        // find_successor: the smallest key >= `key'
+        it = expected.lower_bound(key);
+        found = index.find_successor(key, &k, &v);
+        if(it == expected.end()){
+            REQUIRE(!found);
+        } else {
+            REQUIRE(found);
+            REQUIRE(k == it->first);
+            REQUIRE(v == it->second);
+        }
+
+        // find_any: exact match
+        found = index.find_any(key, &v);
+        REQUIRE(found == (expected.count(key) > 0));
+        if(found){ REQUIRE(v == expected.at(key)); }
+    }
+}
+
+TEST_CASE("sanity"){
+    ConcurrentDynamicIndex<int64_t, int64_t, 4, 4> index;
+    REQUIRE(index.empty());
+    int64_t v = -1;
+    REQUIRE(!index.find_any(10, &v));
+
+    const int64_t max_key = 2000;
+    vector<int64_t> keys;
+    for(int64_t key = 2; key <= max_key; key += 2){ keys.push_back(key); }
+    mt19937_64 random_generator{42};
+    shuffle(begin(keys), end(keys), random_generator);
+
+    map<int64_t, int64_t> expected;
+    for(size_t i = 0; i < keys.size(); i++){
+        index.insert(keys[i], keys[i] * 10);
+        expected[keys[i]] = keys[i] * 10;
+        if(i % 97 == 0) validate(index, expected, max_key);
+    }
+    validate(index, expected, max_key);
+
+    // remove half of the keys
+    shuffle(begin(keys), end(keys), random_generator);
+    for(size_t i = 0; i < keys.size() / 2; i++){
+        int64_t value = -1;
+        REQUIRE(index.remove_any(keys[i], &value));
+        REQUIRE(value == keys[i] * 10);
+        REQUIRE(!index.remove_any(keys[i]));
+        expected.erase(keys[i]);
+        if(i % 97 == 0) validate(index, expected, max_key);
+    }
+    validate(index, expected, max_key);
+
+    // remove everything else
+    for(size_t i = keys.size() / 2; i < keys.size(); i++){ index.remove(keys[i]); }
+    REQUIRE(index.empty());
+    REQUIRE(!index.find_first(max_key, nullptr, &v));
+    REQUIRE(!index.find_successor(0, nullptr, &v));
+
+    // the emptied nodes can be filled again
+    expected.clear();
+    for(int64_t key = 1; key <= max_key; key += 3){ index.insert(key, key * 10); expected[key] = key * 10; }
+    validate(index, expected, max_key);
+}
+
+TEST_CASE("duplicates"){
+    ConcurrentDynamicIndex<int64_t, int64_t, 4, 4> index;
+    const int64_t num_keys = 50, num_copies = 20;
+    for(int64_t copy = 0; copy < num_copies; copy++){
+        for(int64_t key = 1; key <= num_keys; key++){ index.insert(key * 10, key * 10); }
+    }
+    REQUIRE(index.size() == num_keys * num_copies);
+
+    for(int64_t key = 1; key <= num_keys; key++){
+        int64_t k = -1, v = -1;
+        REQUIRE(index.find_first(key * 10 + 5, &k, &v));
+        REQUIRE(k == key * 10);
+        REQUIRE(index.find_successor(key * 10 - 5, &k, &v));
+        REQUIRE(k == key * 10);
+        REQUIRE(index.find_any(key * 10, &v));
+        REQUIRE(v == key * 10);
+    }
+
+    // remove the copies one by one
+    for(int64_t key = 1; key <= num_keys; key += 2){
+        for(int64_t copy = 0; copy < num_copies; copy++){
+            int64_t v = -1;
+            REQUIRE(index.remove_any(key * 10, &v));
+            REQUIRE(v == key * 10);
+        }
+        REQUIRE(!index.remove_any(key * 10));
+    }
+
+    // remove all copies at once
+    for(int64_t key = 2; key <= num_keys; key += 2){
+        index.remove(key * 10);
+        int64_t v = -1;
+        REQUIRE(!index.find_any(key * 10, &v));
+    }
+    REQUIRE(index.empty());
+}
+
+TEST_CASE("load_sorted"){
+    ConcurrentDynamicIndex<int64_t, int64_t, 8, 8> index;
+    for(int64_t key = 0; key < 100; key++){ index.insert(key, -key); } // replaced by load_sorted
+
+    for(uint64_t size : {0, 1, 7, 8, 9, 100, 12345}){
+        for(double fill_factor : {1.0, 0.5}){
+            vector<int64_t> keys, values;
+            map<int64_t, int64_t> expected;
+            for(int64_t i = 1; i <= (int64_t) size; i++){
+                keys.push_back(i * 3); values.push_back(i * 30);
+                expected[i * 3] = i * 30;
+            }
+            index.load_sorted(keys.data(), values.data(), size, fill_factor);
+            validate(index, expected, 3 * size + 3);
+
+            // the tree can be altered after the bulk load
+            for(int64_t i = 1; i <= (int64_t) size; i += 5){
+                index.insert(i * 3 + 1, i * 30 + 10); expected[i * 3 + 1] = i * 30 + 10;
+                REQUIRE(index.remove_any(i * 3)); expected.erase(i * 3);
+            }
+            validate(index, expected, 3 * size + 3);
+        }
+    }
+
+    index.clear();
+    REQUIRE(index.empty());
+}
+
+TEST_CASE("concurrent"){
+    const int64_t cardinality = 100000;
+    ConcurrentDynamicIndex<int64_t, int64_t, 8, 8> index;
+    for(int64_t key = 4; key <= 4 * cardinality; key += 4){ index.insert(key, key * 10); } // these keys are never removed
+    atomic<bool> done = false;
+    atomic<int64_t> num_errors = 0;
+
+    // the writers insert and remove the keys not multiple of 4, each on its own residue class
+    const int num_writers = 2;
+    vector<thread> writers;
+    for(int i = 0; i < num_writers; i++){
+        writers.emplace_back([&, i](){
+            mt19937_64 random_generator(i);
+            vector<int64_t> keys;
+            for(int64_t key = i + 1; key < 4 * cardinality; key += 4){ keys.push_back(key); }
+            for(int round = 0; round < 2; round++){
+                shuffle(begin(keys), end(keys), random_generator);
+                for(auto key : keys){ index.insert(key, key * 10); }
+                shuffle(begin(keys), end(keys), random_generator);
+                for(auto key : keys){ if(!index.remove_any(key)) num_errors++; }
+            }
+        });
+    }
+
+    const int num_readers = 2;
+    vector<thread> readers;
+    for(int i = 0; i < num_readers; i++){
+        readers.emplace_back([&, i](){
+            mt19937_64 random_generator(i + 100);
+            uniform_int_distribution<int64_t> distribution{1, cardinality};
+            while(!done){
+                int64_t key = 4 * distribution(random_generator);
+                int64_t k = -1, v = -1;
+                if(!index.find_any(key, &v) || v != key * 10){ num_errors++; }
+
+                // there is always a key multiple of 4 within the distance 3
+                if(!index.find_first(key + 3, &k, &v) || k < key || k > key + 3 || v != k * 10){ num_errors++; }
+                if(!index.find_successor(key - 3, &k, &v) || k < key - 3 || k > key || v != k * 10){ num_errors++; }
+            }
+        });
+    }
+
+    for(auto& t : writers){ t.join(); }
+    done = true;
+    for(auto& t : readers){ t.join(); }
+    REQUIRE(num_errors == 0);
+
+    REQUIRE(index.size() == cardinality);
+    map<int64_t, int64_t> expected;
+    for(int64_t key = 4; key <= 4 * cardinality; key += 4){ expected[key] = key * 10; }
+    validate(index, expected, 4 * cardinality);
+}
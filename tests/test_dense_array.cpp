@@ -5,9 +5,14 @@
  *      Author: Dean De Leo
  */
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include "third-party/catch/catch.hpp"
@@ -52,6 +57,29 @@ TEST_CASE("sanity"){
     }
 }
 
+TEST_CASE("eytzinger"){
+    DenseArray dense_array{/* node size */ 4, StaticIndexLayout::EYTZINGER};
+    for(int64_t i = 1; i <= 1000; i++){
+        dense_array.insert(i * 2, i * 20);
+    }
+    dense_array.build();
+    REQUIRE(dense_array.size() == 1000);
+
+    for(int64_t key = 0; key <= 2002; key++){
+        auto res = dense_array.find(key);
+        if(key >= 2 && key <= 2000 && key % 2 == 0){
+            REQUIRE(res == key * 10);
+        } else {
+            REQUIRE(res == -1);
+        }
+    }
+
+    auto sum = dense_array.sum(100, 199); // 100, 102, ..., 198
+    REQUIRE(sum.m_num_elements == 50);
+    REQUIRE(sum.m_first_key == 100);
+    REQUIRE(sum.m_last_key == 198);
+}
+
 TEST_CASE("merge"){
     DenseArray denseArray{7};
 
@@ -413,3 +441,168 @@ TEST_CASE("sum"){
     }
 }
 
+
+TEST_CASE("delta"){
+    DenseArray dense_array{16};
+    for(int64_t i = 1; i <= 1000; i++){ dense_array.insert(i * 2, i * 20); }
+    dense_array.build();
+
+    // the elements in the delta are visible to lookups and scans before the next build
+    for(int64_t i = 1; i <= 100; i++){ dense_array.insert(i * 20 +1, (i * 20 +1) * 10); }
+    REQUIRE(dense_array.size() == 1100);
+    for(int64_t key = 0; key <= 2002; key++){
+        bool present = (key >= 2 && key <= 2000 && key % 2 == 0) || (key >= 21 && key <= 2001 && key % 20 == 1);
+        REQUIRE(dense_array.find(key) == (present ? key * 10 : -1));
+    }
+    auto sum = dense_array.sum(1, 41); // 2, 4, ..., 40 + 21, 41
+    REQUIRE(sum.m_num_elements == 22);
+    REQUIRE(sum.m_first_key == 2);
+    REQUIRE(sum.m_last_key == 41);
+    REQUIRE(sum.m_sum_keys == 20 * 21 + 21 + 41);
+    int64_t previous = -1;
+    size_t count = 0;
+    auto it = dense_array.iterator();
+    while(it->hasNext()){
+        auto e = it->next();
+        REQUIRE(e.first > previous);
+        REQUIRE(e.second == e.first * 10);
+        previous = e.first;
+        count++;
+    }
+    REQUIRE(count == 1100);
+
+    dense_array.build();
+    REQUIRE(dense_array.size() == 1100);
+    REQUIRE(dense_array.find(1001) == 10010);
+}
+
+TEST_CASE("background_merge"){
+    constexpr int64_t sz = 100000;
+    DenseArray dense_array{16};
+    dense_array.set_merge_threshold(1000);
+
+    // a permutation of the keys in [1, sz]
+    vector<int64_t> keys;
+    for(int64_t i = 1; i <= sz; i++){ keys.push_back((i * 7919) % sz +1); }
+    for(int64_t i = 0; i < sz; i++){
+        dense_array.insert(keys[i], keys[i] * 10);
+        if(i % 997 == 0){ // interleave some reads, while a merge may be in progress
+            REQUIRE(dense_array.size() == i +1);
+            REQUIRE(dense_array.find(keys[i]) == keys[i] * 10);
+            REQUIRE(dense_array.find(keys[i / 2]) == keys[i / 2] * 10);
+            auto sum = dense_array.sum(0, sz);
+            REQUIRE(sum.m_num_elements == i +1);
+        }
+    }
+    REQUIRE(dense_array.size() == sz);
+    dense_array.build();
+    REQUIRE(dense_array.size() == sz);
+
+    auto sum = dense_array.sum(0, sz);
+    REQUIRE(sum.m_num_elements == sz);
+    REQUIRE(sum.m_first_key == 1);
+    REQUIRE(sum.m_last_key == sz);
+    REQUIRE(sum.m_sum_keys == sz * (sz +1) / 2);
+    for(int64_t key = 1; key <= sz; key++){ REQUIRE(dense_array.find(key) == key * 10); }
+}
+
+namespace {
+// A dense array whose merges fail, while `m_fail' is set
+class FailingDenseArray : public DenseArray {
+public:
+    atomic<bool> m_fail { true };
+    mutable atomic<uint64_t> m_num_failures { 0 };
+
+    FailingDenseArray() : DenseArray(16) { }
+
+protected:
+    MergeOutput merge(const delta_t& delta) const override {
+        if(m_fail){
+            m_num_failures++;
+            throw runtime_error("injected failure");
+        }
+        return DenseArray::merge(delta);
+    }
+};
+} // anonymous namespace
+
+TEST_CASE("failed_merge"){
+    constexpr int64_t sz = 20000;
+    FailingDenseArray dense_array;
+    dense_array.set_merge_threshold(1000);
+
+    for(int64_t i = 0; i < sz; i++){
+        int64_t key = (i * 7919) % sz +1;
+        try {
+            dense_array.insert(key, key * 10);
+        } catch(runtime_error&){ /* the merge in the background failed, the element has been inserted anyway */ }
+        if(i % 100 == 0){ this_thread::sleep_for(1ms); } // let the merge in progress fail, the next inserts restart it
+    }
+    REQUIRE_THROWS(dense_array.build());
+    REQUIRE(dense_array.m_num_failures > 1);
+
+    // no update is lost by the failed merges
+    REQUIRE(dense_array.size() == sz);
+    REQUIRE(dense_array.sum(0, sz).m_num_elements == sz);
+    for(int64_t key = 1; key <= sz; key++){ REQUIRE(dense_array.find(key) == key * 10); }
+
+    dense_array.m_fail = false;
+    dense_array.build();
+    REQUIRE(dense_array.size() == sz);
+    auto sum = dense_array.sum(0, sz);
+    REQUIRE(sum.m_num_elements == sz);
+    REQUIRE(sum.m_sum_keys == sz * (sz +1) / 2);
+    for(int64_t key = 1; key <= sz; key++){ REQUIRE(dense_array.find(key) == key * 10); }
+}
+
+TEST_CASE("parallel_merge"){
+    constexpr int64_t sz = 400000;
+    DenseArray dense_array1{16};
+    DenseArray dense_array4{16};
+    dense_array4.set_merge_threads(4);
+
+    // a permutation of the even keys in [2, 2 * sz], in two rounds
+    for(int round = 0; round < 2; round++){
+        for(int64_t i = round; i < sz; i += 2){
+            int64_t key = ((i * 7919) % sz +1) * 2;
+            dense_array1.insert(key, key * 10);
+            dense_array4.insert(key, key * 10);
+        }
+        dense_array1.build();
+        dense_array4.build();
+    }
+
+    // append the odd keys at the end, only the last elements of the arrays are rewritten
+    for(int64_t key = 2 * sz + 1; key <= 4 * sz; key += 2){
+        dense_array1.insert(key, key * 10);
+        dense_array4.insert(key, key * 10);
+    }
+    dense_array1.build();
+    dense_array4.build();
+    dense_array4.insert(4 * sz - 2, (4 * sz - 2) * 10); // before the last element
+    dense_array4.build();
+    dense_array1.insert(4 * sz - 2, (4 * sz - 2) * 10);
+    dense_array1.build();
+
+    REQUIRE(dense_array1.size() == 2 * sz +1);
+    REQUIRE(dense_array4.size() == 2 * sz +1);
+    auto it1 = dense_array1.iterator();
+    auto it4 = dense_array4.iterator();
+    while(it1->hasNext()){
+        REQUIRE(it4->hasNext());
+        auto e1 = it1->next();
+        auto e4 = it4->next();
+        REQUIRE(e1 == e4);
+        REQUIRE(e1.second == e1.first * 10);
+    }
+    REQUIRE(!it4->hasNext());
+
+    for(int64_t key = 0; key <= 4 * sz + 1; key++){
+        bool present = (key >= 2 && key <= 2 * sz && key % 2 == 0) || (key > 2 * sz && key <= 4 * sz && key % 2 == 1) || (key == 4 * sz - 2);
+        REQUIRE(dense_array4.find(key) == (present ? key * 10 : -1));
+    }
+    auto sum = dense_array4.sum(0, 4 * sz);
+    REQUIRE(sum.m_num_elements == 2 * sz +1);
+    REQUIRE(sum.m_first_key == 2);
+    REQUIRE(sum.m_last_key == 4 * sz - 1);
+}
@@ -277,3 +277,35 @@ TEST_CASE("type_mismatch"){
     abtree.find_any(0.1, &value);
     abtree.remove_any(0.1, &value);
     abtree.remove(0.1);}
+
+TEST_CASE("load_sorted"){
+    for(double fill_factor : {1.0, 0.5, 0.1}){
+        for(uint64_t num_threads : {1, 4}){
+            for(int64_t size : {0, 5, 64, 65, 1000, 1000000}){
+                DynamicIndex<int64_t, int64_t, 64, 64> abtree{};
+                abtree.insert(-5, 3); // replaced by the load
+                vector<int64_t> keys, values;
+                for(int64_t i = 0; i < size; i++){ keys.push_back(2 * i); values.push_back(i); }
+                abtree.load_sorted(keys.data(), values.data(), size, fill_factor, num_threads);
+                REQUIRE(abtree.size() == size);
+
+                int64_t key = -1, value = -1;
+                for(int64_t i = 0; i < size; i++){
+                    REQUIRE(abtree.find_any(2 * i, &value) == true);
+                    REQUIRE(value == i);
+                    REQUIRE(abtree.find_first(2 * i + 1, &key, &value) == true);
+                    REQUIRE(key == 2 * i);
+                }
+
+                // the tree can be updated afterwards
+                for(int64_t i = 0; i < size; i++){ abtree.insert(2 * i + 1, i); }
+                for(int64_t i = 0; i < size; i++){ REQUIRE(abtree.remove_any(2 * i) == true); }
+                for(int64_t i = 0; i < size; i++){
+                    REQUIRE(abtree.find_any(2 * i + 1, &value) == true);
+                    REQUIRE(abtree.find_any(2 * i, &value) == false);
+                }
+                REQUIRE(abtree.size() == size);
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * test_fenwick_tree.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Dean De Leo
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "third-party/catch/catch.hpp"
+
+#include "pma/generic/fenwick_tree.hpp"
+
+#include <cinttypes>
+
+using namespace pma;
+using namespace std;
+
+TEST_CASE("cardinality_tree"){
+    constexpr size_t num_segments = 13; // not a power of 2
+    uint16_t sizes[num_segments];
+    for(size_t i = 0; i < num_segments; i++){ sizes[i] = i * 3 % 7; }
+
+    FenwickTree tree;
+    tree.rebuild(sizes, num_segments);
+    REQUIRE(tree.size() == num_segments);
+
+    auto validate = [&](){
+        for(size_t start = 0; start <= num_segments; start++){
+            int64_t expected = 0;
+            for(size_t end = start; end <= num_segments; end++){
+                REQUIRE(tree.sum(start, end) == expected);
+                if(end < num_segments) expected += sizes[end];
+            }
+        }
+    };
+    validate();
+
+    sizes[4]++; tree.update(4, +1);
+    sizes[12]--; tree.update(12, -1);
+    validate();
+
+    // alter a window, as in a spread
+    sizes[5] = 2; sizes[6] = 2; sizes[7] = 2;
+    tree.refresh(sizes, 5, 3);
+    validate();
+}
@@ -213,3 +213,37 @@ TEST_CASE("sum"){
         }
     }
 }
+
+TEST_CASE("mremap_growth"){
+    const size_t capacity = 1024 * 64;
+    auto keys_ptr = generate_array(capacity, 7);
+    auto keys = keys_ptr.get();
+
+    PMA_Impl4 pma;
+    pma.set_mremap_growth(true);
+    REQUIRE(pma.has_mremap_growth());
+    for(int64_t i = 0; i < capacity; i++){
+        pma.insert(keys[i].first, keys[i].second);
+    }
+    REQUIRE(pma.size() == capacity);
+    REQUIRE_THROWS(pma.set_mremap_growth(false));
+
+    auto it = pma.iterator();
+    int64_t index = 0;
+    while(it->hasNext()){
+        auto pair = it->next();
+        index++;
+        REQUIRE(pair.first == index);
+        REQUIRE(pair.second == index * 1000);
+    }
+    REQUIRE(index == capacity);
+    for(int64_t key = 1; key <= capacity; key++){
+        REQUIRE(pma.find(key) == key * 1000);
+    }
+
+    pma.clear();
+    REQUIRE(pma.empty());
+    REQUIRE(pma.has_mremap_growth());
+    pma.insert(1, 1000);
+    REQUIRE(pma.find(1) == 1000);
+}
@@ -4,6 +4,11 @@
 #include "buffered_rewired_memory.hpp"
 #include "miscellaneous.hpp"
 #include "rewired_memory.hpp"
+#include "rewired_memory_snapshot.hpp"
+
+#include <cstdlib> // mkdtemp
+#include <unistd.h> // unlink, rmdir
+#include <vector>
 
 using namespace std;
 
@@ -122,3 +127,101 @@ TEST_CASE("acquire_buffer"){
 
     REQUIRE(rmem.get_used_buffers() == 0); // all employed buffers should have been released
 }
+
+TEST_CASE("snapshot"){
+    constexpr size_t extent_const = 2;
+    constexpr size_t num_extents = 8;
+    RewiredMemory rmem { extent_const, num_extents };
+    const size_t values_per_extent = rmem.get_extent_size() / sizeof(uint64_t);
+
+    uint64_t* vmem[num_extents];
+    for(size_t i = 0; i < num_extents; i++){
+        vmem[i] = (uint64_t*) (reinterpret_cast<char*>(rmem.get_start_address()) + i * rmem.get_extent_size());
+        for(size_t j = 0; j < values_per_extent; j++){ vmem[i][j] = i; }
+    }
+    rmem.swap(vmem[0], vmem[1]); // [1, 0, 2, 3, ...]
+
+    auto snapshot = rmem.snapshot(num_extents);
+    REQUIRE(rmem.has_snapshots());
+    REQUIRE(snapshot->get_num_extents() == num_extents);
+    auto snapshot_extent = [&](size_t i){ return (const uint64_t*) ((const char*) snapshot->get_start_address() + i * rmem.get_extent_size()); };
+    REQUIRE(snapshot_extent(0)[0] == 1);
+    REQUIRE(snapshot_extent(1)[0] == 0);
+
+    // alter the source, the snapshot must not observe the changes
+    rmem.prepare_write(vmem[2], rmem.get_extent_size());
+    for(size_t j = 0; j < values_per_extent; j++){ vmem[2][j] = 100; }
+    rmem.swap(vmem[3], vmem[4]);
+    rmem.prepare_write(vmem[3], 2 * rmem.get_extent_size());
+    vmem[3][0] = 200;
+    vmem[4][values_per_extent -1] = 300;
+    rmem.extend(2);
+    REQUIRE(rmem.get_physical_memory_size() > rmem.get_allocated_memory_size());
+
+    // source
+    REQUIRE(vmem[2][0] == 100);
+    REQUIRE(vmem[2][values_per_extent -1] == 100);
+    REQUIRE(vmem[3][0] == 200);
+    REQUIRE(vmem[3][1] == 4);
+    REQUIRE(vmem[4][0] == 3);
+    REQUIRE(vmem[4][values_per_extent -1] == 300);
+
+    // snapshot
+    for(size_t i = 0; i < num_extents; i++){
+        size_t expected = (i == 0) ? 1 : (i == 1) ? 0 : i;
+        REQUIRE(snapshot_extent(i)[0] == expected);
+        REQUIRE(snapshot_extent(i)[values_per_extent -1] == expected);
+    }
+
+    // release the snapshot, the private copies are recycled
+    snapshot.reset();
+    REQUIRE(!rmem.has_snapshots());
+    REQUIRE(rmem.get_physical_memory_size() == rmem.get_allocated_memory_size());
+    REQUIRE(vmem[3][0] == 200);
+}
+
+TEST_CASE("persistence"){
+    constexpr size_t extent_const = 2;
+    constexpr size_t num_extents = 8;
+    char directory[] = "/tmp/test_rewired_memory_XXXXXX";
+    REQUIRE(mkdtemp(directory) != nullptr);
+    string path = string(directory) + "/memory";
+
+    vector<uint32_t> translation_map;
+    size_t values_per_extent = 0;
+    { // create & save
+        RewiredMemory rmem { extent_const, num_extents, /* max memory */ (1ull << 30), directory };
+        REQUIRE(rmem.is_file_backed());
+        values_per_extent = rmem.get_extent_size() / sizeof(uint64_t);
+        uint64_t* vmem = (uint64_t*) rmem.get_start_address();
+        for(size_t i = 0; i < num_extents * values_per_extent; i++){ vmem[i] = i; }
+        rmem.swap(vmem, vmem + 5 * values_per_extent);
+        rmem.swap(vmem + 2 * values_per_extent, vmem + 3 * values_per_extent);
+        rmem.save(path);
+        translation_map = rmem.get_translation_map();
+    }
+    REQUIRE(translation_map[0] == 5);
+    REQUIRE(translation_map[5] == 0);
+
+    { // restore
+        RewiredMemory rmem { path, extent_const, translation_map, /* max memory */ (1ull << 30) };
+        REQUIRE(rmem.get_allocated_extents() == num_extents);
+        REQUIRE(rmem.get_translation_map() == translation_map);
+        uint64_t* vmem = (uint64_t*) rmem.get_start_address();
+        for(size_t i = 0; i < num_extents; i++){
+            size_t expected_extent = translation_map[i];
+            for(size_t j = 0; j < values_per_extent; j++){
+                REQUIRE(vmem[i * values_per_extent + j] == expected_extent * values_per_extent + j);
+            }
+        }
+
+        // the restored instance can keep being rewired & extended
+        rmem.swap(vmem, vmem + 5 * values_per_extent);
+        rmem.extend(2);
+        REQUIRE(vmem[0] == 0);
+        REQUIRE(rmem.get_allocated_extents() == num_extents + 2);
+    }
+
+    unlink(path.c_str());
+    rmdir(directory);
+}
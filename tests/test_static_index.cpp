@@ -6,7 +6,10 @@
  */
 
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <utility>
 
 #define CATCH_CONFIG_MAIN
@@ -143,3 +146,138 @@ TEST_CASE("height6"){
         REQUIRE(index.find((i+1) * 10 +1) == i);
     }
 }
+
+TEST_CASE("eytzinger"){
+    for(size_t num_keys : {1, 2, 3, 4, 7, 8, 9, 100, 1025}){
+        StaticIndex index(/* node size, ignored */ 4, /* number of keys */ num_keys, StaticIndexLayout::EYTZINGER);
+        REQUIRE(index.layout() == StaticIndexLayout::EYTZINGER);
+        for(int i = 0; i < num_keys; i++){
+            index.set_separator_key(i, (i+1) * 10);
+        } // 10, 20, 30, 40, 50, 60, 70, etc.
+
+        for(int i = 0; i < num_keys; i++){
+            REQUIRE(index.get_separator_key(i) == (i+1) * 10);
+            REQUIRE(index.find((i+1) * 10 -1) == max(i -1, 0));
+            REQUIRE(index.find((i+1) * 10) == i);
+            REQUIRE(index.find((i+1) * 10 +1) == i);
+        }
+        REQUIRE(index.find(numeric_limits<int64_t>::max()) == num_keys -1);
+
+        // the copy must be independent
+        StaticIndex copy(index);
+        index.set_separator_key(num_keys -1, num_keys * 10 + 5);
+        REQUIRE(copy.get_separator_key(num_keys -1) == num_keys * 10);
+    }
+}
+
+TEST_CASE("eytzinger_duplicates"){
+    constexpr size_t num_keys = 50;
+    StaticIndex btree(/* node size */ 5, /* number of keys */ num_keys, StaticIndexLayout::BTREE);
+    StaticIndex eytzinger(/* node size */ 5, /* number of keys */ num_keys, StaticIndexLayout::EYTZINGER);
+    for(int i = 0; i < num_keys; i++){
+        btree.set_separator_key(i, (i / 4) * 10);
+        eytzinger.set_separator_key(i, (i / 4) * 10);
+    } // 0, 0, 0, 0, 10, 10, 10, 10, 20, etc.
+
+    for(int64_t key = -5; key <= (num_keys / 4 + 1) * 10; key += 5){
+        REQUIRE(eytzinger.find(key) == btree.find(key));
+        REQUIRE(eytzinger.find_first(key) == btree.find_first(key));
+        REQUIRE(eytzinger.find_last(key) == btree.find_last(key));
+    }
+}
+
+TEST_CASE("learned"){
+    // keys with a skewed distribution and runs of duplicates, to stretch the error of the linear models
+    for(size_t num_keys : {1, 2, 3, 8, 9, 100, 1025, 5000}){
+        StaticIndex btree(/* node size */ 8, /* number of keys */ num_keys, StaticIndexLayout::BTREE);
+        StaticIndex learned(/* piece size */ 8, /* number of keys */ num_keys, StaticIndexLayout::LEARNED);
+        REQUIRE(learned.layout() == StaticIndexLayout::LEARNED);
+        auto key_at = [](int64_t i){ return (i < 100) ? (i / 3) * 10 : 1000 + i * i; };
+        for(int i = 0; i < num_keys; i++){
+            btree.set_separator_key(i, key_at(i));
+            learned.set_separator_key(i, key_at(i));
+        }
+
+        for(int i = 0; i < num_keys; i++){
+            REQUIRE(learned.get_separator_key(i) == key_at(i));
+            for(int64_t key : {key_at(i) -1, key_at(i), key_at(i) +1}){
+                REQUIRE(learned.find(key) == btree.find(key));
+                REQUIRE(learned.find_first(key) == btree.find_first(key));
+                REQUIRE(learned.find_last(key) == btree.find_last(key));
+            }
+        }
+        REQUIRE(learned.find(numeric_limits<int64_t>::max()) == num_keys -1);
+
+        // patch a single key, only its model is refitted
+        if(num_keys > 50){
+            learned.set_separator_key(50, key_at(50) +1);
+            btree.set_separator_key(50, key_at(50) +1);
+            for(int64_t key = key_at(45); key <= key_at(55); key++){
+                REQUIRE(learned.find(key) == btree.find(key));
+            }
+        }
+    }
+}
+
+TEST_CASE("bulk_rebuild"){
+    // large enough to split the B-tree & the Eytzinger layout among multiple threads
+    constexpr size_t num_keys = (1ull << 17) + 7;
+    unique_ptr<int64_t[]> keys { new int64_t[num_keys] };
+    for(size_t i = 0; i < num_keys; i++){ keys[i] = (i / 2) * 3; } // with duplicates
+
+    for(auto layout : {StaticIndexLayout::BTREE, StaticIndexLayout::EYTZINGER, StaticIndexLayout::LEARNED}){
+        for(size_t node_size : {5, 65}){
+            StaticIndex expected(node_size, num_keys, layout);
+            for(size_t i = 0; i < num_keys; i++){ expected.set_separator_key(i, keys[i]); }
+
+            // start from a smaller index, so that the bulk rebuild also has to grow the tree
+            StaticIndex index(node_size, 10, layout);
+            for(uint64_t num_threads : {1, 4}){
+                index.rebuild(num_keys, keys.get(), num_threads);
+                REQUIRE(index.minimum() == keys[0]);
+                for(size_t i = 0; i < num_keys; i += 97){
+                    REQUIRE(index.get_separator_key(i) == keys[i]);
+                    for(int64_t key : {keys[i] -1, keys[i], keys[i] +1}){
+                        REQUIRE(index.find(key) == expected.find(key));
+                        REQUIRE(index.find_first(key) == expected.find_first(key));
+                        REQUIRE(index.find_last(key) == expected.find_last(key));
+                    }
+                }
+            }
+
+            // shrink
+            index.rebuild(100, keys.get(), 4);
+            for(size_t i = 0; i < 100; i++){
+                REQUIRE(index.find(keys[i]) == (i < 2 ? 0 : min<uint64_t>(i | 1, 99)));
+            }
+        }
+    }
+}
+
+TEST_CASE("save_load"){
+    constexpr size_t num_keys = 1000;
+    for(auto layout : {StaticIndexLayout::BTREE, StaticIndexLayout::EYTZINGER, StaticIndexLayout::LEARNED}){
+        StaticIndex index(/* node size */ 8, num_keys, layout);
+        for(size_t i = 0; i < num_keys; i++){ index.set_separator_key(i, i * 10); }
+        stringstream ss;
+        index.save(ss);
+
+        StaticIndex copy(/* node size */ 8, 1, layout);
+        copy.load(ss);
+        for(size_t i = 0; i < num_keys; i++){
+            REQUIRE(copy.get_separator_key(i) == i * 10);
+            REQUIRE(copy.find(i * 10 + 5) == index.find(i * 10 + 5));
+        }
+
+        // a different layout or node size must be rejected
+        for(auto other : {StaticIndexLayout::BTREE, StaticIndexLayout::EYTZINGER, StaticIndexLayout::LEARNED}){
+            if(other == layout) continue;
+            stringstream in(ss.str());
+            StaticIndex mismatch(/* node size */ 8, 1, other);
+            REQUIRE_THROWS(mismatch.load(in));
+        }
+        stringstream in(ss.str());
+        StaticIndex mismatch(/* node size */ 16, 1, layout);
+        REQUIRE_THROWS(mismatch.load(in));
+    }
+}
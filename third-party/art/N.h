@@ -21,6 +21,15 @@ namespace ART_unsynchronized {
     using TID = uint64_t;
 
     struct LoadKeyInterface; // forward decl.
+    class N; // forward decl.
+
+    // Release the memory of a node unlinked from the tree. Without a deleter, the nodes are deleted immediately,
+    // with concurrent readers their deallocation must be deferred until no reader can still access them.
+    // The deleter also marks a tree with concurrent readers: the writers only lock the nodes when it is given.
+    struct DeleteNodeInterface {
+        virtual ~DeleteNodeInterface(){}
+        virtual void operator() (N* node) = 0;
+    };
 
 /*
  * SynchronizedTree
@@ -60,6 +69,9 @@ namespace ART_unsynchronized {
     protected:
         Prefix prefix;
 
+        // optimistic lock coupling: bit 0 = obsolete, bit 1 = locked, the remaining bits are the version
+        std::atomic<uint64_t> versionLockObsolete{0b100};
+
 
         void setType(NTypes type);
 
@@ -69,13 +81,29 @@ namespace ART_unsynchronized {
 
         uint32_t getCount() const;
 
+        // Optimistic lock coupling. The writers must be serialised by the caller, the readers never block them
+        // but restart when a node they read has been altered or unlinked from the tree in the meanwhile.
+        static bool isLocked(uint64_t version);
+
+        static bool isObsolete(uint64_t version);
+
+        void writeLock();
+
+        void writeUnlock();
+
+        void writeUnlockObsolete();
+
+        uint64_t readLockOrRestart(bool &needRestart) const;
+
+        void checkOrRestart(uint64_t startRead, bool &needRestart) const;
+
         static N *getChild(const uint8_t k, N *node);
 
-        static void insertA(N *node, N *parentNode, uint8_t keyParent, uint8_t key, N *val);
+        static void insertA(N *node, N *parentNode, uint8_t keyParent, uint8_t key, N *val, DeleteNodeInterface* deleter);
 
-        static void change(N *node, uint8_t key, N *val);
+        static void change(N *node, uint8_t key, N *val, DeleteNodeInterface* deleter);
 
-        static void removeA(N *node, uint8_t key, N *parentNode, uint8_t keyParent);
+        static void removeA(N *node, uint8_t key, N *parentNode, uint8_t keyParent, DeleteNodeInterface* deleter);
 
         bool hasPrefix() const;
 
@@ -99,17 +127,22 @@ namespace ART_unsynchronized {
 
         static TID getMaxLeaf(N* n);
 
+        static N* getMaxChild(N* n);
+
         static void deleteChildren(N *node);
 
         static void deleteNode(N *node);
 
+        // Release the node with the given deleter, after marking it as obsolete, or delete it immediately without deleter
+        static void retireNode(N *node, DeleteNodeInterface* deleter);
+
         static std::tuple<N *, uint8_t> getSecondChild(N *node, const uint8_t k);
 
         template<typename curN, typename biggerN>
-        static void insertGrow(curN *n, N *parentNode, uint8_t keyParent, uint8_t key, N *val);
+        static void insertGrow(curN *n, N *parentNode, uint8_t keyParent, uint8_t key, N *val, DeleteNodeInterface* deleter);
 
         template<typename curN, typename smallerN>
-        static void removeAndShrink(curN *n, N *parentNode, uint8_t keyParent, uint8_t key);
+        static void removeAndShrink(curN *n, N *parentNode, uint8_t keyParent, uint8_t key, DeleteNodeInterface* deleter);
 
         static void getChildren(const N *node, uint8_t start, uint8_t end, std::tuple<uint8_t, N *> children[],
                                 uint32_t &childrenCount);
@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <emmintrin.h> // _mm_pause
 
 #include "N.h"
 
@@ -20,6 +21,50 @@ namespace ART_unsynchronized {
         return type;
     }
 
+    bool N::isLocked(uint64_t version) {
+        return (version & 0b10) == 0b10;
+    }
+
+    bool N::isObsolete(uint64_t version) {
+        return (version & 0b1) == 0b1;
+    }
+
+    void N::writeLock() {
+        // a single writer at the time, no need of a CAS
+        uint64_t version = versionLockObsolete.load(std::memory_order_relaxed);
+        assert(!isLocked(version) && "The writers must be serialised");
+        versionLockObsolete.store(version + 0b10, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // the following changes must not be visible before the lock
+    }
+
+    void N::writeUnlock() {
+        // reset the lock bit and increase the version
+        versionLockObsolete.store(versionLockObsolete.load(std::memory_order_relaxed) + 0b10, std::memory_order_release);
+    }
+
+    void N::writeUnlockObsolete() {
+        versionLockObsolete.store(versionLockObsolete.load(std::memory_order_relaxed) + 0b11, std::memory_order_release);
+    }
+
+    uint64_t N::readLockOrRestart(bool &needRestart) const {
+        uint64_t version = versionLockObsolete.load(std::memory_order_acquire);
+        while (isLocked(version)) {
+            _mm_pause();
+            version = versionLockObsolete.load(std::memory_order_acquire);
+        }
+        if (isObsolete(version)) {
+            needRestart = true;
+        }
+        return version;
+    }
+
+    void N::checkOrRestart(uint64_t startRead, bool &needRestart) const {
+        std::atomic_thread_fence(std::memory_order_acquire); // the previous reads cannot be reordered after the check
+        if (versionLockObsolete.load(std::memory_order_relaxed) != startRead) {
+            needRestart = true;
+        }
+    }
+
     N *N::getAnyChild(const N *node) {
         switch (node->getType()) {
             case NTypes::N4: {
@@ -43,36 +88,38 @@ namespace ART_unsynchronized {
         __builtin_unreachable();
     }
 
-    void N::change(N *node, uint8_t key, N *val) {
+    void N::change(N *node, uint8_t key, N *val, DeleteNodeInterface* deleter) {
+        if (deleter != nullptr) node->writeLock();
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
                 n->change(key, val);
-                return;
+                break;
             }
             case NTypes::N16: {
                 auto n = static_cast<N16 *>(node);
                 n->change(key, val);
-                return;
+                break;
             }
             case NTypes::N48: {
                 auto n = static_cast<N48 *>(node);
                 n->change(key, val);
-                return;
+                break;
             }
             case NTypes::N256: {
                 auto n = static_cast<N256 *>(node);
                 n->change(key, val);
-                return;
+                break;
             }
         }
-        assert(false);
-        __builtin_unreachable();
+        if (deleter != nullptr) node->writeUnlock();
     }
 
     template<typename curN, typename biggerN>
-    void N::insertGrow(curN *n, N *parentNode, uint8_t keyParent, uint8_t key, N *val) {
+    void N::insertGrow(curN *n, N *parentNode, uint8_t keyParent, uint8_t key, N *val, DeleteNodeInterface* deleter) {
+        if (deleter != nullptr) n->writeLock();
         if (n->insert(key, val)) {
+            if (deleter != nullptr) n->writeUnlock();
             return;
         }
 
@@ -80,31 +127,33 @@ namespace ART_unsynchronized {
         n->copyTo(nBig);
         nBig->insert(key, val);
 
-        N::change(parentNode, keyParent, nBig);
+        N::change(parentNode, keyParent, nBig, deleter);
 
-        delete n;
+        retireNode(n, deleter);
     }
 
-    void N::insertA(N *node, N *parentNode, uint8_t keyParent, uint8_t key, N *val) {
+    void N::insertA(N *node, N *parentNode, uint8_t keyParent, uint8_t key, N *val, DeleteNodeInterface* deleter) {
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
-                insertGrow<N4, N16>(n, parentNode, keyParent, key, val);
+                insertGrow<N4, N16>(n, parentNode, keyParent, key, val, deleter);
                 return;
             }
             case NTypes::N16: {
                 auto n = static_cast<N16 *>(node);
-                insertGrow<N16, N48>(n, parentNode, keyParent, key, val);
+                insertGrow<N16, N48>(n, parentNode, keyParent, key, val, deleter);
                 return;
             }
             case NTypes::N48: {
                 auto n = static_cast<N48 *>(node);
-                insertGrow<N48, N256>(n, parentNode, keyParent, key, val);
+                insertGrow<N48, N256>(n, parentNode, keyParent, key, val, deleter);
                 return;
             }
             case NTypes::N256: {
                 auto n = static_cast<N256 *>(node);
+                if (deleter != nullptr) n->writeLock();
                 n->insert(key, val);
+                if (deleter != nullptr) n->writeUnlock();
                 return;
             }
         }
@@ -166,8 +215,10 @@ namespace ART_unsynchronized {
     }
 
     template<typename curN, typename smallerN>
-    void N::removeAndShrink(curN *n, N *parentNode, uint8_t keyParent, uint8_t key) {
+    void N::removeAndShrink(curN *n, N *parentNode, uint8_t keyParent, uint8_t key, DeleteNodeInterface* deleter) {
+        if (deleter != nullptr) n->writeLock();
         if (n->remove(key, parentNode == nullptr)) {
+            if (deleter != nullptr) n->writeUnlock();
             return;
         }
 
@@ -176,31 +227,33 @@ namespace ART_unsynchronized {
 
         n->remove(key, true);
         n->copyTo(nSmall);
-        N::change(parentNode, keyParent, nSmall);
+        N::change(parentNode, keyParent, nSmall, deleter);
 
-        delete n;
+        retireNode(n, deleter);
     }
 
-    void N::removeA(N *node, uint8_t key, N *parentNode, uint8_t keyParent) {
+    void N::removeA(N *node, uint8_t key, N *parentNode, uint8_t keyParent, DeleteNodeInterface* deleter) {
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
+                if (deleter != nullptr) n->writeLock();
                 n->remove(key, false);
+                if (deleter != nullptr) n->writeUnlock();
                 return;
             }
             case NTypes::N16: {
                 auto n = static_cast<N16 *>(node);
-                removeAndShrink<N16, N4>(n, parentNode, keyParent, key);
+                removeAndShrink<N16, N4>(n, parentNode, keyParent, key, deleter);
                 return;
             }
             case NTypes::N48: {
                 auto n = static_cast<N48 *>(node);
-                removeAndShrink<N48, N16>(n, parentNode, keyParent, key);
+                removeAndShrink<N48, N16>(n, parentNode, keyParent, key, deleter);
                 return;
             }
             case NTypes::N256: {
                 auto n = static_cast<N256 *>(node);
-                removeAndShrink<N256, N48>(n, parentNode, keyParent, key);
+                removeAndShrink<N256, N48>(n, parentNode, keyParent, key, deleter);
                 return;
             }
         }
@@ -299,6 +352,15 @@ namespace ART_unsynchronized {
         delete node;
     }
 
+    void N::retireNode(N *node, DeleteNodeInterface* deleter) {
+        if (deleter != nullptr) {
+            node->writeUnlockObsolete();
+            (*deleter)(node);
+        } else {
+            deleteNode(node);
+        }
+    }
+
 
     TID N::getAnyChildTid(N *n) {
         N *nextNode = n;
@@ -327,26 +389,30 @@ namespace ART_unsynchronized {
         assert(node != nullptr);
 
         while(!isLeaf(node)){
-            switch (node->getType()) {
-            case NTypes::N4:
-                node = static_cast<N4*>(node)->getMaxChild();
-                break;
-            case NTypes::N16:
-                node = static_cast<N16 *>(node)->getMaxChild();
-                break;
-            case NTypes::N48:
-                node = static_cast<N48 *>(node)->getMaxChild();
-                break;
-            case NTypes::N256:
-                node = static_cast<N256 *>(node)->getMaxChild();
-                break;
-            }
+            node = getMaxChild(node);
             assert(node != nullptr);
         }
 
         return getLeaf(node);
     }
 
+    N* N::getMaxChild(N* node){
+        assert(node != nullptr && !isLeaf(node));
+        switch (node->getType()) {
+        case NTypes::N4:
+            return static_cast<N4*>(node)->getMaxChild();
+        case NTypes::N16:
+            return static_cast<N16 *>(node)->getMaxChild();
+        case NTypes::N48:
+            return static_cast<N48 *>(node)->getMaxChild();
+        case NTypes::N256:
+            return static_cast<N256 *>(node)->getMaxChild();
+        }
+
+        assert(false);
+        __builtin_unreachable();
+    }
+
     N* N::getChildLessOrEqual(N* node, uint8_t key, bool* out_exact_match){
         bool flag_ignore;
         bool& flag_exact_match = (out_exact_match != nullptr) ? *out_exact_match : flag_ignore;
@@ -24,7 +24,7 @@ using namespace std;
 
 namespace ART_unsynchronized {
 
-    Tree::Tree(shared_ptr<LoadKeyInterface> loadKey) : root(new N256(nullptr, 0)), loadKey(move(loadKey)) {
+    Tree::Tree(shared_ptr<LoadKeyInterface> loadKey, shared_ptr<DeleteNodeInterface> deleteNode) : root(new N256(nullptr, 0)), loadKey(move(loadKey)), deleteNode(move(deleteNode)) {
     }
 
     Tree::~Tree() {
@@ -73,27 +73,7 @@ namespace ART_unsynchronized {
 
         // base case, the current node is a leaf
         if(N::isLeaf(node)){
-            TID leaf_value = N::getLeaf(node);
-            *output_result = leaf_value;
-            Key leaf_key;
-            (*loadKey)(leaf_value, leaf_key);
-            while(level < leaf_key.getKeyLen() && level < key.getKeyLen()){
-                if(key[level] < leaf_key[level]){
-                    return false;
-                } else if(key[level] == leaf_key[level]) {
-                    level++;
-                } else { // key[level] > leaf_key[level]
-                    return true;
-                }
-            }
-
-            if(key.getKeyLen() == leaf_key.getKeyLen()){ // same value
-                return true;
-            } else if (key.getKeyLen() <= level){ // key < leaf_key
-                return false;
-            } else { // leaf_key.getKeyLen() <= level --> key > leaf_key
-                return true;
-            }
+            return findLessOrEqualLeaf(key, node, level, output_result);
         }
 
         // first check the damn prefix
@@ -146,6 +126,31 @@ namespace ART_unsynchronized {
         }
     }
 
+    bool Tree::findLessOrEqualLeaf(const Key& key, N* node, uint32_t level, TID* output_result) const {
+        assert(N::isLeaf(node));
+        TID leaf_value = N::getLeaf(node);
+        *output_result = leaf_value;
+        Key leaf_key;
+        (*loadKey)(leaf_value, leaf_key);
+        while(level < leaf_key.getKeyLen() && level < key.getKeyLen()){
+            if(key[level] < leaf_key[level]){
+                return false;
+            } else if(key[level] == leaf_key[level]) {
+                level++;
+            } else { // key[level] > leaf_key[level]
+                return true;
+            }
+        }
+
+        if(key.getKeyLen() == leaf_key.getKeyLen()){ // same value
+            return true;
+        } else if (key.getKeyLen() <= level){ // key < leaf_key
+            return false;
+        } else { // leaf_key.getKeyLen() <= level --> key > leaf_key
+            return true;
+        }
+    }
+
     TID Tree::findLessOrEqual(const Key& key) const {
         TID result;
         auto match = findLessOrEqual(key, root, 0, &result);
@@ -156,6 +161,100 @@ namespace ART_unsynchronized {
         }
     }
 
+    N* Tree::descendStep(const Key& key, N* node, uint32_t& level){
+        assert(node != nullptr && !N::isLeaf(node));
+        level += node->getPrefixLength();
+        if(level >= key.getKeyLen()) return nullptr;
+
+        bool exact_match; // set by N::getChildLessOrEqual as side effect
+        N* child = N::getChildLessOrEqual(node, key[level], &exact_match);
+        if(child == nullptr || !exact_match || N::isLeaf(child)) return nullptr;
+        level++;
+        return child;
+    }
+
+    bool Tree::findLessOrEqualOptimistic(const Key& key, N* node, uint64_t version, uint32_t level, TID* output_result, bool& needRestart) const {
+        assert(node != nullptr && !N::isLeaf(node));
+
+        // same logic of #findLessOrEqual, but validate the version of the node after each read
+        auto prefixResult = checkPrefixCompare(node, key, level, loadKey.get());
+        node->checkOrRestart(version, needRestart);
+        if(needRestart) return false;
+        switch(prefixResult){
+        case PCCompareResults::Smaller: { // the key is bigger than any element in this node
+            N* child = N::getMaxChild(node);
+            node->checkOrRestart(version, needRestart);
+            if(needRestart) return false;
+            *output_result = getMaxLeafOptimistic(child, node, version, needRestart);
+            return true;
+        } break;
+        case PCCompareResults::Equal:
+            break;
+        case PCCompareResults::Bigger: // ask the parent to return the max for the sibling that precedes this node
+            return false;
+        }
+
+        bool exact_match = false;
+        N* child = N::getChildLessOrEqual(node, key[level], &exact_match);
+        node->checkOrRestart(version, needRestart);
+        if(needRestart || child == nullptr) return false;
+
+        if(exact_match){ // percolate the tree
+            bool match = false;
+            if(N::isLeaf(child)){
+                match = findLessOrEqualLeaf(key, child, level +1, output_result);
+            } else {
+                uint64_t child_version = child->readLockOrRestart(needRestart);
+                node->checkOrRestart(version, needRestart);
+                if(needRestart) return false;
+                match = findLessOrEqualOptimistic(key, child, child_version, level +1, output_result, needRestart);
+                if(needRestart) return false;
+            }
+            if(match) return true;
+
+            // then the correct is the maximum of the previous sibling
+            auto sibling = N::getPredecessor(node, key[level]);
+            node->checkOrRestart(version, needRestart);
+            if(needRestart || sibling == nullptr) return false;
+            *output_result = getMaxLeafOptimistic(sibling, node, version, needRestart);
+            return true;
+        } else { // key[level] > child[level], return the max from the given child
+            *output_result = getMaxLeafOptimistic(child, node, version, needRestart);
+            return true;
+        }
+    }
+
+    TID Tree::getMaxLeafOptimistic(N* node, N* parent, uint64_t parentVersion, bool& needRestart) {
+        while(!N::isLeaf(node)){
+            uint64_t version = node->readLockOrRestart(needRestart);
+            parent->checkOrRestart(parentVersion, needRestart);
+            if(needRestart) return 0;
+
+            N* child = N::getMaxChild(node);
+            node->checkOrRestart(version, needRestart);
+            if(needRestart) return 0;
+
+            parent = node;
+            parentVersion = version;
+            node = child;
+        }
+
+        return N::getLeaf(node);
+    }
+
+    TID Tree::findLessOrEqualOptimistic(const Key& key) const {
+        while(true){
+            bool needRestart = false;
+            TID result = 0;
+            uint64_t version = root->readLockOrRestart(needRestart);
+            if(needRestart) continue;
+            bool match = findLessOrEqualOptimistic(key, root, version, 0, &result, needRestart);
+            if(!needRestart){
+                return match ? result : 0;
+            }
+        }
+    }
+
     TID Tree::checkKey(const TID tid, const Key &k) const {
         Key kt;
         (*loadKey)(tid, kt);
@@ -192,12 +291,15 @@ namespace ART_unsynchronized {
                     newNode->insert(k[nextLevel], N::setLeaf(tid));
                     newNode->insert(nonMatchingKey, node);
 
-                    // 3) update parentNode to point to the new node
-                    N::change(parentNode, parentKey, newNode);
+                    // 3) update parentNode to point to the new node. With concurrent readers, lock the node first,
+                    // so that the readers reaching it through the new node do not observe the old prefix
+                    if (deleteNode) node->writeLock();
+                    N::change(parentNode, parentKey, newNode, deleteNode.get());
 
                     // 4) update prefix of node
                     node->setPrefix(remainingPrefix,
                                     node->getPrefixLength() - ((nextLevel - level) + 1));
+                    if (deleteNode) node->writeUnlock();
 
                     return;
                 }
@@ -210,7 +312,7 @@ namespace ART_unsynchronized {
             nextNode = N::getChild(nodeKey, node);
 
             if (nextNode == nullptr) {
-                N::insertA(node, parentNode, parentKey, nodeKey, N::setLeaf(tid));
+                N::insertA(node, parentNode, parentKey, nodeKey, N::setLeaf(tid), deleteNode.get());
                 return;
             }
             if (N::isLeaf(nextNode)) {
@@ -227,7 +329,7 @@ namespace ART_unsynchronized {
                 auto n4 = new N4(&k[level], prefixLength);
                 n4->insert(k[level + prefixLength], N::setLeaf(tid));
                 n4->insert(key[level + prefixLength], nextNode);
-                N::change(node, k[level - 1], n4);
+                N::change(node, k[level - 1], n4, deleteNode.get());
                 return;
             }
 
@@ -271,21 +373,21 @@ namespace ART_unsynchronized {
                             N *secondNodeN;
                             uint8_t secondNodeK;
                             std::tie(secondNodeN, secondNodeK) = N::getSecondChild(node, nodeKey);
+                            if (deleteNode) node->writeLock();
                             if (N::isLeaf(secondNodeN)) {
 
                                 //N::remove(node, k[level]); not necessary
-                                N::change(parentNode, parentKey, secondNodeN);
-
-                                delete node;
+                                N::change(parentNode, parentKey, secondNodeN, deleteNode.get());
                             } else {
                                 //N::remove(node, k[level]); not necessary
-                                N::change(parentNode, parentKey, secondNodeN);
+                                if (deleteNode) secondNodeN->writeLock();
+                                N::change(parentNode, parentKey, secondNodeN, deleteNode.get());
                                 secondNodeN->addPrefixBefore(node, secondNodeK);
-
-                                delete node;
+                                if (deleteNode) secondNodeN->writeUnlock();
                             }
+                            N::retireNode(node, deleteNode.get());
                         } else {
-                            N::removeA(node, k[level], parentNode, parentKey);
+                            N::removeA(node, k[level], parentNode, parentKey, deleteNode.get());
                         }
                         return;
                     }
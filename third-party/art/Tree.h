@@ -29,6 +29,8 @@ namespace ART_unsynchronized {
 
         std::shared_ptr<LoadKeyInterface> loadKey;
 
+        std::shared_ptr<DeleteNodeInterface> deleteNode; // nullptr to delete the nodes immediately, without concurrent readers
+
         enum class CheckPrefixResult : uint8_t {
             Match,
             NoMatch,
@@ -65,13 +67,22 @@ namespace ART_unsynchronized {
 
         bool findLessOrEqual(const Key& key, N* node, uint32_t level, TID* output_result) const;
 
+        // Base case of #findLessOrEqual, compare the key with the one of the given leaf
+        bool findLessOrEqualLeaf(const Key& key, N* leaf, uint32_t level, TID* output_result) const;
+
+        // Same as #findLessOrEqual, with optimistic lock coupling. The node must have been read with the given version.
+        bool findLessOrEqualOptimistic(const Key& key, N* node, uint64_t version, uint32_t level, TID* output_result, bool& needRestart) const;
+
+        // Retrieve the maximum leaf in the subtree rooted at the given child of `parent', with optimistic lock coupling
+        static TID getMaxLeafOptimistic(N* child, N* parent, uint64_t parentVersion, bool& needRestart);
+
     public:
 
-        Tree(std::shared_ptr<LoadKeyInterface> loadKey);
+        Tree(std::shared_ptr<LoadKeyInterface> loadKey, std::shared_ptr<DeleteNodeInterface> deleteNode = nullptr);
 
         Tree(const Tree &) = delete;
 
-        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey) { }
+        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey), deleteNode(t.deleteNode) { }
 
         ~Tree();
 
@@ -80,6 +91,18 @@ namespace ART_unsynchronized {
         // Find the greatest element less or equal than `key'
         TID findLessOrEqual(const Key& key) const;
 
+        // Same as #findLessOrEqual, but it can run concurrently to a writer, with optimistic lock coupling.
+        // The nodes unlinked by the writer must not be released while a reader may still access them, see DeleteNodeInterface.
+        TID findLessOrEqualOptimistic(const Key& key) const;
+
+        // Interleaved lookups, the root of the tree
+        N* getRoot() const { return root; }
+
+        // Interleaved lookups, move from `node' to its child along the path of `key', without checking the prefix of the
+        // node. Return nullptr if the descent cannot proceed further through an exact match, that is, when
+        // #findLessOrEqual would need to resolve the key from `node'. It does not access any other node than `node'.
+        static N* descendStep(const Key& key, N* node, uint32_t& level);
+
         void insert(const Key &k, TID tid);
 
         void remove(const Key &k, TID tid);